@@ -14,13 +14,13 @@ local htmld
 -- List here all the sections for which we're generating the documentation
 local doc_sections_html = { "arch_platform", "refman_gen", "refman_ps_lm3s", "refman_ps_str9", "refman_ps_mbed", "refman_ps_mizar32", "refman_ps_stm32" }
 local doc_sections_target = { "refman_gen", "refman_ps_stm32" }
-local target_doc_modules =  { "elua", "cpu", "pd", "bit", "pack", "uart", "spi", "pio", "pwm", "i2c", "tmr", "term", "can", "nrf", "adc", "snd", "net" }
+local target_doc_modules =  { "elua", "cpu", "pd", "bit", "pack", "uart", "spi", "pio", "pwm", "i2c", "tmr", "term", "can", "nrf", "adc", "snd", "net", "aio" }
 
 -- List here all the components of each section
 local components = 
 { 
   arch_platform = { "ll", "pio", "spi", "uart", "timers", "pwm", "cpu", "eth", "adc", "i2c", "can" },
-  refman_gen = { "bit", "pd", "cpu", "pack", "adc", "term", "pio", "uart", "spi", "tmr", "pwm", "net", "can", "rpc", "elua", "i2c", "nrf" },
+  refman_gen = { "bit", "pd", "cpu", "pack", "adc", "term", "pio", "uart", "spi", "tmr", "pwm", "net", "can", "rpc", "elua", "i2c", "nrf", "aio" },
   refman_ps_lm3s = { "disp" },
   refman_ps_str9 = { "pio", "rtc" },
   refman_ps_mbed = { "pio" },
@@ -0,0 +1,71 @@
+-- eLua reference manual - aio module
+
+data_en = 
+{
+
+  -- Title
+  title = "eLua reference manual - aio module",
+
+  -- Menu name
+  menu_name = "aio",
+
+  desc = "Asynchronous file I/O",
+
+  -- Overview
+  overview = [[This module contains functions for reading and writing files without blocking the Lua program. A request is queued by @#aio.read@aio.read@ or @#aio.write@aio.write@, which return immediately. The request is executed in the background, in small chunks, between the instructions of the Lua virtual machine (the file systems are not reentrant, so the requests can't be executed from an interrupt handler). When a request is finished an $INT_AIO_DONE$ interrupt is generated, with the request ID as the resource number. Use @refman_gen_cpu.html#cpu.set_int_handler@cpu.set_int_handler@ to handle it (for example to resume a coroutine that waits for the request), then @#aio.result@aio.result@ to get the result. The background execution stops while Lua is blocked in a C function (for example waiting for terminal input).</p>
+<p>$NOTE$: don't close a file that has pending requests.]],
+
+  -- Functions
+  funcs = 
+  {
+    { sig = "id = #aio.read#( file, size, [offset] )",
+      desc = "Queue a read request.",
+      args = 
+      {
+        "$file$ - the file (as returned by $io.open$).",
+        "$size$ - the number of bytes to read.",
+        "$offset (optional)$ - the file offset of the first byte. Defaults to the current file position."
+      },
+      ret = "The request ID."
+    },
+
+    { sig = "id = #aio.write#( file, data, [offset] )",
+      desc = "Queue a write request. The data is copied, so it can be changed after this call.",
+      args = 
+      {
+        "$file$ - the file (as returned by $io.open$).",
+        "$data$ - the data to write (a string).",
+        "$offset (optional)$ - the file offset of the first byte. Defaults to the current file position."
+      },
+      ret = "The request ID."
+    },
+
+    { sig = "done = #aio.done#( id )",
+      desc = "Checks if a request is finished.",
+      args = "$id$ - the request ID.",
+      ret = "$true$ if the request is finished, $false$ otherwise."
+    },
+
+    { sig = "res, err = #aio.result#( id )",
+      desc = [[Returns the result of a request and releases it. If the request is not finished yet, it is finished now (in the foreground). After this call the file position is right after the last byte read or written.]],
+      args = "$id$ - the request ID.",
+      ret = 
+      {
+        "$res$ - the data (for a read request) or the number of bytes written (for a write request), or $nil$ for error.",
+        "$err$ - the error code (0 if no error)."
+      }
+    },
+
+    { sig = "#aio.cancel#( id )",
+      desc = "Releases a request without waiting for it to finish. The part of the request that was already executed is not undone.",
+      args = "$id$ - the request ID."
+    },
+
+    { sig = "n = #aio.pending#()",
+      desc = "Returns the number of requests that are not finished yet.",
+      ret = "The number of pending requests."
+    },
+  },
+}
+
+data_pt = data_en
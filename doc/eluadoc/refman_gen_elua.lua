@@ -52,6 +52,72 @@ data_en =
       ret = "true if the file system is mounted, false otherwise."
     },
 
+    { sig = "entries = #elua.listdir#( path )",
+      desc = "Lists the files of a directory on any file system.",
+      args = "$path$ - the directory (for example $/rfs/scripts$).",
+      ret = "a table with the size of every file, indexed by the file name, or $nil$ if the directory can't be opened."
+    },
+
+    { sig = "limit, used = #elua.fdlimit#( fsname, [limit] )",
+      desc = [[Returns (and optionally changes) the maximum number of files that can be open at the same time on a file system. The default limits are set at build time with $DM_DEFAULT_FD_LIMIT$ and $DM_FD_LIMITS$, the total number of open files is always limited by $DM_MAX_FDS$. Lowering the limit doesn't close any file that is already open.]],
+      args =
+      {
+        "$fsname$ - the name of the file system (for example $/rom$).",
+        "$limit (optional)$ - the new limit."
+      },
+      ret =
+      {
+        "$limit$ - the maximum number of open files for this file system.",
+        "$used$ - the number of files currently open on this file system."
+      }
+    },
+
+    { sig = "count = #elua.resolvecount#()",
+      desc = [[Returns the number of path to file system resolutions done by the device manager since startup (each $open$, $opendir$ or $unlink$ does one). Useful to find out how much file system probing an application does (for example when loading modules with $require$).]],
+      ret = "the number of path resolutions."
+    },
+
+    { sig = "stats = #elua.seekstats#( [reset] )",
+      desc = [[Returns statistics about the cost of seeking in files on the FAT file systems ($/mmc$). Without help, a seek follows the FAT cluster chain from the start of the file (or from the current position when seeking forward), so its cost grows with the file size. Files opened read-only get a cluster link map on their first seek (the number of maps is set at build time with $MMCFS_CLMT_MAPS$), after which seeking doesn't read the FAT anymore.]],
+      args = "$reset (optional)$ - if $true$, the counters are cleared after they are read.",
+      ret = [[a table with the following fields: $seeks$ (number of seeks), $fastseeks$ (number of seeks done with a cluster link map), $links$ (number of FAT cluster links followed by seeks and to build the maps) and $maps$ (number of cluster link maps built).]]
+    },
+
+    { sig = "stats = #elua.dcache#( [reset] )",
+      desc = [[Returns the statistics of the directory entry cache used by the FAT file systems for path lookups. The cache remembers where a name was found in a directory, and also that a name doesn't exist, so probing the same paths again (for example when loading modules with $require$) doesn't scan the directories. Creating, removing or renaming a file invalidates the cached names of its directory. The size of the cache is set at build time in $ffconf.h$ ($_DCACHE_ENTRIES$), only ASCII names up to $_DCACHE_NAME$ characters are cached.]],
+      args = "$reset (optional)$ - if $true$, the counters are cleared after they are read.",
+      ret = [[a table with the following fields: $hits$ (names found in the cache), $neg_hits$ (names known not to exist found in the cache), $misses$ (names looked up in the directories) and $purges$ (directory changes that invalidated cached names).]]
+    },
+
+    { sig = "stats = #elua.diskcache#( [reset] )",
+      desc = [[Returns the statistics of the sector cache used by the FAT file systems (only available if $BUILD_DISKCACHE$ is enabled). The cache keeps FAT/directory sectors and file data sectors in separate parts (their sizes are set at build time with $DISKCACHE_META_SECTORS$ and $DISKCACHE_DATA_SECTORS$), so reading a large file doesn't evict the file system metadata. Writes are kept in the cache until the file is flushed or closed.]],
+      args = "$reset (optional)$ - if $true$, the counters are cleared after they are read.",
+      ret = [[a table with the following fields: $meta_sectors$ and $data_sectors$ (the size of the cache), $meta_hits$, $meta_misses$, $data_hits$ and $data_misses$ (number of sectors found or not found in the cache), $bypass$ (number of multi sector file data transfers done directly), $writebacks$ (number of sectors written to the disk) and $writecmds$ (number of write commands sent to the disk).]]
+    },
+
+    { sig = "stats = #elua.blkdev#( [reset] )",
+      desc = [[Returns the statistics of the block device layer that sits between the FAT file systems (and their sector cache) and the disk drivers. Small writes to consecutive sectors are queued and sent to the device as a single multi sector command ($BLKDEV_QUEUE_SECTORS$), and when a read continues the previous one the following sectors are read ahead with the same command ($BLKDEV_READAHEAD_SECTORS$), so sequential file reads become large transfers however the data is sliced by the application.]],
+      args = "$reset (optional)$ - if $true$, the counters are cleared after they are read.",
+      ret = [[a table with the following fields: $reads$ and $writes$ (requests from the file systems), $dev_reads$ and $dev_writes$ (commands sent to the devices), $ra_fills$ (read ahead commands), $ra_hits$ (sectors read from the read ahead buffer) and $merged$ (write requests merged with queued writes).]]
+    },
+
+    { sig = "stats = #elua.nandftl#( [reset] )",
+      desc = [[Returns the statistics of the flash translation layer used by $/nand$ (only available if $BUILD_NANDFTL$ is enabled). The FTL keeps a map of the whole chip in RAM and never rewrites a page in place: every sector is written to the next free page and the blocks with the least valid data are reclaimed by a garbage collector. The write amplification of a workload is $flash_writes / host_writes$.]],
+      args = "$reset (optional)$ - if $true$, the counters are cleared after they are read.",
+      ret = [[a table with the following fields: $sectors$ (size of the volume), $host_writes$ (sectors written by the file system), $flash_writes$ (pages programmed, including the garbage collector and wear levelling), $gc_blocks$ (blocks reclaimed), $gc_moves$ (pages copied by the garbage collector), $wl_moves$ (blocks moved to level the wear), $erases$ (blocks erased), $free_blocks$, $bad_blocks$, $min_erase$ and $max_erase$ (the smallest and the largest erase count of the blocks).]]
+    },
+
+    { sig = "reclaimed = #elua.nandftl_gc#()",
+      desc = [[Runs the garbage collector of the $/nand$ flash translation layer on a single block if the number of free blocks is below the background threshold ($NANDFTL_GC_FREE$). An application can call this when it's idle, so that later writes don't have to wait for the garbage collector (only available if $BUILD_NANDFTL$ is enabled).]],
+      ret = "$true$ if a block was reclaimed, $false$ otherwise."
+    },
+
+    { sig = "stats = #elua.rfsstats#( [reset] )",
+      desc = [[Returns the traffic of the remote file system client (only available if $BUILD_RFS$ is enabled). Every request waits for a response, so the number of requests is the number of round trips, except that pipelined reads and writes share their round trips.]],
+      args = "$reset (optional)$ - if $true$, the counters are cleared after they are read.",
+      ret = [[a table with the following fields: $requests$ (number of requests sent to the server), $sent$ and $received$ (bytes sent and received, including the packet headers).]]
+    },
+
     { sig = "#elua.help#( [topic] )",
       desc = "Prints the help on the specified topic (similar to the shell command $apihelp$).",
       args = [[$topic (optional)$ - the name of the topic. This can be either:
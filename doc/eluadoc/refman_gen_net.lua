@@ -122,13 +122,29 @@ enum
         "$sock$ - the socket.",
         "$str$ - the data to send."
       },
-      ret = 
+      ret =
       {
         "$res$ - the number of bytes actually sent or -1 for error.",
         "$err$ - the error code`, as defined @#error_codes@here@.`.`"
       }
     },
 
+    { sig = "res, err = #net.sendfile#( sock, file, [offset], [len] )",
+      desc = [[Send the contents of an open file to a TCP socket. The data goes directly from the file system to the TCP/IP stack, without creating any Lua strings. If the file system can map its files in memory (like the ROM file system) the data is sent directly from there.]],
+      args =
+      {
+        "$sock$ - the socket.",
+        "$file$ - the file (as returned by $io.open$).",
+        "$offset (optional)$ - the file offset of the first byte to send. Defaults to the current file position.",
+        "$len (optional)$ - the number of bytes to send. Defaults to everything up to the end of the file."
+      },
+      ret =
+      {
+        "$res$ - the number of bytes actually sent or -1 for error. After this call, the file position is right after the last byte sent.",
+        "$err$ - the error code`, as defined @#error_codes@here@.`.`"
+      }
+    },
+
     { sig = "res, err = #net.recv#( sock, maxsize, [timer_id, timeout] )",
       desc = "Read data from a TCP socket.",
       args = 
@@ -0,0 +1,55 @@
+// Block device layer between the file systems and the disk drivers
+
+#ifndef __BLKDEV_H__
+#define __BLKDEV_H__
+
+#include "type.h"
+#include "diskio.h"
+#include "platform_conf.h"
+
+/*******************************************************************************
+Every disk driver exports a BLKDEV descriptor instead of implementing the
+FatFs disk interface directly. The block layer implements the disk interface
+(below the sector cache, if BUILD_DISKCACHE is enabled) and maps each FatFs
+drive to a descriptor (BLKDEV_DRIVES in platform_conf.h, by default drive 0
+is mmc_blkdev and drive 1 is nand_blkdev). Requests go through a small queue:
+
+- writes are delayed and merged with the following writes to the next
+  sectors, so many small writes become a single multi sector command. The
+  queue is written when it's full, when a request doesn't extend it, when a
+  read needs its sectors and when the file system syncs.
+- sequential runs of small reads are detected per drive and the following
+  sectors are read ahead in a single command.
+- requests larger than the transfer limit of a device are split.
+*******************************************************************************/
+
+// Block device descriptor (the functions use the FatFs disk interface types)
+typedef struct
+{
+  DSTATUS ( *init )();
+  DSTATUS ( *status )();
+  DRESULT ( *read )( BYTE *buff, DWORD sector, BYTE count );
+  DRESULT ( *write )( const BYTE *buff, DWORD sector, BYTE count );
+  DRESULT ( *ioctl )( BYTE ctrl, void *buff );
+  BYTE max_count;                   // largest transfer done with one command
+} BLKDEV;
+
+// Block layer statistics
+typedef struct
+{
+  u32 reads;                        // read requests
+  u32 writes;                       // write requests
+  u32 dev_reads;                    // read commands sent to the devices
+  u32 dev_writes;                   // write commands sent to the devices
+  u32 ra_fills;                     // read ahead commands
+  u32 ra_hits;                      // sectors read from the read ahead buffer
+  u32 merged;                       // write requests merged in the queue
+} BLKDEV_STATS;
+
+// Devices implemented by the drivers
+extern const BLKDEV mmc_blkdev;
+extern const BLKDEV nand_blkdev;
+
+void blkdev_get_stats( BLKDEV_STATS *pstats, int reset );
+
+#endif // #ifndef __BLKDEV_H__
@@ -0,0 +1,42 @@
+// eLua asynchronous file I/O
+
+#ifndef __ELUA_AIO_H__
+#define __ELUA_AIO_H__
+
+#include "type.h"
+
+/*******************************************************************************
+Asynchronous requests are queued with aio_submit and executed in the background
+in small chunks by the regular (synchronous) _read_r/_write_r/_lseek_r stubs.
+The file system drivers are not reentrant and some of them need interrupts to
+work (RFS, for example), so the chunks are never executed from an interrupt
+handler: the executor is a "service" that runs from the Lua hook, between VM
+instructions (see elua_int_request_service). When a request is finished an
+INT_AIO_DONE interrupt is queued with the request ID as its resource number.
+*******************************************************************************/
+
+// Request operations
+enum
+{
+  AIO_OP_READ = 0,
+  AIO_OP_WRITE
+};
+
+// Request states
+enum
+{
+  AIO_STATE_FREE = 0,
+  AIO_STATE_QUEUED,
+  AIO_STATE_DONE
+};
+
+void aio_init();
+int aio_submit( int op, int fd, void *buf, u32 len, u32 offset );
+int aio_get_state( int id );
+s32 aio_get_result( int id, int *perr );
+void aio_wait( int id );
+void aio_release( int id );
+void aio_cancel_fd( int fd );
+unsigned aio_get_pending();
+
+#endif
@@ -35,6 +35,9 @@ typedef struct
 // C interrupt handlers
 typedef void( *elua_int_c_handler )( elua_int_resnum resnum );
 
+// Background service (runs from the Lua hook, between VM instructions)
+typedef void( *elua_int_service )( void );
+
 // Handler key in the registry
 #define LUA_INT_HANDLER_KEY             ( int )&elua_int_add
 
@@ -51,6 +54,8 @@ void elua_int_cleanup();
 void elua_int_disable_all();
 elua_int_c_handler elua_int_set_c_handler( elua_int_id inttype, elua_int_c_handler phandler );
 elua_int_c_handler elua_int_get_c_handler( elua_int_id inttype );
+void elua_int_set_service( elua_int_service pservice );
+void elua_int_request_service( int count );
 
 #endif
 
@@ -6,6 +6,9 @@
 #include "devman.h"
 
 DM_DEVICE* remotefs_init();
+void remotefs_set_compression( int enable );
+void remotefs_get_compression_stats( u32 *praw, u32 *pwire );
+void remotefs_get_stats( u32 *prequests, u32 *psent, u32 *preceived, int reset );
 
 #endif
 
@@ -24,14 +24,36 @@
 #define   ELUARPC_U16_SIZE        3
 #define   ELUARPC_U8_SIZE         2
 #define   ELUARPC_OP_ID_SIZE      2
+#define   ELUARPC_SEQ_SIZE        2
 #define   ELUARPC_READ_BUF_OFFSET ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_RESPONSE_SIZE + ELUARPC_PTR_HEADER_SIZE )
 #define   ELUARPC_SMALL_READ_BUF_OFFSET ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_RESPONSE_SIZE + ELUARPC_SMALL_PTR_HEADER_SIZE )
-#define   ELUARPC_WRITE_REQUEST_EXTRA ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_OP_ID_SIZE + ELUARPC_U32_SIZE + ELUARPC_PTR_HEADER_SIZE + ELUARPC_END_SIZE )
+#define   ELUARPC_WRITE_REQUEST_EXTRA ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_SEQ_SIZE + ELUARPC_OP_ID_SIZE + ELUARPC_U32_SIZE + ELUARPC_PTR_HEADER_SIZE + ELUARPC_END_SIZE )
 #define   ELUARPC_DISCOVER_SIZE   5
 // WARNING: DISCOVER_SIG must be ELUARPC_START_OFFSET - 1 bytes long!
 #define   ELUARPC_DISCOVER_SIG    "eRD"
 #define   ELUARPC_DISCOVER_RESP   "eSRV"
 
+// Packet encodings
+// v1: every field starts with its type, the packet has fixed start and end
+//     markers
+// v2: compact packets: the fields don't have types (their order is given by
+//     the format of the operation), integers and pointer lengths are LEB128
+//     varints and the packet ends with an optional CRC16 instead of the markers
+// Received packets are decoded in both encodings, the encoding set with
+// eluarpc_set_encoding is used for the packets written from now on.
+#define   ELUARPC_ENC_V1          0
+#define   ELUARPC_ENC_V2          1
+#define   ELUARPC_ENC_CRC         2
+#define   ELUARPC_V2_HEADER_SIZE  3
+#define   ELUARPC_V2_SEQ_SIZE     1
+#define   ELUARPC_V2_PTR_HEADER_SIZE 3
+#define   ELUARPC_V2_CRC_SIZE     2
+#define   ELUARPC_CRC_INIT        0xFFFF
+
+// Packets can carry an optional sequence number (right after the start of
+// the packet), used to match pipelined requests with their responses
+#define   ELUARPC_NO_SEQ          ( -1 )
+
 // Public interface
 // Get request ID
 int eluarpc_get_request_id( const u8 *p, u8 *pid );
@@ -42,6 +64,27 @@ u32 eluarpc_replace_flag( u32 val, u32 origflag, u32 newflag );
 // Get packet size
 int eluarpc_get_packet_size( const u8 *p, u16 *psize );
 
+// Set the sequence number of the packets written from now on
+// (ELUARPC_NO_SEQ writes packets without a sequence number)
+void eluarpc_set_seq( int seq );
+
+// Get the sequence number of a packet (ELUARPC_NO_SEQ if it doesn't have one)
+int eluarpc_get_seq( const u8 *p );
+
+// Set the encoding of the packets written from now on (ELUARPC_ENC_xxx)
+void eluarpc_set_encoding( int enc );
+
+// Get the encoding of a packet
+int eluarpc_get_encoding( const u8 *p );
+
+// Update a CRC16-CCITT with 'len' bytes (start with ELUARPC_CRC_INIT)
+u16 eluarpc_crc16( u16 crc, const u8 *p, u16 len );
+
+// Get the offset of the data in a response with a single pointer ("rp")
+// written with the current encoding and sequence number, for writing the
+// data in place before the response is built (with a NULL pointer)
+u16 eluarpc_get_read_buf_offset();
+
 // Create a discover packet and return its size
 int eluarpc_build_discover_packet( u8 *p );
 
@@ -0,0 +1,36 @@
+// Small LZ77 compressor for data links (RFS payloads)
+
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include "type.h"
+
+/*******************************************************************************
+Every block is compressed on its own (there's no dictionary shared between
+blocks), so the window is the block itself, limited to LZ_WINDOW_SIZE bytes
+by the format. The compressed data is a sequence of:
+
+- literal runs: a control byte 0x00-0x1F (run length - 1) then the bytes
+- matches: a control byte LLLOOOOO (LLL is the length - 2, 7 means that the
+  next byte is added to the length), then the low byte of the offset - 1
+  (the high 5 bits are OOOOO)
+
+The decompressor needs no memory besides the output buffer. The compressor
+needs a hash table of LZ_HASH_SIZE u16 given by the caller.
+*******************************************************************************/
+
+#ifndef LZ_HASH_BITS
+#define LZ_HASH_BITS          8
+#endif
+#define LZ_HASH_SIZE          ( 1 << LZ_HASH_BITS )
+#define LZ_WINDOW_SIZE        8192
+
+// Compress 'srclen' bytes to 'dest'. Returns the size of the compressed data or
+// 0 if it doesn't fit in 'destmax' bytes.
+u32 lz_compress( const u8 *src, u32 srclen, u8 *dest, u32 destmax, u16 *phash );
+
+// Decompress 'srclen' bytes to 'dest'. Returns the size of the data or -1 if
+// the data is invalid or doesn't fit in 'destmax' bytes.
+s32 lz_decompress( const u8 *src, u32 srclen, u8 *dest, u32 destmax );
+
+#endif
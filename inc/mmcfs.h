@@ -6,8 +6,28 @@
 #include "type.h"
 #include "devman.h"
 
+// Seek statistics
+typedef struct
+{
+  u32 seeks;                        // number of seeks
+  u32 fastseeks;                    // seeks done with a cluster link map
+  u32 links;                        // cluster links followed in the FAT
+  u32 maps;                         // cluster link maps built
+} MMCFS_SEEK_STATS;
+
+// Directory entry cache statistics
+typedef struct
+{
+  u32 hits;                         // names found in the cache
+  u32 neg_hits;                     // missing names found in the cache
+  u32 misses;                       // names looked up in the directories
+  u32 purges;                       // directory changes
+} MMCFS_DCACHE_STATS;
+
 // FS functions
 const DM_DEVICE* mmcfs_init();
 void mmcfs_int_handler();
+void mmcfs_get_seek_stats( MMCFS_SEEK_STATS *pstats, int reset );
+void mmcfs_get_dcache_stats( MMCFS_DCACHE_STATS *pstats, int reset );
 
 #endif
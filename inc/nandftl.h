@@ -0,0 +1,72 @@
+// Log-structured flash translation layer for small page NAND flash
+
+#ifndef __NANDFTL_H__
+#define __NANDFTL_H__
+
+#include "type.h"
+
+/*******************************************************************************
+The FTL exports the NAND chip as an array of 512 bytes sectors. The map from
+sectors to flash pages covers the whole device (all the zones) and it lives in
+RAM, so it's built only once, when the FTL is mounted. A map entry can cover
+a "unit" of a few consecutive sectors (NANDFTL_PAGES_PER_UNIT) to make the map
+smaller; the sectors of a unit are always written together. Sectors are never
+written in place: every write goes to the next free page of the current
+"frontier" block and the page that held the previous copy of the sector
+becomes garbage. Full blocks are reclaimed by the garbage collector, which
+copies the valid pages of the blocks with the least valid data to the
+frontier, and the wear levelling code makes sure that blocks with static
+data are also recycled from time to time.
+
+Each page is written together with its spare area, which keeps the logical
+sector number, the sequence number of the block and the erase count of the
+block, so the map can be rebuilt after a reset (or a power loss) by scanning
+the spare areas.
+*******************************************************************************/
+
+#define NANDFTL_PAGE_SIZE     512
+#define NANDFTL_SPARE_SIZE    16
+
+// Results of nandftl_init
+enum
+{
+  NANDFTL_OK = 0,
+  NANDFTL_BLANK,                    // no FTL data on the chip (needs a file system)
+  NANDFTL_ERROR
+};
+
+// FTL statistics
+typedef struct
+{
+  u32 host_writes;                  // sectors written by the file system
+  u32 flash_writes;                 // pages programmed (including GC and WL)
+  u32 gc_blocks;                    // blocks reclaimed by the garbage collector
+  u32 gc_moves;                     // pages copied by the garbage collector
+  u32 wl_moves;                     // blocks moved by the wear levelling code
+  u32 erases;                       // blocks erased
+  u32 free_blocks;                  // blocks ready to be used
+  u32 bad_blocks;                   // blocks that can't be used
+  u32 min_erase;                    // smallest erase count
+  u32 max_erase;                    // largest erase count
+} NANDFTL_STATS;
+
+// Low level interface (implemented by the platform)
+// Pages are numbered from 0 (block number * pages per block + page in block)
+// 'data' or 'spare' can be NULL if only one of them is needed
+// All functions return PLATFORM_OK or PLATFORM_ERR
+int nand_ll_init();
+int nand_ll_read( u32 page, u8 *data, u8 *spare );
+int nand_ll_write( u32 page, const u8 *data, const u8 *spare );
+int nand_ll_erase( u32 block );
+
+// FTL interface
+int nandftl_init();
+int nandftl_is_blank();
+u32 nandftl_get_sectors();
+int nandftl_read( u32 sector, u8 *buf, unsigned count );
+int nandftl_write( u32 sector, const u8 *buf, unsigned count );
+int nandftl_sync();
+int nandftl_gc_step();
+void nandftl_get_stats( NANDFTL_STATS *pstats, int reset );
+
+#endif // #ifndef __NANDFTL_H__
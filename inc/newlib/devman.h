@@ -9,7 +9,6 @@
 
 // Maximum number of devices in the system
 #define DM_MAX_DEVICES        16
-#define DM_MAX_DEVICES_BITS   4
 
 // Maximum number of a device name
 #define DM_MAX_DEV_NAME       12
@@ -17,18 +16,19 @@
 // GLOBAL maximum file length (on ALL supported filesystem)
 #define DM_MAX_FNAME_LENGTH   30
 
-// Pack/unpack descriptions
-// Even if a file descriptor is an 'int', newlib treats it as a short, so we need to stuff
-// everything into 16 bits. Actually 15, since negative fd's are actually error indications
-#define DM_MAKE_DESC( devid, fd ) ( ( ( devid ) << ( 15 - DM_MAX_DEVICES_BITS ) ) | ( fd ) )
-#define DM_GET_DEVID( desc )      ( ( desc ) >> ( 15 - DM_MAX_DEVICES_BITS ) )
-#define DM_GET_FD( desc )         ( ( desc ) & ( ( 1 << ( 15 - DM_MAX_DEVICES_BITS ) ) - 1 ) )
-
 // STDIO file number
 #define DM_STDIN_NUM              0
 #define DM_STDOUT_NUM             1
 #define DM_STDERR_NUM             2
 
+// Descriptors
+// The descriptors seen by Newlib are indexes in a global table that maps them
+// to a device and a device specific descriptor. The first entries are always
+// the STDIO descriptors. The total number of descriptors is given by DM_MAX_FDS,
+// the number of descriptors for a single device can be further limited with
+// dm_set_fd_limit (or at build time with DM_DEFAULT_FD_LIMIT/DM_FD_LIMITS)
+#define DM_FIRST_FD               ( DM_STDERR_NUM + 1 )
+
 // Our platform independent "dirent" structure (for opendir/readdir)
 struct dm_dirent {
   u32 fsize;
@@ -40,6 +40,13 @@ typedef struct {
   void *userdata;
 } DM_DIR;
 
+// File information returned by dm_stat
+struct dm_stat {
+  u32 fsize;
+  u32 ftime;
+  u8 isdir;
+};
+
 // A device structure with pointers to all the device functions
 typedef struct
 {
@@ -54,8 +61,32 @@ typedef struct
   int ( *p_closedir_r )( struct _reent *r, void* dir ); 
   const char* ( *p_getaddr_r )( struct _reent *r, int fd );
   int ( *p_unlink_r )( struct _reent *r, const char *fname );
+  int ( *p_ioctl_r )( struct _reent *r, int fd, unsigned long request, void *ptr );
+  int ( *p_batch_r )( struct _reent *r, int begin );
+  int ( *p_rename_r )( struct _reent *r, const char *oldname, const char *newname );
+  int ( *p_mkdir_r )( struct _reent *r, const char *name, int mode );
+  int ( *p_stat_r )( struct _reent *r, const char *name, struct dm_stat *pstat );
 } DM_DEVICE;
 
+// Pool of per-descriptor state objects for device implementations
+// The objects are allocated only when first needed and recycled on release,
+// so a device doesn't need static arrays sized for the worst case.
+// Both allocation and release are O(1). The pool limit must be less than 255.
+typedef struct
+{
+  void **slots;             // objects (NULL if not allocated yet)
+  u8 *next;                 // free list links
+  u16 objsize;              // size of an object
+  u8 limit;                 // maximum number of objects
+  u8 high;                  // slots [0, high) were already used at least once
+  s16 free;                 // first free slot (-1 if none)
+} DM_POOL;
+
+#define DM_POOL_DECLARE( name, objsize, limit )\
+  static void* name##_slots[ limit ];\
+  static u8 name##_next[ limit ];\
+  static DM_POOL name = { name##_slots, name##_next, objsize, limit, 0, -1 }
+
 // Errors
 #define DM_ERR_ALREADY_REGISTERED   (-1)
 #define DM_ERR_NOT_REGISTERED       (-2)
@@ -75,11 +106,43 @@ int dm_get_num_devices();
 // Initialize device manager
 int dm_init();
 
+// Path resolution
+// A path is resolved by its first component ("/rom/file" is on the "/rom"
+// device). Paths that don't start with a device name are resolved to the
+// "/" device, if registered. With DM_RESOLVE_FILE the path must name a
+// file: a single component ("/file") always goes to the "/" device and the
+// remainder is the actual file name (without the leading '/').
+#define DM_RESOLVE_FILE             1
+int dm_resolve_path( const char *path, const char **prest, int flags );
+u32 dm_get_resolve_count();
+
+// Descriptor management
+int dm_fd_alloc( int devid );
+void dm_fd_bind( int fd, int devfd );
+void dm_fd_release( int fd );
+const DM_DEVICE* dm_fd_get_device( int fd, int *pdevfd );
+int dm_set_fd_limit( const char *name, int limit );
+int dm_get_fd_usage( const char *name, int *plimit );
+
+// Per-descriptor state pools
+int dm_pool_alloc( DM_POOL *pool );
+void* dm_pool_get( DM_POOL *pool, int idx );
+void dm_pool_free( DM_POOL *pool, int idx );
+
 // DM specific functions (uniform over all the installed filesystems)
 DM_DIR *dm_opendir( const char* dirname );
 struct dm_dirent* dm_readdir( DM_DIR *d );
 int dm_closedir( DM_DIR *d );
 const char* dm_getaddr( int fd );
+const char* dm_getaddr_fixed( int fd );
+int dm_batch( const char *path, int begin );
+int dm_rename( const char *oldname, const char *newname );
+int dm_mkdir( const char *name, int mode );
+int dm_stat( const char *name, struct dm_stat *pstat );
+int dm_sendfile( int fd, int s, u32 offset, u32 len );
+
+// 'len' argument of dm_sendfile for "send everything up to the end of file"
+#define DM_SENDFILE_TO_EOF          0xFFFFFFFFUL
 
 #endif
 
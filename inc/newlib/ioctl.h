@@ -15,6 +15,20 @@ struct fd_seek
   int dir;
 };
 
+// Reserve space for the file (argument: pointer to an u32 with the number of
+// bytes to reserve after the end of the file)
+#define FDPREALLOC    0x02
+
+// Get the preferred transfer size of the file, usually the size of a cluster
+// or of a network packet (argument: pointer to an u32 that receives the size)
+#define FDBLKSIZE     0x03
+
+// Get the address of a memory mapped file that stays valid while the file is
+// open, because the device never moves its files (argument: pointer to a
+// const char* that receives the address). Devices that can't guarantee it
+// (RAMFS, for example) don't implement this request.
+#define FDGETADDR_FIXED 0x04
+
 // ***************** Base IOCTRL numbers for other devices *********************
 #define IOCTL_BASE_UART     0x100
 
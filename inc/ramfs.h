@@ -0,0 +1,23 @@
+// RAM filesystem
+
+#ifndef __RAMFS_H__
+#define __RAMFS_H__
+
+#include "type.h"
+#include "devman.h"
+
+/*******************************************************************************
+The RAM filesystem keeps its files in a dedicated memory area (usually in
+external SRAM). The area is divided in RAMFS_BLOCK_SIZE blocks and each file
+occupies a single contiguous run of blocks (an "extent"), so any file can be
+memory mapped with dm_getaddr (and executed in place by Lua). A file that grows
+past its extent is moved to a larger one; if the free space is too fragmented
+the area is compacted first. Files that were mapped with dm_getaddr are never
+moved by compaction, so their address stays valid until they are truncated,
+grown past their extent or removed.
+*******************************************************************************/
+
+// FS functions
+const DM_DEVICE* ramfs_init();
+
+#endif
@@ -13,17 +13,37 @@
 typedef u32 ( *p_rfsc_send )( const u8 *p, u32 size );
 typedef u32 ( *p_rfsc_recv )( u8 *p, u32 size, s32 timeout );
 
+// Receives the data of a read stream
+typedef void ( *p_rfsc_data )( const u8 *p, u32 size, void *arg );
+
 // Public interface
 void rfsc_setup( u8 *pbuf, p_rfsc_send rfsc_send_func, p_rfsc_recv rfsc_recv_func, u32 timeout );
+void rfsc_set_max_packet( u32 size );
+u32 rfsc_get_max_data();
 void rfsc_set_timeout( u32 timeout );
+void rfsc_set_max_window( unsigned window );
+void rfsc_set_encoding( int enc );
+void rfsc_set_dir_buffer( u8 *pbuf, u32 size );
+void rfsc_set_compression( u8 *pbuf, u32 size, u16 *phash );
+void rfsc_get_compression_stats( u32 *praw, u32 *pwire );
+void rfsc_get_stats( u32 *prequests, u32 *psent, u32 *preceived, int reset );
 int rfsc_open( const char* pathname, int flags, int mode );
+int rfsc_open_stat( const char* pathname, int flags, int mode, u32 *psize, u32 *pmtime );
 s32 rfsc_write( int fd, const void *buf, u32 count );
 s32 rfsc_read( int fd, void *buf, u32 count );
+s32 rfsc_write_stream( int fd, const void *buf, u32 count, u32 blksize );
+s32 rfsc_read_stream( int fd, void *buf, u32 count, u32 blksize );
+s32 rfsc_read_stream_cb( int fd, u32 count, u32 blksize, p_rfsc_data cb, void *arg );
 s32 rfsc_lseek( int fd, s32 offset, int whence );
 int rfsc_close( int fd );
+void rfsc_close_nowait( int fd );
 u32 rfsc_opendir( const char* name );
 void rfsc_readdir( u32 d, const char **pname, u32 *psize, u32 *ptime );
 int rfsc_closedir( u32 d );
+int rfsc_stat( const char *name, u32 *psize, u32 *pmtime, int *pisdir );
+int rfsc_unlink( const char *name );
+int rfsc_rename( const char *oldname, const char *newname );
+int rfsc_mkdir( const char *name, int mode );
 
 #endif
 
@@ -17,13 +17,21 @@ int os_open( const char *pathname, int flags, int mode );
 u32 os_open_sys_flags_to_rfs_flags( int sysflags );
 s32 os_write( int fd, const void *buf, u32 count );
 s32 os_read( int fd, void *buf, u32 count );
+s32 os_pwrite( int fd, const void *buf, u32 count, u32 offset );
+s32 os_pread( int fd, void *buf, u32 count, u32 offset );
 int os_close( int fd );
 s32 os_lseek( int fd, s32 offset, int whence );
+int os_fstat( int fd, u32 *psize, u32 *pmtime );
 u32 os_lseek_sys_whence_to_rfs_whence( int syswhence );
 int os_isdir( const char *name );
 u32 os_opendir( const char* name );
 void os_readdir( u32 d, const char **pname );
+void os_readdir_stat( u32 d, const char **pname, u32 *psize, u32 *pmtime );
 int os_closedir( u32 d );
+int os_stat( const char *name, u32 *psize, u32 *pmtime, int *pisdir );
+int os_unlink( const char *name );
+int os_rename( const char *oldname, const char *newname );
+int os_mkdir( const char *name, int mode );
 
 #endif
 
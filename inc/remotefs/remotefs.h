@@ -15,9 +15,47 @@
 #define   RFS_OP_OPENDIR  0x06
 #define   RFS_OP_READDIR  0x07
 #define   RFS_OP_CLOSEDIR 0x08
-#define   RFS_OP_LAST     RFS_OP_CLOSEDIR
+#define   RFS_OP_HELLO    0x09
+#define   RFS_OP_READDIR_BATCH 0x0A
+#define   RFS_OP_STAT     0x0B
+#define   RFS_OP_UNLINK   0x0C
+#define   RFS_OP_RENAME   0x0D
+#define   RFS_OP_MKDIR    0x0E
+#define   RFS_OP_READZ    0x0F
+#define   RFS_OP_WRITEZ   0x10
+#define   RFS_OP_BUFSIZE  0x11
+#define   RFS_OP_LAST     RFS_OP_BUFSIZE
 #define   RFS_OP_RES_MOD  0x80
 
+// Protocol version
+// v1: one request at a time, packets without sequence numbers
+// v2: negotiated with RFS_OP_HELLO, every packet has a sequence number and the
+//     client can have up to 'window' requests in flight (the server executes
+//     them in order). The open response has the size and the modification
+//     time of the file (used by the client cache).
+// v3: the hello response also has the capabilities of the server (the
+//     optional operations that it implements, RFS_CAP_xxx below)
+#define   RFS_PROTOCOL_VERSION      3
+
+// Server capabilities (protocol v3)
+#define   RFS_CAP_READDIR_BATCH     0x01
+#define   RFS_CAP_STAT              0x02
+#define   RFS_CAP_UNLINK            0x04
+#define   RFS_CAP_RENAME            0x08
+#define   RFS_CAP_MKDIR             0x10
+#define   RFS_CAP_COMPACT_RPC       0x20      // accepts compact (v2) eluarpc packets
+#define   RFS_CAP_COMPRESS          0x40      // readz/writez (LZ compressed data, see lz.h)
+#define   RFS_CAP_BUFSIZE           0x80      // packets larger than RFS_DEFAULT_PACKET_SIZE (bufsize)
+
+// Largest packet that every server accepts. A client with a larger buffer
+// asks for more with bufsize (RFS_CAP_BUFSIZE).
+#define   RFS_DEFAULT_PACKET_SIZE   4096
+
+// The entries returned by readdir_batch are packed one after the other: size
+// (u32, little endian), modification time (u32, little endian), then the
+// name (ASCIIZ)
+#define   RFS_DIRENT_HEADER_SIZE    8
+
 // Platform independent constants for "flags" in "open"
 #define   RFS_OPEN_FLAG_APPEND      0x01
 #define   RFS_OPEN_FLAG_CREAT       0x02
@@ -43,9 +81,14 @@
 // RFS port (for UDP transport)
 #define   RFS_UDP_PORT              20666
 
+// RFS port (for TCP transport)
+#define   RFS_TCP_PORT              20666
+
 // Function: int open(const char *pathname,int flags, mode_t mode)
 void remotefs_open_write_response( u8 *p, int result );
 int remotefs_open_read_response( const u8 *p, int *presult );
+void remotefs_open_write_response_v2( u8 *p, int result, u32 size, u32 mtime );
+int remotefs_open_read_response_v2( const u8 *p, int *presult, u32 *psize, u32 *pmtime );
 void remotefs_open_write_request( u8 *p, const char* pathname, int flags, int mode );
 int remotefs_open_read_request( const u8 *p, const char **ppathname, int *pflags, int *pmode );
 
@@ -92,5 +135,69 @@ int remotefs_closedir_read_response( const u8 *p, int *pd );
 void remotefs_closedir_write_request( u8 *p, u32 d );
 int remotefs_closedir_read_request( const u8 *p, u32 *pd );
 
-#endif
+// Function: hello( u32 version, u32 window )
+// Returns the protocol version and the window accepted by the server (and
+// its capabilities for v3 clients)
+void remotefs_hello_write_response( u8 *p, u32 version, u32 window );
+int remotefs_hello_read_response( const u8 *p, u32 *pversion, u32 *pwindow );
+void remotefs_hello_write_response_v3( u8 *p, u32 version, u32 window, u32 caps );
+int remotefs_hello_read_response_v3( const u8 *p, u32 *pversion, u32 *pwindow, u32 *pcaps );
+void remotefs_hello_write_request( u8 *p, u32 version, u32 window );
+int remotefs_hello_read_request( const u8 *p, u32 *pversion, u32 *pwindow );
+
+// Function: ssize_t readz( int fd, void *buf, size_t count )
+// Like read, the data is compressed if this makes it smaller ('size' is the
+// number of bytes read, the data is compressed if it has less bytes)
+void remotefs_readz_write_response( u8 *p, u32 size, const void *data, u32 datalen );
+int remotefs_readz_read_response( const u8 *p, u32 *psize, const u8 **ppdata, u32 *pdatalen );
+void remotefs_readz_write_request( u8 *p, int fd, u32 count );
+int remotefs_readz_read_request( const u8 *p, int *pfd, u32 *pcount );
+
+// Function: ssize_t writez( int fd, const void *buf, size_t count )
+// Like write, the data is compressed if it has less than 'count' bytes
+void remotefs_writez_write_response( u8 *p, u32 result );
+int remotefs_writez_read_response( const u8 *p, u32 *presult );
+void remotefs_writez_write_request( u8 *p, int fd, u32 count, const void *data, u32 datalen );
+int remotefs_writez_read_request( const u8 *p, int *pfd, u32 *pcount, const void **pdata, u32 *pdatalen );
+
+// Function: u32 bufsize( u32 size )
+// Asks for packets of up to 'size' bytes, returns the size accepted by the
+// server (the largest packet for the rest of the session)
+void remotefs_bufsize_write_response( u8 *p, u32 size );
+int remotefs_bufsize_read_response( const u8 *p, u32 *psize );
+void remotefs_bufsize_write_request( u8 *p, u32 size );
+int remotefs_bufsize_read_request( const u8 *p, u32 *psize );
+
+// Function: void readdir_batch( u32 d, u32 maxsize )
+// Returns as many entries as fit in 'maxsize' bytes (see RFS_DIRENT_HEADER_SIZE)
+// and a flag that is set if the last entry of the directory was returned
+void remotefs_readdir_batch_write_response( u8 *p, u32 count, u32 last, const void *data, u32 size );
+int remotefs_readdir_batch_read_response( const u8 *p, u32 *pcount, u32 *plast, const u8 **pdata, u32 *psize );
+void remotefs_readdir_batch_write_request( u8 *p, u32 d, u32 maxsize );
+int remotefs_readdir_batch_read_request( const u8 *p, u32 *pd, u32 *pmaxsize );
+
+// Function: int stat( const char *name, u32 *psize, u32 *pmtime, u32 *pisdir )
+void remotefs_stat_write_response( u8 *p, int result, u32 size, u32 mtime, u32 isdir );
+int remotefs_stat_read_response( const u8 *p, int *presult, u32 *psize, u32 *pmtime, u32 *pisdir );
+void remotefs_stat_write_request( u8 *p, const char *name );
+int remotefs_stat_read_request( const u8 *p, const char **pname );
+
+// Function: int unlink( const char *name )
+void remotefs_unlink_write_response( u8 *p, int result );
+int remotefs_unlink_read_response( const u8 *p, int *presult );
+void remotefs_unlink_write_request( u8 *p, const char *name );
+int remotefs_unlink_read_request( const u8 *p, const char **pname );
+
+// Function: int rename( const char *oldname, const char *newname )
+void remotefs_rename_write_response( u8 *p, int result );
+int remotefs_rename_read_response( const u8 *p, int *presult );
+void remotefs_rename_write_request( u8 *p, const char *oldname, const char *newname );
+int remotefs_rename_read_request( const u8 *p, const char **poldname, const char **pnewname );
+
+// Function: int mkdir( const char *name, int mode )
+void remotefs_mkdir_write_response( u8 *p, int result );
+int remotefs_mkdir_read_response( const u8 *p, int *presult );
+void remotefs_mkdir_write_request( u8 *p, const char *name, int mode );
+int remotefs_mkdir_read_request( const u8 *p, const char **pname, int *pmode );
 
+#endif
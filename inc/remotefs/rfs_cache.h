@@ -0,0 +1,38 @@
+// Client cache of remote file blocks
+
+#ifndef __RFS_CACHE_H__
+#define __RFS_CACHE_H__
+
+#include "type.h"
+
+/*******************************************************************************
+The cache keeps blocks of the files read through /rfs, so a file that is read
+again (for example a module that is loaded with dofile/require many times
+during development) doesn't have to be transferred again. Files are keyed by
+their path and validated by a token (size and modification time) that v2
+servers return when a file is opened: if the token changed the cached blocks
+are dropped, otherwise the reads are served from the cache and opening the
+file is the only round trip (the close isn't waited for).
+
+- sequential runs of reads are detected and the next blocks are read ahead
+  with a single pipelined request stream.
+- seeks in cached files are done locally.
+- opening a file for writing, every write through /rfs and removing or
+  renaming the file through /rfs invalidates the cached copy of the file.
+- files opened by v1 servers (no token) aren't cached.
+
+The token has the resolution of the host file system timestamps, so a file
+that changes twice in the same second without changing its size on the host
+might be read from the cache.
+*******************************************************************************/
+
+void rfscache_init( u32 xfer_size );
+int rfscache_open( int fd, const char *path, int flags, u32 size, u32 mtime );
+int rfscache_is_cached( int fd );
+s32 rfscache_read( int fd, void *buf, u32 count );
+s32 rfscache_lseek( int fd, s32 offset, int whence );
+void rfscache_write( int fd );
+void rfscache_remove( const char *path );
+int rfscache_close( int fd );
+
+#endif // #ifndef __RFS_CACHE_H__
@@ -12,8 +12,14 @@
 #define   TYPE_END        0x06
 #define   TYPE_OP_ID      0x07
 #define   TYPE_SMALL_PTR  0x08
+#define   TYPE_SEQ        0x09
 #define   TYPE_PKT_SIZE   0xA5
 #define   TYPE_DISCOVER   0xC8
+// Compact (v2) packet, the low bits are flags
+#define   TYPE_PKT_V2     0xB0
+#define   TYPE_PKT_V2_MASK  0xFC
+#define   TYPE_PKT_V2_SEQ   0x01
+#define   TYPE_PKT_V2_CRC   0x02
                                     
 #endif
 
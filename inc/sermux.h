@@ -13,4 +13,33 @@
 #define SERMUX_ESCAPE_XOR_MASK   0x20
 #define SERMUX_ESC_MASK          0x100
 
+// Framed protocol (v2). Every frame is
+//   [SERMUX_V2_SOF][channel][length][payload (length bytes)][CRC16 (LE)]
+// The CRC (eluarpc_crc16) covers the channel, the length and the payload.
+// The data channels are the virtual UARTs (channel 0 is SERMUX_SERVICE_ID_FIRST).
+// Each side can send at most 'credit' bytes on a channel: the credits start
+// with the window announced by the other side in its HELLO frame (the free
+// space of its buffer for the channel) and more credits come in CREDIT
+// frames when the data is read from the buffer.
+#define SERMUX_V2_SOF            0xC5
+#define SERMUX_V2_MAX_PAYLOAD    64
+#define SERMUX_V2_OVERHEAD       5
+#define SERMUX_V2_MAX_FRAME      ( SERMUX_V2_MAX_PAYLOAD + SERMUX_V2_OVERHEAD )
+#define SERMUX_V2_CTRL_CHANNEL   0xFF
+
+// Control frames (on SERMUX_V2_CTRL_CHANNEL, the first byte is the type)
+// SYNC: [SERMUX_V2_SYNC][token]
+//   Sent on startup and after a bad frame. The sender doesn't send data
+//   until it gets a HELLO with the same token.
+// HELLO: [SERMUX_V2_HELLO][token][number of channels][window (u16 LE) for every channel]
+//   The answer to a SYNC. The data sent before the SYNC is already in the
+//   buffers when the windows are computed, so they replace the credits of
+//   the other side. After answering a SYNC the host sends its own SYNC if
+//   it isn't waiting for a HELLO already, the board only if it is (its SYNC
+//   might have been sent before the host was listening).
+// CREDIT: [SERMUX_V2_CREDIT][channel][credits (u16 LE)]
+#define SERMUX_V2_SYNC           0x01
+#define SERMUX_V2_HELLO          0x02
+#define SERMUX_V2_CREDIT         0x03
+
 #endif
@@ -50,6 +50,19 @@
   #endif // #ifndef BUILD_UIP
 #endif // #ifdef BUILD_DNS
 
+// RFS over TCP needs a TCP/IP stack and the address of the server
+#ifdef RFS_TRANSPORT_TCP
+  #if !defined( BUILD_UIP ) && !defined( BUILD_SIM_NET )
+  #error "RFS_TRANSPORT_TCP requires TCP/IP support (enable BUILD_UIP in platform_conf.h)"
+  #endif
+  #ifndef RFS_TCP_SERVER_IP0
+  #error "RFS_TRANSPORT_TCP requires the address of the server (RFS_TCP_SERVER_IP0..3 in platform_conf.h)"
+  #endif
+  #ifdef RFS_TRANSPORT_UDP
+  #error "Can't have two RFS transports (don't enable RFS_TRANSPORT_TCP and RFS_TRANSPORT_UDP at the same time)"
+  #endif
+#endif // #ifdef RFS_TRANSPORT_TCP
+
 // For linenoise we need term
 #ifdef BUILD_LINENOISE
   #if !defined( BUILD_TERM ) && !defined( BUILD_TERM_VRAM )
@@ -74,13 +87,14 @@
   #endif
 #endif
 
-// MMCFS uses the virtual timer to implement its timeouts
-#if defined( BUILD_MMCFS ) && (!defined( VTMR_NUM_TIMERS ) || VTMR_NUM_TIMERS == 0)
+// MMCFS uses the virtual timer to implement its timeouts (the simulator disk
+// in MMCFS_SIM mode has no SPI timeouts, so it doesn't need it)
+#if defined( BUILD_MMCFS ) && !defined( MMCFS_SIM ) && (!defined( VTMR_NUM_TIMERS ) || VTMR_NUM_TIMERS == 0)
   #error "BUILD_MMCFS needs virtual timer support. Define VTMR_NUM_TIMERS > 0"
 #endif
 
 // MMCFS tick runs off VTMR timer so these values must be the same
-#if defined( BUILD_MMCFS ) && MMCFS_TICK_HZ != VTMR_FREQ_HZ
+#if defined( BUILD_MMCFS ) && !defined( MMCFS_SIM ) && MMCFS_TICK_HZ != VTMR_FREQ_HZ
   #error "MMCFS_TICK_HZ must be equal to VTMR_FREQ_HZ"
 #endif
 
@@ -2,6 +2,9 @@ local args = { ... }
 local b = require "utils.build"
 local builder = b.new_builder( ".build/mux" )
 local utils = b.utils
+
+-- Set builder options BEFORE calling builder:init
+builder:add_option( 'bench', 'build the loopback benchmark (muxbench) instead of mux', false )
 builder:init( args )
 builder:set_build_mode( builder.BUILD_DIR_LINEARIZED )
 
@@ -19,7 +22,7 @@ else
   exeprefix = ""
 end
 
-local full_files = utils.prepend_path( flist, "mux_src" ) .. utils.prepend_path( rfs_flist, "rfs_server_src" ) .. "src/remotefs/remotefs.c src/eluarpc.c"
+local full_files = utils.prepend_path( flist, "mux_src" ) .. utils.prepend_path( rfs_flist, "rfs_server_src" ) .. "src/remotefs/remotefs.c src/eluarpc.c src/lz.c"
 local local_include = "mux_src rfs_server_src inc inc/remotefs"
 local compcmd = builder:compile_cmd{ flags = "-m32 -O0 -Wall -g", defines = cdefs, includes = local_include }
 local linkcmd = builder:link_cmd{ flags = "-m32", libraries = socklib }
@@ -28,6 +31,14 @@ builder:set_link_cmd( linkcmd )
 builder:set_exe_extension( exeprefix )
 
 -- Build everyting
-builder:make_exe_target( "mux", full_files )
+if builder:get_option( 'bench' ) then
+  if utils.is_windows() then
+    print "The mux benchmark is not supported under Windows"
+    os.exit( 1 )
+  end
+  builder:make_exe_target( "muxbench", "mux_src/muxbench.c src/eluarpc.c" )
+else
+  builder:make_exe_target( "mux", full_files )
+end
 builder:build()
 
@@ -9,5 +9,14 @@
 #define NET_TIMEOUT_MS              100
 #define MEM_BUF_SIZE                ( 6 * 1024 )
 
+// Size of the blocks read from and written to the ports
+#define MUX_BUF_SIZE                4096
+// Size of the queues of every service (must hold a whole RFS response)
+#define MUX_QUEUE_SIZE              ( 20 * 1024 )
+// Bytes sent by a service before the next service can send
+#define MUX_SERVICE_QUANTUM         256
+// Time between the SYNC frames sent while the board doesn't answer (v2)
+#define MUX_V2_SYNC_MS              1000
+
 #endif
 
@@ -12,6 +12,7 @@
 #include "type.h"
 #include "serial.h"
 #include "sermux.h"
+#include "eluarpc.h"
 #include "rfs.h"
 #include "deskutils.h"
 
@@ -24,17 +25,30 @@
 #define HND_TRANSPORT_OFFSET  0
 #define HND_FIRST_VOFFSET     1
 
-#define RFS_PSEUDO_SELIDX     0xFF
+// Bytes that must be escaped on the transport
+#define MUX_IS_SPECIAL( c )   ( ( c ) == SERMUX_ESCAPE_CHAR || ( c ) == SERMUX_FORCE_SID_CHAR || ( ( c ) >= SERMUX_SERVICE_ID_FIRST && ( c ) <= SERMUX_SERVICE_ID_LAST ) )
 
 // Send/receive/init function pointers
 typedef u32 ( *p_recv_func )( u8 *p, u32 size );
 typedef u32 ( *p_send_func )( const u8 *p, u32 size );
 typedef int ( *p_init_func )( void );
 
-// Serial thread buffer structure
+// Byte queue (the data is at 'start', the free space at the end)
+typedef struct {
+  u8 *data;
+  u32 start;
+  u32 size;
+  u32 max;
+} MUX_QUEUE;
+
+// Service data structure
 typedef struct {
   const char *pname;
-  ser_handler fd;
+  ser_handler fd;             // SER_HANDLER_INVALID for the RFS server
+  MUX_QUEUE in;               // data from the service waiting for the transport
+  MUX_QUEUE out;              // data from the transport waiting for the service
+  u32 credits;                // v2: bytes that the board can still get
+  u32 consumed;               // v2: bytes taken from 'out' and not returned in a CREDIT yet
 } SERVICE_DATA;
 
 // Serial transport data structure
@@ -46,19 +60,36 @@ typedef struct {
 } TRANSPORT_SER;
 
 static SERVICE_DATA *services;
-static unsigned vport_num;
+static unsigned vport_num, service_num, service_next;
 
 static TRANSPORT_SER *transport_data;
 static p_send_func transport_send;
 static p_init_func transport_init;
 
 static int service_id_in = -1, service_id_out = -1;
+static int prev_sent = -1, got_esc;
+
+// Transport buffers
+static u8 transport_in[ MUX_BUF_SIZE ];
+static u32 transport_in_pos, transport_in_size;
+static MUX_QUEUE transport_out;
+
+// RFS response waiting for room in the RFS service queue
+static u16 rfs_size;
+static u8 *rfs_ptr;
  
 static ser_handler transport_hnd = SER_HANDLER_INVALID;
 static int mux_mode;
 static int verbose_mode;
 static int rfs_service_id = -1, service_offset;
 
+// Framed protocol (v2) state
+static int mux_v2;
+static u8 v2_rx_frame[ SERMUX_V2_MAX_PAYLOAD + 4 ]; // channel, length, payload, CRC
+static u32 v2_rx_pos;
+static int v2_rx_active, v2_waiting;
+static u8 v2_sync_token;
+
 // ***************************************************************************
 // Serial transport implementation
 
@@ -66,7 +97,7 @@ static u32 transport_ser_send( const u8 *p, u32 size )
 {
   TRANSPORT_SER *pser = ( TRANSPORT_SER* )transport_data;
 
-  return ser_write( pser->fd, p, size );
+  return ser_write_nb( pser->fd, p, size );
 }
 
 static int transport_ser_init()
@@ -92,9 +123,475 @@ static int transport_ser_init()
 // ****************************************************************************
 // Utility functions and helpers
 
+static int queue_init( MUX_QUEUE *q, u32 max )
+{
+  q->start = q->size = 0;
+  q->max = max;
+  return ( q->data = ( u8* )malloc( max ) ) != NULL;
+}
+
+// Return the free space at the end of the queue (moving the data to the
+// start of the queue first if needed)
+static u32 queue_free( MUX_QUEUE *q )
+{
+  if( q->start > 0 && q->start + q->size > q->max / 2 )
+  {
+    memmove( q->data, q->data + q->start, q->size );
+    q->start = 0;
+  }
+  return q->max - q->start - q->size;
+}
+
+static u8* queue_tail( MUX_QUEUE *q )
+{
+  return q->data + q->start + q->size;
+}
+
+static u32 queue_put( MUX_QUEUE *q, const u8 *p, u32 size )
+{
+  u32 free = queue_free( q );
+
+  if( size > free )
+    size = free;
+  memcpy( queue_tail( q ), p, size );
+  q->size += size;
+  return size;
+}
+
+static void queue_drop( MUX_QUEUE *q, u32 size )
+{
+  q->start += size;
+  if( ( q->size -= size ) == 0 )
+    q->start = 0;
+}
+
 static void transport_send_byte( u8 data )
 {
-  transport_send( &data, 1 );
+  if( queue_put( &transport_out, &data, 1 ) == 0 )
+    log_err( "Transport buffer full, byte %d dropped\n", data );
+}
+
+// Return the length of the data at 'p' that doesn't need escaping. The bytes
+// that need escaping are all above 0xC0, so 4 bytes are checked at once: if
+// no byte has both bit 7 and bit 6 set the whole word can be sent as is.
+static u32 mux_plain_run( const u8 *p, u32 size )
+{
+  u32 i = 0, w;
+
+  while( i < size )
+  {
+    if( i + 4 <= size )
+    {
+      memcpy( &w, p + i, 4 );
+      if( ( w & ( w << 1 ) & 0x80808080UL ) == 0 )
+      {
+        i += 4;
+        continue;
+      }
+    }
+    if( MUX_IS_SPECIAL( p[ i ] ) )
+      break;
+    i ++;
+  }
+  return i;
+}
+
+// Escape data from a service to the transport buffer. Return the number of
+// bytes of 'p' that fit in the buffer.
+static u32 mux_escape( const u8 *p, u32 size )
+{
+  u32 i = 0, run, free;
+  u8 c;
+
+  while( i < size )
+  {
+    free = queue_free( &transport_out );
+    run = mux_plain_run( p + i, size - i );
+    if( run > 0 )
+    {
+      if( run > free )
+        run = free;
+      if( run == 0 )
+        break;
+      memcpy( queue_tail( &transport_out ), p + i, run );
+      transport_out.size += run;
+      i += run;
+      prev_sent = p[ i - 1 ];
+      continue;
+    }
+    if( free < 2 )
+      break;
+    c = p[ i ++ ] ^ SERMUX_ESCAPE_XOR_MASK;
+    queue_tail( &transport_out )[ 0 ] = SERMUX_ESCAPE_CHAR;
+    queue_tail( &transport_out )[ 1 ] = c;
+    transport_out.size += 2;
+    prev_sent = SERMUX_ESC_MASK | c;
+  }
+  return i;
+}
+
+// Move the data waiting in the service queues to the transport buffer. The
+// services take turns, every one sends at most MUX_SERVICE_QUANTUM bytes at
+// a time, so a busy service can't keep the others waiting.
+static void mux_send_services()
+{
+  SERVICE_DATA *pservice;
+  unsigned i, idle = 0;
+  u32 size;
+  int sid;
+
+  while( idle < service_num && queue_free( &transport_out ) > 2 )
+  {
+    i = service_next;
+    service_next = ( service_next + 1 ) % service_num;
+    pservice = services + i;
+    if( pservice->in.size == 0 )
+    {
+      idle ++;
+      continue;
+    }
+    idle = 0;
+    sid = SERMUX_SERVICE_ID_FIRST + i;
+    if( sid != service_id_out )
+    {
+      log_msg( "Changed service_id_out from %d(%X) to %d(%X).\n", service_id_out, service_id_out, sid, sid );
+      transport_send_byte( sid );
+      service_id_out = sid;
+    }
+    size = pservice->in.size > MUX_SERVICE_QUANTUM ? MUX_SERVICE_QUANTUM : pservice->in.size;
+    queue_drop( &pservice->in, mux_escape( pservice->in.data + pservice->in.start, size ) );
+  }
+}
+
+// Queue the RFS response for the transport. Return 0 if it doesn't fit in
+// the queue of the RFS service yet.
+static int mux_queue_rfs_response()
+{
+  SERVICE_DATA *pservice = services + rfs_service_id - SERMUX_SERVICE_ID_FIRST;
+
+  if( rfs_size > pservice->in.max )
+  {
+    log_err( "RFS response of %u bytes too large, dropped\n", ( unsigned )rfs_size );
+    rfs_size = 0;
+  }
+  if( rfs_size > queue_free( &pservice->in ) )
+    return 0;
+  queue_put( &pservice->in, rfs_ptr, rfs_size );
+  rfs_size = 0;
+  return 1;
+}
+
+// Send data from the transport to the current input service. Return the
+// number of bytes used (less than 'size' if the RFS server has a response
+// that must be sent before it can get the next request).
+static u32 mux_service_data( const u8 *p, u32 size )
+{
+  SERVICE_DATA *pservice;
+  u32 i;
+
+  if( service_id_in == rfs_service_id ) // this request is for the RFS server
+  {
+    for( i = 0; i < size; i ++ )
+    {
+      rfs_mem_read_request_packet( p[ i ] );
+      if( rfs_mem_has_response() ) // we have a response from the RFS server
+      {
+        rfs_mem_write_response( &rfs_size, &rfs_ptr );
+        rfs_mem_start_request(); // initialize the RFS server for a new request
+        if( !mux_queue_rfs_response() )
+          return i + 1;
+      }
+    }
+    return size;
+  }
+  if( ( unsigned )( service_id_in - SERMUX_SERVICE_ID_FIRST ) >= service_num )
+    return size;
+  pservice = services + service_id_in - SERMUX_SERVICE_ID_FIRST;
+  if( ( i = queue_put( &pservice->out, p, size ) ) < size )
+    log_err( "Buffer of %s full, %u bytes dropped\n", pservice->pname, ( unsigned )( size - i ) );
+  return size;
+}
+
+// Interpret the data from the transport
+static int mux_transport_input()
+{
+  u8 c;
+  u32 run;
+
+  while( transport_in_pos < transport_in_size )
+  {
+    if( rfs_size > 0 && !mux_queue_rfs_response() )
+      break;
+    c = transport_in[ transport_in_pos ];
+    // Most data isn't escaped and goes to the same service
+    if( !got_esc && service_id_in != -1 && !MUX_IS_SPECIAL( c ) )
+    {
+      run = mux_plain_run( transport_in + transport_in_pos, transport_in_size - transport_in_pos );
+      transport_in_pos += mux_service_data( transport_in + transport_in_pos, run );
+      continue;
+    }
+    transport_in_pos ++;
+    if( c == SERMUX_ESCAPE_CHAR )
+      got_esc = 1;
+    else if( c >= SERMUX_SERVICE_ID_FIRST && c <= SERMUX_SERVICE_ID_LAST )
+    {
+      log_msg( "Changed service_id_in from %d(%X) to %d(%X).\n", service_id_in, service_id_in, c, c );
+      service_id_in = c;
+    }
+    else if( c == SERMUX_FORCE_SID_CHAR )
+    {
+      if( prev_sent == -1 )
+      {
+        log_err( "Protocol error: got request to resend service ID when the last char sent was not set.\n" );
+        return 0;
+      }
+      log_msg( "Got request to resend service_id_out %d(%X).\n", service_id_out, service_id_out );
+      // Re-transmit the last data AND the service ID
+      transport_send_byte( service_id_out );
+      if( prev_sent & SERMUX_ESC_MASK )
+        transport_send_byte( SERMUX_ESCAPE_CHAR );
+      transport_send_byte( prev_sent & 0xFF );
+      prev_sent = -1;
+    }
+    else
+    {
+      if( got_esc )
+      {
+        // Got an escape last time, check the char now (with the 5th bit flipped)
+        c ^= SERMUX_ESCAPE_XOR_MASK;
+        if( !MUX_IS_SPECIAL( c ) )
+        {
+          log_err( "Protocol error: invalid escape sequence\n" );
+          return 0;
+        }
+        got_esc = 0;
+      }
+      if( service_id_in == -1 )
+      {
+        transport_send_byte( SERMUX_FORCE_SID_CHAR );
+        log_msg( "Requested resend of service ID for byte %3d ('%c').\n", c, isprint( c ) ? c : ' ' );
+      }
+      else
+        mux_service_data( &c, 1 );
+    }
+  }
+  return 1;
+}
+
+// ****************************************************************************
+// Framed protocol (v2)
+
+// Put a frame in the transport buffer. Return 0 if there's no room for it.
+static int mux_v2_send_frame( u8 channel, const u8 *p, u8 len )
+{
+  u8 *d;
+  u16 crc;
+
+  if( queue_free( &transport_out ) < ( u32 )len + SERMUX_V2_OVERHEAD )
+    return 0;
+  d = queue_tail( &transport_out );
+  d[ 0 ] = SERMUX_V2_SOF;
+  d[ 1 ] = channel;
+  d[ 2 ] = len;
+  memcpy( d + 3, p, len );
+  crc = eluarpc_crc16( ELUARPC_CRC_INIT, d + 1, len + 2 );
+  d[ len + 3 ] = crc & 0xFF;
+  d[ len + 4 ] = crc >> 8;
+  transport_out.size += len + SERMUX_V2_OVERHEAD;
+  return 1;
+}
+
+// Ask the board for its windows, nothing is sent until they come
+static void mux_v2_sync()
+{
+  u8 frame[ 2 ];
+
+  frame[ 0 ] = SERMUX_V2_SYNC;
+  frame[ 1 ] = ++ v2_sync_token;
+  v2_waiting = 1;
+  log_msg( "Sending SYNC %u.\n", v2_sync_token );
+  if( !mux_v2_send_frame( SERMUX_V2_CTRL_CHANNEL, frame, 2 ) )
+    log_err( "Transport buffer full, SYNC dropped\n" );
+}
+
+// Send our windows (the free space of the service queues) to the board
+static void mux_v2_hello( u8 token )
+{
+  u8 frame[ 3 + 2 * SERMUX_SERVICE_MAX ];
+  unsigned i;
+  u32 free;
+
+  frame[ 0 ] = SERMUX_V2_HELLO;
+  frame[ 1 ] = token;
+  frame[ 2 ] = service_num;
+  for( i = 0; i < service_num; i ++ )
+  {
+    free = services[ i ].out.max - services[ i ].out.size;
+    if( free > 0xFFFF )
+      free = 0xFFFF;
+    frame[ 3 + 2 * i ] = free & 0xFF;
+    frame[ 4 + 2 * i ] = free >> 8;
+    services[ i ].consumed = 0;
+  }
+  if( !mux_v2_send_frame( SERMUX_V2_CTRL_CHANNEL, frame, 3 + 2 * service_num ) )
+    log_err( "Transport buffer full, HELLO dropped\n" );
+}
+
+// Interpret a frame from the board
+static void mux_v2_frame( u8 channel, const u8 *p, u8 len )
+{
+  SERVICE_DATA *pservice;
+  unsigned i;
+  u32 size;
+
+  if( channel < service_num )
+  {
+    pservice = services + channel;
+    if( ( size = queue_put( &pservice->out, p, len ) ) < len )
+      log_err( "Buffer of %s full, %u bytes dropped\n", pservice->pname, ( unsigned )( len - size ) );
+  }
+  else if( channel != SERMUX_V2_CTRL_CHANNEL || len < 2 )
+    log_err( "Protocol error: invalid frame on channel %u\n", channel );
+  else if( p[ 0 ] == SERMUX_V2_SYNC )
+  {
+    // The board (re)started: send our windows and get its windows again
+    log_msg( "Got SYNC %u.\n", p[ 1 ] );
+    mux_v2_hello( p[ 1 ] );
+    if( !v2_waiting )
+      mux_v2_sync();
+  }
+  else if( p[ 0 ] == SERMUX_V2_HELLO && len >= 3 )
+  {
+    if( !v2_waiting || p[ 1 ] != v2_sync_token )
+      return;
+    for( i = 0; i < service_num; i ++ )
+      services[ i ].credits = i < p[ 2 ] && len >= 5 + 2 * i ? p[ 3 + 2 * i ] | ( ( u32 )p[ 4 + 2 * i ] << 8 ) : 0;
+    v2_waiting = 0;
+    log_msg( "Got HELLO %u with %u channel(s).\n", p[ 1 ], p[ 2 ] );
+  }
+  else if( p[ 0 ] == SERMUX_V2_CREDIT && len >= 4 && p[ 1 ] < service_num )
+    services[ p[ 1 ] ].credits += p[ 2 ] | ( ( u32 )p[ 3 ] << 8 );
+}
+
+// Interpret the frames from the transport. The frames never have to wait for
+// a service (the board only sends the data that fits in the service queues),
+// so all the transport data is used.
+static void mux_v2_transport_input()
+{
+  u32 n;
+
+  while( transport_in_pos < transport_in_size )
+  {
+    if( !v2_rx_active )
+    {
+      if( transport_in[ transport_in_pos ++ ] == SERMUX_V2_SOF )
+      {
+        v2_rx_active = 1;
+        v2_rx_pos = 0;
+      }
+      continue;
+    }
+    // Copy the channel and length first, then the rest of the frame
+    n = v2_rx_pos < 2 ? 1 : v2_rx_frame[ 1 ] + 4 - v2_rx_pos;
+    if( n > transport_in_size - transport_in_pos )
+      n = transport_in_size - transport_in_pos;
+    memcpy( v2_rx_frame + v2_rx_pos, transport_in + transport_in_pos, n );
+    v2_rx_pos += n;
+    transport_in_pos += n;
+    if( v2_rx_pos == 2 && v2_rx_frame[ 1 ] > SERMUX_V2_MAX_PAYLOAD )
+    {
+      v2_rx_active = 0;
+      log_err( "Protocol error: invalid frame length %u\n", v2_rx_frame[ 1 ] );
+      mux_v2_sync();
+    }
+    else if( v2_rx_pos > 2 && v2_rx_pos == v2_rx_frame[ 1 ] + 4u )
+    {
+      v2_rx_active = 0;
+      if( eluarpc_crc16( ELUARPC_CRC_INIT, v2_rx_frame, v2_rx_pos - 2 ) == ( v2_rx_frame[ v2_rx_pos - 2 ] | ( ( u16 )v2_rx_frame[ v2_rx_pos - 1 ] << 8 ) ) )
+        mux_v2_frame( v2_rx_frame[ 0 ], v2_rx_frame + 2, v2_rx_frame[ 1 ] );
+      else
+      {
+        log_err( "Protocol error: bad frame CRC\n" );
+        mux_v2_sync();
+      }
+    }
+  }
+}
+
+// Give the requests that came for the RFS server to the server, one at a time
+static void mux_v2_run_rfs()
+{
+  SERVICE_DATA *pservice = services + rfs_service_id - SERMUX_SERVICE_ID_FIRST;
+
+  while( pservice->out.size > 0 )
+  {
+    if( rfs_size > 0 && !mux_queue_rfs_response() )
+      return;
+    rfs_mem_read_request_packet( pservice->out.data[ pservice->out.start ] );
+    queue_drop( &pservice->out, 1 );
+    pservice->consumed ++;
+    if( rfs_mem_has_response() )
+    {
+      rfs_mem_write_response( &rfs_size, &rfs_ptr );
+      rfs_mem_start_request();
+    }
+  }
+  if( rfs_size > 0 )
+    mux_queue_rfs_response();
+}
+
+// Return the credits for the data taken from the service queues
+static void mux_v2_send_credits()
+{
+  SERVICE_DATA *pservice;
+  unsigned i;
+  u8 frame[ 4 ];
+
+  for( i = 0; i < service_num; i ++ )
+  {
+    pservice = services + i;
+    if( pservice->consumed == 0 || ( pservice->consumed < pservice->out.max / 4 && pservice->out.size > 0 ) )
+      continue;
+    frame[ 0 ] = SERMUX_V2_CREDIT;
+    frame[ 1 ] = i;
+    frame[ 2 ] = pservice->consumed & 0xFF;
+    frame[ 3 ] = pservice->consumed >> 8;
+    if( !mux_v2_send_frame( SERMUX_V2_CTRL_CHANNEL, frame, 4 ) )
+      break;
+    pservice->consumed = 0;
+  }
+}
+
+// Send the data of the services in frames. The services take turns, one
+// frame each, and a service only sends what the board has room for, so a
+// service that the board doesn't read can't keep the others waiting.
+static void mux_v2_send_services()
+{
+  SERVICE_DATA *pservice;
+  unsigned i, idle = 0;
+  u32 size;
+
+  mux_v2_send_credits();
+  if( v2_waiting )
+    return;
+  while( idle < service_num && queue_free( &transport_out ) >= SERMUX_V2_MAX_FRAME )
+  {
+    i = service_next;
+    service_next = ( service_next + 1 ) % service_num;
+    pservice = services + i;
+    size = pservice->in.size < pservice->credits ? pservice->in.size : pservice->credits;
+    if( size > SERMUX_V2_MAX_PAYLOAD )
+      size = SERMUX_V2_MAX_PAYLOAD;
+    if( size == 0 )
+    {
+      idle ++;
+      continue;
+    }
+    idle = 0;
+    mux_v2_send_frame( i, pservice->in.data + pservice->in.start, size );
+    queue_drop( &pservice->in, size );
+    pservice->credits -= size;
+  }
 }
 
 // Transport parser
@@ -154,14 +651,11 @@ int main( int argc, char **argv )
 {
   unsigned i;
   SERVICE_DATA *tservice;
-  int c, prev_sent = -1;
-  int temp;
-  int got_esc = 0;
   char* rfs_dir_name;
   ser_handler *phandlers;
-  int selidx;
-  u16 rfs_size = 0;
-  u8 *rfs_ptr;
+  u8 *pevents;
+  u32 size;
+  int res;
 
   // Interpret arguments
   setvbuf( stdout, NULL, _IONBF, 0 );  
@@ -171,6 +665,7 @@ int main( int argc, char **argv )
     log_err( "  mode: \n" );
     log_err( "    'mux':                 serial multiplexer mode\n" );
     log_err( "    'rfsmux:<directory>':  combined RFS and multiplexer mode.\n" );
+    log_err( "    'mux2', 'rfsmux2:<directory>': the same with the framed protocol (SERMUX_PROTOCOL_V2).\n" );
     log_err( "  transport: '<port>,<baud>,<flow>' ('flow' specifies the flow control type and can be 'none' or 'rtscts').\n" );
     log_err( "  vcom1, ..., vcomn: multiplexer serial ports.\n" );
     log_err( "  Use '-v' for verbose output.\n" );
@@ -178,11 +673,13 @@ int main( int argc, char **argv )
   }
   
   // Check mode
-  if( !strcmp( argv[ MODE_IDX ], "mux" ) )
+  if( !strcmp( argv[ MODE_IDX ], "mux2" ) || !strncmp( argv[ MODE_IDX ], "rfsmux2:", strlen( "rfsmux2:" ) ) )
+    mux_v2 = 1;
+  if( !strcmp( argv[ MODE_IDX ], "mux" ) || !strcmp( argv[ MODE_IDX ], "mux2" ) )
     mux_mode = MODE_MUX;
-  else if( !strncmp( argv[ MODE_IDX ], "rfsmux:", strlen( "rfsmux:" ) ) )
+  else if( !strncmp( argv[ MODE_IDX ], "rfsmux:", strlen( "rfsmux:" ) ) || !strncmp( argv[ MODE_IDX ], "rfsmux2:", strlen( "rfsmux2:" ) ) )
   {
-    rfs_dir_name = argv[ MODE_IDX ] + strlen( "rfsmux:" );
+    rfs_dir_name = strchr( argv[ MODE_IDX ], ':' ) + 1;
     mux_mode = MODE_RFSMUX;
     rfs_service_id = SERMUX_SERVICE_ID_FIRST;
     service_offset = 1;
@@ -205,9 +702,10 @@ int main( int argc, char **argv )
     log_init( LOG_NONE );
   
   // Get number of virtual UARTs     
-  if( ( vport_num = i - FIRST_SERVICE_IDX + 1 ) > SERMUX_SERVICE_MAX )
+  vport_num = i - FIRST_SERVICE_IDX + 1;
+  if( ( service_num = vport_num + service_offset ) > SERMUX_SERVICE_MAX )
   {
-    log_err( "Too many service ports, maximum is %d\n", SERMUX_SERVICE_MAX );
+    log_err( "Too many service ports, maximum is %d\n", SERMUX_SERVICE_MAX - service_offset );
     return 1;
   }
   
@@ -218,22 +716,39 @@ int main( int argc, char **argv )
     return 1;
 
   // Open all the service ports
-  if( ( services = ( SERVICE_DATA* )malloc( sizeof( SERVICE_DATA ) * vport_num ) ) == NULL )
+  if( ( services = ( SERVICE_DATA* )malloc( sizeof( SERVICE_DATA ) * service_num ) ) == NULL )
   {
     log_err( "Not enough memory\n" );
     return 1;
   }
-  if( ( phandlers = ( ser_handler* )malloc( sizeof( ser_handler ) * ( vport_num + 1 ) ) ) == NULL )
+  if( ( phandlers = ( ser_handler* )malloc( sizeof( ser_handler ) * ( vport_num + 1 ) ) ) == NULL ||
+      ( pevents = ( u8* )malloc( vport_num + 1 ) ) == NULL )
   {
     log_err( "Not enough memory\n" );
     return 1;  
   }
   phandlers[ HND_TRANSPORT_OFFSET ] = transport_hnd;
 
-  memset( services, 0, sizeof( SERVICE_DATA ) * vport_num );
+  memset( services, 0, sizeof( SERVICE_DATA ) * service_num );
+  for( i = 0; i < service_num; i ++ )
+    if( !queue_init( &services[ i ].in, MUX_QUEUE_SIZE ) || !queue_init( &services[ i ].out, MUX_QUEUE_SIZE ) )
+    {
+      log_err( "Not enough memory\n" );
+      return 1;
+    }
+  if( !queue_init( &transport_out, MUX_BUF_SIZE ) )
+  {
+    log_err( "Not enough memory\n" );
+    return 1;
+  }
+  if( service_offset )
+  {
+    services[ 0 ].pname = "RFS";
+    services[ 0 ].fd = SER_HANDLER_INVALID;
+  }
   for( i = 0; i < vport_num; i ++ ) 
   {
-    tservice = services + i;
+    tservice = services + i + service_offset;
     if( ( tservice->fd = ser_open( argv[ i + FIRST_SERVICE_IDX ] ) ) == SER_HANDLER_INVALID )
     {
       log_err( "Unable to open port %s\n", argv[ i + FIRST_SERVICE_IDX ] );
@@ -259,119 +774,81 @@ int main( int argc, char **argv )
   }
 
   log_msg( "Starting service multiplexer on %u port(s)\n", vport_num );
+  if( mux_v2 )
+    mux_v2_sync();
   
-  // Main service thread
+  // Main service thread: the data is read and written in blocks, the ports
+  // are only waited for when there's room for their data or something to send
   while( 1 )
   {
-    if( rfs_size > 0 ) // Response packet from RFS
+    if( mux_v2 ) // credits for the data written in the previous pass
+      mux_v2_send_credits();
+    pevents[ HND_TRANSPORT_OFFSET ] = ( transport_in_pos == transport_in_size ? SER_SELECT_READ : 0 ) | ( transport_out.size ? SER_SELECT_WRITE : 0 );
+    for( i = 0; i < vport_num; i ++ )
     {
-      c = *rfs_ptr ++;
-      rfs_size --;
-      selidx = RFS_PSEUDO_SELIDX;
+      tservice = services + i + service_offset;
+      pevents[ i + HND_FIRST_VOFFSET ] = ( queue_free( &tservice->in ) > 0 ? SER_SELECT_READ : 0 ) | ( tservice->out.size ? SER_SELECT_WRITE : 0 );
     }
-    else
+    if( ( res = ser_select( phandlers, vport_num + 1, pevents, mux_v2 && v2_waiting ? MUX_V2_SYNC_MS : SER_INF_TIMEOUT ) ) == -1 )
+    {
+      log_err( "Error on select, aborting program\n" );
+      return 1;
+    }
+    if( res == 0 && mux_v2 && v2_waiting ) // no answer from the board yet
+      mux_v2_sync();
+
+    // Read the data of the transport and the services
+    if( pevents[ HND_TRANSPORT_OFFSET ] & SER_SELECT_READ )
     {
-      if( ( c = ser_select_byte( phandlers, vport_num + 1, SER_INF_TIMEOUT ) ) == -1 )
+      transport_in_pos = 0;
+      if( ( transport_in_size = ser_read( transport_hnd, transport_in, MUX_BUF_SIZE, SER_NO_TIMEOUT ) ) == 0 )
       {
-        log_err( "Error on select, aborting program\n" );
+        log_err( "Error reading the transport, aborting program\n" );
         return 1;
       }
-      selidx = c >> 8;
-      c = c & 0xFF;
     }
-    //log_msg( "Got byte %d from idx %d\n", c, selidx );
-    if( selidx == HND_TRANSPORT_OFFSET ) // Got byte on transport interface
-    {
-      // Interpret byte
-      if( c != SERMUX_ESCAPE_CHAR )
+    for( i = 0; i < vport_num; i ++ )
+      if( pevents[ i + HND_FIRST_VOFFSET ] & SER_SELECT_READ )
       {
-        if( c >= SERMUX_SERVICE_ID_FIRST && c <= SERMUX_SERVICE_ID_LAST )
-        {
-          log_msg( "Changed service_id_in from %d(%X) to %d(%X).\n", service_id_in, service_id_in, c, c );
-          service_id_in = c;
-        } 
-        else if( c == SERMUX_FORCE_SID_CHAR )
-        {
-          if( prev_sent == -1 )
-          {
-            log_err( "Protocol error: got request to resend service ID when the last char sent was not set.\n" );
-            return 1;
-          }
-          log_msg( "Got request to resend service_id_out %d(%X).\n", service_id_out, service_id_out );
-          // Re-transmit the last data AND the service ID
-          transport_send_byte( service_id_out );
-          if( prev_sent & SERMUX_ESC_MASK )
-            transport_send_byte( SERMUX_ESCAPE_CHAR );
-          transport_send_byte( prev_sent & 0xFF );
-          prev_sent = -1;
-        }          
-        else
+        tservice = services + i + service_offset;
+        size = queue_free( &tservice->in );
+        if( ( size = ser_read( tservice->fd, queue_tail( &tservice->in ), size > MUX_BUF_SIZE ? MUX_BUF_SIZE : size, SER_NO_TIMEOUT ) ) == 0 )
         {
-          if( got_esc )
-          {
-            // Got an escape last time, check the char now (with the 5th bit flipped)
-            c ^= SERMUX_ESCAPE_XOR_MASK;
-            if( c != SERMUX_ESCAPE_CHAR && c != SERMUX_FORCE_SID_CHAR && ( c < SERMUX_SERVICE_ID_FIRST || c > SERMUX_SERVICE_ID_LAST ) )
-            {
-               log_err( "Protocol error: invalid escape sequence\n" );
-               return 1;
-            }
-            got_esc = 0;
-          }  
-          if( service_id_in == -1 )
-          {
-            transport_send_byte( SERMUX_FORCE_SID_CHAR );
-            log_msg( "Requested resend of service ID for byte %3d ('%c').\n", c, isprint( c ) ? c : ' ' );
-          }
-          else
-          {
-            if( service_id_in == rfs_service_id ) // this request is for the RFS server
-            {
-              rfs_mem_read_request_packet( c );
-              if( rfs_mem_has_response() ) // we have a response from the RFS server
-              {
-                rfs_mem_write_response( &rfs_size, &rfs_ptr );                  
-                rfs_mem_start_request(); // initialize the RFS server for a new request  
-              }
-            }
-            else
-            {
-              //log_msg( "Sending byte %d to %s\n", c, services[ service_id_in - SERMUX_SERVICE_ID_FIRST - service_offset ].pname );
-              ser_write_byte( services[ service_id_in - SERMUX_SERVICE_ID_FIRST - service_offset ].fd, c );
-            }
-          }
+          log_err( "Error reading port %s, aborting program\n", tservice->pname );
+          return 1;
         }
+        tservice->in.size += size;
       }
-      else
-        got_esc = 1;                          
+
+    // Move the data between the queues
+    if( mux_v2 )
+    {
+      mux_v2_transport_input();
+      if( mux_mode == MODE_RFSMUX )
+        mux_v2_run_rfs();
+      mux_v2_send_services();
     }
     else
     {
-      // No byte to read, there must be something to send
-      if( selidx == RFS_PSEUDO_SELIDX )
-        temp = SERMUX_SERVICE_ID_FIRST;
-      else        
-        temp = SERMUX_SERVICE_ID_FIRST + selidx - HND_FIRST_VOFFSET + service_offset;
-      prev_sent = c;
-      // Send the service ID first if needed
-      if( temp != service_id_out )
-      {
-        log_msg( "Changed service_id_out from %d(%X) to %d(%X).\n", service_id_out, service_id_out, temp, temp );
-        transport_send_byte( temp );
-      }
-      // Then send the actual data byte, escaping it if needed
-      if( c == SERMUX_ESCAPE_CHAR || c == SERMUX_FORCE_SID_CHAR || ( c >= SERMUX_SERVICE_ID_FIRST && c <= SERMUX_SERVICE_ID_LAST ) )
+      if( !mux_transport_input() )
+        return 1;
+      mux_send_services();
+    }
+
+    // And write as much as possible
+    if( transport_out.size )
+      queue_drop( &transport_out, transport_send( transport_out.data + transport_out.start, transport_out.size ) );
+    for( i = 0; i < vport_num; i ++ )
+    {
+      tservice = services + i + service_offset;
+      if( tservice->out.size )
       {
-        transport_send_byte( SERMUX_ESCAPE_CHAR );
-        transport_send_byte( ( u8 )c ^ SERMUX_ESCAPE_XOR_MASK );
-        prev_sent = SERMUX_ESC_MASK | ( ( u8 )c ^ SERMUX_ESCAPE_XOR_MASK );
+        size = ser_write_nb( tservice->fd, tservice->out.data + tservice->out.start, tservice->out.size );
+        queue_drop( &tservice->out, size );
+        tservice->consumed += size;
       }
-      else
-        transport_send_byte( c );
-      service_id_out = temp;
     }
   }
 
   return 0;
 }
-
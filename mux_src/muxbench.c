@@ -0,0 +1,446 @@
+// Serial multiplexer loopback benchmark (POSIX only)
+// Runs mux on pseudo terminals: the transport pty is used by an emulated board
+// that sends every byte that it gets on a service back to the same service,
+// and every service pty gets a stream of test data (with all the byte values,
+// so the escape sequences are used too) that must come back unchanged.
+// With 'v2' the board and mux use the framed protocol and the board has a
+// small buffer for every channel, like a real board. With 'stall' the board
+// never reads channel 0 and the first service sends as fast as it can: the
+// other services must keep their throughput and no buffer can overflow.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "type.h"
+#include "sermux.h"
+#include "eluarpc.h"
+
+#define BENCH_BUF_SIZE          4096
+#define BENCH_WINDOW            2048    // bytes in flight on every service
+#define BENCH_BOARD_BUF_SIZE    ( 256 * 1024 )
+#define BENCH_MAX_SERVICES      SERMUX_SERVICE_MAX
+#define BENCH_START_DELAY_US    1000000 // mux waits 200ms for every port that it opens
+#define BENCH_CHANNEL_SIZE      256     // buffer of every channel on the board
+
+typedef struct
+{
+  int fd;
+  char name[ 64 ];
+  u32 sent;
+  u32 received;
+} BENCH_PORT;
+
+static BENCH_PORT bench_transport, bench_services[ BENCH_MAX_SERVICES ];
+static unsigned bench_nservices;
+
+// Emulated board state
+static int board_sid_in = -1, board_sid_out = -1, board_got_esc;
+static u8 board_out[ BENCH_BOARD_BUF_SIZE ];
+static u32 board_out_size;
+static u32 board_errors, board_force_sid, board_overflows;
+static int bench_v2, bench_stall;
+
+// Emulated board state (v2)
+static u8 board_ch_data[ BENCH_MAX_SERVICES ][ BENCH_CHANNEL_SIZE ];
+static u32 board_ch_size[ BENCH_MAX_SERVICES ], board_consumed[ BENCH_MAX_SERVICES ];
+static u32 board_credits[ BENCH_MAX_SERVICES ], board_stalled;
+static u8 board_frame[ SERMUX_V2_MAX_PAYLOAD + 4 ];
+static u32 board_frame_pos;
+static int board_frame_active, board_waiting = 1;
+static u8 board_sync_token;
+
+// ****************************************************************************
+// Helpers
+
+static double bench_now_us()
+{
+  struct timeval tv;
+
+  gettimeofday( &tv, NULL );
+  return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+// The data of a service at the given position
+static u8 bench_data( unsigned service, u32 pos )
+{
+  return ( u8 )( pos * 7 + service * 31 + ( pos >> 8 ) );
+}
+
+// Open a pty and put its slave in raw mode
+static int bench_open_pty( BENCH_PORT *pport )
+{
+  struct termios t;
+  int slave;
+
+  if( ( pport->fd = posix_openpt( O_RDWR | O_NOCTTY ) ) == -1 || grantpt( pport->fd ) == -1 || unlockpt( pport->fd ) == -1 )
+    return 0;
+  strncpy( pport->name, ptsname( pport->fd ), sizeof( pport->name ) - 1 );
+  if( ( slave = open( pport->name, O_RDWR | O_NOCTTY ) ) == -1 )
+    return 0;
+  tcgetattr( slave, &t );
+  cfmakeraw( &t );
+  tcsetattr( slave, TCSANOW, &t );
+  close( slave );
+  fcntl( pport->fd, F_SETFL, O_NONBLOCK );
+  return 1;
+}
+
+// ****************************************************************************
+// Emulated board: decode the mux stream and send the data back
+
+static void board_send( unsigned sid, u8 c )
+{
+  if( board_out_size + 3 > BENCH_BOARD_BUF_SIZE )
+  {
+    board_errors ++;
+    return;
+  }
+  if( ( int )sid != board_sid_out )
+  {
+    board_out[ board_out_size ++ ] = ( u8 )sid;
+    board_sid_out = sid;
+  }
+  if( c == SERMUX_ESCAPE_CHAR || c == SERMUX_FORCE_SID_CHAR || ( c >= SERMUX_SERVICE_ID_FIRST && c <= SERMUX_SERVICE_ID_LAST ) )
+  {
+    board_out[ board_out_size ++ ] = SERMUX_ESCAPE_CHAR;
+    c ^= SERMUX_ESCAPE_XOR_MASK;
+  }
+  board_out[ board_out_size ++ ] = c;
+}
+
+static void board_input( const u8 *p, u32 size )
+{
+  u8 c;
+
+  while( size -- )
+  {
+    c = *p ++;
+    if( c == SERMUX_ESCAPE_CHAR )
+      board_got_esc = 1;
+    else if( c >= SERMUX_SERVICE_ID_FIRST && c <= SERMUX_SERVICE_ID_LAST )
+      board_sid_in = c;
+    else if( c == SERMUX_FORCE_SID_CHAR )
+      board_force_sid ++;
+    else
+    {
+      if( board_got_esc )
+      {
+        c ^= SERMUX_ESCAPE_XOR_MASK;
+        board_got_esc = 0;
+      }
+      if( board_sid_in == -1 )
+        board_errors ++;
+      else if( bench_stall && board_sid_in == SERMUX_SERVICE_ID_FIRST )
+      {
+        // Nothing stops the host, so the buffer of the channel overflows
+        if( ++ board_stalled > BENCH_CHANNEL_SIZE )
+          board_overflows ++;
+      }
+      else
+        board_send( board_sid_in, c );
+    }
+  }
+}
+
+// ****************************************************************************
+// Emulated board with the framed protocol: the data goes to the channel
+// buffers first and is sent back when the host has room for it
+
+static void board_v2_send( u8 channel, const u8 *p, u8 len )
+{
+  u8 *d = board_out + board_out_size;
+  u16 crc;
+
+  if( board_out_size + len + SERMUX_V2_OVERHEAD > BENCH_BOARD_BUF_SIZE )
+  {
+    board_errors ++;
+    return;
+  }
+  d[ 0 ] = SERMUX_V2_SOF;
+  d[ 1 ] = channel;
+  d[ 2 ] = len;
+  memcpy( d + 3, p, len );
+  crc = eluarpc_crc16( ELUARPC_CRC_INIT, d + 1, len + 2 );
+  d[ len + 3 ] = crc & 0xFF;
+  d[ len + 4 ] = crc >> 8;
+  board_out_size += len + SERMUX_V2_OVERHEAD;
+}
+
+static void board_v2_sync()
+{
+  u8 frame[ 2 ] = { SERMUX_V2_SYNC, ++ board_sync_token };
+
+  board_waiting = 1;
+  board_v2_send( SERMUX_V2_CTRL_CHANNEL, frame, 2 );
+}
+
+static void board_v2_frame( u8 channel, const u8 *p, u8 len )
+{
+  u8 frame[ 3 + 2 * BENCH_MAX_SERVICES ];
+  unsigned i;
+
+  if( channel < bench_nservices )
+  {
+    if( board_ch_size[ channel ] + len > BENCH_CHANNEL_SIZE )
+    {
+      board_overflows += board_ch_size[ channel ] + len - BENCH_CHANNEL_SIZE;
+      len = BENCH_CHANNEL_SIZE - board_ch_size[ channel ];
+    }
+    memcpy( board_ch_data[ channel ] + board_ch_size[ channel ], p, len );
+    board_ch_size[ channel ] += len;
+  }
+  else if( channel != SERMUX_V2_CTRL_CHANNEL || len < 2 )
+    board_errors ++;
+  else if( p[ 0 ] == SERMUX_V2_SYNC )
+  {
+    frame[ 0 ] = SERMUX_V2_HELLO;
+    frame[ 1 ] = p[ 1 ];
+    frame[ 2 ] = bench_nservices;
+    for( i = 0; i < bench_nservices; i ++ )
+    {
+      frame[ 3 + 2 * i ] = ( BENCH_CHANNEL_SIZE - board_ch_size[ i ] ) & 0xFF;
+      frame[ 4 + 2 * i ] = ( BENCH_CHANNEL_SIZE - board_ch_size[ i ] ) >> 8;
+      board_consumed[ i ] = 0;
+    }
+    board_v2_send( SERMUX_V2_CTRL_CHANNEL, frame, 3 + 2 * bench_nservices );
+    if( board_waiting )
+      board_v2_sync();
+  }
+  else if( p[ 0 ] == SERMUX_V2_HELLO && len >= 3 )
+  {
+    if( board_waiting && p[ 1 ] == board_sync_token )
+    {
+      for( i = 0; i < bench_nservices; i ++ )
+        board_credits[ i ] = i < p[ 2 ] ? p[ 3 + 2 * i ] | ( p[ 4 + 2 * i ] << 8 ) : 0;
+      board_waiting = 0;
+    }
+  }
+  else if( p[ 0 ] == SERMUX_V2_CREDIT && len >= 4 && p[ 1 ] < bench_nservices )
+    board_credits[ p[ 1 ] ] += p[ 2 ] | ( p[ 3 ] << 8 );
+  else
+    board_errors ++;
+}
+
+static void board_v2_input( const u8 *p, u32 size )
+{
+  while( size -- )
+  {
+    if( !board_frame_active )
+    {
+      if( *p ++ == SERMUX_V2_SOF )
+        board_frame_active = 1;
+      else
+        board_errors ++;
+      board_frame_pos = 0;
+      continue;
+    }
+    board_frame[ board_frame_pos ++ ] = *p ++;
+    if( board_frame_pos == 2 && board_frame[ 1 ] > SERMUX_V2_MAX_PAYLOAD )
+    {
+      board_errors ++;
+      board_frame_active = 0;
+    }
+    else if( board_frame_pos > 2 && board_frame_pos == board_frame[ 1 ] + 4u )
+    {
+      board_frame_active = 0;
+      if( eluarpc_crc16( ELUARPC_CRC_INIT, board_frame, board_frame_pos - 2 ) != ( board_frame[ board_frame_pos - 2 ] | ( board_frame[ board_frame_pos - 1 ] << 8 ) ) )
+        board_errors ++;
+      else
+        board_v2_frame( board_frame[ 0 ], board_frame + 2, board_frame[ 1 ] );
+    }
+  }
+}
+
+// The application of the board: send the data of the channels back and
+// return the credits when half of a buffer was read
+static void board_v2_run()
+{
+  unsigned i;
+  u32 size;
+  u8 frame[ 4 ];
+
+  for( i = bench_stall ? 1 : 0; i < bench_nservices; i ++ )
+  {
+    while( !board_waiting && ( size = board_ch_size[ i ] < board_credits[ i ] ? board_ch_size[ i ] : board_credits[ i ] ) > 0 )
+    {
+      if( size > SERMUX_V2_MAX_PAYLOAD )
+        size = SERMUX_V2_MAX_PAYLOAD;
+      board_v2_send( i, board_ch_data[ i ], size );
+      memmove( board_ch_data[ i ], board_ch_data[ i ] + size, board_ch_size[ i ] - size );
+      board_ch_size[ i ] -= size;
+      board_credits[ i ] -= size;
+      board_consumed[ i ] += size;
+    }
+    if( board_consumed[ i ] >= BENCH_CHANNEL_SIZE / 2 )
+    {
+      frame[ 0 ] = SERMUX_V2_CREDIT;
+      frame[ 1 ] = i;
+      frame[ 2 ] = board_consumed[ i ] & 0xFF;
+      frame[ 3 ] = board_consumed[ i ] >> 8;
+      board_v2_send( SERMUX_V2_CTRL_CHANNEL, frame, 4 );
+      board_consumed[ i ] = 0;
+    }
+  }
+}
+
+// ****************************************************************************
+// Entry point
+
+int main( int argc, char **argv )
+{
+  struct pollfd fds[ BENCH_MAX_SERVICES + 1 ];
+  u8 buf[ BENCH_BUF_SIZE ];
+  char *muxargs[ BENCH_MAX_SERVICES + 4 ];
+  char transport_arg[ 96 ];
+  unsigned seconds, i, n;
+  u32 errors = 0, total = 0, min = 0xFFFFFFFF, max = 0;
+  double start, end, elapsed;
+  struct rusage ru;
+  ssize_t res;
+  pid_t pid;
+  BENCH_PORT *pport;
+
+  if( argc < 4 )
+  {
+    fprintf( stderr, "Usage: %s <mux executable> <services> <seconds> [v2] [stall]\n", argv[ 0 ] );
+    return 1;
+  }
+  bench_nservices = atoi( argv[ 2 ] );
+  seconds = atoi( argv[ 3 ] );
+  for( i = 4; i < ( unsigned )argc; i ++ )
+    if( !strcmp( argv[ i ], "v2" ) )
+      bench_v2 = 1;
+    else if( !strcmp( argv[ i ], "stall" ) )
+      bench_stall = 1;
+  if( bench_nservices == 0 || bench_nservices > BENCH_MAX_SERVICES || seconds == 0 || ( bench_stall && bench_nservices < 2 ) )
+  {
+    fprintf( stderr, "Invalid number of services (1-%d, at least 2 with 'stall') or seconds\n", BENCH_MAX_SERVICES );
+    return 1;
+  }
+
+  // Create the ptys and start mux on their slaves
+  if( !bench_open_pty( &bench_transport ) )
+  {
+    fprintf( stderr, "Unable to create the transport pty\n" );
+    return 1;
+  }
+  snprintf( transport_arg, sizeof( transport_arg ), "%s,921600,none", bench_transport.name );
+  muxargs[ 0 ] = argv[ 1 ];
+  muxargs[ 1 ] = bench_v2 ? "mux2" : "mux";
+  muxargs[ 2 ] = transport_arg;
+  for( i = 0; i < bench_nservices; i ++ )
+  {
+    if( !bench_open_pty( bench_services + i ) )
+    {
+      fprintf( stderr, "Unable to create the service ptys\n" );
+      return 1;
+    }
+    muxargs[ i + 3 ] = bench_services[ i ].name;
+  }
+  muxargs[ i + 3 ] = NULL;
+  if( ( pid = fork() ) == 0 )
+  {
+    execv( argv[ 1 ], muxargs );
+    _exit( 1 );
+  }
+  usleep( BENCH_START_DELAY_US * ( bench_nservices + 1 ) / 4 + BENCH_START_DELAY_US );
+  if( waitpid( pid, NULL, WNOHANG ) != 0 )
+  {
+    fprintf( stderr, "Unable to start %s\n", argv[ 1 ] );
+    return 1;
+  }
+
+  if( bench_v2 )
+    board_v2_sync();
+
+  // Keep BENCH_WINDOW bytes in flight on every service and check what comes back
+  start = bench_now_us();
+  end = start + seconds * 1000000.0;
+  while( bench_now_us() < end )
+  {
+    fds[ 0 ].fd = bench_transport.fd;
+    fds[ 0 ].events = POLLIN | ( board_out_size ? POLLOUT : 0 );
+    for( i = 0; i < bench_nservices; i ++ )
+    {
+      pport = bench_services + i;
+      fds[ i + 1 ].fd = pport->fd;
+      fds[ i + 1 ].events = POLLIN | ( pport->sent - pport->received < BENCH_WINDOW || ( bench_stall && i == 0 ) ? POLLOUT : 0 );
+    }
+    if( poll( fds, bench_nservices + 1, 100 ) <= 0 )
+      continue;
+    // Transport (board side)
+    if( fds[ 0 ].revents & POLLIN )
+      if( ( res = read( bench_transport.fd, buf, sizeof( buf ) ) ) > 0 )
+      {
+        if( bench_v2 )
+        {
+          board_v2_input( buf, res );
+          board_v2_run();
+        }
+        else
+          board_input( buf, res );
+      }
+    if( board_out_size && ( fds[ 0 ].revents & POLLOUT ) )
+      if( ( res = write( bench_transport.fd, board_out, board_out_size ) ) > 0 )
+      {
+        memmove( board_out, board_out + res, board_out_size - res );
+        board_out_size -= res;
+      }
+    // Services
+    for( i = 0; i < bench_nservices; i ++ )
+    {
+      pport = bench_services + i;
+      if( fds[ i + 1 ].revents & POLLIN )
+        if( ( res = read( pport->fd, buf, sizeof( buf ) ) ) > 0 )
+        {
+          for( n = 0; n < res; n ++ )
+            if( buf[ n ] != bench_data( i, pport->received + n ) )
+              errors ++;
+          pport->received += res;
+        }
+      if( fds[ i + 1 ].revents & POLLOUT )
+      {
+        for( n = 0; n < BENCH_WINDOW - ( bench_stall && i == 0 ? 0 : pport->sent - pport->received ); n ++ )
+          buf[ n ] = bench_data( i, pport->sent + n );
+        if( ( res = write( pport->fd, buf, n ) ) > 0 )
+          pport->sent += res;
+      }
+    }
+  }
+  elapsed = ( bench_now_us() - start ) / 1000000.0;
+  kill( pid, SIGTERM );
+  wait4( pid, NULL, 0, &ru );
+
+  for( i = 0; i < bench_nservices; i ++ )
+  {
+    if( bench_stall && i == 0 )
+    {
+      printf( "service 0: stalled after %u bytes\n", ( unsigned )bench_services[ 0 ].sent );
+      continue;
+    }
+    printf( "service %u: %.1f KB/s\n", i, bench_services[ i ].received / ( 1024.0 * elapsed ) );
+    total += bench_services[ i ].received;
+    if( bench_services[ i ].received < min )
+      min = bench_services[ i ].received;
+    if( bench_services[ i ].received > max )
+      max = bench_services[ i ].received;
+  }
+  printf( "%u services: %.1f KB/s total, mux CPU %.1f%% (user %.2f s, system %.2f s)\n", bench_nservices, total / ( 1024.0 * elapsed ),
+          100.0 * ( ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0 ) / elapsed,
+          ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0, ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0 );
+  printf( "%u data errors, %u board errors, %u board buffer overflows, %u service ID requests\n", ( unsigned )errors, ( unsigned )board_errors,
+          ( unsigned )board_overflows, ( unsigned )board_force_sid );
+  // Every service must get its share (a stalled service can't starve the others)
+  return errors || board_errors || board_overflows || min == 0 || min < max / 4 ? 1 : 0;
+}
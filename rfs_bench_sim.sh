@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# RFS throughput benchmark on the simulator: build the simulator with RFS and
+# the simulator server, share a scratch directory and run test/bench-rfsops.lua
+# with the pipe transport. The arguments are passed to build_elua.lua (for
+# example -DBUILD_RFS_CACHE or -DBUILD_RFS_COMPRESS).
+
+set -e
+
+lua build_elua.lua board=sim -DBUILD_RFS "$@"
+lua rfs_server.lua sim=true
+
+SCRATCH=$(mktemp -d /tmp/rfs_bench.XXXXXX)
+cleanup()
+{
+  [ -n "$SERVER" ] && kill $SERVER 2> /dev/null
+  rm -rf $SCRATCH
+}
+trap cleanup EXIT
+
+cp test/bench-rfsops.lua test/benchtmr.lua $SCRATCH
+./rfs_sim_server $SCRATCH &
+SERVER=$!
+# Wait for the server to create its pipes (/tmp/elua_srv_*)
+while [ ! -p /tmp/elua_srv_read -o ! -p /tmp/elua_srv_write ]; do sleep 0.1; done
+
+# The shell reads the commands from the pipe, 'exit' stops the simulator
+printf "lua /rfs/bench-rfsops.lua\nexit\n" | ./elua_lua_linux.elf | tee $SCRATCH.log
+RES=0
+grep -q "rfsops: OK" $SCRATCH.log || RES=1
+rm -f $SCRATCH.log
+exit $RES
@@ -1,6 +1,7 @@
 import os, sys, platform
 
 sim = ARGUMENTS.get( 'sim', '0' )
+loadgen = ARGUMENTS.get( 'loadgen', '0' )
 
 flist = ""
 cdefs = "-DRFS_STANDALONE_MODE"
@@ -17,18 +18,23 @@ if platform.system() == "Windows":
   cdefs = cdefs + " -DWIN32_BUILD"
   exeprefix = ".exe"
   socklib = '-lws2_32'
+elif loadgen == '1':
+  flist = "rfs_loadgen.c"
+  exeprefix = ""
 else:
   flist = "%s server.c os_io_posix.c log.c net_posix.c serial_posix.c deskutils.c rfs_transports.c" % mainname
   exeprefix = ""
 
-if sim == '0':
+if loadgen == '1':
+  output = 'rfs_loadgen'
+elif sim == '0':
   output = 'rfs_server%s' % exeprefix
 else:
   output = 'rfs_sim_server%s' % exeprefix
 #endif
 
 full_files = " " + " ".join( [ "rfs_server_src/%s" % name for name in flist.split() ] )
-full_files = full_files + " src/remotefs/remotefs.c src/eluarpc.c"
+full_files = full_files + " src/remotefs/remotefs.c src/eluarpc.c src/lz.c"
 local_include = "-Irfs_server_src -Iinc/remotefs -Iinc"
 
 # Compiler/linker options
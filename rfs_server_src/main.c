@@ -16,10 +16,15 @@
 #include "rfs.h"
 #include "deskutils.h"
 #include "rfs_transports.h"
+#ifndef WIN32_BUILD
+#include <poll.h>
+#endif
 
 #ifdef RFS_STANDALONE_MODE
 int main( int argc, const char **argv )
 {  
+  unsigned i;
+
   // Initialize data
   if( rfs_init( argc, argv ) != 0 )
     return 1;
@@ -31,15 +36,51 @@ int main( int argc, const char **argv )
     return 1;
   }
   
-  // Enter the server endless loop
+#ifdef WIN32_BUILD
+  // Enter the server endless loop (single transport)
+  while( 1 )
+    rfs_serve_request( p_transport_data );
+#else
+  // Enter the server endless loop: wait for data on all the transports and
+  // serve a request from each transport that has data in turn (a transport
+  // can have more than one descriptor, for example a TCP server)
   while( 1 )
   {
-    p_transport_data->f_read_request();
-    server_execute_request( rfs_buffer );
-    p_transport_data->f_send_response();
+    int handles[ RFS_MAX_HANDLES ];
+    struct pollfd fds[ RFS_MAX_HANDLES ];
+    unsigned first[ RFS_MAX_TRANSPORTS + 1 ], nfds = 0, j;
+
+    for( i = 0; i < rfs_num_transports; i ++ )
+    {
+      first[ i ] = nfds;
+      nfds += rfs_transports[ i ]->f_get_handles( handles + nfds, RFS_MAX_HANDLES - nfds );
+    }
+    first[ i ] = nfds;
+    for( j = 0; j < nfds; j ++ )
+    {
+      fds[ j ].fd = handles[ j ];
+      fds[ j ].events = POLLIN;
+      fds[ j ].revents = 0;
+    }
+    if( poll( fds, nfds, -1 ) < 0 )
+    {
+      if( errno == EINTR )
+        continue;
+      log_err( "poll error %d\n", errno );
+      break;
+    }
+    for( i = 0; i < rfs_num_transports; i ++ )
+      for( j = first[ i ]; j < first[ i + 1 ]; j ++ )
+        if( fds[ j ].revents & ( POLLIN | POLLERR | POLLHUP ) )
+        {
+          rfs_serve_request( rfs_transports[ i ] );
+          break;
+        }
   }
+#endif
 
-  p_transport_data->f_cleanup();
+  for( i = 0; i < rfs_num_transports; i ++ )
+    rfs_transports[ i ]->f_cleanup();
   return 0;
 }
 #endif
@@ -1,6 +1,7 @@
 // Remote FS server
 
 #include "remotefs.h"
+#include "eluarpc.h"
 #include "server.h"
 #include "type.h"
 #include "log.h"
@@ -18,16 +19,32 @@
 // ****************************************************************************
 // Local variables
 
-#define   MAX_PACKET_SIZE     4096
+#define   MAX_PACKET_SIZE     SERVER_MAX_PACKET_SIZE
 
-static u8 rfs_buffer[ MAX_PACKET_SIZE + RFS_WRITE_REQUEST_EXTRA ]; 
+static u8 rfs_buffer[ MAX_PACKET_SIZE + ELUARPC_WRITE_REQUEST_EXTRA ]; 
 static int rfs_read_fd;
 static int rfs_write_fd;
 
 // ****************************************************************************
 // Helpers
 
-// Read a packet from the serial port
+// Read exactly 'size' bytes from the pipe (a pipelining client can send many
+// requests at once, so a read can return only a part of a request)
+static u32 read_pipe( u8 *p, u32 size )
+{
+  u32 cnt = 0;
+  ssize_t res;
+
+  while( cnt < size )
+  {
+    if( ( res = read( rfs_read_fd, p + cnt, size - cnt ) ) <= 0 )
+      break;
+    cnt += ( u32 )res;
+  }
+  return cnt;
+}
+
+// Read a packet from the pipe
 static void read_request_packet()
 {
   u16 temp16;
@@ -36,22 +53,22 @@ static void read_request_packet()
   while( 1 )
   {
     // First read the length
-    if( ( readbytes = read( rfs_read_fd, rfs_buffer, RFS_START_OFFSET ) ) != RFS_START_OFFSET )
+    if( ( readbytes = read_pipe( rfs_buffer, ELUARPC_START_OFFSET ) ) != ELUARPC_START_OFFSET )
     {
-//      log_msg( "read_request_packet: ERROR reading packet length. Requested %d bytes, got %d bytes\n", RFS_START_OFFSET, readbytes );
+//      log_msg( "read_request_packet: ERROR reading packet length. Requested %d bytes, got %d bytes\n", ELUARPC_START_OFFSET, readbytes );
       continue;
     }
 
-    if( remotefs_get_packet_size( rfs_buffer, &temp16 ) == REMOTEFS_ERR )
+    if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
     {
       // log_msg( "read_request_packet: ERROR getting packet size.\n" );
       continue;
     }
 
     // Then the rest of the data
-    if( ( readbytes = read( rfs_read_fd, rfs_buffer + RFS_START_OFFSET, temp16 - RFS_START_OFFSET ) ) != temp16 - RFS_START_OFFSET )
+    if( ( readbytes = read_pipe( rfs_buffer + ELUARPC_START_OFFSET, temp16 - ELUARPC_START_OFFSET ) ) != temp16 - ELUARPC_START_OFFSET )
     {
-      // log_msg( "read_request_packet: ERROR reading full packet, got %u bytes, expected %u bytes\n", ( unsigned )readbytes, ( unsigned )temp16 - RFS_START_OFFSET );
+      // log_msg( "read_request_packet: ERROR reading full packet, got %u bytes, expected %u bytes\n", ( unsigned )readbytes, ( unsigned )temp16 - ELUARPC_START_OFFSET );
       continue;
     }
     else
@@ -59,13 +76,13 @@ static void read_request_packet()
   }
 }
 
-// Send a packet to the serial port
+// Send a packet to the pipe
 static void send_response_packet()
 {
   u16 temp16;
 
   // Send request
-  if( remotefs_get_packet_size( rfs_buffer, &temp16 ) != REMOTEFS_ERR )
+  if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) != ELUARPC_ERR )
   {
     log_msg( "send_response_packet: sending response packet of %u bytes\n", ( unsigned )temp16 );
     write( rfs_write_fd, rfs_buffer, temp16 );
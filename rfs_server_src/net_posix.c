@@ -25,6 +25,9 @@ net_ssize_t net_recvfrom( NET_SOCKET s, void *buf, size_t len, int flags, struct
   fd_set fds;
   struct timeval tv;
   
+  // No need to wait separately for a blocking read
+  if( timeout == NET_INF_TIMEOUT )
+    return recvfrom( s, buf, len, flags, from, fromlen );
   FD_ZERO( &fds );
   FD_SET( s, &fds );
   tv.tv_sec = timeout / 1000000;
@@ -53,6 +53,16 @@ s32 os_read( int fd, void *buf, u32 count )
   return ( s32 )read( fd, buf, ( size_t )count );
 }
 
+s32 os_pwrite( int fd, const void *buf, u32 count, u32 offset )
+{
+  return ( s32 )pwrite( fd, buf, ( size_t )count, ( off_t )offset );
+}
+
+s32 os_pread( int fd, void *buf, u32 count, u32 offset )
+{
+  return ( s32 )pread( fd, buf, ( size_t )count, ( off_t )offset );
+}
+
 int os_close( int fd )
 {
   return close( fd );
@@ -83,6 +93,17 @@ s32 os_lseek( int fd, s32 offset, int whence )
   return ( s32 )lseek( fd, ( off_t )offset, realwhence );
 }
 
+int os_fstat( int fd, u32 *psize, u32 *pmtime )
+{
+  struct stat res;
+
+  if( fstat( fd, &res ) == -1 )
+    return -1;
+  *psize = ( u32 )res.st_size;
+  *pmtime = ( u32 )res.st_mtime;
+  return 0;
+}
+
 u32 os_lseek_sys_whence_to_rfs_whence( int syswhence )
 {
   switch( syswhence )
@@ -116,9 +137,10 @@ u32 os_opendir( const char* name )
   return 0;
 }
 
-void os_readdir( u32 d, const char **pname )
+void os_readdir_stat( u32 d, const char **pname, u32 *psize, u32 *pmtime )
 {
   struct dirent *ent;
+  struct stat res;
   static char realname[ RFS_MAX_FNAME_SIZE + 1 ]; 
 
   while( 1 )
@@ -134,13 +156,53 @@ void os_readdir( u32 d, const char **pname )
       realname[ 0 ] = realname[ RFS_MAX_FNAME_SIZE ] = '\0';
       strncpy( realname, ent->d_name, RFS_MAX_FNAME_SIZE );
       *pname = realname;
+      if( fstatat( dirfd( ( DIR* )d ), ent->d_name, &res, 0 ) == -1 )
+        *psize = *pmtime = 0;
+      else
+      {
+        *psize = ( u32 )res.st_size;
+        *pmtime = ( u32 )res.st_mtime;
+      }
       break;
     }
   }
 }
 
+void os_readdir( u32 d, const char **pname )
+{
+  u32 size, mtime;
+
+  os_readdir_stat( d, pname, &size, &mtime );
+}
+
 int os_closedir( u32 d )
 {
   return closedir( ( DIR* )d );
 }
 
+int os_stat( const char *name, u32 *psize, u32 *pmtime, int *pisdir )
+{
+  struct stat res;
+
+  if( stat( name, &res ) == -1 )
+    return -1;
+  *psize = ( u32 )res.st_size;
+  *pmtime = ( u32 )res.st_mtime;
+  *pisdir = S_ISDIR( res.st_mode ) ? 1 : 0;
+  return 0;
+}
+
+int os_unlink( const char *name )
+{
+  return unlink( name );
+}
+
+int os_rename( const char *oldname, const char *newname )
+{
+  return rename( oldname, newname );
+}
+
+int os_mkdir( const char *name, int mode )
+{
+  return mkdir( name, ( mode_t )mode );
+}
@@ -8,6 +8,7 @@
 #include <windows.h>
 #include <string.h>
 #include <stdio.h>
+#include <direct.h>
 #include "os_io.h"
 #include "remotefs.h"
 #include "eluarpc.h"
@@ -52,6 +53,21 @@ s32 os_read( int fd, void *buf, u32 count )
   return ( s32 )_read( fd, buf, ( unsigned int )count );
 }
 
+// No pread/pwrite here, but the server is single threaded anyway
+s32 os_pwrite( int fd, const void *buf, u32 count, u32 offset )
+{
+  if( _lseek( fd, ( long )offset, SEEK_SET ) == -1 )
+    return -1;
+  return ( s32 )_write( fd, buf, ( unsigned int )count );
+}
+
+s32 os_pread( int fd, void *buf, u32 count, u32 offset )
+{
+  if( _lseek( fd, ( long )offset, SEEK_SET ) == -1 )
+    return -1;
+  return ( s32 )_read( fd, buf, ( unsigned int )count );
+}
+
 int os_close( int fd )
 {
   return _close( fd );
@@ -82,6 +98,17 @@ s32 os_lseek( int fd, s32 offset, int whence )
   return ( s32 )_lseek( fd, ( long )offset, realwhence );
 }
 
+int os_fstat( int fd, u32 *psize, u32 *pmtime )
+{
+  struct _stat res;
+
+  if( _fstat( fd, &res ) == -1 )
+    return -1;
+  *psize = ( u32 )res.st_size;
+  *pmtime = ( u32 )res.st_mtime;
+  return 0;
+}
+
 u32 os_lseek_sys_whence_to_rfs_whence( int syswhence )
 {
   switch( syswhence )
@@ -124,7 +151,17 @@ u32 os_opendir( const char* name )
   return 0;
 }
 
-void os_readdir( u32 d, const char **pname )
+// Helper: convert a FILETIME to a Unix time
+static u32 win32_filetime_to_unix( const FILETIME *pft )
+{
+  ULARGE_INTEGER t;
+
+  t.LowPart = pft->dwLowDateTime;
+  t.HighPart = pft->dwHighDateTime;
+  return ( u32 )( ( t.QuadPart - 116444736000000000ULL ) / 10000000ULL );
+}
+
+void os_readdir_stat( u32 d, const char **pname, u32 *psize, u32 *pmtime )
 {
   static char realname[ RFS_MAX_FNAME_SIZE + 1 ]; 
 
@@ -141,6 +178,8 @@ void os_readdir( u32 d, const char **pname )
       else
         strncpy( realname, win32_dir_data.cAlternateFileName, RFS_MAX_FNAME_SIZE );
       *pname = realname;
+      *psize = ( u32 )win32_dir_data.nFileSizeLow;
+      *pmtime = win32_filetime_to_unix( &win32_dir_data.ftLastWriteTime );
     }    
     if( FindNextFile( win32_dir_hnd, &win32_dir_data ) == 0 )
       found_last_file = 1;  
@@ -149,7 +188,41 @@ void os_readdir( u32 d, const char **pname )
   }
 }
 
+void os_readdir( u32 d, const char **pname )
+{
+  u32 size, mtime;
+
+  os_readdir_stat( d, pname, &size, &mtime );
+}
+
 int os_closedir( u32 d )
 {
   return FindClose( win32_dir_hnd ) == 0 ? -1 : 0;
 }
+
+int os_stat( const char *name, u32 *psize, u32 *pmtime, int *pisdir )
+{
+  struct _stat res;
+
+  if( _stat( name, &res ) == -1 )
+    return -1;
+  *psize = ( u32 )res.st_size;
+  *pmtime = ( u32 )res.st_mtime;
+  *pisdir = ( res.st_mode & _S_IFDIR ) ? 1 : 0;
+  return 0;
+}
+
+int os_unlink( const char *name )
+{
+  return _unlink( name );
+}
+
+int os_rename( const char *oldname, const char *newname )
+{
+  return rename( oldname, newname );
+}
+
+int os_mkdir( const char *name, int mode )
+{
+  return _mkdir( name );
+}
@@ -0,0 +1,288 @@
+// RFS load generator: many simulated clients talking to a RFS server over UDP
+// (POSIX only). Every client is a separate process with its own socket, so the
+// server sees it as a separate board.
+
+#include "remotefs.h"
+#include "eluarpc.h"
+#include "type.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOADGEN_BUF_SIZE        4096
+#define LOADGEN_CHUNK           512
+#define LOADGEN_SHARED_SIZE     ( 32 * 1024 )
+#define LOADGEN_PRIVATE_SIZE    4096
+#define LOADGEN_TIMEOUT_MS      2000
+#define LOADGEN_MAX_CLIENTS     64
+
+// Results sent by every client to the parent
+typedef struct
+{
+  unsigned long ops;
+  unsigned long bytes;
+  unsigned long errors;
+  unsigned long timeouts;
+  unsigned long wire;                 // bytes sent and received
+  double total_us;
+  double max_us;
+} LOADGEN_RESULT;
+
+static u8 lg_buf[ LOADGEN_BUF_SIZE + ELUARPC_WRITE_REQUEST_EXTRA ];
+static u8 lg_data[ LOADGEN_SHARED_SIZE ];
+static int lg_socket;
+static LOADGEN_RESULT lg_res;
+static int lg_encoding = ELUARPC_ENC_V1;
+
+// ****************************************************************************
+// Client helpers
+
+static double lg_now_us()
+{
+  struct timeval tv;
+
+  gettimeofday( &tv, NULL );
+  return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+// Send the request in lg_buf and wait for its response (one request at a time)
+static int lg_transact()
+{
+  u16 size;
+  struct pollfd pfd;
+  ssize_t res;
+  double t = lg_now_us();
+
+  if( eluarpc_get_packet_size( lg_buf, &size ) == ELUARPC_ERR || send( lg_socket, lg_buf, size, 0 ) != size )
+    return 0;
+  pfd.fd = lg_socket;
+  pfd.events = POLLIN;
+  if( poll( &pfd, 1, LOADGEN_TIMEOUT_MS ) <= 0 || ( res = recv( lg_socket, lg_buf, sizeof( lg_buf ), 0 ) ) < ELUARPC_START_OFFSET )
+  {
+    lg_res.timeouts ++;
+    return 0;
+  }
+  t = lg_now_us() - t;
+  lg_res.wire += size + res;
+  lg_res.ops ++;
+  lg_res.total_us += t;
+  if( t > lg_res.max_us )
+    lg_res.max_us = t;
+  return 1;
+}
+
+static int lg_open( const char *name, int flags )
+{
+  int fd;
+
+  remotefs_open_write_request( lg_buf, name, flags, 0 );
+  if( !lg_transact() || remotefs_open_read_response( lg_buf, &fd ) == ELUARPC_ERR )
+    return -1;
+  return fd;
+}
+
+static int lg_close( int fd )
+{
+  int res;
+
+  remotefs_close_write_request( lg_buf, fd );
+  if( !lg_transact() || remotefs_close_read_response( lg_buf, &res ) == ELUARPC_ERR )
+    return -1;
+  return res;
+}
+
+static s32 lg_read( int fd, u8 *dest, u32 count )
+{
+  const u8 *p;
+
+  remotefs_read_write_request( lg_buf, fd, count );
+  if( !lg_transact() || remotefs_read_read_response( lg_buf, &p, &count ) == ELUARPC_ERR )
+    return -1;
+  memcpy( dest, p, count );
+  lg_res.bytes += count;
+  return ( s32 )count;
+}
+
+static s32 lg_write( int fd, const u8 *src, u32 count )
+{
+  remotefs_write_write_request( lg_buf, fd, src, count );
+  if( !lg_transact() || remotefs_write_read_response( lg_buf, &count ) == ELUARPC_ERR || ( s32 )count < 0 )
+    return -1;
+  lg_res.bytes += count;
+  return ( s32 )count;
+}
+
+static s32 lg_lseek( int fd, s32 offset, int whence )
+{
+  remotefs_lseek_write_request( lg_buf, fd, offset, whence );
+  if( !lg_transact() || remotefs_lseek_read_response( lg_buf, &offset ) == ELUARPC_ERR )
+    return -1;
+  return offset;
+}
+
+// Read a whole file and compare it with the expected data
+static int lg_read_file( const char *name, const u8 *expected, u32 size )
+{
+  u8 temp[ LOADGEN_CHUNK ];
+  u32 total = 0;
+  s32 res;
+  int fd, ok = 1;
+
+  if( ( fd = lg_open( name, RFS_OPEN_FLAG_RDONLY ) ) < 0 )
+    return 0;
+  while( ( res = lg_read( fd, temp, LOADGEN_CHUNK ) ) > 0 )
+  {
+    if( total + res > size || memcmp( temp, expected + total, res ) )
+      ok = 0;
+    total += res;
+  }
+  lg_close( fd );
+  return ok && res == 0 && total == size;
+}
+
+// A simulated client: reads the shared file again and again and sometimes
+// writes and checks its own private file
+static void lg_client( int id, struct sockaddr_in *srv, unsigned seconds, int resfd )
+{
+  char privname[ 32 ];
+  u8 privdata[ LOADGEN_PRIVATE_SIZE ], temp[ LOADGEN_PRIVATE_SIZE ];
+  double end = lg_now_us() + seconds * 1000000.0;
+  unsigned iter, i;
+  int fd;
+
+  if( ( lg_socket = socket( AF_INET, SOCK_DGRAM, 0 ) ) < 0 || connect( lg_socket, ( struct sockaddr* )srv, sizeof( *srv ) ) < 0 )
+    exit( 1 );
+  eluarpc_set_seq( ELUARPC_NO_SEQ );
+  eluarpc_set_encoding( lg_encoding );
+  sprintf( privname, "loadgen_%d.dat", id );
+  for( i = 0; i < LOADGEN_PRIVATE_SIZE; i ++ )
+    privdata[ i ] = ( u8 )( id * 7 + i );
+  for( iter = 0; lg_now_us() < end; iter ++ )
+  {
+    if( !lg_read_file( "loadgen.dat", lg_data, LOADGEN_SHARED_SIZE ) )
+      lg_res.errors ++;
+    if( iter % 4 )
+      continue;
+    if( ( fd = lg_open( privname, RFS_OPEN_FLAG_RDWR | RFS_OPEN_FLAG_CREAT | RFS_OPEN_FLAG_TRUNC ) ) < 0 )
+    {
+      lg_res.errors ++;
+      continue;
+    }
+    for( i = 0; i < LOADGEN_PRIVATE_SIZE; i += LOADGEN_CHUNK )
+      lg_write( fd, privdata + i, LOADGEN_CHUNK );
+    if( lg_lseek( fd, 0, RFS_LSEEK_SET ) != 0 )
+      lg_res.errors ++;
+    for( i = 0; i < LOADGEN_PRIVATE_SIZE; i += LOADGEN_CHUNK )
+      lg_read( fd, temp + i, LOADGEN_CHUNK );
+    if( memcmp( temp, privdata, LOADGEN_PRIVATE_SIZE ) )
+      lg_res.errors ++;
+    lg_close( fd );
+    privdata[ 0 ] ++;
+  }
+  write( resfd, &lg_res, sizeof( lg_res ) );
+  exit( 0 );
+}
+
+// ****************************************************************************
+// Entry point
+
+int main( int argc, char **argv )
+{
+  struct sockaddr_in srv;
+  LOADGEN_RESULT total, r;
+  unsigned clients, seconds, i;
+  int fds[ 2 ];
+  FILE *fp;
+
+  if( argc < 5 )
+  {
+    fprintf( stderr, "Usage: %s <server ip> <shared dir> <clients> <seconds> [v1|v2|v2crc]\n", argv[ 0 ] );
+    fprintf( stderr, "The server must run with the UDP transport on <shared dir>.\n" );
+    fprintf( stderr, "The last argument is the eluarpc encoding of the packets (default v1).\n" );
+    return 1;
+  }
+  clients = atoi( argv[ 3 ] );
+  seconds = atoi( argv[ 4 ] );
+  if( clients == 0 || clients > LOADGEN_MAX_CLIENTS || seconds == 0 )
+  {
+    fprintf( stderr, "Invalid number of clients (1-%d) or seconds\n", LOADGEN_MAX_CLIENTS );
+    return 1;
+  }
+  if( argc > 5 )
+  {
+    if( !strcmp( argv[ 5 ], "v2" ) )
+      lg_encoding = ELUARPC_ENC_V2;
+    else if( !strcmp( argv[ 5 ], "v2crc" ) )
+      lg_encoding = ELUARPC_ENC_V2 | ELUARPC_ENC_CRC;
+    else if( strcmp( argv[ 5 ], "v1" ) )
+    {
+      fprintf( stderr, "Invalid encoding %s\n", argv[ 5 ] );
+      return 1;
+    }
+  }
+  memset( &srv, 0, sizeof( srv ) );
+  srv.sin_family = AF_INET;
+  srv.sin_port = htons( RFS_UDP_PORT );
+  if( inet_aton( argv[ 1 ], &srv.sin_addr ) == 0 )
+  {
+    fprintf( stderr, "Invalid server address %s\n", argv[ 1 ] );
+    return 1;
+  }
+
+  // Create the file read by all the clients
+  for( i = 0; i < LOADGEN_SHARED_SIZE; i ++ )
+    lg_data[ i ] = ( u8 )( i * 13 + ( i >> 8 ) );
+  sprintf( ( char* )lg_buf, "%s/loadgen.dat", argv[ 2 ] );
+  if( ( fp = fopen( ( char* )lg_buf, "wb" ) ) == NULL || fwrite( lg_data, 1, LOADGEN_SHARED_SIZE, fp ) != LOADGEN_SHARED_SIZE )
+  {
+    fprintf( stderr, "Unable to create %s\n", ( char* )lg_buf );
+    return 1;
+  }
+  fclose( fp );
+
+  // Start the clients and collect their results
+  if( pipe( fds ) < 0 )
+    return 1;
+  for( i = 0; i < clients; i ++ )
+    if( fork() == 0 )
+    {
+      close( fds[ 0 ] );
+      lg_client( i, &srv, seconds, fds[ 1 ] );
+    }
+  close( fds[ 1 ] );
+  memset( &total, 0, sizeof( total ) );
+  for( i = 0; i < clients && read( fds[ 0 ], &r, sizeof( r ) ) == sizeof( r ); i ++ )
+  {
+    total.ops += r.ops;
+    total.bytes += r.bytes;
+    total.errors += r.errors;
+    total.timeouts += r.timeouts;
+    total.wire += r.wire;
+    total.total_us += r.total_us;
+    if( r.max_us > total.max_us )
+      total.max_us = r.max_us;
+  }
+  while( wait( NULL ) > 0 );
+  printf( "%u clients, %u s: %lu requests (%.0f/s), %.2f MB/s, latency avg %.0f us max %.0f us, %lu errors, %lu timeouts\n",
+          i, seconds, total.ops, total.ops / ( double )seconds, total.bytes / ( seconds * 1048576.0 ),
+          total.ops ? total.total_us / total.ops : 0, total.max_us, total.errors, total.timeouts );
+  printf( "On the wire: %.1f bytes/request, %.1f%% overhead\n", total.ops ? total.wire / ( double )total.ops : 0,
+          total.wire ? 100.0 * ( total.wire - total.bytes ) / total.wire : 0 );
+  for( i = 0; i < clients; i ++ )
+  {
+    sprintf( ( char* )lg_buf, "%s/loadgen_%u.dat", argv[ 2 ], i );
+    unlink( ( char* )lg_buf );
+  }
+  return total.errors || total.timeouts ? 1 : 0;
+}
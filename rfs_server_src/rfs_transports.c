@@ -16,12 +16,19 @@
 #include "rfs.h"
 #include "deskutils.h"
 #include "rfs_transports.h"
+#ifndef WIN32_BUILD
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+#endif
 
 // ****************************************************************************
 // Local variables
 
 u8 rfs_buffer[ MAX_PACKET_SIZE + ELUARPC_WRITE_REQUEST_EXTRA ];
 const RFS_TRANSPORT_DATA *p_transport_data; 
+const RFS_TRANSPORT_DATA *rfs_transports[ RFS_MAX_TRANSPORTS ];
+unsigned rfs_num_transports;
 
 // ****************************************************************************
 // Serial transport implementation
@@ -35,38 +42,40 @@ static void flush_serial()
 }
 
 // Read a packet from the serial port
-static void ser_read_request_packet()
+// Once a packet started, the rest of it must come in SER_PACKET_TIMEOUT ms
+// (the other transports are blocked meanwhile)
+#define SER_PACKET_TIMEOUT    1000
+
+static int ser_read_request_packet()
 {
   u16 temp16;
   u32 readbytes;
 
-  while( 1 )
+  // First read the length
+  if( ( readbytes = ser_read( ser, rfs_buffer, ELUARPC_START_OFFSET, SER_PACKET_TIMEOUT ) ) != ELUARPC_START_OFFSET )
   {
-    // First read the length
-    if( ( readbytes = ser_read( ser, rfs_buffer, ELUARPC_START_OFFSET, SER_INF_TIMEOUT ) ) != ELUARPC_START_OFFSET )
-    {
-      log_msg( "read_request_packet: ERROR reading packet length. Requested %d bytes, got %d bytes\n", ELUARPC_START_OFFSET, readbytes );
-      flush_serial();
-      continue;
-    }
+    log_msg( "read_request_packet: ERROR reading packet length. Requested %d bytes, got %d bytes\n", ELUARPC_START_OFFSET, readbytes );
+    flush_serial();
+    return 0;
+  }
 
-    if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
-    {
-      log_msg( "read_request_packet: ERROR getting packet size.\n" );
-      flush_serial();
-      continue;
-    }
+  if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
+  {
+    log_msg( "read_request_packet: ERROR getting packet size.\n" );
+    flush_serial();
+    return 0;
+  }
 
-    // Then the rest of the data
-    if( ( readbytes = ser_read( ser, rfs_buffer + ELUARPC_START_OFFSET, temp16 - ELUARPC_START_OFFSET, SER_INF_TIMEOUT ) ) != temp16 - ELUARPC_START_OFFSET )
-    {
-      log_msg( "read_request_packet: ERROR reading full packet, got %u bytes, expected %u bytes\n", ( unsigned )readbytes, ( unsigned )temp16 - ELUARPC_START_OFFSET );
-      flush_serial();
-      continue;
-    }
-    else
-      break;
+  // Then the rest of the data
+  if( ( readbytes = ser_read( ser, rfs_buffer + ELUARPC_START_OFFSET, temp16 - ELUARPC_START_OFFSET, SER_PACKET_TIMEOUT ) ) != temp16 - ELUARPC_START_OFFSET )
+  {
+    log_msg( "read_request_packet: ERROR reading full packet, got %u bytes, expected %u bytes\n", ( unsigned )readbytes, ( unsigned )temp16 - ELUARPC_START_OFFSET );
+    flush_serial();
+    return 0;
   }
+  // A serial port has a single client
+  server_set_client( NULL, 0 );
+  return 1;
 }
 
 // Send a packet to the serial port
@@ -107,7 +116,19 @@ static void ser_cleanup()
   ser_close( ser );
 }
 
-const RFS_TRANSPORT_DATA ser_transport_data = { ser_read_request_packet, ser_send_response_packet, ser_cleanup };
+#ifndef WIN32_BUILD
+static unsigned ser_get_handles( int *phandles, unsigned maxhandles )
+{
+  if( maxhandles == 0 )
+    return 0;
+  phandles[ 0 ] = ser;
+  return 1;
+}
+#else
+#define ser_get_handles       NULL
+#endif
+
+const RFS_TRANSPORT_DATA ser_transport_data = { ser_read_request_packet, ser_send_response_packet, ser_cleanup, ser_get_handles };
 
 // ****************************************************************************
 // UDP transport implementation
@@ -126,37 +147,39 @@ static u32 udp_read_helper( u8 *dest, u32 size )
   return readbytes;
 }
 
-static void udp_read_request_packet()
+static int udp_read_request_packet()
 {
   u16 temp16;
+  u8 key[ 6 ];
  
-  while( 1 )
+  // First read the length
+  if( ( temp16 = udp_read_helper( rfs_buffer, MAX_PACKET_SIZE ) ) < ELUARPC_START_OFFSET )
   {
-    // First read the length
-    if( ( temp16 = udp_read_helper( rfs_buffer, MAX_PACKET_SIZE ) ) < ELUARPC_START_OFFSET )
-    {
-      log_msg( "Got UDP data with invalid size, ignoring.\n" );
-      continue;
-    }
+    log_msg( "Got UDP data with invalid size, ignoring.\n" );
+    return 0;
+  }
 
-    // 'the length' might actually be a discovery packet, check that first
-    if( eluarpc_is_discover_packet( rfs_buffer ) )
-    {
-      log_msg( "Got UDP discovery packet, sending back response.\n" );
-      temp16 = eluarpc_build_discover_response( rfs_buffer );
-      net_sendto( trans_socket, ( char* )rfs_buffer, temp16, 0, ( struct sockaddr* )&trans_from, sizeof( trans_from ) );
-      continue;
-    }
+  // 'the length' might actually be a discovery packet, check that first
+  if( eluarpc_is_discover_packet( rfs_buffer ) )
+  {
+    log_msg( "Got UDP discovery packet, sending back response.\n" );
+    temp16 = eluarpc_build_discover_response( rfs_buffer );
+    net_sendto( trans_socket, ( char* )rfs_buffer, temp16, 0, ( struct sockaddr* )&trans_from, sizeof( trans_from ) );
+    return 0;
+  }
 
-    // Check for valid length
-    if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
-    {
-      log_msg( "read_request_packet: ERROR getting packet size.\n" );
-      continue;
-    }
-    else
-      break;
+  // Check for valid length
+  if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
+  {
+    log_msg( "read_request_packet: ERROR getting packet size.\n" );
+    return 0;
   }
+
+  // Every board (address and port) has its own session
+  memcpy( key, &trans_from.sin_addr, 4 );
+  memcpy( key + 4, &trans_from.sin_port, 2 );
+  server_set_client( key, sizeof( key ) );
+  return 1;
 }
 
 static void udp_send_response_packet()
@@ -200,7 +223,229 @@ static void udp_cleanup()
   net_close( trans_socket );
 }
 
-const RFS_TRANSPORT_DATA udp_transport_data = { udp_read_request_packet, udp_send_response_packet, udp_cleanup };
+#ifndef WIN32_BUILD
+static unsigned udp_get_handles( int *phandles, unsigned maxhandles )
+{
+  if( maxhandles == 0 )
+    return 0;
+  phandles[ 0 ] = trans_socket;
+  return 1;
+}
+#else
+#define udp_get_handles       NULL
+#endif
+
+const RFS_TRANSPORT_DATA udp_transport_data = { udp_read_request_packet, udp_send_response_packet, udp_cleanup, udp_get_handles };
+
+// ****************************************************************************
+// TCP transport implementation (POSIX only)
+// A listening socket and up to RFS_TCP_MAX_CLIENTS connections, each one with
+// its own session. Packets can be as large as the session buffer size
+// negotiated by the client (up to MAX_PACKET_SIZE).
+
+#ifndef WIN32_BUILD
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL          0
+#endif
+
+// Once a packet started, the rest of it must come in TCP_PACKET_TIMEOUT ms
+#define TCP_PACKET_TIMEOUT    1000
+#define TCP_KEY_SIZE          7
+
+static int tcp_listen_socket = -1;
+static int tcp_clients[ RFS_TCP_MAX_CLIENTS ];
+static u8 tcp_keys[ RFS_TCP_MAX_CLIENTS ][ TCP_KEY_SIZE ];
+static unsigned tcp_next;
+static int tcp_crt = -1;
+
+// Helper: read the specified number of bytes from a connection
+static u32 tcp_read_helper( int s, u8 *dest, u32 size )
+{
+  struct pollfd pfd;
+  u32 readbytes = 0;
+  ssize_t res;
+
+  pfd.fd = s;
+  pfd.events = POLLIN;
+  while( readbytes < size )
+  {
+    if( poll( &pfd, 1, TCP_PACKET_TIMEOUT ) <= 0 || ( res = recv( s, dest + readbytes, size - readbytes, 0 ) ) <= 0 )
+      break;
+    readbytes += res;
+  }
+  return readbytes;
+}
+
+static void tcp_close_client( unsigned i )
+{
+  log_msg( "TCP client %u disconnected\n", i );
+  close( tcp_clients[ i ] );
+  tcp_clients[ i ] = -1;
+  if( tcp_crt == ( int )i )
+    tcp_crt = -1;
+  // The session of the connection goes away with it
+  server_drop_client( tcp_keys[ i ], TCP_KEY_SIZE );
+}
+
+static void tcp_accept()
+{
+  struct sockaddr_in from;
+  socklen_t fromlen = sizeof( from );
+  int s, i, flag = 1;
+
+  if( ( s = accept( tcp_listen_socket, ( struct sockaddr* )&from, &fromlen ) ) < 0 )
+    return;
+  for( i = 0; i < RFS_TCP_MAX_CLIENTS; i ++ )
+    if( tcp_clients[ i ] == -1 )
+      break;
+  if( i == RFS_TCP_MAX_CLIENTS )
+  {
+    log_msg( "Too many TCP clients, rejecting connection.\n" );
+    close( s );
+    return;
+  }
+  // Responses are complete packets, don't delay them
+  setsockopt( s, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof( flag ) );
+  tcp_clients[ i ] = s;
+  tcp_keys[ i ][ 0 ] = 't';
+  memcpy( tcp_keys[ i ] + 1, &from.sin_addr, 4 );
+  memcpy( tcp_keys[ i ] + 5, &from.sin_port, 2 );
+  log_msg( "TCP client %d connected\n", i );
+}
+
+// Read a full packet from the given connection
+static int tcp_read_packet( unsigned i )
+{
+  u16 temp16;
+  u32 readbytes;
+
+  if( ( readbytes = tcp_read_helper( tcp_clients[ i ], rfs_buffer, ELUARPC_START_OFFSET ) ) != ELUARPC_START_OFFSET )
+    return 0;
+  if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR || temp16 < ELUARPC_START_OFFSET || temp16 > sizeof( rfs_buffer ) )
+  {
+    log_msg( "read_request_packet: ERROR getting packet size.\n" );
+    return 0;
+  }
+  if( ( readbytes = tcp_read_helper( tcp_clients[ i ], rfs_buffer + ELUARPC_START_OFFSET, temp16 - ELUARPC_START_OFFSET ) ) != temp16 - ELUARPC_START_OFFSET )
+  {
+    log_msg( "read_request_packet: ERROR reading full packet, got %u bytes, expected %u bytes\n", ( unsigned )readbytes, ( unsigned )temp16 - ELUARPC_START_OFFSET );
+    return 0;
+  }
+  return 1;
+}
+
+static int tcp_read_request_packet()
+{
+  struct pollfd fds[ RFS_TCP_MAX_CLIENTS ];
+  unsigned i, n;
+
+  // Accept a new connection first
+  fds[ 0 ].fd = tcp_listen_socket;
+  fds[ 0 ].events = POLLIN;
+  if( poll( fds, 1, 0 ) > 0 )
+    tcp_accept();
+
+  // Then read a request from the next connection that has data, in turn, so
+  // that a busy client can't starve the others
+  for( i = 0; i < RFS_TCP_MAX_CLIENTS; i ++ )
+  {
+    fds[ i ].fd = tcp_clients[ i ];
+    fds[ i ].events = POLLIN;
+    fds[ i ].revents = 0;
+  }
+  if( poll( fds, RFS_TCP_MAX_CLIENTS, 0 ) <= 0 )
+    return 0;
+  for( n = 0; n < RFS_TCP_MAX_CLIENTS; n ++ )
+  {
+    i = ( tcp_next + n ) % RFS_TCP_MAX_CLIENTS;
+    if( tcp_clients[ i ] == -1 || ( fds[ i ].revents & ( POLLIN | POLLERR | POLLHUP ) ) == 0 )
+      continue;
+    tcp_next = i + 1;
+    // A connection with invalid data is out of sync, close it
+    if( tcp_read_packet( i ) == 0 )
+    {
+      tcp_close_client( i );
+      return 0;
+    }
+    tcp_crt = i;
+    server_set_client( tcp_keys[ i ], TCP_KEY_SIZE );
+    return 1;
+  }
+  return 0;
+}
+
+static void tcp_send_response_packet()
+{
+  u16 temp16;
+  u32 sent = 0;
+  ssize_t res;
+
+  if( tcp_crt == -1 || eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
+    return;
+  log_msg( "send_response_packet: sending response packet of %u bytes\n", ( unsigned )temp16 );
+  while( sent < temp16 )
+  {
+    if( ( res = send( tcp_clients[ tcp_crt ], rfs_buffer + sent, temp16 - sent, MSG_NOSIGNAL ) ) <= 0 )
+    {
+      tcp_close_client( tcp_crt );
+      return;
+    }
+    sent += res;
+  }
+}
+
+static int tcp_server_init( unsigned server_port )
+{
+  struct sockaddr_in server;
+  int i, flag = 1;
+
+  for( i = 0; i < RFS_TCP_MAX_CLIENTS; i ++ )
+    tcp_clients[ i ] = -1;
+  if( ( tcp_listen_socket = socket( AF_INET, SOCK_STREAM, 0 ) ) < 0 )
+  {
+    log_err( "Unable to create socket\n" );
+    return 0;
+  }
+  setsockopt( tcp_listen_socket, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof( flag ) );
+  memset( &server, 0, sizeof( server ) );
+  server.sin_family = AF_INET;
+  server.sin_port = htons( server_port );
+  server.sin_addr.s_addr = htonl( INADDR_ANY );
+  if( bind( tcp_listen_socket, ( struct sockaddr * )&server, sizeof( server ) ) < 0 || listen( tcp_listen_socket, RFS_TCP_MAX_CLIENTS ) < 0 )
+  {
+    log_err( "Unable to bind socket\n" );
+    return 0;
+  }
+  log_msg( "Running RFS server on TCP port %u.\n", ( unsigned )server_port );
+  return 1;
+}
+
+static void tcp_cleanup()
+{
+  unsigned i;
+
+  for( i = 0; i < RFS_TCP_MAX_CLIENTS; i ++ )
+    if( tcp_clients[ i ] != -1 )
+      tcp_close_client( i );
+  close( tcp_listen_socket );
+}
+
+static unsigned tcp_get_handles( int *phandles, unsigned maxhandles )
+{
+  unsigned i, n = 0;
+
+  if( maxhandles > 0 )
+    phandles[ n ++ ] = tcp_listen_socket;
+  for( i = 0; i < RFS_TCP_MAX_CLIENTS && n < maxhandles; i ++ )
+    if( tcp_clients[ i ] != -1 )
+      phandles[ n ++ ] = tcp_clients[ i ];
+  return n;
+}
+
+const RFS_TRANSPORT_DATA tcp_transport_data = { tcp_read_request_packet, tcp_send_response_packet, tcp_cleanup, tcp_get_handles };
+
+#endif // #ifndef WIN32_BUILD
 
 // ****************************************************************************
 // Memory transport implementation
@@ -301,13 +546,13 @@ static int mem_server_init()
   return 1;   
 }
 
-const RFS_TRANSPORT_DATA mem_transport_data = { NULL, NULL, NULL };
+const RFS_TRANSPORT_DATA mem_transport_data = { NULL, NULL, NULL, NULL };
 
 // ****************************************************************************
 // Helper functions
 
 // Transport parser
-static int parse_transport_and_init( const char* s )
+static int parse_one_transport_and_init( const char* s )
 {
   const char *c, *c2;
   char *temps, *tempb;
@@ -359,6 +604,16 @@ static int parse_transport_and_init( const char* s )
     }
     return udp_server_init( RFS_UDP_PORT );   
   }
+  else if( !strcmp( s, "tcp" ) )
+  {
+#ifndef WIN32_BUILD
+    p_transport_data = &tcp_transport_data;
+    return tcp_server_init( RFS_TCP_PORT );
+#else
+    log_err( "Error: the TCP transport is not supported on Windows\n" );
+    return 0;
+#endif
+  }
   else if( !strcmp( s, "mem" ) )
   {
     // Direct memory transport, only used with mux in rfsmux mode
@@ -369,6 +624,56 @@ static int parse_transport_and_init( const char* s )
   return 0;
 }
 
+// Parse a list of transports separated by '+' (each kind can be used once)
+static int parse_transport_and_init( const char *s )
+{
+  const char *c;
+  char *temps;
+  int res;
+  unsigned i;
+
+  rfs_num_transports = 0;
+  while( 1 )
+  {
+    c = strchr( s, '+' );
+    temps = c ? l_strndup( s, c - s ) : l_strndup( s, strlen( s ) );
+    res = parse_one_transport_and_init( temps );
+    free( temps );
+    if( res == 0 )
+      return 0;
+    for( i = 0; i < rfs_num_transports; i ++ )
+      if( rfs_transports[ i ] == p_transport_data || rfs_transports[ i ] == &mem_transport_data || p_transport_data == &mem_transport_data )
+      {
+        log_err( "Error: invalid transport list\n" );
+        return 0;
+      }
+#ifdef WIN32_BUILD
+    if( rfs_num_transports > 0 )
+    {
+      log_err( "Error: only one transport can be used on Windows\n" );
+      return 0;
+    }
+#endif
+    rfs_transports[ rfs_num_transports ++ ] = p_transport_data;
+    if( c == NULL )
+      break;
+    s = c + 1;
+  }
+  p_transport_data = rfs_transports[ 0 ];
+  return 1;
+}
+
+// Read a request from the given transport, execute it and send the response
+// Returns 0 if there was no request (invalid data or a discovery packet)
+int rfs_serve_request( const RFS_TRANSPORT_DATA *ptrans )
+{
+  if( ptrans->f_read_request() == 0 )
+    return 0;
+  server_execute_request( rfs_buffer );
+  ptrans->f_send_response();
+  return 1;
+}
+
 // *****************************************************************************
 // Entry point
 
@@ -386,6 +691,8 @@ int rfs_init( int argc, const char **argv )
     log_err( "Usage: %s <transport> <dirname> [-v]\n", argv[ 0 ] );
     log_err( "  Serial transport: 'ser:<sername>,<serspeed>,<flow> ('flow' defines the flow control and can be either 'none' or 'rtscts')\n" );
     log_err( "  UDP transport: 'udp'\n" );
+    log_err( "  TCP transport: 'tcp' (not on Windows)\n" );
+    log_err( "  Use '+' to serve more than one transport (for example 'udp+ser:/dev/ttyUSB0,115200,none').\n" );
     log_err( "Use -v for verbose output.\n" );
     return 1;
   }
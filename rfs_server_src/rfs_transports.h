@@ -1,23 +1,33 @@
 #ifndef _RFS_TRANSPORTS_H
 #define _RFS_TRANSPORTS_H
 
-typedef void ( *p_read_request )( void );
+typedef int ( *p_read_request )( void );
 typedef void ( *p_send_response )( void );
 typedef void ( *p_cleanup )( void );
+typedef unsigned ( *p_get_handles )( int *phandles, unsigned maxhandles );
 typedef struct
 {
-  p_read_request f_read_request;
+  p_read_request f_read_request;      // returns 1 if a request was read
   p_send_response f_send_response;
   p_cleanup f_cleanup;
+  p_get_handles f_get_handles;        // descriptors for poll, returns their number (POSIX only)
 } RFS_TRANSPORT_DATA;
 
-#define   MAX_PACKET_SIZE     4096
+#define   MAX_PACKET_SIZE     SERVER_MAX_PACKET_SIZE
+#define   RFS_MAX_TRANSPORTS  3
+#define   RFS_TCP_MAX_CLIENTS 8
+#define   RFS_MAX_HANDLES     ( RFS_MAX_TRANSPORTS + RFS_TCP_MAX_CLIENTS )
 
 extern const RFS_TRANSPORT_DATA *p_transport_data; 
 extern const RFS_TRANSPORT_DATA mem_transport_data;
 extern const RFS_TRANSPORT_DATA udp_transport_data;
 extern const RFS_TRANSPORT_DATA ser_transport_data;
+extern const RFS_TRANSPORT_DATA tcp_transport_data;
+extern const RFS_TRANSPORT_DATA *rfs_transports[ RFS_MAX_TRANSPORTS ];
+extern unsigned rfs_num_transports;
 extern u8 rfs_buffer[ MAX_PACKET_SIZE + ELUARPC_WRITE_REQUEST_EXTRA ];
 
+int rfs_serve_request( const RFS_TRANSPORT_DATA *ptrans );
+
 #endif
 
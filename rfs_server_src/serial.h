@@ -31,6 +31,10 @@
 #define SER_FLOW_NONE           0
 #define SER_FLOW_RTSCTS         1
 
+// Events for ser_select
+#define SER_SELECT_READ         1
+#define SER_SELECT_WRITE        2
+
 // Serial access functions (to be implemented by each platform)
 ser_handler ser_open( const char *sername );
 void ser_close( ser_handler id );
@@ -40,6 +44,8 @@ int ser_read_byte( ser_handler id, u32 timeout );
 u32 ser_write( ser_handler id, const u8 *src, u32 size );
 u32 ser_write_byte( ser_handler id, u8 data );
 int ser_select_byte( ser_handler *pobjects, unsigned nobjects, int timeout );
+int ser_select( ser_handler *pobjects, unsigned nobjects, u8 *pevents, int timeout );
+u32 ser_write_nb( ser_handler id, const u8 *src, u32 size );
 
 #endif
 
@@ -157,8 +157,9 @@ u32 ser_read( ser_handler id, u8* dest, u32 maxsize, u32 timeout )
     retval = select( ( int )id + 1, &readfs, NULL, NULL, timeout == SER_INF_TIMEOUT ? NULL : &tv );
     if( retval == -1 || retval == 0 )
       break;
-    else 
-      readbytes += ( u32 )read( id, dest + readbytes, maxsize - readbytes );
+    if( ( retval = read( id, dest + readbytes, maxsize - readbytes ) ) <= 0 )
+      break;
+    readbytes += ( u32 )retval;
   }
   return readbytes;
 }
@@ -188,6 +189,15 @@ u32 ser_write_byte( ser_handler id, u8 data )
   return ( u32 )write( id, &data, 1 );
 }
 
+// Write as many bytes as the port accepts now, without waiting for them to be
+// transmitted. Return the number of bytes written.
+u32 ser_write_nb( ser_handler id, const u8 *src, u32 size )
+{
+  ssize_t res = write( ( int )id, src, size );
+
+  return res > 0 ? ( u32 )res : 0;
+}
+
 // Perform 'select' on the specified handler(s), returning a single byte 
 // if it could be read (plus the object ID in the upper 8 bits) and -1
 // otherwise
@@ -225,3 +235,39 @@ int ser_select_byte( ser_handler *pobjects, unsigned nobjects, int timeout )
   return res;
 }
 
+// Wait for the events in 'pevents' (SER_SELECT_READ/SER_SELECT_WRITE) on the
+// specified handler(s). 'pevents' gets the events that happened. Return the
+// number of handlers with events, 0 for timeout and -1 for error.
+int ser_select( ser_handler *pobjects, unsigned nobjects, u8 *pevents, int timeout )
+{
+  int i, maxfd = -1;
+  fd_set readfs, writefs;
+  struct timeval tv;
+  int res;
+
+  FD_ZERO( &readfs );
+  FD_ZERO( &writefs );
+  for( i = 0; i < nobjects; i ++ )
+  {
+    if( pevents[ i ] & SER_SELECT_READ )
+      FD_SET( pobjects[ i ], &readfs );
+    if( pevents[ i ] & SER_SELECT_WRITE )
+      FD_SET( pobjects[ i ], &writefs );
+    if( pevents[ i ] && pobjects[ i ] > maxfd )
+      maxfd = pobjects[ i ];
+  }
+
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = ( timeout % 1000 ) * 1000;
+  res = select( maxfd + 1, &readfs, &writefs, NULL, timeout == SER_INF_TIMEOUT ? NULL : &tv );
+  if( res < 0 )
+    return errno == EINTR ? 0 : -1;
+  res = 0;
+  for( i = 0; i < nobjects; i ++ )
+  {
+    pevents[ i ] = ( FD_ISSET( pobjects[ i ], &readfs ) ? SER_SELECT_READ : 0 ) | ( FD_ISSET( pobjects[ i ], &writefs ) ? SER_SELECT_WRITE : 0 );
+    if( pevents[ i ] )
+      res ++;
+  }
+  return res;
+}
@@ -226,6 +226,13 @@ u32 ser_write_byte( ser_handler id, u8 data )
   return ser_write( id, &data, 1 );
 }
 
+// Write without waiting for the transmission (the overlapped write of
+// ser_write already does this)
+u32 ser_write_nb( ser_handler id, const u8 *src, u32 size )
+{
+  return ser_write( id, src, size );
+}
+
 // Perform 'select' on the specified handler(s), returning a single byte 
 // if it could be read (plus the object ID in the upper 8 bits) and -1
 // otherwise
@@ -285,3 +292,52 @@ int ser_select_byte( ser_handler *pobjects, unsigned nobjects, int timeout )
   return res;
 }
 
+// Wait for the events in 'pevents' (SER_SELECT_READ/SER_SELECT_WRITE) on the
+// specified handler(s). 'pevents' gets the events that happened. Return the
+// number of handlers with events, 0 for timeout and -1 for error.
+// The writes are complete when ser_write returns, so the ports are always
+// writable. A read of a single byte is started on every port that waits for
+// data and ser_read returns this byte after select.
+int ser_select( ser_handler *pobjects, unsigned nobjects, u8 *pevents, int timeout )
+{
+  int i;
+  DWORD readbytes, dwRes;
+  int res = 0, writable = 0;
+  unsigned num_wait = 0;
+
+  if( nobjects >= MAXIMUM_WAIT_OBJECTS )
+    return -1;
+
+  for( i = 0; i < nobjects; i ++ )
+  {
+    if( pevents[ i ] & SER_SELECT_WRITE )
+      writable = 1;
+    if( !( pevents[ i ] & SER_SELECT_READ ) )
+      continue;
+    if( !pobjects[ i ]->fWaitingOnRead )
+    {
+      init_ov( &pobjects[ i ]->o );
+      if( !ReadFile( pobjects[ i ]->hnd, &pobjects[ i ]->databuf, 1, &readbytes, &pobjects[ i ]->o ) && GetLastError() != ERROR_IO_PENDING )
+        return -1;
+      pobjects[ i ]->fWaitingOnRead = TRUE;
+    }
+    sel_handler_map[ num_wait ] = i;
+    sel_handlers[ num_wait ++ ] = pobjects[ i ]->o.hEvent;
+  }
+
+  if( num_wait > 0 )
+  {
+    dwRes = WaitForMultipleObjects( num_wait, sel_handlers, FALSE, writable ? 0 : timeout == SER_INF_TIMEOUT ? INFINITE : timeout );
+    if( dwRes == WAIT_FAILED )
+      return -1;
+  }
+  for( i = 0; i < nobjects; i ++ )
+    pevents[ i ] &= SER_SELECT_WRITE;
+  for( i = 0; i < num_wait; i ++ )
+    if( WaitForSingleObject( sel_handlers[ i ], 0 ) == WAIT_OBJECT_0 )
+      pevents[ sel_handler_map[ i ] ] |= SER_SELECT_READ;
+  for( i = 0; i < nobjects; i ++ )
+    if( pevents[ i ] )
+      res ++;
+  return res;
+}
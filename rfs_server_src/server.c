@@ -9,20 +9,246 @@
 #include "type.h"
 #include "os_io.h"
 #include "log.h"
+#include "lz.h"
 
 static char* server_basedir;
 static char server_fullname[ PLATFORM_MAX_FNAME_LEN + 1 ];
+static char server_newname[ PLATFORM_MAX_FNAME_LEN + 1 ];
+static int server_seq;
+
+// Largest number of requests that a v2 client can have in flight
+#define SERVER_MAX_WINDOW   16
+
+// Optional operations implemented by this server (protocol v3)
+#define SERVER_CAPS         ( RFS_CAP_READDIR_BATCH | RFS_CAP_STAT | RFS_CAP_UNLINK | RFS_CAP_RENAME | RFS_CAP_MKDIR | RFS_CAP_COMPACT_RPC | RFS_CAP_COMPRESS | RFS_CAP_BUFSIZE )
+
+// Largest directory listing sent in a single response
+#define SERVER_MAX_BATCH    2048
+
+// Directory entries of readdir_batch
+static u8 server_batch[ SERVER_MAX_BATCH ];
+
+// Largest block of data sent or received with readz/writez
+#define SERVER_MAX_ZBLOCK   SERVER_MAX_PACKET_SIZE
+
+// Data of readz/writez (uncompressed and compressed) and the hash table of
+// the compressor
+static u8 server_zdata[ SERVER_MAX_ZBLOCK ];
+static u8 server_zpacked[ SERVER_MAX_ZBLOCK ];
+static u16 server_zhash[ LZ_HASH_SIZE ];
+
+// Client sessions. Every client (identified by its transport address) has
+// its own file and directory handles and protocol options, so clients can't
+// use the files of other clients. The handles sent to the clients are
+// indexes in the session tables. When the table is full the least recently
+// used session is dropped and its files are closed.
+#define SERVER_MAX_SESSIONS 64
+#define SERVER_MAX_FILES    16
+#define SERVER_MAX_DIRS     4
+#define SERVER_MAX_KEY_SIZE 32
+
+// Files opened only for reading are shared by all the sessions and are kept
+// open after they are closed by the clients (for the next open). All reads
+// are done with pread at the position kept in the session.
+#define SERVER_FD_CACHE_SIZE 16
+#define SERVER_NO_CACHE     0xFF
+
+typedef struct
+{
+  int osfd;                           // -1 if free
+  u32 pos;
+  u32 stamp;
+  u8 append;
+  u8 cached;                          // fd cache entry or SERVER_NO_CACHE
+} SERVER_FILE;
+
+typedef struct
+{
+  u8 key[ SERVER_MAX_KEY_SIZE ];
+  u8 keylen;
+  u8 used;
+  u8 version;
+  u8 window;
+  u32 stamp;
+  SERVER_FILE files[ SERVER_MAX_FILES ];
+  u32 dirs[ SERVER_MAX_DIRS ];        // OS handles, 0 if free
+  // Entry that didn't fit in the previous readdir_batch response of 'pending_d'
+  u32 pending_d;
+  char pending_name[ RFS_MAX_FNAME_SIZE + 1 ];
+  u32 pending_size, pending_mtime;
+} SERVER_SESSION;
+
+typedef struct
+{
+  char *name;                         // NULL if the file changed or the entry is free
+  int osfd;                           // -1 if free
+  u16 refs;
+  u32 stamp;
+} SERVER_CACHED_FD;
+
+static SERVER_SESSION server_sessions[ SERVER_MAX_SESSIONS ];
+static SERVER_SESSION *server_crt;
+static SERVER_CACHED_FD server_fd_cache[ SERVER_FD_CACHE_SIZE ];
+static u32 server_stamp;
 
 typedef int ( *p_server_handler )( u8 *p );
 
 // *****************************************************************************
 // Internal helpers: execute the given request, build the response
 
+// Helper: get the full name of a file in the shared directory. Returns 0 if
+// the name has ".." components (it could point outside the shared directory).
+static int server_get_fullname( char *dest, const char *name )
+{
+  char separator[ 2 ] = { PLATFORM_PATH_SEPARATOR, 0 };
+  const char *p;
+
+  for( p = name; p && ( p = strstr( p, ".." ) ) != NULL; p += 2 )
+    if( ( p == name || p[ -1 ] == '/' || p[ -1 ] == '\\' ) && ( p[ 2 ] == '\0' || p[ 2 ] == '/' || p[ 2 ] == '\\' ) )
+      return 0;
+  dest[ 0 ] = dest[ PLATFORM_MAX_FNAME_LEN ] = 0;
+  strncpy( dest, server_basedir, PLATFORM_MAX_FNAME_LEN );
+  if( name && strlen( name ) > 0 )
+  {
+    if( dest[ strlen( dest ) - 1 ] != PLATFORM_PATH_SEPARATOR )
+      strncat( dest, separator, PLATFORM_MAX_FNAME_LEN );
+    strncat( dest, name, PLATFORM_MAX_FNAME_LEN );
+  }
+  return 1;
+}
+
+// Helper: get a shared read only descriptor for the given file (opens it if
+// needed). Returns the fd cache entry or SERVER_NO_CACHE.
+static u8 server_fdcache_open( const char *name )
+{
+  unsigned i, found = SERVER_NO_CACHE;
+  SERVER_CACHED_FD *pc;
+  u32 size, mtime, csize, cmtime;
+  int isdir;
+
+  if( os_stat( name, &size, &mtime, &isdir ) == -1 || isdir )
+    return SERVER_NO_CACHE;
+  for( i = 0; i < SERVER_FD_CACHE_SIZE; i ++ )
+  {
+    pc = server_fd_cache + i;
+    if( pc->name == NULL || strcmp( pc->name, name ) )
+      continue;
+    // A file that was replaced on the host has a different size or mtime
+    if( os_fstat( pc->osfd, &csize, &cmtime ) == 0 && csize == size && cmtime == mtime )
+    {
+      pc->refs ++;
+      pc->stamp = ++ server_stamp;
+      return i;
+    }
+    free( pc->name );
+    pc->name = NULL;
+    if( pc->refs == 0 )
+    {
+      os_close( pc->osfd );
+      pc->osfd = -1;
+    }
+    break;
+  }
+  // Use a free entry or the least recently used entry without readers
+  for( i = 0; i < SERVER_FD_CACHE_SIZE; i ++ )
+  {
+    pc = server_fd_cache + i;
+    if( pc->osfd == -1 )
+    {
+      found = i;
+      break;
+    }
+    if( pc->refs == 0 && ( found == SERVER_NO_CACHE || pc->stamp < server_fd_cache[ found ].stamp ) )
+      found = i;
+  }
+  if( found == SERVER_NO_CACHE )
+    return SERVER_NO_CACHE;
+  pc = server_fd_cache + found;
+  if( pc->osfd != -1 )
+  {
+    log_msg( "server_fdcache_open: closing %s\n", pc->name );
+    os_close( pc->osfd );
+    free( pc->name );
+    pc->name = NULL;
+  }
+  if( ( pc->osfd = os_open( name, RFS_OPEN_FLAG_RDONLY, 0 ) ) < 0 )
+  {
+    pc->osfd = -1;
+    return SERVER_NO_CACHE;
+  }
+  pc->name = strdup( name );
+  pc->refs = 1;
+  pc->stamp = ++ server_stamp;
+  return found;
+}
+
+// Helper: close a file of a session
+static int server_file_close( SERVER_FILE *pf )
+{
+  SERVER_CACHED_FD *pc;
+  int res = 0;
+
+  if( pf->cached != SERVER_NO_CACHE )
+  {
+    pc = server_fd_cache + pf->cached;
+    // The descriptor stays open for the next client, unless the file changed
+    if( -- pc->refs == 0 && pc->name == NULL )
+    {
+      os_close( pc->osfd );
+      pc->osfd = -1;
+    }
+  }
+  else
+    res = os_close( pf->osfd );
+  pf->osfd = -1;
+  return res;
+}
+
+// Helper: get a file of the current session
+static SERVER_FILE* server_file_get( int fd )
+{
+  SERVER_FILE *pf;
+
+  if( fd < 0 || fd >= SERVER_MAX_FILES || ( pf = server_crt->files + fd )->osfd == -1 )
+  {
+    log_msg( "server: invalid file handle %d\n", fd );
+    return NULL;
+  }
+  pf->stamp = ++ server_stamp;
+  return pf;
+}
+
+// Helper: get a directory of the current session (0 if not valid)
+static u32 server_dir_get( u32 d )
+{
+  if( d == 0 || d > SERVER_MAX_DIRS )
+    return 0;
+  return server_crt->dirs[ d - 1 ];
+}
+
+// Helper: drop a session, closing all its files and directories
+static void server_session_close( SERVER_SESSION *ps )
+{
+  unsigned i;
+
+  for( i = 0; i < SERVER_MAX_FILES; i ++ )
+    if( ps->files[ i ].osfd != -1 )
+      server_file_close( ps->files + i );
+  for( i = 0; i < SERVER_MAX_DIRS; i ++ )
+    if( ps->dirs[ i ] )
+      os_closedir( ps->dirs[ i ] );
+  memset( ps, 0, sizeof( *ps ) );
+  for( i = 0; i < SERVER_MAX_FILES; i ++ )
+    ps->files[ i ].osfd = -1;
+}
+
 static int server_open( u8 *p )
 {
   const char *filename;
-  int mode, flags, fd;
-  char separator[ 2 ] = { PLATFORM_PATH_SEPARATOR, 0 };
+  int mode, flags, fd = -1, osfd = -1, i;
+  u8 cached = SERVER_NO_CACHE;
+  u32 size, mtime;
+  SERVER_FILE *pf = NULL;
   
   // Validate request
   log_msg( "server_open: request handler starting\n" );
@@ -31,27 +257,77 @@ static int server_open( u8 *p )
     log_msg( "server_open: unable to read request\n" );
     return SERVER_ERR;
   }
+  // Get a free handle (or reuse the least recently used one)
+  for( i = 0; i < SERVER_MAX_FILES; i ++ )
+    if( server_crt->files[ i ].osfd == -1 )
+    {
+      pf = server_crt->files + i;
+      break;
+    }
+    else if( pf == NULL || server_crt->files[ i ].stamp < pf->stamp )
+      pf = server_crt->files + i;
+  if( pf->osfd != -1 )
+  {
+    log_msg( "server_open: too many files, closing handle %d\n", ( int )( pf - server_crt->files ) );
+    server_file_close( pf );
+  }
   // Get real filename
-  server_fullname[ 0 ] = server_fullname[ PLATFORM_MAX_FNAME_LEN ] = 0;
-  strncpy( server_fullname, server_basedir, PLATFORM_MAX_FNAME_LEN );
-  if( filename && strlen( filename ) > 0 )
+  if( server_get_fullname( server_fullname, filename ) )
   {
-    if( server_fullname[ strlen( server_fullname ) - 1 ] != PLATFORM_PATH_SEPARATOR )
-      strncat( server_fullname, separator, PLATFORM_MAX_FNAME_LEN );
-    strncat( server_fullname, filename, PLATFORM_MAX_FNAME_LEN );
+    log_msg( "server_open: full file path is %s\n", server_fullname ); 
+    if( ( flags & ( RFS_OPEN_FLAG_WRONLY | RFS_OPEN_FLAG_RDWR | RFS_OPEN_FLAG_CREAT | RFS_OPEN_FLAG_TRUNC | RFS_OPEN_FLAG_APPEND ) ) == 0 &&
+        ( cached = server_fdcache_open( server_fullname ) ) != SERVER_NO_CACHE )
+      osfd = server_fd_cache[ cached ].osfd;
+    else
+      osfd = os_open( server_fullname, flags, mode );
+  }
+  if( osfd >= 0 )
+  {
+    pf->osfd = osfd;
+    pf->pos = 0;
+    pf->append = ( flags & RFS_OPEN_FLAG_APPEND ) != 0;
+    pf->cached = cached;
+    pf->stamp = ++ server_stamp;
+    fd = pf - server_crt->files;
   }
-  log_msg( "server_open: full file path is %s\n", server_fullname ); 
-  fd = os_open( server_fullname, flags, mode );
-  log_msg( "server_open: OS file handler is %d\n", fd );
-  remotefs_open_write_response( p, fd );
+  log_msg( "server_open: OS file handler is %d (handle %d, %s)\n", osfd, fd, cached != SERVER_NO_CACHE ? "shared" : "private" );
+  // v2 clients also get the size and the modification time of the file
+  if( server_seq != ELUARPC_NO_SEQ )
+  {
+    if( fd < 0 || os_fstat( osfd, &size, &mtime ) == -1 )
+      size = mtime = 0;
+    remotefs_open_write_response_v2( p, fd, size, mtime );
+  }
+  else
+    remotefs_open_write_response( p, fd );
   return SERVER_OK;
 }
 
+// Helper: write data to a file of the current session at its position
+static s32 server_file_write( int fd, const void *buf, u32 count )
+{
+  SERVER_FILE *pf;
+  s32 res = -1;
+
+  if( ( pf = server_file_get( fd ) ) != NULL )
+  {
+    if( pf->append )
+    {
+      res = os_write( pf->osfd, buf, count );
+      pf->pos = ( u32 )os_lseek( pf->osfd, 0, RFS_LSEEK_CUR );
+    }
+    else if( ( res = os_pwrite( pf->osfd, buf, count, pf->pos ) ) > 0 )
+      pf->pos += ( u32 )res;
+  }
+  return res;
+}
+
 static int server_write( u8 *p )
 {
   int fd;
   const void *buf;
   u32 count;
+  s32 res;
   
   log_msg( "server_write: request handler starting\n" );
   if( remotefs_write_read_request( p, &fd, &buf, &count ) == ELUARPC_ERR )
@@ -60,9 +336,39 @@ static int server_write( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_write: fd = %d, buf = %p, count = %u\n", fd, buf, ( unsigned )count );
-  count = ( u32 )os_write( fd, buf, count );
-  log_msg( "server_write: OS response is %u\n", ( unsigned )count );
-  remotefs_write_write_response( p, count );
+  res = server_file_write( fd, buf, count );
+  log_msg( "server_write: OS response is %d\n", ( int )res );
+  remotefs_write_write_response( p, ( u32 )res );
+  return SERVER_OK;
+}
+
+static int server_writez( u8 *p )
+{
+  int fd;
+  const void *data;
+  u32 count, datalen;
+  s32 res = -1;
+
+  log_msg( "server_writez: request handler starting\n" );
+  if( remotefs_writez_read_request( p, &fd, &count, &data, &datalen ) == ELUARPC_ERR )
+  {
+    log_msg( "server_writez: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_writez: fd = %d, count = %u, compressed to %u bytes\n", fd, ( unsigned )count, ( unsigned )datalen );
+  // The data is compressed if it has less than 'count' bytes
+  if( datalen < count )
+  {
+    if( count <= SERVER_MAX_ZBLOCK && lz_decompress( data, datalen, server_zdata, count ) == ( s32 )count )
+      datalen = count;
+    data = server_zdata;
+  }
+  if( datalen == count )
+    res = server_file_write( fd, data, count );
+  else
+    log_msg( "server_writez: invalid data\n" );
+  log_msg( "server_writez: OS response is %d\n", ( int )res );
+  remotefs_writez_write_response( p, ( u32 )res );
   return SERVER_OK;
 }
 
@@ -70,6 +376,8 @@ static int server_read( u8 *p )
 {
   int fd;
   u32 count;
+  s32 res = -1;
+  SERVER_FILE *pf;
   
   log_msg( "server_read: request handler starting\n" );
   if( remotefs_read_read_request( p, &fd, &count ) == ELUARPC_ERR )
@@ -78,15 +386,55 @@ static int server_read( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_read: fd = %d, count = %u\n", fd, ( unsigned )count );
-  count = ( u32 )os_read( fd, p + ELUARPC_READ_BUF_OFFSET, count );
-  log_msg( "server_read: OS response is %u\n", ( unsigned )count );
+  if( count > SERVER_MAX_PACKET_SIZE )
+    count = SERVER_MAX_PACKET_SIZE;
+  // The data goes directly to its place in the response
+  if( ( pf = server_file_get( fd ) ) != NULL )
+    res = os_pread( pf->osfd, p + eluarpc_get_read_buf_offset(), count, pf->pos );
+  count = res > 0 ? ( u32 )res : 0;
+  if( pf )
+    pf->pos += count;
+  log_msg( "server_read: OS response is %d\n", ( int )res );
   remotefs_read_write_response( p, count );
   return SERVER_OK;
 }
 
-static int server_close( u8 *p )
+static int server_readz( u8 *p )
 {
   int fd;
+  u32 count, zlen = 0;
+  s32 res = -1;
+  SERVER_FILE *pf;
+
+  log_msg( "server_readz: request handler starting\n" );
+  if( remotefs_readz_read_request( p, &fd, &count ) == ELUARPC_ERR )
+  {
+    log_msg( "server_readz: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_readz: fd = %d, count = %u\n", fd, ( unsigned )count );
+  if( count > SERVER_MAX_ZBLOCK )
+    count = SERVER_MAX_ZBLOCK;
+  if( ( pf = server_file_get( fd ) ) != NULL )
+    res = os_pread( pf->osfd, server_zdata, count, pf->pos );
+  count = res > 0 ? ( u32 )res : 0;
+  if( pf )
+    pf->pos += count;
+  // The data is sent compressed only if this makes it smaller
+  if( count > 0 )
+    zlen = lz_compress( server_zdata, count, server_zpacked, count - 1, server_zhash );
+  log_msg( "server_readz: OS response is %d, sending %u bytes\n", ( int )res, ( unsigned )( zlen ? zlen : count ) );
+  if( zlen )
+    remotefs_readz_write_response( p, count, server_zpacked, zlen );
+  else
+    remotefs_readz_write_response( p, count, server_zdata, count );
+  return SERVER_OK;
+}
+
+static int server_close( u8 *p )
+{
+  int fd, res = -1;
+  SERVER_FILE *pf;
   
   log_msg( "server_close: request handler starting\n" );
   if( remotefs_close_read_request( p, &fd ) == ELUARPC_ERR )
@@ -95,16 +443,19 @@ static int server_close( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_close: fd = %d\n", fd );
-  fd = os_close( fd );
-  log_msg( "server_close: OS response is %d\n", fd );
-  remotefs_close_write_response( p, fd );
+  if( ( pf = server_file_get( fd ) ) != NULL )
+    res = server_file_close( pf );
+  log_msg( "server_close: OS response is %d\n", res );
+  remotefs_close_write_response( p, res );
   return SERVER_OK;
 }
 
 static int server_lseek( u8 *p )
 {
   int fd, whence;
-  s32 offset;
+  s32 offset, res = -1;
+  u32 size, mtime;
+  SERVER_FILE *pf;
 
   log_msg( "server_lseek: request handler starting\n" );
   if( remotefs_lseek_read_request( p, &fd, &offset, &whence ) == ELUARPC_ERR )
@@ -113,17 +464,39 @@ static int server_lseek( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_lseek: fd = %d, offset = %d, whence = %d\n", fd, ( int )offset, whence );
-  offset = os_lseek( fd, offset, whence );
-  log_msg( "server_lseek: OS response is %d\n", ( int )offset );
-  remotefs_lseek_write_response( p, offset );
+  // The position is kept in the session (the descriptor might be shared)
+  if( ( pf = server_file_get( fd ) ) != NULL )
+  {
+    switch( whence )
+    {
+      case RFS_LSEEK_SET:
+        res = offset;
+        break;
+
+      case RFS_LSEEK_CUR:
+        res = ( s32 )pf->pos + offset;
+        break;
+
+      case RFS_LSEEK_END:
+        if( os_fstat( pf->osfd, &size, &mtime ) == 0 )
+          res = ( s32 )size + offset;
+        break;
+    }
+    if( res >= 0 )
+      pf->pos = ( u32 )res;
+    else
+      res = -1;
+  }
+  log_msg( "server_lseek: new position is %d\n", ( int )res );
+  remotefs_lseek_write_response( p, res );
   return SERVER_OK;
 }
 
 static int server_opendir( u8 *p )
 {
   const char* name;
-  u32 d;
-  char separator[ 2 ] = { PLATFORM_PATH_SEPARATOR, 0 };
+  u32 d = 0, osd = 0;
+  unsigned i;
 
   log_msg( "server_opendir: request handler starting\n" );
   if( remotefs_opendir_read_request( p, &name ) == ELUARPC_ERR )
@@ -131,18 +504,19 @@ static int server_opendir( u8 *p )
     log_msg( "server_opendir: unable to read request\n" );
     return SERVER_ERR;
   }
-  // Get real filename
-  server_fullname[ 0 ] = server_fullname[ PLATFORM_MAX_FNAME_LEN ] = 0;
-  strncpy( server_fullname, server_basedir, PLATFORM_MAX_FNAME_LEN );
-  if( name && strlen( name ) > 0 )
+  for( i = 0; i < SERVER_MAX_DIRS; i ++ )
+    if( server_crt->dirs[ i ] == 0 )
+      break;
+  if( i < SERVER_MAX_DIRS && server_get_fullname( server_fullname, name ) )
   {
-    if( server_fullname[ strlen( server_fullname ) - 1 ] != PLATFORM_PATH_SEPARATOR )
-      strncat( server_fullname, separator, PLATFORM_MAX_FNAME_LEN );
-    strncat( server_fullname, name, PLATFORM_MAX_FNAME_LEN );
+    log_msg( "server_opendir: full dirname is %s\n", server_fullname );
+    if( ( osd = os_opendir( server_fullname ) ) != 0 )
+    {
+      server_crt->dirs[ i ] = osd;
+      d = i + 1;
+    }
   }
-  log_msg( "server_opendir: full dirname is %s\n", server_fullname );
-  d = os_opendir( server_fullname );
-  log_msg( "server_opendir: OS response is %08X\n", d );
+  log_msg( "server_opendir: OS response is %08X (handle %u)\n", osd, ( unsigned )d );
   remotefs_opendir_write_response( p, d );
   return SERVER_OK;
 }
@@ -150,9 +524,7 @@ static int server_opendir( u8 *p )
 static int server_readdir( u8 *p )
 {
   const char* name;
-  u32 fsize = 0, d;
-  int fd;
-  char separator[ 2 ] = { PLATFORM_PATH_SEPARATOR, 0 };
+  u32 fsize = 0, ftime = 0, d;
 
   log_msg( "server_readdir: request handler starting\n" );
   if( remotefs_readdir_read_request( p, &d ) == ELUARPC_ERR )
@@ -161,40 +533,94 @@ static int server_readdir( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_readdir: DIR = %08X\n", d );
-  os_readdir( d, &name );
-  if( name )
-  {
-    // Need to compute size now
-    // Get real filename
-    server_fullname[ 0 ] = server_fullname[ PLATFORM_MAX_FNAME_LEN ] = 0;
-    strncpy( server_fullname, server_basedir, PLATFORM_MAX_FNAME_LEN );
-    if( name && strlen( name ) > 0 )
+  if( server_dir_get( d ) == 0 )
+    name = NULL;
+  else if( server_crt->pending_d == d )
+  {
+    // Entry left by a previous readdir_batch
+    name = server_crt->pending_name;
+    fsize = server_crt->pending_size;
+    ftime = server_crt->pending_mtime;
+    server_crt->pending_d = 0;
+  }
+  else
+    os_readdir_stat( server_dir_get( d ), &name, &fsize, &ftime );
+  log_msg( "server_readdir: OS response is fname = %s, fsize = %u\n", name, ( unsigned )fsize );
+  remotefs_readdir_write_response( p, name, fsize, ftime );
+  return SERVER_OK;
+}
+
+// Helper: write a little endian u32
+static u8* server_put_u32( u8 *p, u32 data )
+{
+  *p ++ = ( u8 )data;
+  *p ++ = ( u8 )( data >> 8 );
+  *p ++ = ( u8 )( data >> 16 );
+  *p ++ = ( u8 )( data >> 24 );
+  return p;
+}
+
+static int server_readdir_batch( u8 *p )
+{
+  const char *name;
+  u32 d, osd, maxsize, size, mtime, count = 0, last = 0, len;
+  u8 *pdata = server_batch;
+  SERVER_SESSION *ps = server_crt;
+
+  log_msg( "server_readdir_batch: request handler starting\n" );
+  if( remotefs_readdir_batch_read_request( p, &d, &maxsize ) == ELUARPC_ERR )
+  {
+    log_msg( "server_readdir_batch: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_readdir_batch: DIR = %08X, maxsize = %u\n", d, ( unsigned )maxsize );
+  if( maxsize > SERVER_MAX_BATCH )
+    maxsize = SERVER_MAX_BATCH;
+  osd = server_dir_get( d );
+  while( 1 )
+  {
+    if( osd == 0 )
+      name = NULL;
+    else if( ps->pending_d == d )
     {
-      if( server_fullname[ strlen( server_fullname ) - 1 ] != PLATFORM_PATH_SEPARATOR )
-        strncat( server_fullname, separator, PLATFORM_MAX_FNAME_LEN );
-      strncat( server_fullname, name, PLATFORM_MAX_FNAME_LEN );
+      name = ps->pending_name;
+      size = ps->pending_size;
+      mtime = ps->pending_mtime;
+      ps->pending_d = 0;
     }
-    fd = os_open( server_fullname, RFS_OPEN_FLAG_RDONLY, 0 );
-    if( fd )
+    else
+      os_readdir_stat( osd, &name, &size, &mtime );
+    if( name == NULL )
     {
-      fsize = os_lseek( fd, 0, RFS_LSEEK_END );
-      os_close( fd );
+      last = 1;
+      break;
     }
-    else
+    len = RFS_DIRENT_HEADER_SIZE + strlen( name ) + 1;
+    if( pdata - server_batch + len > maxsize )
     {
-      log_msg( "server_readdir: unable to open file %s\n", server_fullname );
-      name = NULL;
+      // Keep it for the next request
+      if( name != ps->pending_name )
+        strcpy( ps->pending_name, name );
+      ps->pending_d = d;
+      ps->pending_size = size;
+      ps->pending_mtime = mtime;
+      break;
     }
+    pdata = server_put_u32( pdata, size );
+    pdata = server_put_u32( pdata, mtime );
+    strcpy( ( char* )pdata, name );
+    pdata += strlen( name ) + 1;
+    count ++;
   }
-  log_msg( "server_readdir: OS response is fname = %s, fsize = %u\n", name, ( unsigned )fsize );
-  remotefs_readdir_write_response( p, name, fsize, 0 );
+  log_msg( "server_readdir_batch: %u entries, last = %u\n", ( unsigned )count, ( unsigned )last );
+  remotefs_readdir_batch_write_response( p, count, last, server_batch, pdata - server_batch );
   return SERVER_OK;
 }
 
 static int server_closedir( u8 *p )
 {
   u32 d;
-  int res;
+  int res = -1;
 
   log_msg( "server_closedir: request handler starting\n" );
   if( remotefs_closedir_read_request( p, &d ) == ELUARPC_ERR )
@@ -203,9 +629,130 @@ static int server_closedir( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_closedir: DIR = %08X\n", d );
-  res = os_closedir( d );
+  if( server_crt->pending_d == d )
+    server_crt->pending_d = 0;
+  if( server_dir_get( d ) != 0 )
+  {
+    res = os_closedir( server_dir_get( d ) );
+    server_crt->dirs[ d - 1 ] = 0;
+  }
   log_msg( "server_closedir: OS response is %d\n", res );
-  remotefs_closedir_write_response( p, d );
+  remotefs_closedir_write_response( p, res );
+  return SERVER_OK;
+}
+
+static int server_hello( u8 *p )
+{
+  u32 version, window;
+
+  log_msg( "server_hello: request handler starting\n" );
+  if( remotefs_hello_read_request( p, &version, &window ) == ELUARPC_ERR )
+  {
+    log_msg( "server_hello: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_hello: client version = %u, window = %u\n", ( unsigned )version, ( unsigned )window );
+  if( window > SERVER_MAX_WINDOW )
+    window = SERVER_MAX_WINDOW;
+  server_crt->version = version < RFS_PROTOCOL_VERSION ? version : RFS_PROTOCOL_VERSION;
+  server_crt->window = window;
+  // v3 clients also get the capabilities of the server
+  if( version >= 3 )
+    remotefs_hello_write_response_v3( p, RFS_PROTOCOL_VERSION, window, SERVER_CAPS );
+  else
+    remotefs_hello_write_response( p, version, window );
+  return SERVER_OK;
+}
+
+static int server_bufsize( u8 *p )
+{
+  u32 size;
+
+  log_msg( "server_bufsize: request handler starting\n" );
+  if( remotefs_bufsize_read_request( p, &size ) == ELUARPC_ERR )
+  {
+    log_msg( "server_bufsize: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  // Every packet fits in the transport buffers, so there's nothing to keep
+  // in the session
+  if( size > SERVER_MAX_PACKET_SIZE )
+    size = SERVER_MAX_PACKET_SIZE;
+  log_msg( "server_bufsize: packets of up to %u bytes\n", ( unsigned )size );
+  remotefs_bufsize_write_response( p, size );
+  return SERVER_OK;
+}
+
+static int server_stat( u8 *p )
+{
+  const char *name;
+  u32 size = 0, mtime = 0;
+  int isdir = 0, res = -1;
+
+  log_msg( "server_stat: request handler starting\n" );
+  if( remotefs_stat_read_request( p, &name ) == ELUARPC_ERR )
+  {
+    log_msg( "server_stat: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  if( server_get_fullname( server_fullname, name ) )
+    res = os_stat( server_fullname, &size, &mtime, &isdir );
+  log_msg( "server_stat: %s, OS response is %d (size = %u, dir = %d)\n", server_fullname, res, ( unsigned )size, isdir );
+  remotefs_stat_write_response( p, res, size, mtime, isdir );
+  return SERVER_OK;
+}
+
+static int server_unlink( u8 *p )
+{
+  const char *name;
+  int res = -1;
+
+  log_msg( "server_unlink: request handler starting\n" );
+  if( remotefs_unlink_read_request( p, &name ) == ELUARPC_ERR )
+  {
+    log_msg( "server_unlink: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  if( server_get_fullname( server_fullname, name ) )
+    res = os_unlink( server_fullname );
+  log_msg( "server_unlink: %s, OS response is %d\n", server_fullname, res );
+  remotefs_unlink_write_response( p, res );
+  return SERVER_OK;
+}
+
+static int server_rename( u8 *p )
+{
+  const char *oldname, *newname;
+  int res = -1;
+
+  log_msg( "server_rename: request handler starting\n" );
+  if( remotefs_rename_read_request( p, &oldname, &newname ) == ELUARPC_ERR )
+  {
+    log_msg( "server_rename: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  if( server_get_fullname( server_fullname, oldname ) && server_get_fullname( server_newname, newname ) )
+    res = os_rename( server_fullname, server_newname );
+  log_msg( "server_rename: %s to %s, OS response is %d\n", server_fullname, server_newname, res );
+  remotefs_rename_write_response( p, res );
+  return SERVER_OK;
+}
+
+static int server_mkdir( u8 *p )
+{
+  const char *name;
+  int mode, res = -1;
+
+  log_msg( "server_mkdir: request handler starting\n" );
+  if( remotefs_mkdir_read_request( p, &name, &mode ) == ELUARPC_ERR )
+  {
+    log_msg( "server_mkdir: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  if( server_get_fullname( server_fullname, name ) )
+    res = os_mkdir( server_fullname, mode );
+  log_msg( "server_mkdir: %s, OS response is %d\n", server_fullname, res );
+  remotefs_mkdir_write_response( p, res );
   return SERVER_OK;
 }
 
@@ -214,20 +761,101 @@ static int server_closedir( u8 *p )
 
 static const p_server_handler server_handlers[] = 
 { 
-  server_open, server_write, server_read, server_close, server_lseek, server_opendir, server_readdir, server_closedir
+  server_open, server_write, server_read, server_close, server_lseek, server_opendir, server_readdir, server_closedir,
+  server_hello, server_readdir_batch, server_stat, server_unlink, server_rename, server_mkdir, server_readz, server_writez,
+  server_bufsize
 };
 
 void server_setup( const char* basedir )
 {
+  unsigned i;
+
   server_basedir = strdup( basedir );
+  for( i = 0; i < SERVER_MAX_SESSIONS; i ++ )
+    server_session_close( server_sessions + i );
+  for( i = 0; i < SERVER_FD_CACHE_SIZE; i ++ )
+    server_fd_cache[ i ].osfd = -1;
+  server_crt = NULL;
 }
 
 void server_cleanup()
 {
+  unsigned i;
+
+  for( i = 0; i < SERVER_MAX_SESSIONS; i ++ )
+    if( server_sessions[ i ].used )
+      server_session_close( server_sessions + i );
+  for( i = 0; i < SERVER_FD_CACHE_SIZE; i ++ )
+    if( server_fd_cache[ i ].osfd != -1 )
+    {
+      os_close( server_fd_cache[ i ].osfd );
+      free( server_fd_cache[ i ].name );
+      server_fd_cache[ i ].name = NULL;
+      server_fd_cache[ i ].osfd = -1;
+    }
   free( server_basedir );
   server_basedir = NULL;
 }
 
+// Select the session of the client that sent the next request ('key' is its
+// transport address, transports with a single client can use an empty key).
+// A new session is started for a new client.
+void server_set_client( const void *key, unsigned keylen )
+{
+  SERVER_SESSION *ps, *pfree = NULL;
+  unsigned i;
+
+  if( keylen > SERVER_MAX_KEY_SIZE )
+    keylen = SERVER_MAX_KEY_SIZE;
+  for( i = 0; i < SERVER_MAX_SESSIONS; i ++ )
+  {
+    ps = server_sessions + i;
+    if( ps->used && ps->keylen == keylen && !memcmp( ps->key, key, keylen ) )
+    {
+      ps->stamp = ++ server_stamp;
+      server_crt = ps;
+      return;
+    }
+    if( pfree == NULL || !ps->used || ( pfree->used && ps->stamp < pfree->stamp ) )
+      pfree = ps;
+  }
+  if( pfree->used )
+  {
+    log_msg( "server_set_client: too many clients, dropping session %d\n", ( int )( pfree - server_sessions ) );
+    server_session_close( pfree );
+  }
+  log_msg( "server_set_client: new session %d\n", ( int )( pfree - server_sessions ) );
+  memcpy( pfree->key, key, keylen );
+  pfree->keylen = keylen;
+  pfree->used = 1;
+  pfree->version = 1;
+  pfree->stamp = ++ server_stamp;
+  server_crt = pfree;
+}
+
+// Drop the session of a client that went away (for example a closed TCP
+// connection), closing its files
+void server_drop_client( const void *key, unsigned keylen )
+{
+  SERVER_SESSION *ps;
+  unsigned i;
+
+  if( keylen > SERVER_MAX_KEY_SIZE )
+    keylen = SERVER_MAX_KEY_SIZE;
+  for( i = 0; i < SERVER_MAX_SESSIONS; i ++ )
+  {
+    ps = server_sessions + i;
+    if( ps->used && ps->keylen == keylen && !memcmp( ps->key, key, keylen ) )
+    {
+      log_msg( "server_drop_client: closing session %d\n", ( int )i );
+      if( server_crt == ps )
+        server_crt = NULL;
+      server_session_close( ps );
+      return;
+    }
+  }
+}
+
 int server_execute_request( u8 *pdata )
 {
   u8 req;
@@ -238,7 +866,14 @@ int server_execute_request( u8 *pdata )
     printf( "server_execute_request: invalid request ID!\n" );
     return SERVER_ERR;
   }
-  log_msg( "server_execute_request: got request with ID %d\n", req );
+  // v2 requests have a sequence number, the response must have the same one
+  server_seq = eluarpc_get_seq( pdata );
+  eluarpc_set_seq( server_seq );
+  // The response has the encoding of the request (v1 clients get v1 packets)
+  eluarpc_set_encoding( eluarpc_get_encoding( pdata ) );
+  log_msg( "server_execute_request: got request with ID %d (seq %d)\n", req, server_seq );
+  if( server_crt == NULL )
+    server_set_client( NULL, 0 );
   if( req >= RFS_OP_FIRST && req <= RFS_OP_LAST ) 
     return server_handlers[ req - RFS_OP_FIRST ]( pdata );
   else
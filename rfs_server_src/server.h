@@ -9,9 +9,16 @@
 #define SERVER_OK     0
 #define SERVER_ERR    1
 
+// Largest packet accepted from a client that asks for large packets (the
+// transports need a buffer of SERVER_MAX_PACKET_SIZE + ELUARPC_WRITE_REQUEST_EXTRA
+// bytes)
+#define SERVER_MAX_PACKET_SIZE  16384
+
 // Server function                     
 void server_setup( const char *basedir );
 void server_cleanup();
+void server_set_client( const void *key, unsigned keylen );
+void server_drop_client( const void *key, unsigned keylen );
 int server_execute_request( u8 *pdata );
 
 #endif
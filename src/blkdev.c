@@ -0,0 +1,294 @@
+// Block device layer between the file systems and the disk drivers (blkdev.h)
+
+#include "platform_conf.h"
+#ifdef BUILD_MMCFS
+
+#include "blkdev.h"
+#include "ffconf.h"
+#include "diskio.h"
+#define DISKCACHE_DRIVER
+#include "diskcache.h"
+#include <string.h>
+
+// Default configuration (can be overriden in platform_conf.h)
+// Maximum number of sectors in the write queue (0 writes through)
+#ifndef BLKDEV_QUEUE_SECTORS
+#define BLKDEV_QUEUE_SECTORS      4
+#endif
+
+// Number of sectors read ahead when a sequential run is detected (0 disables
+// the read ahead)
+#ifndef BLKDEV_READAHEAD_SECTORS
+#define BLKDEV_READAHEAD_SECTORS  4
+#endif
+
+// Block devices of the FatFs drives
+#ifndef BLKDEV_DRIVES
+#ifdef BUILD_NANDFTL
+#define BLKDEV_DRIVES             { &mmc_blkdev, &nand_blkdev }
+#else
+#define BLKDEV_DRIVES             { &mmc_blkdev }
+#endif
+#endif
+
+#if BLKDEV_QUEUE_SECTORS > 255 || BLKDEV_READAHEAD_SECTORS > 255
+#error "The block layer buffers can have at most 255 sectors"
+#endif
+
+#define BLKDEV_SECTOR_SIZE        _MAX_SS
+#define BLKDEV_NONE               0xFF
+#define BLKDEV_NO_SECTOR          0xFFFFFFFFUL
+
+static const BLKDEV* const bd_drives[] = BLKDEV_DRIVES;
+#define BLKDEV_NUM_DRIVES         ( sizeof( bd_drives ) / sizeof( BLKDEV* ) )
+
+// The write queue and the read ahead buffer can live at a fixed address
+// (usually in external RAM) or in the data section
+#ifdef BLKDEV_START_ADDRESS
+#define bd_data                   ( ( BYTE* )( BLKDEV_START_ADDRESS ) )
+#else
+// Word aligned, some drivers transfer words
+static DWORD bd_buffers[ ( BLKDEV_QUEUE_SECTORS + BLKDEV_READAHEAD_SECTORS ) * BLKDEV_SECTOR_SIZE / 4 + 1 ];
+#define bd_data                   ( ( BYTE* )bd_buffers )
+#endif
+#define bd_queue                  bd_data
+#define bd_ra                     ( bd_data + BLKDEV_QUEUE_SECTORS * BLKDEV_SECTOR_SIZE )
+
+// Write queue (consecutive sectors of a single drive)
+static BYTE bd_q_drv = BLKDEV_NONE;
+static DWORD bd_q_sector;
+static BYTE bd_q_count;
+
+// Read ahead buffer
+static BYTE bd_ra_drv = BLKDEV_NONE;
+static DWORD bd_ra_sector;
+static BYTE bd_ra_count;
+
+// Per drive state: end of the last read request and size of the disk
+static DWORD bd_last_end[ BLKDEV_NUM_DRIVES ];
+static DWORD bd_sectors[ BLKDEV_NUM_DRIVES ];
+static BLKDEV_STATS bd_stats;
+
+// ****************************************************************************
+// Helpers
+
+static const BLKDEV* bdh_get_dev( BYTE drv )
+{
+  return drv < BLKDEV_NUM_DRIVES ? bd_drives[ drv ] : NULL;
+}
+
+static int bdh_overlap( DWORD s1, DWORD c1, DWORD s2, DWORD c2 )
+{
+  return s1 < s2 + c2 && s2 < s1 + c1;
+}
+
+// Helper: read from the device (splitting the request if needed)
+static DRESULT bdh_read( BYTE drv, BYTE *buff, DWORD sector, BYTE count )
+{
+  const BLKDEV *pdev = bd_drives[ drv ];
+  BYTE chunk, max = pdev->max_count ? pdev->max_count : 255;
+
+  for( ; count; count -= chunk, sector += chunk, buff += chunk * BLKDEV_SECTOR_SIZE )
+  {
+    chunk = count < max ? count : max;
+    bd_stats.dev_reads ++;
+    if( pdev->read( buff, sector, chunk ) != RES_OK )
+      return RES_ERROR;
+  }
+  return RES_OK;
+}
+
+// Helper: write to the device (splitting the request if needed)
+static DRESULT bdh_write( BYTE drv, const BYTE *buff, DWORD sector, BYTE count )
+{
+  const BLKDEV *pdev = bd_drives[ drv ];
+  BYTE chunk, max = pdev->max_count ? pdev->max_count : 255;
+  DRESULT res;
+
+  if( pdev->write == NULL )
+    return RES_WRPRT;
+  for( ; count; count -= chunk, sector += chunk, buff += chunk * BLKDEV_SECTOR_SIZE )
+  {
+    chunk = count < max ? count : max;
+    bd_stats.dev_writes ++;
+    if( ( res = pdev->write( buff, sector, chunk ) ) != RES_OK )
+      return res;
+  }
+  return RES_OK;
+}
+
+// Helper: write the queued sectors
+static DRESULT bdh_flush()
+{
+  BYTE drv = bd_q_drv;
+
+  if( drv == BLKDEV_NONE )
+    return RES_OK;
+  bd_q_drv = BLKDEV_NONE;
+  return bdh_write( drv, bd_queue, bd_q_sector, bd_q_count );
+}
+
+// Helper: write the queue if it has some of the given sectors
+static DRESULT bdh_flush_range( BYTE drv, DWORD sector, DWORD count )
+{
+  if( bd_q_drv == drv && bdh_overlap( bd_q_sector, bd_q_count, sector, count ) )
+    return bdh_flush();
+  return RES_OK;
+}
+
+// ****************************************************************************
+// FatFs disk interface
+
+DSTATUS disk_initialize( BYTE drv )
+{
+  const BLKDEV *pdev = bdh_get_dev( drv );
+  DSTATUS stat;
+
+  if( pdev == NULL )
+    return STA_NOINIT;
+  // A new medium might have been inserted, the queued writes were meant for
+  // the old one
+  if( bd_q_drv == drv )
+    bd_q_drv = BLKDEV_NONE;
+  if( bd_ra_drv == drv )
+    bd_ra_drv = BLKDEV_NONE;
+  bd_last_end[ drv ] = BLKDEV_NO_SECTOR;
+  bd_sectors[ drv ] = 0;
+  stat = pdev->init();
+  if( ( stat & STA_NOINIT ) == 0 && pdev->ioctl( GET_SECTOR_COUNT, bd_sectors + drv ) != RES_OK )
+    bd_sectors[ drv ] = 0;
+  return stat;
+}
+
+DSTATUS disk_status( BYTE drv )
+{
+  const BLKDEV *pdev = bdh_get_dev( drv );
+
+  return pdev ? pdev->status() : STA_NOINIT;
+}
+
+DRESULT disk_read( BYTE drv, BYTE *buff, DWORD sector, BYTE count )
+{
+  int seq;
+#if BLKDEV_READAHEAD_SECTORS > 0
+  DWORD ra;
+#endif
+
+  if( bdh_get_dev( drv ) == NULL || count == 0 )
+    return RES_PARERR;
+  bd_stats.reads ++;
+  seq = sector == bd_last_end[ drv ];
+  bd_last_end[ drv ] = sector + count;
+  // Queued writes must reach the device before their sectors are read
+  if( bdh_flush_range( drv, sector, count ) != RES_OK )
+    return RES_ERROR;
+  if( bd_ra_drv == drv && sector >= bd_ra_sector && sector + count <= bd_ra_sector + bd_ra_count )
+  {
+    memcpy( buff, bd_ra + ( sector - bd_ra_sector ) * BLKDEV_SECTOR_SIZE, count * BLKDEV_SECTOR_SIZE );
+    bd_stats.ra_hits += count;
+    return RES_OK;
+  }
+#if BLKDEV_READAHEAD_SECTORS > 0
+  // A small read that continues the previous one: read the following
+  // sectors too (but not past the end of the disk)
+  ra = BLKDEV_READAHEAD_SECTORS;
+  if( sector + ra > bd_sectors[ drv ] )
+    ra = sector < bd_sectors[ drv ] ? bd_sectors[ drv ] - sector : 0;
+  if( seq && count < ra )
+  {
+    bd_ra_drv = BLKDEV_NONE;
+    if( bdh_flush_range( drv, sector, ra ) != RES_OK )
+      return RES_ERROR;
+    bd_stats.ra_fills ++;
+    if( bdh_read( drv, bd_ra, sector, ( BYTE )ra ) == RES_OK )
+    {
+      bd_ra_drv = drv;
+      bd_ra_sector = sector;
+      bd_ra_count = ( BYTE )ra;
+      memcpy( buff, bd_ra, count * BLKDEV_SECTOR_SIZE );
+      return RES_OK;
+    }
+    // The read ahead failed, try to read only what was asked for
+  }
+#endif
+  return bdh_read( drv, buff, sector, count );
+}
+
+DRESULT disk_write( BYTE drv, const BYTE *buff, DWORD sector, BYTE count )
+{
+  DWORD i;
+
+  if( bdh_get_dev( drv ) == NULL || count == 0 )
+    return RES_PARERR;
+  bd_stats.writes ++;
+  // Keep the read ahead buffer up to date
+  if( bd_ra_drv == drv )
+    for( i = 0; i < count; i ++ )
+      if( sector + i - bd_ra_sector < bd_ra_count )
+        memcpy( bd_ra + ( sector + i - bd_ra_sector ) * BLKDEV_SECTOR_SIZE, buff + i * BLKDEV_SECTOR_SIZE, BLKDEV_SECTOR_SIZE );
+#if BLKDEV_QUEUE_SECTORS > 0
+  if( count <= BLKDEV_QUEUE_SECTORS && bd_drives[ drv ]->write )
+  {
+    if( bd_q_drv == drv && sector >= bd_q_sector && sector + count <= bd_q_sector + bd_q_count )
+    {
+      // Rewrite of queued sectors
+      memcpy( bd_queue + ( sector - bd_q_sector ) * BLKDEV_SECTOR_SIZE, buff, count * BLKDEV_SECTOR_SIZE );
+      bd_stats.merged ++;
+      return RES_OK;
+    }
+    if( bd_q_drv == drv && sector == bd_q_sector + bd_q_count && bd_q_count + count <= BLKDEV_QUEUE_SECTORS )
+    {
+      // The request extends the queue
+      memcpy( bd_queue + bd_q_count * BLKDEV_SECTOR_SIZE, buff, count * BLKDEV_SECTOR_SIZE );
+      bd_q_count += count;
+      bd_stats.merged ++;
+      return RES_OK;
+    }
+    if( bdh_flush() != RES_OK )
+      return RES_ERROR;
+    memcpy( bd_queue, buff, count * BLKDEV_SECTOR_SIZE );
+    bd_q_drv = drv;
+    bd_q_sector = sector;
+    bd_q_count = count;
+    return RES_OK;
+  }
+#endif
+  if( bdh_flush_range( drv, sector, count ) != RES_OK )
+    return RES_ERROR;
+  return bdh_write( drv, buff, sector, count );
+}
+
+DRESULT disk_ioctl( BYTE drv, BYTE ctrl, void *buff )
+{
+  const BLKDEV *pdev = bdh_get_dev( drv );
+
+  if( pdev == NULL )
+    return RES_PARERR;
+  // The queue is written when the file system syncs (a failed write of the
+  // queue is reported here)
+  if( ctrl == CTRL_SYNC && bd_q_drv == drv && bdh_flush() != RES_OK )
+    return RES_ERROR;
+  return pdev->ioctl( ctrl, buff );
+}
+
+// ****************************************************************************
+// Public interface
+
+void blkdev_get_stats( BLKDEV_STATS *pstats, int reset )
+{
+  memcpy( pstats, &bd_stats, sizeof( BLKDEV_STATS ) );
+  if( reset )
+    memset( &bd_stats, 0, sizeof( BLKDEV_STATS ) );
+}
+
+#else // #ifdef BUILD_MMCFS
+
+#include "blkdev.h"
+#include <string.h>
+
+void blkdev_get_stats( BLKDEV_STATS *pstats, int reset )
+{
+  memset( pstats, 0, sizeof( BLKDEV_STATS ) );
+}
+
+#endif // #ifdef BUILD_MMCFS
@@ -6,15 +6,34 @@
 #include "buf.h"
 #include "elua_int.h"
 #include "sermux.h"
+#include "eluarpc.h"
 
 // ****************************************************************************
 // UART functions
 
 #ifdef BUILD_SERMUX
+#ifdef SERMUX_PROTOCOL_V2
+// Framed protocol (see sermux.h). The interrupt handler assembles the frames
+// and writes their data to the virtual UART buffers. The frames are sent by
+// the application code (send and receive functions), so the interrupt
+// handler never waits for the physical UART.
+static u8 v2_rx_frame[ SERMUX_V2_MAX_PAYLOAD + 4 ]; // channel, length, payload, CRC
+static u8 v2_rx_pos, v2_rx_active;
+// Data waiting to be sent on every virtual UART and the credits for it
+static u8 v2_tx_data[ SERMUX_NUM_VUART ][ SERMUX_V2_MAX_PAYLOAD ];
+static u8 v2_tx_size[ SERMUX_NUM_VUART ];
+static volatile u16 v2_tx_credits[ SERMUX_NUM_VUART ];
+// Data read from the virtual UART buffers and not returned in a CREDIT yet
+static u16 v2_rx_consumed[ SERMUX_NUM_VUART ];
+// Handshake: nothing is sent until the HELLO that answers our SYNC comes
+static volatile u8 v2_waiting = 1, v2_sync_pending = 1, v2_hello_pending;
+static volatile u8 v2_sync_token, v2_hello_token;
+#else // #ifdef SERMUX_PROTOCOL_V2
 int uart_service_id_in = -1;
 int uart_service_id_out = -1;
 u8 uart_got_esc = 0;
 int uart_last_sent = -1;
+#endif // #ifdef SERMUX_PROTOCOL_V2
 // [TODO] add interrupt support for virtual UARTs
 #else // #ifdef BUILD_SERMUX
 #define SERMUX_PHYS_ID        ( 0xFFFF )
@@ -30,12 +49,173 @@ int platform_uart_exists( unsigned id )
 #endif // #ifdef BUILD_SERMUX
 }
 
+#ifdef SERMUX_PROTOCOL_V2
+static void cmn_v2_send_frame( u8 channel, const u8 *p, u8 len )
+{
+  u8 header[ 2 ];
+  u16 crc;
+
+  header[ 0 ] = channel;
+  header[ 1 ] = len;
+  crc = eluarpc_crc16( eluarpc_crc16( ELUARPC_CRC_INIT, header, 2 ), p, len );
+  platform_s_uart_send( SERMUX_PHYS_ID, SERMUX_V2_SOF );
+  platform_s_uart_send( SERMUX_PHYS_ID, channel );
+  platform_s_uart_send( SERMUX_PHYS_ID, len );
+  while( len -- )
+    platform_s_uart_send( SERMUX_PHYS_ID, *p ++ );
+  platform_s_uart_send( SERMUX_PHYS_ID, crc & 0xFF );
+  platform_s_uart_send( SERMUX_PHYS_ID, crc >> 8 );
+}
+
+// Send the control frames requested by the interrupt handler and return the
+// credits for the data read from the virtual UART buffers
+static void cmn_v2_poll()
+{
+  u8 frame[ 3 + 2 * SERMUX_NUM_VUART ];
+  unsigned i, free;
+
+  if( v2_hello_pending )
+  {
+    v2_hello_pending = 0;
+    frame[ 0 ] = SERMUX_V2_HELLO;
+    frame[ 1 ] = v2_hello_token;
+    frame[ 2 ] = SERMUX_NUM_VUART;
+    for( i = 0; i < SERMUX_NUM_VUART; i ++ )
+    {
+      free = buf_get_size( BUF_ID_UART, SERMUX_SERVICE_ID_FIRST + i ) - buf_get_count( BUF_ID_UART, SERMUX_SERVICE_ID_FIRST + i );
+      frame[ 3 + 2 * i ] = free & 0xFF;
+      frame[ 4 + 2 * i ] = free >> 8;
+      v2_rx_consumed[ i ] = 0;
+    }
+    cmn_v2_send_frame( SERMUX_V2_CTRL_CHANNEL, frame, 3 + 2 * SERMUX_NUM_VUART );
+  }
+  if( v2_sync_pending )
+  {
+    v2_waiting = 1;
+    frame[ 0 ] = SERMUX_V2_SYNC;
+    frame[ 1 ] = ++ v2_sync_token;
+    v2_sync_pending = 0;
+    cmn_v2_send_frame( SERMUX_V2_CTRL_CHANNEL, frame, 2 );
+  }
+  for( i = 0; i < SERMUX_NUM_VUART; i ++ )
+    if( v2_rx_consumed[ i ] > 0 && v2_rx_consumed[ i ] >= buf_get_size( BUF_ID_UART, SERMUX_SERVICE_ID_FIRST + i ) / 2 )
+    {
+      frame[ 0 ] = SERMUX_V2_CREDIT;
+      frame[ 1 ] = i;
+      frame[ 2 ] = v2_rx_consumed[ i ] & 0xFF;
+      frame[ 3 ] = v2_rx_consumed[ i ] >> 8;
+      v2_rx_consumed[ i ] = 0;
+      cmn_v2_send_frame( SERMUX_V2_CTRL_CHANNEL, frame, 4 );
+    }
+}
+
+// Send the data waiting for a virtual UART (waits for the credits)
+static void cmn_v2_flush( unsigned channel )
+{
+  u8 size = v2_tx_size[ channel ];
+  int old_status;
+
+  if( size == 0 )
+    return;
+  while( v2_waiting || v2_tx_credits[ channel ] < size )
+    cmn_v2_poll();
+  old_status = platform_cpu_set_global_interrupts( PLATFORM_CPU_DISABLE );
+  v2_tx_credits[ channel ] -= size;
+  platform_cpu_set_global_interrupts( old_status );
+  cmn_v2_send_frame( channel, v2_tx_data[ channel ], size );
+  v2_tx_size[ channel ] = 0;
+}
+
+// Receive from a virtual UART. The data waiting on all the virtual UARTs is
+// sent first, as the other side might need it before it can answer.
+static int cmn_v2_recv( unsigned id, s32 timeout )
+{
+  t_buf_data data;
+  unsigned i;
+
+  for( i = 0; i < SERMUX_NUM_VUART; i ++ )
+    cmn_v2_flush( i );
+  while( 1 )
+  {
+    cmn_v2_poll();
+    if( buf_read( BUF_ID_UART, id, &data ) != PLATFORM_UNDERFLOW )
+    {
+      v2_rx_consumed[ id - SERMUX_SERVICE_ID_FIRST ] ++;
+      cmn_v2_poll();
+      return ( int )data;
+    }
+    if( timeout == 0 )
+      return -1;
+  }
+}
+
+// A frame was received (called from the interrupt handler)
+static void cmn_v2_frame( u8 channel, const u8 *p, u8 len )
+{
+  unsigned i;
+
+  if( channel < SERMUX_NUM_VUART )
+  {
+    for( i = 0; i < len; i ++ )
+      buf_write( BUF_ID_UART, SERMUX_SERVICE_ID_FIRST + channel, ( t_buf_data* )( p + i ) );
+  }
+  else if( channel == SERMUX_V2_CTRL_CHANNEL && len >= 2 )
+  {
+    if( p[ 0 ] == SERMUX_V2_SYNC )
+    {
+      v2_hello_token = p[ 1 ];
+      v2_hello_pending = 1;
+      if( v2_waiting )
+        v2_sync_pending = 1;
+    }
+    else if( p[ 0 ] == SERMUX_V2_HELLO && len >= 3 && v2_waiting && !v2_sync_pending && p[ 1 ] == v2_sync_token )
+    {
+      for( i = 0; i < SERMUX_NUM_VUART; i ++ )
+        v2_tx_credits[ i ] = i < p[ 2 ] && len >= 5 + 2 * i ? p[ 3 + 2 * i ] | ( ( u16 )p[ 4 + 2 * i ] << 8 ) : 0;
+      v2_waiting = 0;
+    }
+    else if( p[ 0 ] == SERMUX_V2_CREDIT && len >= 4 && p[ 1 ] < SERMUX_NUM_VUART )
+      v2_tx_credits[ p[ 1 ] ] += p[ 2 ] | ( ( u16 )p[ 3 ] << 8 );
+  }
+}
+
+// Frame receiver: a bad frame is dropped and the credits are synchronized again
+static void cmn_v2_rx_handler( u8 data )
+{
+  if( !v2_rx_active )
+  {
+    if( data == SERMUX_V2_SOF )
+      v2_rx_active = 1;
+    v2_rx_pos = 0;
+    return;
+  }
+  v2_rx_frame[ v2_rx_pos ++ ] = data;
+  if( v2_rx_pos == 2 && data > SERMUX_V2_MAX_PAYLOAD )
+  {
+    v2_rx_active = 0;
+    v2_sync_pending = 1;
+  }
+  else if( v2_rx_pos > 2 && v2_rx_pos == v2_rx_frame[ 1 ] + 4 )
+  {
+    v2_rx_active = 0;
+    if( eluarpc_crc16( ELUARPC_CRC_INIT, v2_rx_frame, v2_rx_pos - 2 ) == ( v2_rx_frame[ v2_rx_pos - 2 ] | ( ( u16 )v2_rx_frame[ v2_rx_pos - 1 ] << 8 ) ) )
+      cmn_v2_frame( v2_rx_frame[ 0 ], v2_rx_frame + 2, v2_rx_frame[ 1 ] );
+    else
+      v2_sync_pending = 1;
+  }
+}
+#endif // #ifdef SERMUX_PROTOCOL_V2
+
 // Helper function for buffers
 static int cmn_recv_helper( unsigned id, s32 timeout )
 {
 #ifdef BUF_ENABLE_UART
   t_buf_data data;
   
+#ifdef SERMUX_PROTOCOL_V2
+  if( id >= SERMUX_SERVICE_ID_FIRST )
+    return cmn_v2_recv( id, timeout );
+#endif // #ifdef SERMUX_PROTOCOL_V2
   if( buf_is_enabled( BUF_ID_UART, id ) )
   {
     if( timeout == 0 )
@@ -84,6 +264,9 @@ static void cmn_rx_handler( int usart_id, u8 data )
 #ifdef BUILD_SERMUX
   if( usart_id == SERMUX_PHYS_ID )
   {
+#ifdef SERMUX_PROTOCOL_V2
+    cmn_v2_rx_handler( data );
+#else // #ifdef SERMUX_PROTOCOL_V2
     if( data != SERMUX_ESCAPE_CHAR )
     {
       if( ( data >= SERMUX_SERVICE_ID_FIRST ) && data < ( SERMUX_SERVICE_ID_FIRST + SERMUX_NUM_VUART ) )
@@ -113,6 +296,7 @@ static void cmn_rx_handler( int usart_id, u8 data )
     }
     else
       uart_got_esc = 1;
+#endif // #ifdef SERMUX_PROTOCOL_V2
   }
   else
 #endif // #ifdef BUILD_SERMUX
@@ -125,6 +309,13 @@ void platform_uart_send( unsigned id, u8 data )
 #ifdef BUILD_SERMUX
   if( id >= SERMUX_SERVICE_ID_FIRST && id < SERMUX_SERVICE_ID_FIRST + SERMUX_NUM_VUART )
   {
+#ifdef SERMUX_PROTOCOL_V2
+    // The data goes in a frame, sent when it's full or at the end of a line
+    id -= SERMUX_SERVICE_ID_FIRST;
+    v2_tx_data[ id ][ v2_tx_size[ id ] ++ ] = data;
+    if( v2_tx_size[ id ] == SERMUX_V2_MAX_PAYLOAD || data == '\n' )
+      cmn_v2_flush( id );
+#else // #ifdef SERMUX_PROTOCOL_V2
     if( id != uart_service_id_out )
       platform_s_uart_send( SERMUX_PHYS_ID, id );
     uart_last_sent = data;
@@ -137,6 +328,7 @@ void platform_uart_send( unsigned id, u8 data )
     else
       platform_s_uart_send( SERMUX_PHYS_ID, data );
     uart_service_id_out = id;
+#endif // #ifdef SERMUX_PROTOCOL_V2
   }
   else
 #endif // #ifdef BUILD_SERMUX
@@ -0,0 +1,252 @@
+// eLua asynchronous file I/O
+
+#include "platform_conf.h"
+#ifdef BUILD_AIO
+
+#include "elua_aio.h"
+#include "elua_int.h"
+#include "platform.h"
+#include "type.h"
+#include "utils.h"
+#include <reent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef BUILD_LUA_INT_HANDLERS
+#error "BUILD_AIO needs BUILD_LUA_INT_HANDLERS"
+#endif
+
+#ifndef INT_AIO_DONE
+#error "BUILD_AIO needs the INT_AIO_DONE interrupt"
+#endif
+
+// Default configuration (can be overriden in platform_conf.h)
+// Maximum number of requests (at most 16)
+#ifndef AIO_MAX_REQUESTS
+#define AIO_MAX_REQUESTS      8
+#endif
+
+// Maximum number of bytes transferred in a single step
+#ifndef AIO_CHUNK_SIZE
+#define AIO_CHUNK_SIZE        512
+#endif
+
+// Number of Lua VM instructions between two steps of the executor
+#ifndef AIO_PUMP_INTERVAL
+#define AIO_PUMP_INTERVAL     100
+#endif
+
+#if AIO_MAX_REQUESTS > 16
+#error "AIO_MAX_REQUESTS must be at most 16"
+#endif
+
+// A request ID is the request index plus a sequence number, so that stale IDs
+// aren't mistaken for new requests in the same slot
+#define AIO_IDX_BITS          4
+#define AIO_ID_TO_IDX( id )   ( ( id ) & ( ( 1 << AIO_IDX_BITS ) - 1 ) )
+#define AIO_MAKE_ID( idx, seq ) ( ( ( seq ) << AIO_IDX_BITS ) | ( idx ) )
+#define AIO_SEQ_MASK          ( 0x7FFF >> AIO_IDX_BITS )
+
+typedef struct
+{
+  u8 *buf;
+  u32 len;
+  u32 offset;
+  u32 done;
+  int fd;
+  int err;
+  u16 seq;
+  u8 op;
+  u8 state;
+} AIO_REQUEST;
+
+static AIO_REQUEST aio_requests[ AIO_MAX_REQUESTS ];
+static unsigned aio_next;               // next request served by the executor
+static unsigned aio_pending;            // number of queued requests
+static u16 aio_seq;
+
+// Helper: return the request for an ID (NULL if the ID is not valid)
+static AIO_REQUEST* aioh_get_request( int id )
+{
+  AIO_REQUEST *preq;
+
+  if( id < 0 || AIO_ID_TO_IDX( id ) >= AIO_MAX_REQUESTS )
+    return NULL;
+  preq = aio_requests + AIO_ID_TO_IDX( id );
+  if( preq->state == AIO_STATE_FREE || preq->seq != ( id >> AIO_IDX_BITS ) )
+    return NULL;
+  return preq;
+}
+
+// Helper: mark a request as finished and notify Lua
+static void aioh_finish( AIO_REQUEST *preq )
+{
+  preq->state = AIO_STATE_DONE;
+  aio_pending --;
+  elua_int_add( INT_AIO_DONE, AIO_MAKE_ID( preq - aio_requests, preq->seq ) );
+}
+
+// Helper: execute one step of the given request
+static void aioh_step( AIO_REQUEST *preq )
+{
+  u32 chunk = UMIN( preq->len - preq->done, AIO_CHUNK_SIZE );
+  _ssize_t res;
+  _off_t pos;
+
+  _REENT->_errno = 0;
+  // Every step seeks explicitly, so synchronous operations on the same file
+  // between two steps don't corrupt the request. The file position is put
+  // back after the step, so the steps don't move it under the synchronous
+  // code either.
+  if( ( pos = _lseek_r( _REENT, preq->fd, 0, SEEK_CUR ) ) == -1 ||
+      _lseek_r( _REENT, preq->fd, preq->offset + preq->done, SEEK_SET ) == -1 )
+    res = -1;
+  else if( preq->op == AIO_OP_READ )
+    res = _read_r( _REENT, preq->fd, preq->buf + preq->done, chunk );
+  else
+    res = _write_r( _REENT, preq->fd, preq->buf + preq->done, chunk );
+  if( res < 0 )
+    preq->err = _REENT->_errno ? _REENT->_errno : EIO;
+  else
+    preq->done += res;
+  if( pos != -1 )
+    _lseek_r( _REENT, preq->fd, pos, SEEK_SET );
+  if( res <= 0 || preq->done == preq->len )
+    aioh_finish( preq );
+}
+
+// Helper: execute one step of the next queued request (round robin)
+static void aioh_run_next()
+{
+  unsigned i;
+
+  for( i = 0; i < AIO_MAX_REQUESTS; i ++ )
+  {
+    aio_next = ( aio_next + 1 ) % AIO_MAX_REQUESTS;
+    if( aio_requests[ aio_next ].state == AIO_STATE_QUEUED )
+    {
+      aioh_step( aio_requests + aio_next );
+      break;
+    }
+  }
+}
+
+// The executor (runs from the Lua hook)
+static void aio_service()
+{
+  if( aio_pending == 0 )
+    return;
+  aioh_run_next();
+  if( aio_pending > 0 )
+    elua_int_request_service( AIO_PUMP_INTERVAL );
+}
+
+// ****************************************************************************
+// Public interface
+
+void aio_init()
+{
+  memset( aio_requests, 0, sizeof( aio_requests ) );
+  aio_pending = 0;
+  elua_int_set_service( aio_service );
+}
+
+// Queue a new request
+// Returns the request ID or -1 if there are too many requests
+int aio_submit( int op, int fd, void *buf, u32 len, u32 offset )
+{
+  unsigned i;
+  AIO_REQUEST *preq;
+
+  for( i = 0; i < AIO_MAX_REQUESTS; i ++ )
+    if( aio_requests[ i ].state == AIO_STATE_FREE )
+      break;
+  if( i == AIO_MAX_REQUESTS )
+    return -1;
+  preq = aio_requests + i;
+  preq->buf = buf;
+  preq->len = len;
+  preq->offset = offset;
+  preq->done = 0;
+  preq->fd = fd;
+  preq->err = 0;
+  preq->op = op;
+  preq->seq = aio_seq = ( aio_seq + 1 ) & AIO_SEQ_MASK;
+  if( len == 0 )
+    preq->state = AIO_STATE_DONE;
+  else
+  {
+    preq->state = AIO_STATE_QUEUED;
+    aio_pending ++;
+    elua_int_request_service( AIO_PUMP_INTERVAL );
+  }
+  return AIO_MAKE_ID( i, preq->seq );
+}
+
+// Returns the state of a request (AIO_STATE_FREE if the ID is not valid)
+int aio_get_state( int id )
+{
+  AIO_REQUEST *preq = aioh_get_request( id );
+
+  return preq ? preq->state : AIO_STATE_FREE;
+}
+
+// Returns the number of bytes transferred by a finished request
+// or -1 for error (the error code is returned as a side effect)
+s32 aio_get_result( int id, int *perr )
+{
+  AIO_REQUEST *preq = aioh_get_request( id );
+
+  if( preq == NULL || preq->state != AIO_STATE_DONE )
+  {
+    *perr = EINVAL;
+    return -1;
+  }
+  *perr = preq->err;
+  return preq->err && preq->done == 0 ? -1 : ( s32 )preq->done;
+}
+
+// Finish a request now (executing it in the foreground)
+void aio_wait( int id )
+{
+  AIO_REQUEST *preq = aioh_get_request( id );
+
+  while( preq && preq->state == AIO_STATE_QUEUED )
+    aioh_step( preq );
+}
+
+// Release a request (cancelling it if it's not finished)
+void aio_release( int id )
+{
+  AIO_REQUEST *preq = aioh_get_request( id );
+
+  if( preq == NULL )
+    return;
+  if( preq->state == AIO_STATE_QUEUED )
+    aio_pending --;
+  preq->state = AIO_STATE_FREE;
+}
+
+// Finish all the queued requests on a descriptor with EBADF (called by
+// _close_r before the descriptor is released, since it can be reused by the
+// next open)
+void aio_cancel_fd( int fd )
+{
+  unsigned i;
+
+  for( i = 0; i < AIO_MAX_REQUESTS; i ++ )
+    if( aio_requests[ i ].state == AIO_STATE_QUEUED && aio_requests[ i ].fd == fd )
+    {
+      aio_requests[ i ].err = EBADF;
+      aioh_finish( aio_requests + i );
+    }
+}
+
+// Returns the number of requests that are not finished yet
+unsigned aio_get_pending()
+{
+  return aio_pending;
+}
+
+#endif // #ifdef BUILD_AIO
@@ -20,6 +20,10 @@ static volatile u8 elua_int_read_idx, elua_int_write_idx;
 static elua_int_element elua_int_queue[ 1 << PLATFORM_INT_QUEUE_LOG_SIZE ];
 // Interrupt enabled/disabled flags
 static u32 elua_int_flags[ LUA_INT_MAX_SOURCES / 32 ];
+// Background service function, its "pending" flag and its hook count
+static elua_int_service elua_int_service_func;
+static volatile u8 elua_int_service_pending;
+static int elua_int_service_count;
 
 // Masking for read/write indexes
 #define INT_IDX_SHIFT                   ( PLATFORM_INT_QUEUE_LOG_SIZE )
@@ -31,30 +35,46 @@ static void elua_int_hook( lua_State *L, lua_Debug *ar )
   elua_int_element crt;
   int old_status;
 
-  // Get interrupt (and remove from queue)
-  crt = elua_int_queue[ elua_int_read_idx ];
-  elua_int_queue[ elua_int_read_idx ].id = ELUA_INT_EMPTY_SLOT;
-  elua_int_read_idx = ( elua_int_read_idx + 1 ) & INT_IDX_MASK;
-
-  if( elua_int_is_enabled( crt.id ) )
+  // Run the background service first if requested
+  if( elua_int_service_pending )
+  {
+    elua_int_service_pending = 0;
+    if( elua_int_service_func )
+      elua_int_service_func();
+  }
+  // Handle the first interrupt in the queue (if any)
+  if( elua_int_queue[ elua_int_read_idx ].id != ELUA_INT_EMPTY_SLOT )
   {
-    // Call Lua handler
-    // Get interrupt handler table
-    lua_rawgeti( L, LUA_REGISTRYINDEX, LUA_INT_HANDLER_KEY ); // inttable
-    lua_rawgeti( L, -1, crt.id ); // inttable f
-    if( !lua_isnil( L, -1 ) )
+    // Get interrupt (and remove from queue)
+    crt = elua_int_queue[ elua_int_read_idx ];
+    elua_int_queue[ elua_int_read_idx ].id = ELUA_INT_EMPTY_SLOT;
+    elua_int_read_idx = ( elua_int_read_idx + 1 ) & INT_IDX_MASK;
+
+    if( elua_int_is_enabled( crt.id ) )
     {
-      lua_pushinteger( L, crt.resnum ); // inttable f resnum
-      lua_call( L, 1, 0 ); // inttable    
+      // Call Lua handler
+      // Get interrupt handler table
+      lua_rawgeti( L, LUA_REGISTRYINDEX, LUA_INT_HANDLER_KEY ); // inttable
+      lua_rawgeti( L, -1, crt.id ); // inttable f
+      if( !lua_isnil( L, -1 ) )
+      {
+        lua_pushinteger( L, crt.resnum ); // inttable f resnum
+        lua_call( L, 1, 0 ); // inttable    
+      }
+      else
+        lua_remove( L, -1 ); // inttable
+      lua_remove( L, -1 );
     }
-    else
-      lua_remove( L, -1 ); // inttable
-    lua_remove( L, -1 );
   }
 
   old_status = platform_cpu_set_global_interrupts( PLATFORM_CPU_DISABLE );
-  if( elua_int_queue[ elua_int_read_idx ].id == ELUA_INT_EMPTY_SLOT ) // no more interrupts in the queue, so clear the hook
-    lua_sethook( L, NULL, 0, 0 );
+  if( elua_int_queue[ elua_int_read_idx ].id == ELUA_INT_EMPTY_SLOT ) // no more interrupts in the queue
+  {
+    if( elua_int_service_pending ) // keep the hook only for the service
+      lua_sethook( L, elua_int_hook, LUA_MASKCOUNT, elua_int_service_count );
+    else
+      lua_sethook( L, NULL, 0, 0 );
+  }
   platform_cpu_set_global_interrupts( old_status );
 }
 
@@ -120,10 +140,35 @@ void elua_int_disable_all()
     elua_int_flags[ i ] = 0;    
 }
 
+// Set the background service function
+void elua_int_set_service( elua_int_service pservice )
+{
+  elua_int_service_func = pservice;
+}
+
+// Ask for the background service to run after 'count' VM instructions
+// Can be called from an interrupt handler
+void elua_int_request_service( int count )
+{
+  lua_State *L = lua_getstate();
+  int old_status;
+
+  if( L == NULL )
+    return;
+  old_status = platform_cpu_set_global_interrupts( PLATFORM_CPU_DISABLE );
+  elua_int_service_count = count;
+  elua_int_service_pending = 1;
+  // Don't delay the interrupts that are already queued
+  if( elua_int_queue[ elua_int_read_idx ].id == ELUA_INT_EMPTY_SLOT )
+    lua_sethook( L, elua_int_hook, LUA_MASKCOUNT, count );
+  platform_cpu_set_global_interrupts( old_status );
+}
+
 // Called from lstate.c/lua_close
 void elua_int_cleanup()
 {
   elua_int_disable_all();
+  elua_int_service_pending = 0;
   elua_int_read_idx = elua_int_write_idx = 0;
   memset( elua_int_queue, ELUA_INT_EMPTY_SLOT, sizeof( elua_int_queue ) );
 }
@@ -153,6 +198,14 @@ int elua_int_add( elua_int_id inttype, elua_int_resnum resnum )
   return PLATFORM_ERR;
 }
 
+void elua_int_set_service( elua_int_service pservice )
+{
+}
+
+void elua_int_request_service( int count )
+{
+}
+
 #endif // #ifdef BUILD_LUA_INT_HANDLERS
 
 // ****************************************************************************
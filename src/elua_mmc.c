@@ -9,6 +9,7 @@
 #if defined( BUILD_MMCFS ) && defined( MMCFS_SPI_GENERIC )
 #include "platform.h"
 #include "diskio.h"
+#include "blkdev.h"
 
 /* Definitions for MMC/SDC command */
 #define CMD0    (0x40+0)    /* GO_IDLE_STATE */
@@ -326,14 +327,12 @@ BYTE send_cmd (
 /* Initialize Disk Drive                                                 */
 /*-----------------------------------------------------------------------*/
 
-DSTATUS disk_initialize (
-    BYTE drv        /* Physical drive nmuber (0) */
-)
+static
+DSTATUS mmc_disk_initialize (void)
 {
     BYTE n, ty, ocr[4];
 
 
-    if (drv) return STA_NOINIT;            /* Supports only single drive */
     if (Stat & STA_NODISK) return Stat;    /* No card in the socket */
     if ((Stat & STA_NOINIT) == 0)          /* prevent re-initialization */
       return Stat;
@@ -395,11 +394,9 @@ DSTATUS disk_initialize (
 /* Get Disk Status                                                       */
 /*-----------------------------------------------------------------------*/
 
-DSTATUS disk_status (
-    BYTE drv        /* Physical drive nmuber (0) */
-)
+static
+DSTATUS mmc_disk_status (void)
 {
-    if (drv) return STA_NOINIT;        /* Supports only single drive */
     return Stat;
 }
 
@@ -409,14 +406,14 @@ DSTATUS disk_status (
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_read (
-    BYTE drv,            /* Physical drive nmuber (0) */
+static
+DRESULT mmc_disk_read (
     BYTE *buff,            /* Pointer to the data buffer to store read data */
     DWORD sector,        /* Start sector number (LBA) */
     BYTE count            /* Sector count (1..255) */
 )
 {
-    if (drv || !count) return RES_PARERR;
+    if (!count) return RES_PARERR;
     if (Stat & STA_NOINIT) return RES_NOTRDY;
 
     if (!(CardType & 4)) sector *= 512;    /* Convert to byte address if needed */
@@ -451,14 +448,14 @@ DRESULT disk_read (
 /*-----------------------------------------------------------------------*/
 
 #if _READONLY == 0
-DRESULT disk_write (
-    BYTE drv,            /* Physical drive nmuber (0) */
+static
+DRESULT mmc_disk_write (
     const BYTE *buff,    /* Pointer to the data to be written */
     DWORD sector,        /* Start sector number (LBA) */
     BYTE count            /* Sector count (1..255) */
 )
 {
-    if (drv || !count) return RES_PARERR;
+    if (!count) return RES_PARERR;
     if (Stat & STA_NOINIT) return RES_NOTRDY;
     if (Stat & STA_PROTECT) return RES_WRPRT;
 
@@ -498,8 +495,8 @@ DRESULT disk_write (
 /* Miscellaneous Functions                                               */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_ioctl (
-    BYTE drv,        /* Physical drive nmuber (0) */
+static
+DRESULT mmc_disk_ioctl (
     BYTE ctrl,        /* Control code */
     void *buff        /* Buffer to send/receive control data */
 )
@@ -509,8 +506,6 @@ DRESULT disk_ioctl (
     WORD csize;
 
 
-    if (drv) return RES_PARERR;
-
     res = RES_ERROR;
 
     if (ctrl == CTRL_POWER) {
@@ -599,6 +594,26 @@ DRESULT disk_ioctl (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Block device descriptor (see blkdev.h)                                */
+/*-----------------------------------------------------------------------*/
+
+const BLKDEV mmc_blkdev =
+{
+    mmc_disk_initialize,
+    mmc_disk_status,
+    mmc_disk_read,
+#if _READONLY == 0
+    mmc_disk_write,
+#else
+    NULL,
+#endif
+    mmc_disk_ioctl,
+    255                 /* CMD18/CMD25 transfer any number of blocks */
+};
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Device Timer Interrupt Procedure  (Platform dependent)                */
 /*-----------------------------------------------------------------------*/
@@ -8,6 +8,8 @@
 #include "rtype.h"
 
 static u8 eluarpc_err_flag;
+static int eluarpc_seq = ELUARPC_NO_SEQ;
+static int eluarpc_enc = ELUARPC_ENC_V1;
 
 // *****************************************************************************
 // Internal functions: fdata serialization
@@ -145,6 +147,11 @@ static u8* eluarpc_start_packet( u8 *p )
   p += ELUARPC_START_OFFSET;
   *p ++ = TYPE_START;
   p = eluarpc_write_u32( p, PACKET_SIG );
+  if( eluarpc_seq != ELUARPC_NO_SEQ )
+  {
+    *p ++ = TYPE_SEQ;
+    *p ++ = ( u8 )eluarpc_seq;
+  }
   return p;
 }
 
@@ -153,7 +160,7 @@ static u8* eluarpc_end_packet( u8 *p )
   u16 len;
   
   *p ++ = TYPE_END;
-  p = eluarpc_write_u32( p, ~PACKET_SIG );
+  p = eluarpc_write_u32( p, ( u32 )~PACKET_SIG );
   len = p - eluarpc_packet_ptr;
   p = eluarpc_packet_ptr;
   *p ++ = TYPE_PKT_SIZE;
@@ -170,6 +177,9 @@ static const u8* eluarpc_match_packet_start( const u8 *p )
   p = eluarpc_read_u32( p, &fdata );
   if( fdata != PACKET_SIG )
     eluarpc_err_flag = ELUARPC_ERR;
+  // Skip the sequence number (if any)
+  if( *p == TYPE_SEQ )
+    p += ELUARPC_SEQ_SIZE;
   return p;
 }
 
@@ -179,17 +189,292 @@ static const u8* eluarpc_match_packet_end( const u8 *p )
   
   p = eluarpc_read_expect( p, TYPE_END );
   p = eluarpc_read_u32( p, &fdata );
-  if( fdata != ~PACKET_SIG )
+  if( fdata != ( u32 )~PACKET_SIG )
     eluarpc_err_flag = ELUARPC_ERR;
   return p;
 }
 
+// *****************************************************************************
+// Internal functions: compact (v2) packets
+// [TYPE_PKT_V2 | flags][size (u16)][seq (u8, optional)][op][fields][CRC16 (optional)]
+
+static int eluarpc_is_v2( const u8 *p )
+{
+  return ( *p & TYPE_PKT_V2_MASK ) == TYPE_PKT_V2;
+}
+
+// CRC16-CCITT (polynomial 0x1021), 4 bits at a time
+static const u16 eluarpc_crc_table[ 16 ] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+u16 eluarpc_crc16( u16 crc, const u8 *p, u16 len )
+{
+  while( len -- )
+  {
+    crc = ( crc << 4 ) ^ eluarpc_crc_table[ ( crc >> 12 ) ^ ( *p >> 4 ) ];
+    crc = ( crc << 4 ) ^ eluarpc_crc_table[ ( crc >> 12 ) ^ ( *p ++ & 0x0F ) ];
+  }
+  return crc;
+}
+
+static u8 *eluarpc_write_varint( u8 *p, u32 fdata )
+{
+  while( fdata >= 0x80 )
+  {
+    *p ++ = ( u8 )( fdata | 0x80 );
+    fdata >>= 7;
+  }
+  *p ++ = ( u8 )fdata;
+  return p;
+}
+
+// Signed values are zigzag encoded, so small negative values are short too
+static u8 *eluarpc_write_svarint( u8 *p, s32 fdata )
+{
+  return eluarpc_write_varint( p, fdata < 0 ? ~( ( u32 )fdata << 1 ) : ( u32 )fdata << 1 );
+}
+
+static u8 *eluarpc_write_ptr_v2( u8 *p, const void* src, u32 srclen )
+{
+  if( src )
+  {
+    p = eluarpc_write_varint( p, srclen );
+    memcpy( p, src, srclen );
+  }
+  else
+  {
+    // The data is already in place (see eluarpc_get_read_buf_offset), so
+    // the length always takes ELUARPC_V2_PTR_HEADER_SIZE bytes
+    *p ++ = ( u8 )( srclen | 0x80 );
+    *p ++ = ( u8 )( ( srclen >> 7 ) | 0x80 );
+    *p ++ = ( u8 )( ( srclen >> 14 ) & 0x7F );
+  }
+  return p + srclen;
+}
+
+static const u8 *eluarpc_read_varint( const u8 *p, u32 *pfdata )
+{
+  unsigned shift = 0;
+  u8 c;
+
+  *pfdata = 0;
+  do
+  {
+    c = *p ++;
+    if( shift < 32 )
+      *pfdata |= ( u32 )( c & 0x7F ) << shift;
+    shift += 7;
+  } while( ( c & 0x80 ) && shift < 35 );
+  if( c & 0x80 )
+    eluarpc_err_flag = ELUARPC_ERR;
+  return p;
+}
+
+static const u8 *eluarpc_read_svarint( const u8 *p, s32 *pfdata )
+{
+  u32 temp;
+
+  p = eluarpc_read_varint( p, &temp );
+  *pfdata = ( temp & 1 ) ? ( s32 )~( temp >> 1 ) : ( s32 )( temp >> 1 );
+  return p;
+}
+
+static u8* eluarpc_start_packet_v2( u8 *p )
+{
+  eluarpc_packet_ptr = p;
+  *p = TYPE_PKT_V2 | ( eluarpc_enc & ELUARPC_ENC_CRC ? TYPE_PKT_V2_CRC : 0 );
+  p += ELUARPC_V2_HEADER_SIZE;
+  if( eluarpc_seq != ELUARPC_NO_SEQ )
+  {
+    *eluarpc_packet_ptr |= TYPE_PKT_V2_SEQ;
+    *p ++ = ( u8 )eluarpc_seq;
+  }
+  return p;
+}
+
+static void eluarpc_end_packet_v2( u8 *p )
+{
+  u8 *pstart = eluarpc_packet_ptr;
+  u16 len = p - pstart, crc;
+
+  if( *pstart & TYPE_PKT_V2_CRC )
+    len += ELUARPC_V2_CRC_SIZE;
+  pstart[ 1 ] = len & 0xFF;
+  pstart[ 2 ] = len >> 8;
+  if( *pstart & TYPE_PKT_V2_CRC )
+  {
+    crc = eluarpc_crc16( ELUARPC_CRC_INIT, pstart, len - ELUARPC_V2_CRC_SIZE );
+    *p ++ = crc & 0xFF;
+    *p = crc >> 8;
+  }
+}
+
+// Check the header (and the CRC) of a compact packet. Returns the first field
+// and the end of the fields in 'pend'.
+static const u8* eluarpc_match_packet_start_v2( const u8 *p, const u8 **pend )
+{
+  u16 len = p[ 1 ] | ( ( u16 )p[ 2 ] << 8 );
+  u16 minlen = ELUARPC_V2_HEADER_SIZE + ELUARPC_RESPONSE_SIZE;
+  u8 flags = *p;
+
+  if( flags & TYPE_PKT_V2_SEQ )
+    minlen += ELUARPC_V2_SEQ_SIZE;
+  if( flags & TYPE_PKT_V2_CRC )
+    minlen += ELUARPC_V2_CRC_SIZE;
+  if( len < minlen )
+  {
+    eluarpc_err_flag = ELUARPC_ERR;
+    len = minlen;
+  }
+  *pend = p + len;
+  if( flags & TYPE_PKT_V2_CRC )
+  {
+    *pend -= ELUARPC_V2_CRC_SIZE;
+    if( eluarpc_crc16( ELUARPC_CRC_INIT, p, len - ELUARPC_V2_CRC_SIZE ) != ( ( *pend )[ 0 ] | ( ( u16 )( *pend )[ 1 ] << 8 ) ) )
+      eluarpc_err_flag = ELUARPC_ERR;
+  }
+  p += ELUARPC_V2_HEADER_SIZE;
+  if( flags & TYPE_PKT_V2_SEQ )
+    p += ELUARPC_V2_SEQ_SIZE;
+  return p;
+}
+
+static void eluarpc_gen_write_v2( u8 *p, const char *fmt, va_list ap )
+{
+  const void *ptr;
+  u32 ptrlen;
+
+  p = eluarpc_start_packet_v2( p );
+  while( *fmt )
+    switch( *fmt ++ )
+    {
+      case 'o':
+      case 'c':
+        *p ++ = ( u8 )va_arg( ap, int );
+        break;
+
+      case 'r':
+        *p ++ = ELUARPC_OP_RES_MOD | ( u8 )va_arg( ap, int );
+        break;
+
+      case 'h':
+        p = eluarpc_write_varint( p, ( u16 )va_arg( ap, int ) );
+        break;
+
+      case 'i':
+        p = eluarpc_write_svarint( p, ( s32 )va_arg( ap, int ) );
+        break;
+
+      case 'l':
+        p = eluarpc_write_varint( p, ( u32 )va_arg( ap, u32 ) );
+        break;
+
+      case 'L':
+        p = eluarpc_write_svarint( p, ( s32 )va_arg( ap, s32 ) );
+        break;
+
+      case 'p':
+        ptr = va_arg( ap, void* );
+        ptrlen = ( u32 )va_arg( ap, u32 );
+        p = eluarpc_write_ptr_v2( p, ptr, ptrlen );
+        break;
+
+      case 'P':
+        ptr = va_arg( ap, void * );
+        ptrlen = ( u16 )va_arg( ap, int );
+        p = eluarpc_write_ptr_v2( p, ptr, ptrlen );
+        break;
+    }
+  eluarpc_end_packet_v2( p );
+}
+
+static int eluarpc_gen_read_v2( const u8 *p, const char *fmt, va_list ap )
+{
+  const u8 *pend;
+  const void *pptr;
+  void *plen;
+  u32 temp32;
+  s32 stemp32;
+  char c;
+
+  p = eluarpc_match_packet_start_v2( p, &pend );
+  while( *fmt && eluarpc_err_flag == ELUARPC_OK )
+    switch( c = *fmt ++ )
+    {
+      case 'o':
+        p = eluarpc_read_expect( p, ( u8 )va_arg( ap, int ) );
+        break;
+
+      case 'r':
+        p = eluarpc_read_expect( p, ELUARPC_OP_RES_MOD | ( u8 )va_arg( ap, int ) );
+        break;
+
+      case 'c':
+        *( u8* )va_arg( ap, void * ) = *p ++;
+        break;
+
+      case 'h':
+        p = eluarpc_read_varint( p, &temp32 );
+        *( u16* )va_arg( ap, void * ) = ( u16 )temp32;
+        break;
+
+      case 'l':
+        p = eluarpc_read_varint( p, ( u32* )va_arg( ap, void * ) );
+        break;
+
+      case 'L':
+        p = eluarpc_read_svarint( p, &stemp32 );
+        *( s32 *)va_arg( ap, void * ) = stemp32;
+        break;
+
+      case 'i':
+        p = eluarpc_read_svarint( p, &stemp32 );
+        *( int* )va_arg( ap, void * ) = ( int )stemp32;
+        break;
+
+      case 'p':
+      case 'P':
+        pptr = va_arg( ap, void** );
+        plen = va_arg( ap, void* );
+        p = eluarpc_read_varint( p, &temp32 );
+        if( p > pend || temp32 > ( u32 )( pend - p ) )
+        {
+          eluarpc_err_flag = ELUARPC_ERR;
+          break;
+        }
+        *( const u8** )pptr = temp32 ? p : NULL;
+        if( plen && c == 'p' )
+          *( u32* )plen = temp32;
+        else if( plen )
+          *( u16* )plen = ( u16 )temp32;
+        p += temp32;
+        break;
+    }
+  // The fields must end exactly where the packet ends
+  if( p != pend )
+    eluarpc_err_flag = ELUARPC_ERR;
+  return eluarpc_err_flag;
+}
+
 // *****************************************************************************
 // Function serialization and deserialization
 
 int eluarpc_get_request_id( const u8 *p, u8 *pid )
 { 
+  const u8 *pend;
+
   eluarpc_err_flag = ELUARPC_OK;
+  if( eluarpc_is_v2( p ) )
+  {
+    // Responses have ELUARPC_OP_RES_MOD set
+    p = eluarpc_match_packet_start_v2( p, &pend );
+    if( ( *pid = *p ) & ELUARPC_OP_RES_MOD )
+      eluarpc_err_flag = ELUARPC_ERR;
+    return eluarpc_err_flag;
+  }
   p = eluarpc_match_packet_start( p );
   p = eluarpc_read_op_id( p, pid );
   return eluarpc_err_flag;
@@ -203,11 +488,48 @@ u32 eluarpc_replace_flag( u32 val, u32 origflag, u32 newflag )
 int eluarpc_get_packet_size( const u8 *p, u16 *psize )
 {
   eluarpc_err_flag = ELUARPC_OK;
+  if( eluarpc_is_v2( p ) )
+  {
+    *psize = p[ 1 ] | ( ( u16 )p[ 2 ] << 8 );
+    return *psize < ELUARPC_START_OFFSET ? ELUARPC_ERR : ELUARPC_OK;
+  }
   p = eluarpc_read_expect( p, TYPE_PKT_SIZE );
   p = eluarpc_read_u16( p, psize );
   return eluarpc_err_flag;
 }
 
+void eluarpc_set_seq( int seq )
+{
+  eluarpc_seq = seq;
+}
+
+int eluarpc_get_seq( const u8 *p )
+{
+  if( eluarpc_is_v2( p ) )
+    return *p & TYPE_PKT_V2_SEQ ? p[ ELUARPC_V2_HEADER_SIZE ] : ELUARPC_NO_SEQ;
+  p += ELUARPC_START_OFFSET + ELUARPC_START_SIZE;
+  return *p == TYPE_SEQ ? p[ 1 ] : ELUARPC_NO_SEQ;
+}
+
+void eluarpc_set_encoding( int enc )
+{
+  eluarpc_enc = enc;
+}
+
+int eluarpc_get_encoding( const u8 *p )
+{
+  if( !eluarpc_is_v2( p ) )
+    return ELUARPC_ENC_V1;
+  return ELUARPC_ENC_V2 | ( *p & TYPE_PKT_V2_CRC ? ELUARPC_ENC_CRC : 0 );
+}
+
+u16 eluarpc_get_read_buf_offset()
+{
+  if( eluarpc_enc & ELUARPC_ENC_V2 )
+    return ELUARPC_V2_HEADER_SIZE + ( eluarpc_seq != ELUARPC_NO_SEQ ? ELUARPC_V2_SEQ_SIZE : 0 ) + ELUARPC_RESPONSE_SIZE + ELUARPC_V2_PTR_HEADER_SIZE;
+  return ELUARPC_READ_BUF_OFFSET + ( eluarpc_seq != ELUARPC_NO_SEQ ? ELUARPC_SEQ_SIZE : 0 );
+}
+
 // Build a discover packet and return its size
 int eluarpc_build_discover_packet( u8 *p )
 {
@@ -255,6 +577,12 @@ void eluarpc_gen_write( u8 *p, const char *fmt, ... )
   u32 ptrlen;
   
   va_start( ap, fmt );
+  if( eluarpc_enc & ELUARPC_ENC_V2 )
+  {
+    eluarpc_gen_write_v2( p, fmt, ap );
+    va_end( ap );
+    return;
+  }
   p = eluarpc_start_packet( p );
   while( *fmt )
     switch( *fmt ++ )
@@ -324,6 +652,12 @@ int eluarpc_gen_read( const u8 *p, const char *fmt, ... )
   
   va_start( ap, fmt );
   eluarpc_err_flag = ELUARPC_OK;
+  if( eluarpc_is_v2( p ) )
+  {
+    eluarpc_gen_read_v2( p, fmt, ap );
+    va_end( ap );
+    return eluarpc_err_flag;
+  }
   p = eluarpc_match_packet_start( p );
   while( *fmt )
     switch( *fmt ++ )
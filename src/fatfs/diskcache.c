@@ -0,0 +1,436 @@
+// Sector cache between FatFs and the low level disk drivers
+// FatFs is built with _FS_TINY, so all the open files share the sector
+// window of the file system object and every window change hits the disk.
+// This cache keeps the most recently used sectors (LRU) and delays writes
+// until the file system is synchronized (f_sync/f_close) or the sector is
+// evicted. FAT/directory sectors and file data sectors have separate parts
+// of the cache. Dirty sectors are written back in sector order, consecutive
+// sectors with a single multi sector write command. File data goes first,
+// then the FAT, then the directories, so a directory entry never reaches the
+// disk before the clusters it points to are allocated.
+
+#include "platform_conf.h"
+#ifdef BUILD_DISKCACHE
+
+#include "diskcache.h"
+#include "ffconf.h"
+#include <string.h>
+
+#ifndef BUILD_MMCFS
+#error "BUILD_DISKCACHE needs BUILD_MMCFS"
+#endif
+
+// Default configuration (can be overriden in platform_conf.h)
+// Number of cached FAT/directory sectors
+#ifndef DISKCACHE_META_SECTORS
+#define DISKCACHE_META_SECTORS    8
+#endif
+
+// Number of cached file data sectors
+#ifndef DISKCACHE_DATA_SECTORS
+#define DISKCACHE_DATA_SECTORS    8
+#endif
+
+// Maximum number of sectors written with a single command on write back
+#ifndef DISKCACHE_FLUSH_SECTORS
+#define DISKCACHE_FLUSH_SECTORS   8
+#endif
+
+#define DISKCACHE_SECTORS         ( DISKCACHE_META_SECTORS + DISKCACHE_DATA_SECTORS )
+#define DISKCACHE_DRIVES          _DRIVES
+#define DISKCACHE_SECTOR_SIZE     _MAX_SS
+#define DISKCACHE_NONE            0xFF
+
+#if DISKCACHE_SECTORS >= DISKCACHE_NONE
+#error "Too many sectors in the disk cache"
+#endif
+
+#if DISKCACHE_META_SECTORS == 0 || DISKCACHE_DATA_SECTORS == 0 || DISKCACHE_FLUSH_SECTORS == 0
+#error "Invalid disk cache configuration"
+#endif
+
+// Entry flags
+#define DISKCACHE_VALID           1
+#define DISKCACHE_DIRTY           2
+
+// Write back order of the dirty sectors
+#define DISKCACHE_ORDER_DATA      0
+#define DISKCACHE_ORDER_FAT       1
+#define DISKCACHE_ORDER_OTHER     2
+#define DISKCACHE_ORDER_ALL       DISKCACHE_ORDER_OTHER
+
+typedef struct
+{
+  DWORD sector;
+  BYTE drv;
+  BYTE flags;
+  BYTE prev, next;                  // LRU list of the entry class
+} DISKCACHE_ENTRY;
+
+static DISKCACHE_ENTRY dc_entries[ DISKCACHE_SECTORS ];
+static BYTE dc_head[ DISKCACHE_NUM_CLASSES ], dc_tail[ DISKCACHE_NUM_CLASSES ];
+static DISKCACHE_STATS dc_stats;
+
+// Sectors hinted as file data by FatFs
+static BYTE dc_hint_drv;
+static DWORD dc_hint_sector, dc_hint_count;
+
+// FAT area of each drive (all the FAT copies)
+static DWORD dc_fat_sector[ DISKCACHE_DRIVES ], dc_fat_count[ DISKCACHE_DRIVES ];
+
+// The sector buffers (and the write back staging buffer) can live at a fixed
+// address (usually in external RAM) or in the data section
+#ifdef DISKCACHE_START_ADDRESS
+#define dc_data                   ( ( BYTE* )( DISKCACHE_START_ADDRESS ) )
+#else
+// Word aligned, some drivers transfer words
+static DWORD dc_buffers[ ( DISKCACHE_SECTORS + DISKCACHE_FLUSH_SECTORS ) * DISKCACHE_SECTOR_SIZE / 4 ];
+#define dc_data                   ( ( BYTE* )dc_buffers )
+#endif
+#define dc_staging                ( dc_data + DISKCACHE_SECTORS * DISKCACHE_SECTOR_SIZE )
+
+#define DC_BUF( idx )             ( dc_data + ( idx ) * DISKCACHE_SECTOR_SIZE )
+#define DC_CLASS( idx )           ( ( idx ) < DISKCACHE_META_SECTORS ? DISKCACHE_META : DISKCACHE_DATA )
+
+// ****************************************************************************
+// LRU lists
+
+// Helper: remove an entry from its list
+static void dch_unlink( BYTE idx )
+{
+  DISKCACHE_ENTRY *pe = dc_entries + idx;
+  int cls = DC_CLASS( idx );
+
+  if( pe->prev != DISKCACHE_NONE )
+    dc_entries[ pe->prev ].next = pe->next;
+  else
+    dc_head[ cls ] = pe->next;
+  if( pe->next != DISKCACHE_NONE )
+    dc_entries[ pe->next ].prev = pe->prev;
+  else
+    dc_tail[ cls ] = pe->prev;
+}
+
+// Helper: make an entry the most recently used one
+static void dch_touch( BYTE idx )
+{
+  DISKCACHE_ENTRY *pe = dc_entries + idx;
+  int cls = DC_CLASS( idx );
+
+  if( dc_head[ cls ] == idx )
+    return;
+  dch_unlink( idx );
+  pe->prev = DISKCACHE_NONE;
+  pe->next = dc_head[ cls ];
+  dc_entries[ dc_head[ cls ] ].prev = idx;
+  dc_head[ cls ] = idx;
+}
+
+// Helper: make an entry the least recently used one
+static void dch_demote( BYTE idx )
+{
+  DISKCACHE_ENTRY *pe = dc_entries + idx;
+  int cls = DC_CLASS( idx );
+
+  if( dc_tail[ cls ] == idx )
+    return;
+  dch_unlink( idx );
+  pe->next = DISKCACHE_NONE;
+  pe->prev = dc_tail[ cls ];
+  dc_entries[ dc_tail[ cls ] ].next = idx;
+  dc_tail[ cls ] = idx;
+}
+
+// Helper: build the (empty) LRU lists
+static void dch_init_lists()
+{
+  BYTE i, first, last;
+  int cls;
+
+  for( cls = 0; cls < DISKCACHE_NUM_CLASSES; cls ++ )
+  {
+    first = cls == DISKCACHE_META ? 0 : DISKCACHE_META_SECTORS;
+    last = cls == DISKCACHE_META ? DISKCACHE_META_SECTORS - 1 : DISKCACHE_SECTORS - 1;
+    for( i = first; i <= last; i ++ )
+    {
+      dc_entries[ i ].flags = 0;
+      dc_entries[ i ].prev = i == first ? DISKCACHE_NONE : i - 1;
+      dc_entries[ i ].next = i == last ? DISKCACHE_NONE : i + 1;
+    }
+    dc_head[ cls ] = first;
+    dc_tail[ cls ] = last;
+  }
+}
+
+// ****************************************************************************
+// Cache management
+
+// Helper: find a sector in the cache
+static BYTE dch_find( BYTE drv, DWORD sector )
+{
+  BYTE i;
+
+  for( i = 0; i < DISKCACHE_SECTORS; i ++ )
+    if( ( dc_entries[ i ].flags & DISKCACHE_VALID ) && dc_entries[ i ].sector == sector && dc_entries[ i ].drv == drv )
+      return i;
+  return DISKCACHE_NONE;
+}
+
+// Helper: return the class of a sector that isn't cached yet
+static int dch_get_class( BYTE drv, DWORD sector )
+{
+  return drv == dc_hint_drv && sector - dc_hint_sector < dc_hint_count ? DISKCACHE_DATA : DISKCACHE_META;
+}
+
+// Helper: return the write back order of a cached sector
+static int dch_get_order( BYTE idx )
+{
+  DISKCACHE_ENTRY *pe = dc_entries + idx;
+
+  if( DC_CLASS( idx ) == DISKCACHE_DATA )
+    return DISKCACHE_ORDER_DATA;
+  if( pe->drv < DISKCACHE_DRIVES && pe->sector - dc_fat_sector[ pe->drv ] < dc_fat_count[ pe->drv ] )
+    return DISKCACHE_ORDER_FAT;
+  return DISKCACHE_ORDER_OTHER;
+}
+
+// Helper: write the given sectors (entries sorted by sector, consecutive
+// sectors) to the disk with a single command
+static DRESULT dch_write_run( const BYTE *pidx, BYTE count )
+{
+  DISKCACHE_ENTRY *pe = dc_entries + pidx[ 0 ];
+  const BYTE *buff;
+  BYTE i;
+
+  if( count == 1 )
+    buff = DC_BUF( pidx[ 0 ] );
+  else
+  {
+    for( i = 0; i < count; i ++ )
+      memcpy( dc_staging + i * DISKCACHE_SECTOR_SIZE, DC_BUF( pidx[ i ] ), DISKCACHE_SECTOR_SIZE );
+    buff = dc_staging;
+  }
+  dc_stats.writecmds ++;
+  if( disk_ll_write( pe->drv, buff, pe->sector, count ) != RES_OK )
+    return RES_ERROR;
+  dc_stats.writebacks += count;
+  for( i = 0; i < count; i ++ )
+    dc_entries[ pidx[ i ] ].flags &= ~DISKCACHE_DIRTY;
+  return RES_OK;
+}
+
+// Helper: write back the dirty sectors of a drive, up to the given order
+static DRESULT dch_flush( BYTE drv, int maxorder )
+{
+  BYTE dirty[ DISKCACHE_SECTORS ];
+  BYTE ndirty, i, j, idx, run;
+  DRESULT res = RES_OK;
+  int order;
+
+  for( order = DISKCACHE_ORDER_DATA; order <= maxorder; order ++ )
+  {
+    // Sort the dirty sectors (insertion sort, there aren't many of them)
+    for( idx = 0, ndirty = 0; idx < DISKCACHE_SECTORS; idx ++ )
+    {
+      if( !( dc_entries[ idx ].flags & DISKCACHE_DIRTY ) || dc_entries[ idx ].drv != drv || dch_get_order( idx ) != order )
+        continue;
+      for( j = ndirty; j > 0 && dc_entries[ dirty[ j - 1 ] ].sector > dc_entries[ idx ].sector; j -- )
+        dirty[ j ] = dirty[ j - 1 ];
+      dirty[ j ] = idx;
+      ndirty ++;
+    }
+    // Write runs of consecutive sectors
+    for( i = 0; i < ndirty; i += run )
+    {
+      for( run = 1; i + run < ndirty && run < DISKCACHE_FLUSH_SECTORS; run ++ )
+        if( dc_entries[ dirty[ i + run ] ].sector != dc_entries[ dirty[ i ] ].sector + run )
+          break;
+      if( dch_write_run( dirty + i, run ) != RES_OK )
+        res = RES_ERROR;
+    }
+    // Don't write the next class if this one failed
+    if( res != RES_OK )
+      break;
+  }
+  return res;
+}
+
+// Helper: get an entry for a new sector (evicting the least recently used
+// sector of the class). Returns DISKCACHE_NONE if a dirty sector can't be
+// written back.
+static BYTE dch_alloc( BYTE drv, DWORD sector, int cls )
+{
+  BYTE idx = dc_tail[ cls ];
+  DISKCACHE_ENTRY *pe = dc_entries + idx;
+  int order;
+
+  if( pe->flags & DISKCACHE_DIRTY )
+  {
+    // The sectors that must reach the disk before this one are written first
+    order = dch_get_order( idx );
+    if( order > DISKCACHE_ORDER_DATA && dch_flush( pe->drv, order - 1 ) != RES_OK )
+      return DISKCACHE_NONE;
+    if( dch_write_run( &idx, 1 ) != RES_OK )
+      return DISKCACHE_NONE;
+  }
+  pe->drv = drv;
+  pe->sector = sector;
+  pe->flags = DISKCACHE_VALID;
+  dch_touch( idx );
+  return idx;
+}
+
+// Helper: discard all the cached sectors of a drive
+static void dch_invalidate( BYTE drv )
+{
+  BYTE i;
+
+  for( i = 0; i < DISKCACHE_SECTORS; i ++ )
+    if( dc_entries[ i ].drv == drv && ( dc_entries[ i ].flags & DISKCACHE_VALID ) )
+    {
+      dc_entries[ i ].flags = 0;
+      dch_demote( i );
+    }
+}
+
+// ****************************************************************************
+// FatFs disk interface
+
+DSTATUS disk_initialize( BYTE drv )
+{
+  static BYTE inited;
+
+  if( !inited )
+  {
+    dch_init_lists();
+    inited = 1;
+  }
+  // A new medium might have been inserted, so forget everything about this
+  // drive (FatFs only initializes a drive after it lost its status)
+  dch_invalidate( drv );
+  return disk_ll_initialize( drv );
+}
+
+DRESULT disk_read( BYTE drv, BYTE *buff, DWORD sector, BYTE count )
+{
+  BYTE i, idx;
+  int cls;
+
+  // Large file data transfers bypass the cache, but they must see the
+  // sectors that are dirty in the cache
+  if( count > 1 && dch_get_class( drv, sector ) == DISKCACHE_DATA )
+  {
+    dc_stats.bypass ++;
+    if( disk_ll_read( drv, buff, sector, count ) != RES_OK )
+      return RES_ERROR;
+    for( i = 0; i < DISKCACHE_SECTORS; i ++ )
+      if( ( dc_entries[ i ].flags & DISKCACHE_DIRTY ) && dc_entries[ i ].drv == drv && dc_entries[ i ].sector - sector < count )
+        memcpy( buff + ( dc_entries[ i ].sector - sector ) * DISKCACHE_SECTOR_SIZE, DC_BUF( i ), DISKCACHE_SECTOR_SIZE );
+    return RES_OK;
+  }
+  for( i = 0; i < count; i ++, sector ++, buff += DISKCACHE_SECTOR_SIZE )
+  {
+    if( ( idx = dch_find( drv, sector ) ) != DISKCACHE_NONE )
+    {
+      dc_stats.hits[ DC_CLASS( idx ) ] ++;
+      dch_touch( idx );
+    }
+    else
+    {
+      cls = dch_get_class( drv, sector );
+      dc_stats.misses[ cls ] ++;
+      if( ( idx = dch_alloc( drv, sector, cls ) ) == DISKCACHE_NONE )
+        return RES_ERROR;
+      if( disk_ll_read( drv, DC_BUF( idx ), sector, 1 ) != RES_OK )
+      {
+        dc_entries[ idx ].flags = 0;
+        dch_demote( idx );
+        return RES_ERROR;
+      }
+    }
+    memcpy( buff, DC_BUF( idx ), DISKCACHE_SECTOR_SIZE );
+  }
+  return RES_OK;
+}
+
+DRESULT disk_write( BYTE drv, const BYTE *buff, DWORD sector, BYTE count )
+{
+  BYTE i, idx;
+
+  // Large file data transfers are written through, the cached copies of
+  // the sectors are refreshed
+  if( count > 1 && dch_get_class( drv, sector ) == DISKCACHE_DATA )
+  {
+    dc_stats.bypass ++;
+    dc_stats.writecmds ++;
+    if( disk_ll_write( drv, buff, sector, count ) != RES_OK )
+      return RES_ERROR;
+    dc_stats.writebacks += count;
+    for( i = 0; i < DISKCACHE_SECTORS; i ++ )
+      if( ( dc_entries[ i ].flags & DISKCACHE_VALID ) && dc_entries[ i ].drv == drv && dc_entries[ i ].sector - sector < count )
+      {
+        memcpy( DC_BUF( i ), buff + ( dc_entries[ i ].sector - sector ) * DISKCACHE_SECTOR_SIZE, DISKCACHE_SECTOR_SIZE );
+        dc_entries[ i ].flags &= ~DISKCACHE_DIRTY;
+      }
+    return RES_OK;
+  }
+  for( i = 0; i < count; i ++, sector ++, buff += DISKCACHE_SECTOR_SIZE )
+  {
+    if( ( idx = dch_find( drv, sector ) ) != DISKCACHE_NONE )
+      dch_touch( idx );
+    else if( ( idx = dch_alloc( drv, sector, dch_get_class( drv, sector ) ) ) == DISKCACHE_NONE )
+      return RES_ERROR;
+    memcpy( DC_BUF( idx ), buff, DISKCACHE_SECTOR_SIZE );
+    dc_entries[ idx ].flags |= DISKCACHE_DIRTY;
+  }
+  return RES_OK;
+}
+
+DRESULT disk_ioctl( BYTE drv, BYTE ctrl, void *buff )
+{
+  // FatFs asks for a sync when a file is synced or closed and when the
+  // file system is unmounted: this is when the dirty sectors are written
+  if( ctrl == CTRL_SYNC && dch_flush( drv, DISKCACHE_ORDER_ALL ) != RES_OK )
+    return RES_ERROR;
+  return disk_ll_ioctl( drv, ctrl, buff );
+}
+
+// ****************************************************************************
+// Public interface
+
+// Called by FatFs before it transfers file data: the given sectors are file
+// data sectors
+void disk_cache_hint( BYTE drv, DWORD sector, DWORD count )
+{
+  dc_hint_drv = drv;
+  dc_hint_sector = sector;
+  dc_hint_count = count;
+}
+
+// Called by FatFs when a volume is mounted: the given sectors hold the FAT
+void disk_cache_set_fat( BYTE drv, DWORD sector, DWORD count )
+{
+  if( drv < DISKCACHE_DRIVES )
+  {
+    dc_fat_sector[ drv ] = sector;
+    dc_fat_count[ drv ] = count;
+  }
+}
+
+void disk_cache_get_stats( DISKCACHE_STATS *pstats )
+{
+  memcpy( pstats, &dc_stats, sizeof( DISKCACHE_STATS ) );
+}
+
+void disk_cache_reset_stats()
+{
+  memset( &dc_stats, 0, sizeof( DISKCACHE_STATS ) );
+}
+
+// Returns the number of cached sectors in a class
+unsigned disk_cache_get_size( int cls )
+{
+  return cls == DISKCACHE_META ? DISKCACHE_META_SECTORS : DISKCACHE_DATA_SECTORS;
+}
+
+#endif // #ifdef BUILD_DISKCACHE
@@ -0,0 +1,59 @@
+// Sector cache between FatFs and the low level disk drivers
+
+#ifndef __DISKCACHE_H__
+#define __DISKCACHE_H__
+
+#include "integer.h"
+#include "diskio.h"
+#include "platform_conf.h"
+
+// Sector classes (FAT/directory sectors and file data sectors use separate
+// parts of the cache, so streaming a large file doesn't evict the metadata)
+#define DISKCACHE_META        0
+#define DISKCACHE_DATA        1
+#define DISKCACHE_NUM_CLASSES 2
+
+// Cache statistics
+typedef struct
+{
+  DWORD hits[ DISKCACHE_NUM_CLASSES ];
+  DWORD misses[ DISKCACHE_NUM_CLASSES ];
+  DWORD bypass;                     // multi sector transfers done directly
+  DWORD writebacks;                 // sectors written to the disk
+  DWORD writecmds;                  // write commands sent to the disk
+} DISKCACHE_STATS;
+
+#ifdef BUILD_DISKCACHE
+
+// The low level drivers are compiled with their functions renamed, so that
+// FatFs calls the cache, which in turn calls the drivers. A driver defines
+// DISKCACHE_DRIVER before including this file.
+#ifdef DISKCACHE_DRIVER
+#define disk_initialize       disk_ll_initialize
+#define disk_read             disk_ll_read
+#define disk_write            disk_ll_write
+#define disk_ioctl            disk_ll_ioctl
+#endif
+
+DSTATUS disk_ll_initialize( BYTE drv );
+DRESULT disk_ll_read( BYTE drv, BYTE *buff, DWORD sector, BYTE count );
+DRESULT disk_ll_write( BYTE drv, const BYTE *buff, DWORD sector, BYTE count );
+DRESULT disk_ll_ioctl( BYTE drv, BYTE ctrl, void *buff );
+
+void disk_cache_hint( BYTE drv, DWORD sector, DWORD count );
+void disk_cache_set_fat( BYTE drv, DWORD sector, DWORD count );
+void disk_cache_get_stats( DISKCACHE_STATS *pstats );
+void disk_cache_reset_stats();
+unsigned disk_cache_get_size( int cls );
+
+#define DISKCACHE_HINT( drv, sector, count )  disk_cache_hint( drv, sector, count )
+#define DISKCACHE_FAT( drv, sector, count )   disk_cache_set_fat( drv, sector, count )
+
+#else // #ifdef BUILD_DISKCACHE
+
+#define DISKCACHE_HINT( drv, sector, count )
+#define DISKCACHE_FAT( drv, sector, count )
+
+#endif // #ifdef BUILD_DISKCACHE
+
+#endif // #ifndef __DISKCACHE_H__
@@ -79,6 +79,7 @@
 #include "ff.h"			/* FatFs configurations and declarations */
 #include "diskio.h"		/* Declarations of low level disk I/O functions */
 #include "platform_conf.h"
+#include "diskcache.h"	/* Sector cache hints */
 
 #ifdef BUILD_MMCFS
 
@@ -138,6 +139,29 @@ FATFS *FatFs[_DRIVES];	/* Pointer to the file system objects (logical drives) */
 static
 WORD Fsid;				/* File system mount ID */
 
+#if _USE_DCACHE
+#if _DCACHE_ENTRIES < 2 || (_DCACHE_ENTRIES & 1) || _DCACHE_NAME < 11 || _DCACHE_NAME > 255
+#error Wrong directory entry cache configuration.
+#endif
+#define DC_SETS		(_DCACHE_ENTRIES / 2)	/* Two entries per hash set */
+#define DC_NEG		0xFFFF					/* Index of a negative entry (name not found) */
+typedef struct _DCENT_ {
+	WORD	id;			/* Owner file system mount ID (0:Unused) */
+	WORD	index;		/* Index of the SFN entry (DC_NEG:Name not found) */
+	DWORD	sclust;		/* Start cluster of the directory */
+#if _USE_LFN
+	WORD	lfn_idx;	/* Index of the top of the LFN entries */
+#endif
+	BYTE	name[_DCACHE_NAME];	/* Upper case name (zero padded) */
+} DCENT;
+static
+DCENT DcTbl[DC_SETS][2];	/* Directory entry cache */
+static
+BYTE DcLru[DC_SETS];		/* Entry to be replaced next in each set */
+static
+DCSTAT DcStat;				/* Directory entry cache statistics */
+#endif
+
 #if _FS_RPATH
 static
 BYTE Drive;				/* Current drive */
@@ -293,6 +317,9 @@ FRESULT sync (	/* FR_OK: successful, FR_DISK_ERR: failed */
 
 
 	res = move_window(fs, 0);
+#if _USE_BATCH
+	if (fs->batch) return res;		/* The volume is flushed when the batch is committed */
+#endif
 	if (res == FR_OK) {
 		/* Update FSInfo sector if needed */
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag) {
@@ -427,7 +454,7 @@ FRESULT put_fat (
 /*-----------------------------------------------------------------------*/
 #if !_FS_READONLY
 static
-FRESULT remove_chain (
+FRESULT free_chain (
 	FATFS *fs,			/* File system object */
 	DWORD clst			/* Cluster# to remove a chain from */
 )
@@ -458,6 +485,54 @@ FRESULT remove_chain (
 
 	return res;
 }
+
+
+#if _USE_BATCH
+/* Commit the current batch: write all the changes, then release the removed
+   chains (so a directory entry on the disk never points to free clusters) */
+static
+FRESULT batch_commit (
+	FATFS *fs			/* File system object */
+)
+{
+	FRESULT res;
+	BYTE batch = fs->batch;
+
+
+	fs->batch = 0;
+	res = sync(fs);
+	while (res == FR_OK && fs->n_pend)
+		res = free_chain(fs, fs->pend[--fs->n_pend]);
+	if (res == FR_OK) res = sync(fs);
+	fs->batch = batch;
+
+	return res;
+}
+#endif
+
+
+static
+FRESULT remove_chain (
+	FATFS *fs,			/* File system object */
+	DWORD clst			/* Cluster# to remove a chain from */
+)
+{
+#if _USE_BATCH
+	FRESULT res;
+
+
+	if (fs->batch) {	/* Keep the chain allocated until the batch is committed */
+		if (clst < 2 || clst >= fs->max_clust) return FR_INT_ERR;
+		if (fs->n_pend == _BATCH_CHAINS) {
+			res = batch_commit(fs);
+			if (res != FR_OK) return res;
+		}
+		fs->pend[fs->n_pend++] = clst;
+		return FR_OK;
+	}
+#endif
+	return free_chain(fs, clst);
+}
 #endif
 
 
@@ -825,6 +900,117 @@ BYTE sum_sfn (
 
 
 
+#if _USE_DCACHE
+/*-----------------------------------------------------------------------*/
+/* Directory entry cache - Make the key of the name and get its set      */
+/*-----------------------------------------------------------------------*/
+
+static
+int dc_key (		/* >=0:Hash set, -1:The name cannot be cached */
+	DIR *dj,		/* Directory object with the name */
+	BYTE *key		/* Buffer for the key (_DCACHE_NAME bytes) */
+)
+{
+	UINT i;
+	DWORD h;
+#if _USE_LFN
+	WCHAR w;
+
+
+	if (!dj->lfn) return -1;			/* SFN only search (numbered SFN generation) */
+	for (i = 0; (w = dj->lfn[i]) != 0; i++) {
+		if (i >= _DCACHE_NAME || w >= 0x80) return -1;	/* Too long or not ASCII */
+		if (w >= 'a' && w <= 'z') w -= 0x20;
+		key[i] = (BYTE)w;
+	}
+#else
+	mem_cpy(key, dj->fn, 11);
+	i = 11;
+#endif
+	if (i < _DCACHE_NAME) mem_set(key + i, 0, _DCACHE_NAME - i);
+
+	h = dj->sclust;
+	for (i = 0; i < _DCACHE_NAME && key[i]; i++) h = h * 31 + key[i];
+	return (int)(h % DC_SETS);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory entry cache - Find or add a name                            */
+/*-----------------------------------------------------------------------*/
+
+static
+DCENT* dc_find (	/* Pointer to the entry, 0:Not found */
+	DIR *dj,		/* Directory object */
+	int set,		/* Hash set */
+	const BYTE *key	/* Key of the name */
+)
+{
+	BYTE i;
+	DCENT *e;
+
+
+	for (i = 0; i < 2; i++) {
+		e = &DcTbl[set][i];
+		if (e->id == dj->fs->id && e->sclust == dj->sclust && !mem_cmp(e->name, key, _DCACHE_NAME)) {
+			DcLru[set] = i ^ 1;
+			return e;
+		}
+	}
+	return 0;
+}
+
+
+static
+void dc_store (
+	DIR *dj,		/* Directory object (index and lfn_idx of the entry found) */
+	int set,		/* Hash set */
+	const BYTE *key,/* Key of the name */
+	BOOL found		/* TRUE:The name exists, FALSE:It doesn't */
+)
+{
+	DCENT *e;
+
+
+	e = &DcTbl[set][DcLru[set]];
+	DcLru[set] ^= 1;
+	e->id = dj->fs->id;
+	e->sclust = dj->sclust;
+	e->index = found ? dj->index : DC_NEG;
+#if _USE_LFN
+	e->lfn_idx = dj->lfn_idx;
+#endif
+	mem_cpy(e->name, key, _DCACHE_NAME);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory entry cache - Forget the names of a directory               */
+/*-----------------------------------------------------------------------*/
+
+static
+void dc_purge (
+	FATFS *fs,		/* File system object */
+	DWORD sclust	/* Start cluster of the directory */
+)
+{
+	DCENT *e;
+
+
+	for (e = &DcTbl[0][0]; e < &DcTbl[0][0] + DC_SETS * 2; e++) {
+		if (e->id == fs->id && e->sclust == sclust) e->id = 0;
+	}
+	DcStat.purges++;
+}
+#endif /* _USE_DCACHE */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
@@ -839,6 +1025,36 @@ FRESULT dir_find (
 #if _USE_LFN
 	BYTE a, ord, sum;
 #endif
+#if _USE_DCACHE
+	BYTE key[_DCACHE_NAME];
+	int set;
+	DCENT *e;
+
+
+	set = dc_key(dj, key);
+	if (set >= 0) {
+		e = dc_find(dj, set, key);
+		if (e) {							/* The name is in the cache */
+			if (e->index == DC_NEG) {		/* Known not to exist */
+				DcStat.neg_hits++;
+				return FR_NO_FILE;
+			}
+			res = dir_seek(dj, e->index);	/* Go to the SFN entry */
+			if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+			if (res != FR_OK) return res;
+			c = dj->dir[DIR_Name];
+			if (c != 0 && c != 0xE5) {		/* Still valid? */
+#if _USE_LFN
+				dj->lfn_idx = e->lfn_idx;
+#endif
+				DcStat.hits++;
+				return FR_OK;
+			}
+			e->id = 0;						/* Stale entry, scan the directory */
+		}
+		DcStat.misses++;
+	}
+#endif
 
 	res = dir_seek(dj, 0);			/* Rewind directory object */
 	if (res != FR_OK) return res;
@@ -880,6 +1096,11 @@ FRESULT dir_find (
 		res = dir_next(dj, FALSE);		/* Next entry */
 	} while (res == FR_OK);
 
+#if _USE_DCACHE
+	if (set >= 0 && (res == FR_OK || res == FR_NO_FILE))	/* Remember the result */
+		dc_store(dj, set, key, res == FR_OK);
+#endif
+
 	return res;
 }
 
@@ -960,6 +1181,9 @@ FRESULT dir_register (	/* FR_OK:Successful, FR_DENIED:No free entry or too many
 	WCHAR *lfn;
 
 
+#if _USE_DCACHE
+	dc_purge(dj->fs, dj->sclust);	/* Names in the directory are going to change */
+#endif
 	fn = dj->fn; lfn = dj->lfn;
 	mem_cpy(sn, fn, 12);
 
@@ -1017,6 +1241,9 @@ FRESULT dir_register (	/* FR_OK:Successful, FR_DENIED:No free entry or too many
 	}
 
 #else	/* Non LFN configuration */
+#if _USE_DCACHE
+	dc_purge(dj->fs, dj->sclust);	/* Names in the directory are going to change */
+#endif
 	res = dir_seek(dj, 0);
 	if (res == FR_OK) {
 		do {	/* Find a blank entry for the SFN */
@@ -1060,6 +1287,9 @@ FRESULT dir_remove (	/* FR_OK: Successful, FR_DISK_ERR: A disk error */
 #if _USE_LFN	/* LFN configuration */
 	WORD i;
 
+#if _USE_DCACHE
+	dc_purge(dj->fs, dj->sclust);	/* Names in the directory are going to change */
+#endif
 	i = dj->index;	/* SFN index */
 	res = dir_seek(dj, (WORD)((dj->lfn_idx == 0xFFFF) ? i : dj->lfn_idx));	/* Goto the SFN or top of the LFN entries */
 	if (res == FR_OK) {
@@ -1075,6 +1305,9 @@ FRESULT dir_remove (	/* FR_OK: Successful, FR_DISK_ERR: A disk error */
 	}
 
 #else			/* Non LFN configuration */
+#if _USE_DCACHE
+	dc_purge(dj->fs, dj->sclust);	/* Names in the directory are going to change */
+#endif
 	res = dir_seek(dj, dj->index);
 	if (res == FR_OK) {
 		res = move_window(dj->fs, dj->sect);
@@ -1566,6 +1799,10 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occured */
 	/* Initialize allocation information */
 	fs->free_clust = 0xFFFFFFFF;
 	fs->wflag = 0;
+#if _USE_BATCH
+	fs->batch = 0;			/* A batch doesn't survive a media change */
+	fs->n_pend = 0;
+#endif
 	/* Get fsinfo if needed */
 	if (fmt == FS_FAT32) {
 	 	fs->fsi_flag = 0;
@@ -1585,6 +1822,7 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occured */
 	fs->cdir = 0;			/* Current directory (root dir) */
 #endif
 	fs->id = ++Fsid;		/* File system mount ID */
+	DISKCACHE_FAT(fs->drive, fs->fatbase, fsize);	/* Tell the cache where the FAT is */
 
 	return FR_OK;
 }
@@ -1751,6 +1989,12 @@ FRESULT f_open (
 	fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
 	fp->fptr = 0; fp->csect = 255;		/* File pointer */
 	fp->dsect = 0;
+#if _USE_FASTSEEK
+	fp->cltbl = 0;						/* No cluster link map table */
+#endif
+#if _USE_PREALLOC && !_FS_READONLY
+	fp->rsv_ncl = 0;					/* No cluster reservation */
+#endif
 	fp->fs = dj.fs; fp->id = dj.fs->id;	/* Owner file system object of the file */
 
 	LEAVE_FF(dj.fs, FR_OK);
@@ -1759,6 +2003,103 @@ FRESULT f_open (
 
 
 
+#if _USE_FASTSEEK
+/*-----------------------------------------------------------------------*/
+/* Get cluster number from the cluster link map table                    */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD ofs		/* File offset to be converted to cluster number */
+)
+{
+	DWORD cl, ncl, *tbl;
+
+
+	tbl = fp->cltbl + 1;	/* Top of the table */
+	cl = ofs / SS(fp->fs) / fp->fs->csize;	/* Cluster order from the top of the file */
+	for (;;) {
+		ncl = *tbl++;			/* Number of clusters in the fragment */
+		if (!ncl) return 0;		/* End of the table? (error) */
+		if (cl < ncl) break;	/* In this fragment? */
+		cl -= ncl; tbl++;		/* Next fragment */
+	}
+	return cl + *tbl;		/* Return the cluster number */
+}
+#endif
+
+
+
+
+#if _USE_PREALLOC && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Get cluster number from the contiguous reservation                    */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD prealloc_clust (	/* 0:Not in the reservation, >=2:Cluster number */
+	FIL* fp,			/* Pointer to the file object */
+	DWORD ofs			/* File offset to be converted to cluster number */
+)
+{
+	DWORD cl;
+
+
+	cl = ofs / SS(fp->fs) / fp->fs->csize;	/* Cluster order from the top of the file */
+	if (cl < fp->rsv_idx || cl - fp->rsv_idx >= fp->rsv_ncl) return 0;
+	return fp->rsv_clust + (cl - fp->rsv_idx);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Release the unused part of the contiguous reservation                 */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT prealloc_trim (
+	FIL* fp				/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	DWORD bcs, used, cl, ncl;
+
+
+	if (!fp->rsv_ncl) return FR_OK;		/* No reservation */
+	res = FR_OK;
+	bcs = (DWORD)fp->fs->csize * SS(fp->fs);
+	used = fp->fsize / bcs + (fp->fsize % bcs ? 1 : 0);	/* Clusters holding file data */
+	if (used == 0) {					/* Nothing written, remove entire cluster chain */
+		res = remove_chain(fp->fs, fp->org_clust);
+		fp->org_clust = 0;
+	} else if (used < fp->rsv_idx + fp->rsv_ncl) {	/* Remove the clusters after the last used one */
+		if (used > fp->rsv_idx) {		/* The last used cluster is in the reservation */
+			cl = fp->rsv_clust + (used - 1 - fp->rsv_idx);
+		} else {						/* Follow the chain to the last used cluster */
+			cl = fp->org_clust;
+			for (ncl = 1; ncl < used && cl >= 2 && cl < fp->fs->max_clust; ncl++)
+				cl = get_fat(fp->fs, cl);
+		}
+		ncl = get_fat(fp->fs, cl);
+		if (ncl == 0xFFFFFFFF) res = FR_DISK_ERR;
+		if (ncl <= 1) res = FR_INT_ERR;
+		if (res == FR_OK && ncl < fp->fs->max_clust) {
+			res = put_fat(fp->fs, cl, 0x0FFFFFFF);
+			if (res == FR_OK) res = remove_chain(fp->fs, ncl);
+		}
+	}
+	fp->rsv_ncl = 0;
+	fp->flag |= FA__WRITTEN;			/* The FAT has to be flushed */
+
+	return res;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Read File                                                             */
 /*-----------------------------------------------------------------------*/
@@ -1791,6 +2132,11 @@ FRESULT f_read (
 		rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt) {
 		if ((fp->fptr % SS(fp->fs)) == 0) {			/* On the sector boundary? */
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
+#if _USE_FASTSEEK
+				if (fp->cltbl && fp->fptr)			/* Get the cluster from the link map table */
+					clst = clmt_clust(fp, fp->fptr);
+				else
+#endif
 				clst = (fp->fptr == 0) ?			/* On the top of the file? */
 					fp->org_clust : get_fat(fp->fs, fp->curr_clust);
 				if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
@@ -1801,6 +2147,7 @@ FRESULT f_read (
 			sect = clust2sect(fp->fs, fp->curr_clust);	/* Get current sector */
 			if (!sect) ABORT(fp->fs, FR_INT_ERR);
 			sect += fp->csect;
+			DISKCACHE_HINT(fp->fs->drive, sect, fp->fs->csize - fp->csect);	/* Rest of the cluster is file data */
 			cc = btr / SS(fp->fs);					/* When remaining bytes >= sector size, */
 			if (cc) {								/* Read maximum contiguous sectors directly */
 				if (fp->csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
@@ -1890,6 +2237,10 @@ FRESULT f_write (
 					if (clst == 0)					/* When there is no cluster chain, */
 						fp->org_clust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
 				} else {							/* Middle or end of the file */
+#if _USE_PREALLOC
+					clst = prealloc_clust(fp, fp->fptr);	/* Reserved cluster (no FAT access) */
+					if (!clst)
+#endif
 					clst = create_chain(fp->fs, fp->curr_clust);			/* Follow or streach cluster chain */
 				}
 				if (clst == 0) break;				/* Could not allocate a new cluster (disk full) */
@@ -1911,8 +2262,17 @@ FRESULT f_write (
 			sect = clust2sect(fp->fs, fp->curr_clust);	/* Get current sector */
 			if (!sect) ABORT(fp->fs, FR_INT_ERR);
 			sect += fp->csect;
+			DISKCACHE_HINT(fp->fs->drive, sect, fp->fs->csize - fp->csect);	/* Rest of the cluster is file data */
 			cc = btw / SS(fp->fs);					/* When remaining bytes >= sector size, */
 			if (cc) {								/* Write maximum contiguous sectors directly */
+#if _USE_PREALLOC
+				clst = fp->curr_clust - fp->rsv_clust;
+				if (fp->rsv_ncl && fp->curr_clust >= fp->rsv_clust && clst < fp->rsv_ncl) {
+					clst = (fp->rsv_ncl - clst) * fp->fs->csize - fp->csect;	/* Reserved clusters are contiguous */
+					if (cc > clst) cc = clst;		/* Clip at the end of the reservation */
+					if (cc > 128) cc = 128;
+				} else
+#endif
 				if (fp->csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
 					cc = fp->fs->csize - fp->csect;
 				if (disk_write(fp->fs->drive, wbuff, sect, (BYTE)cc) != RES_OK)
@@ -1927,6 +2287,12 @@ FRESULT f_write (
 					mem_cpy(fp->buf, wbuff + ((fp->dsect - sect) * SS(fp->fs)), SS(fp->fs));
 					fp->flag &= ~FA__DIRTY;
 				}
+#endif
+#if _USE_PREALLOC
+				if (fp->csect + cc > fp->fs->csize) {	/* Crossed cluster boundaries in the reservation */
+					fp->curr_clust += (fp->csect + cc - 1) / fp->fs->csize;
+					fp->csect = (BYTE)((fp->csect + cc - 1) % fp->fs->csize + 1);
+				} else
 #endif
 				fp->csect += (BYTE)cc;				/* Next sector address in the cluster */
 				wcnt = SS(fp->fs) * cc;				/* Number of bytes transferred */
@@ -2033,6 +2399,11 @@ FRESULT f_close (
 	if (res == FR_OK) fp->fs = NULL;
 	LEAVE_FF(fp->fs, res);
 #else
+#if _USE_PREALLOC
+	res = validate(fp->fs, fp->id);
+	if (res == FR_OK) res = prealloc_trim(fp);	/* Release the unused reserved clusters */
+	if (res != FR_OK) return res;
+#endif
 	res = f_sync(fp);
 	if (res == FR_OK) fp->fs = NULL;
 	return res;
@@ -2115,6 +2486,39 @@ FRESULT f_lseek (
 	if (res != FR_OK) LEAVE_FF(fp->fs, res);
 	if (fp->flag & FA__ERROR)			/* Check abort flag */
 		LEAVE_FF(fp->fs, FR_INT_ERR);
+#if _USE_FASTSEEK
+	if (ofs == CREATE_LINKMAP) {		/* Create the cluster link map table */
+		DWORD *tbl, tlen, ulen, pcl, ncl, tcl;
+
+		if (!fp->cltbl) LEAVE_FF(fp->fs, FR_INVALID_OBJECT);
+#if !_FS_READONLY
+		if (fp->flag & FA_WRITE) LEAVE_FF(fp->fs, FR_DENIED);	/* Only for read-only files */
+#endif
+		tbl = fp->cltbl;
+		tlen = *tbl++; ulen = 2;		/* Given table size and required table size */
+		clst = fp->org_clust;			/* Top of the chain */
+		if (clst) {
+			do {						/* Get a fragment */
+				tcl = clst; ncl = 0; ulen += 2;	/* Top, length and used items */
+				do {
+					pcl = clst; ncl++;
+					clst = get_fat(fp->fs, clst);
+					if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
+					if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
+				} while (clst == pcl + 1);
+				if (ulen <= tlen) {		/* Store the length and top of the fragment */
+					*tbl++ = ncl; *tbl++ = tcl;
+				}
+			} while (clst < fp->fs->max_clust);	/* Repeat until the end of the chain */
+		}
+		*fp->cltbl = ulen;				/* Number of items used */
+		if (ulen <= tlen)
+			*tbl = 0;					/* Terminate the table */
+		else
+			res = FR_NOT_ENOUGH_CORE;	/* The given table is smaller than required */
+		LEAVE_FF(fp->fs, res);
+	}
+#endif
 	if (ofs > fp->fsize					/* In read-only mode, clip offset with the file size */
 #if !_FS_READONLY
 		 && !(fp->flag & FA_WRITE)
@@ -2123,6 +2527,26 @@ FRESULT f_lseek (
 
 	ifptr = fp->fptr;
 	fp->fptr = nsect = 0; fp->csect = 255;
+#if _USE_FASTSEEK
+	if (fp->cltbl) {					/* Fast seek with the cluster link map table */
+		if (ofs > 0) {
+			bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
+			clst = clmt_clust(fp, ofs - 1);
+			if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
+			fp->curr_clust = clst;
+			fp->fptr = ofs;
+			ofs -= (ofs - 1) / bcs * bcs;	/* Offset in the cluster (1..bcs) */
+			fp->csect = (BYTE)(ofs / SS(fp->fs));	/* Sector offset in the cluster */
+			if (ofs % SS(fp->fs)) {
+				nsect = clust2sect(fp->fs, clst);	/* Current sector */
+				if (!nsect) ABORT(fp->fs, FR_INT_ERR);
+				nsect += fp->csect;
+				DISKCACHE_HINT(fp->fs->drive, nsect, fp->fs->csize - fp->csect);	/* Rest of the cluster is file data */
+				fp->csect++;
+			}
+		}
+	} else
+#endif
 	if (ofs > 0) {
 		bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
 		if (ifptr > 0 &&
@@ -2165,6 +2589,7 @@ FRESULT f_lseek (
 				nsect = clust2sect(fp->fs, clst);	/* Current sector */
 				if (!nsect) ABORT(fp->fs, FR_INT_ERR);
 				nsect += fp->csect;
+				DISKCACHE_HINT(fp->fs->drive, nsect, fp->fs->csize - fp->csect);	/* Rest of the cluster is file data */
 				fp->csect++;
 			}
 		}
@@ -2398,6 +2823,10 @@ FRESULT f_truncate (
 	if (!(fp->flag & FA_WRITE))			/* Check access mode */
 		LEAVE_FF(fp->fs, FR_DENIED);
 
+#if _USE_PREALLOC
+	res = prealloc_trim(fp);			/* Release the unused reserved clusters */
+	if (res != FR_OK) ABORT(fp->fs, res);
+#endif
 	if (fp->fsize > fp->fptr) {
 		fp->fsize = fp->fptr;	/* Set file size to current R/W point */
 		fp->flag |= FA__WRITTEN;
@@ -2423,6 +2852,143 @@ FRESULT f_truncate (
 
 
 
+#if _USE_PREALLOC
+/*-----------------------------------------------------------------------*/
+/* Reserve Contiguous Clusters after the End of a File                   */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_prealloc (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD size		/* Number of bytes to reserve after the end of the file */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, used, ncl, lcl, cl, scl, stat, n;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR)			/* Check abort flag */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+	if (!(fp->flag & FA_WRITE))			/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+
+	fs = fp->fs;
+	res = prealloc_trim(fp);			/* Release the previous reservation */
+	if (res != FR_OK) ABORT(fs, res);
+	bcs = (DWORD)fs->csize * SS(fs);
+	used = fp->fsize / bcs + (fp->fsize % bcs ? 1 : 0);	/* Clusters holding file data */
+	if (size > 0xFFFFFFFF - used * bcs) size = 0xFFFFFFFF - used * bcs;	/* File size cannot reach 4GB */
+	ncl = size / bcs + (size % bcs ? 1 : 0);	/* Clusters to reserve */
+	if (ncl == 0) LEAVE_FF(fs, FR_OK);
+
+	/* Find the last cluster of the file (the one holding the last byte) */
+	lcl = 0;
+	if (used) {
+		if (fp->fptr == fp->fsize) {	/* At the end of the file, the current cluster is the last one */
+			lcl = fp->curr_clust;
+		} else {
+			lcl = fp->org_clust;
+			for (n = 1; n < used; n++) {
+				lcl = get_fat(fs, lcl);
+				if (lcl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+				if (lcl < 2 || lcl >= fs->max_clust) ABORT(fs, FR_INT_ERR);
+			}
+		}
+		cl = get_fat(fs, lcl);			/* Remove the clusters left after the file data, if any */
+		if (cl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (cl <= 1) ABORT(fs, FR_INT_ERR);
+		if (cl < fs->max_clust) {
+			res = put_fat(fs, lcl, 0x0FFFFFFF);
+			if (res == FR_OK) res = remove_chain(fs, cl);
+			if (res != FR_OK) ABORT(fs, res);
+		}
+	} else if (fp->org_clust) {			/* Empty file with clusters, remove them */
+		res = remove_chain(fs, fp->org_clust);
+		if (res != FR_OK) ABORT(fs, res);
+		fp->org_clust = 0;
+	}
+
+	/* Find a run of free clusters, preferably right after the file */
+	scl = lcl ? lcl + 1 : fs->last_clust + 1;
+	if (scl < 2 || scl >= fs->max_clust) scl = 2;
+	cl = scl; n = 0;
+	for (;;) {
+		stat = get_fat(fs, cl);
+		if (stat == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (stat == 1) ABORT(fs, FR_INT_ERR);
+		if (stat == 0) {
+			if (++n == ncl) break;		/* Found */
+		} else {
+			n = 0;
+		}
+		if (++cl >= fs->max_clust) {	/* Wrap around (a run can't) */
+			cl = 2; n = 0;
+		}
+		if (cl == scl) LEAVE_FF(fs, FR_DENIED);	/* No run large enough */
+	}
+	cl -= ncl - 1;						/* First cluster of the run */
+
+	/* Link the run and append it to the file */
+	for (n = 0; n < ncl; n++) {
+		res = put_fat(fs, cl + n, n == ncl - 1 ? 0x0FFFFFFF : cl + n + 1);
+		if (res != FR_OK) ABORT(fs, res);
+	}
+	if (lcl) {
+		res = put_fat(fs, lcl, cl);
+		if (res != FR_OK) ABORT(fs, res);
+	} else {
+		fp->org_clust = cl;
+	}
+	fs->last_clust = cl + ncl - 1;		/* Update FSInfo */
+	if (fs->free_clust != 0xFFFFFFFF) {
+		fs->free_clust -= ncl;
+		fs->fsi_flag = 1;
+	}
+	fp->rsv_clust = cl;
+	fp->rsv_idx = used;
+	fp->rsv_ncl = ncl;
+	fp->flag |= FA__WRITTEN;
+
+	LEAVE_FF(fs, FR_OK);
+}
+#endif /* _USE_PREALLOC */
+
+
+
+
+#if _USE_BATCH
+/*-----------------------------------------------------------------------*/
+/* Start or Commit a Batch of Metadata Updates                           */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_batch (
+	const XCHAR *path,	/* Pointer to the logical drive number (root dir) */
+	BYTE begin			/* 1: start a batch, 0: commit it */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = chk_mounted(&path, &fs, 1);
+	if (res != FR_OK) LEAVE_FF(fs, res);
+	if (begin) {			/* Batches can be nested, the outermost one is committed */
+		if (fs->batch == 0xFF) LEAVE_FF(fs, FR_DENIED);
+		fs->batch++;
+	} else if (fs->batch) {
+		if (fs->batch == 1) res = batch_commit(fs);
+		fs->batch--;
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif /* _USE_BATCH */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
@@ -2467,6 +3033,10 @@ FRESULT f_unlink (
 
 	res = dir_remove(&dj);					/* Remove directory entry */
 	if (res == FR_OK) {
+#if _USE_DCACHE
+		if (dclst)							/* The cluster of a removed directory can be reused */
+			dc_purge(dj.fs, dclst);
+#endif
 		if (dclst)
 			res = remove_chain(dj.fs, dclst);	/* Remove the cluster chain */
 		if (res == FR_OK) res = sync(dj.fs);
@@ -2710,6 +3280,24 @@ FRESULT f_rename (
 
 
 
+#if _USE_DCACHE
+/*-----------------------------------------------------------------------*/
+/* Get Directory Entry Cache Statistics                                  */
+/*-----------------------------------------------------------------------*/
+
+void f_getdcstat (
+	DCSTAT *st,		/* Pointer to the statistics to be returned */
+	BYTE reset		/* 1:Clear the statistics after they are read */
+)
+{
+	mem_cpy(st, &DcStat, sizeof(DCSTAT));
+	if (reset) mem_set(&DcStat, 0, sizeof(DCSTAT));
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Forward data to the stream directly (Available on only _FS_TINY cfg)  */
 /*-----------------------------------------------------------------------*/
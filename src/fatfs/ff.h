@@ -326,6 +326,11 @@ typedef struct _FATFS_ {
 	DWORD	dirbase;	/* Root directory start sector (Cluster# on FAT32) */
 	DWORD	database;	/* Data start sector */
 	DWORD	winsect;	/* Current sector appearing in the win[] */
+#if _USE_BATCH && !_FS_READONLY
+	BYTE	batch;		/* Batch nesting level (0: no batch) */
+	BYTE	n_pend;		/* Number of chains waiting to be removed */
+	DWORD	pend[_BATCH_CHAINS];	/* Start clusters of the chains to remove on commit */
+#endif
 	BYTE	win[_MAX_SS];/* Disk access window for Directory/FAT */
 } FATFS;
 
@@ -366,6 +371,14 @@ typedef struct _FIL_ {
 	DWORD	dir_sect;	/* Sector containing the directory entry */
 	BYTE*	dir_ptr;	/* Ponter to the directory entry in the window */
 #endif
+#if _USE_FASTSEEK
+	DWORD*	cltbl;		/* Pointer to the cluster link map table (null on file open) */
+#endif
+#if _USE_PREALLOC && !_FS_READONLY
+	DWORD	rsv_clust;	/* First cluster of the contiguous reservation */
+	DWORD	rsv_idx;	/* Index of rsv_clust in the cluster chain of the file */
+	DWORD	rsv_ncl;	/* Number of reserved clusters (0: no reservation) */
+#endif
 #if !_FS_TINY
 	BYTE	buf[_MAX_SS];/* File R/W buffer */
 #endif
@@ -373,6 +386,19 @@ typedef struct _FIL_ {
 
 
 
+#if _USE_DCACHE
+/* Directory entry cache statistics */
+
+typedef struct _DCSTAT_ {
+	DWORD	hits;		/* Names found in the cache */
+	DWORD	neg_hits;	/* Names known not to exist found in the cache */
+	DWORD	misses;		/* Names looked up in the directory */
+	DWORD	purges;		/* Directory changes that invalidated cached names */
+} DCSTAT;
+#endif
+
+
+
 /* File status structure */
 
 typedef struct _FILINFO_ {
@@ -407,7 +433,8 @@ typedef enum {
 	FR_NOT_ENABLED,		/* 12 */
 	FR_NO_FILESYSTEM,	/* 13 */
 	FR_MKFS_ABORTED,	/* 14 */
-	FR_TIMEOUT			/* 15 */
+	FR_TIMEOUT,			/* 15 */
+	FR_NOT_ENOUGH_CORE	/* 16 */
 } FRESULT;
 
 
@@ -426,6 +453,9 @@ FRESULT f_readdir (DIR*, FILINFO*);					/* Read a directory item */
 FRESULT f_stat (const XCHAR*, FILINFO*);			/* Get file status */
 FRESULT f_getfree (const XCHAR*, DWORD*, FATFS**);	/* Get number of free clusters on the drive */
 FRESULT f_truncate (FIL*);							/* Truncate file */
+FRESULT f_prealloc (FIL*, DWORD);					/* Reserve contiguous clusters after the end of a file */
+FRESULT f_batch (const XCHAR*, BYTE);				/* Start or commit a batch of metadata updates */
+void f_getdcstat (DCSTAT*, BYTE);					/* Get (and reset) the directory entry cache statistics */
 FRESULT f_sync (FIL*);								/* Flush cached data of a writing file */
 FRESULT f_unlink (const XCHAR*);					/* Delete an existing file or directory */
 FRESULT	f_mkdir (const XCHAR*);						/* Create a new directory */
@@ -495,6 +525,11 @@ void ff_rel_grant(_SYNC_t);
 #define FA__ERROR			0x80
 
 
+/* Fast seek: f_lseek offset that builds the cluster link map table */
+
+#define CREATE_LINKMAP		0xFFFFFFFF
+
+
 /* FAT sub type (FATFS.fs_type) */
 
 #define FS_FAT12	1
@@ -12,6 +12,7 @@
 #include "type.h"
 #include "integer.h"
 #include "devman.h"
+#include "platform_conf.h"
 
 /*---------------------------------------------------------------------------/
 / Function and Buffer Configurations
@@ -39,12 +40,46 @@
 /   3: f_lseek is removed in addition to level 2. */
 
 
+#define	_USE_FASTSEEK	1	/* 0 or 1 */
+/* To enable the fast seek feature (cluster link map table), set _USE_FASTSEEK
+/  to 1. This is backported from later FatFs revisions and works only on files
+/  opened without write access. */
+
+
+#define	_USE_PREALLOC	1	/* 0 or 1 */
+/* To enable f_prealloc (contiguous cluster reservation for files that grow
+/  sequentially), set _USE_PREALLOC to 1. The unused part of the reservation
+/  is released by f_close and f_truncate. */
+
+
+#define	_USE_DCACHE		1	/* 0 or 1 */
+#define	_DCACHE_ENTRIES	16	/* Number of cached names (even) */
+#define	_DCACHE_NAME	20	/* Maximum cached name length (11 to 255) */
+/* To enable the directory entry cache, set _USE_DCACHE to 1. Path lookups
+/  remember where a name was found in a directory (or that it was not found),
+/  so probing the same paths again doesn't scan the directory tables. Only
+/  ASCII names up to _DCACHE_NAME characters are cached. */
+
+
+#define	_USE_BATCH		1	/* 0 or 1 */
+#define	_BATCH_CHAINS	32	/* Number of cluster chains released per commit */
+/* To enable batched metadata updates (f_batch), set _USE_BATCH to 1. While a
+/  batch is open the volume is not flushed after every operation and removed
+/  cluster chains are only released when the batch is committed, after the
+/  directory changes reached the disk. */
+
+
 #define	_USE_STRFUNC	0	/* 0, 1 or 2 */
 /* To enable string functions, set _USE_STRFUNC to 1 or 2. */
 
 
-#define	_USE_MKFS	0		/* 0 or 1 */
-/* To enable f_mkfs function, set _USE_MKFS to 1 and set _FS_READONLY to 0 */
+#ifdef BUILD_NANDFTL
+#define	_USE_MKFS	1		/* 0 or 1 */
+#else
+#define	_USE_MKFS	0
+#endif
+/* To enable f_mkfs function, set _USE_MKFS to 1 and set _FS_READONLY to 0.
+/  It's needed by the NAND FTL, a blank chip is formatted when it's mounted. */
 
 
 #define	_USE_FORWARD	0	/* 0 or 1 */
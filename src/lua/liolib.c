@@ -19,6 +19,10 @@
 #include "lualib.h"
 #include "lrotable.h"
 
+#ifndef LUA_CROSS_COMPILER
+#include "ioctl.h"
+#endif
+
 
 #define IO_INPUT	1
 #define IO_OUTPUT	2
@@ -501,6 +505,18 @@ static int f_flush (lua_State *L) {
   return pushresult(L, fflush(tofile(L)) == 0, NULL);
 }
 
+
+#ifndef LUA_CROSS_COMPILER
+/* eLua: reserve contiguous space after the end of the file */
+static int f_prealloc (lua_State *L) {
+  FILE *f = tofile(L);
+  unsigned int bytes = (unsigned int)luaL_checknumber(L, 2);
+  if (fflush(f) != 0)
+    return pushresult(L, 0, NULL);
+  return pushresult(L, ioctl(fileno(f), FDPREALLOC, &bytes) == 0, NULL);
+}
+#endif
+
 #define MIN_OPT_LEVEL 2
 #include "lrodefs.h"
 #if LUA_OPTIMIZE_MEMORY == 2
@@ -541,6 +557,9 @@ const LUA_REG_TYPE flib[] = {
   {LSTRKEY("close"), LFUNCVAL(io_close)},
   {LSTRKEY("flush"), LFUNCVAL(f_flush)},
   {LSTRKEY("lines"), LFUNCVAL(f_lines)},
+#ifndef LUA_CROSS_COMPILER
+  {LSTRKEY("prealloc"), LFUNCVAL(f_prealloc)},
+#endif
   {LSTRKEY("read"), LFUNCVAL(f_read)},
   {LSTRKEY("seek"), LFUNCVAL(f_seek)},
   {LSTRKEY("setvbuf"), LFUNCVAL(f_setvbuf)},
@@ -19,6 +19,9 @@
 #include "lauxlib.h"
 #include "lualib.h"
 #include "lrotable.h"
+#ifndef LUA_CROSS_COMPILER
+#include "devman.h"
+#endif
 
 
 static int os_pushresult (lua_State *L, int i, const char *filename) {
@@ -51,10 +54,64 @@ static int os_remove (lua_State *L) {
 static int os_rename (lua_State *L) {
   const char *fromname = luaL_checkstring(L, 1);
   const char *toname = luaL_checkstring(L, 2);
+#ifndef LUA_CROSS_COMPILER
+  return os_pushresult(L, dm_rename(fromname, toname) == 0, fromname);
+#else
   return os_pushresult(L, rename(fromname, toname) == 0, fromname);
+#endif
+}
+
+
+#ifndef LUA_CROSS_COMPILER
+/* os.mkdir(path [, mode]) */
+static int os_mkdir (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  int mode = luaL_optint(L, 2, 0755);
+  return os_pushresult(L, dm_mkdir(name, mode) == 0, name);
 }
 
 
+/*
+** os.stat(path): returns a table with the size, the modification time
+** and the mode ("file" or "directory") of a file
+*/
+static int os_stat (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  struct dm_stat st;
+  if (dm_stat(name, &st) != 0)
+    return os_pushresult(L, 0, name);
+  lua_createtable(L, 0, 3);
+  lua_pushinteger(L, st.fsize);
+  lua_setfield(L, -2, "size");
+  lua_pushnumber(L, st.ftime);
+  lua_setfield(L, -2, "mtime");
+  lua_pushstring(L, st.isdir ? "directory" : "file");
+  lua_setfield(L, -2, "mode");
+  return 1;
+}
+#endif
+
+
+#ifndef LUA_CROSS_COMPILER
+/*
+** os.batch(f, ...): calls f(...) with the metadata updates of the file
+** systems grouped in a single batch, which is committed when f returns
+** (even if it raises an error). Returns the results of f.
+*/
+static int os_batch (lua_State *L) {
+  int status, base;
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  base = lua_gettop(L);
+  dm_batch(NULL, 1);
+  status = lua_pcall(L, base - 1, LUA_MULTRET, 0);
+  dm_batch(NULL, 0);
+  if (status != 0)
+    lua_error(L);
+  return lua_gettop(L);
+}
+#endif
+
+
 static int os_tmpname (lua_State *L) {
   char buff[LUA_TMPNAMBUFSIZE];
   int err;
@@ -222,6 +279,9 @@ static int os_exit (lua_State *L) {
 #define MIN_OPT_LEVEL 1
 #include "lrodefs.h"
 const LUA_REG_TYPE syslib[] = {
+#ifndef LUA_CROSS_COMPILER
+  {LSTRKEY("batch"),     LFUNCVAL(os_batch)},
+#endif
   {LSTRKEY("clock"),     LFUNCVAL(os_clock)},
   {LSTRKEY("date"),      LFUNCVAL(os_date)},
 #if !defined LUA_NUMBER_INTEGRAL
@@ -230,9 +290,15 @@ const LUA_REG_TYPE syslib[] = {
   {LSTRKEY("execute"),   LFUNCVAL(os_execute)},
   {LSTRKEY("exit"),      LFUNCVAL(os_exit)},
   {LSTRKEY("getenv"),    LFUNCVAL(os_getenv)},
+#ifndef LUA_CROSS_COMPILER
+  {LSTRKEY("mkdir"),     LFUNCVAL(os_mkdir)},
+#endif
   {LSTRKEY("remove"),    LFUNCVAL(os_remove)},
   {LSTRKEY("rename"),    LFUNCVAL(os_rename)},
   {LSTRKEY("setlocale"), LFUNCVAL(os_setlocale)},
+#ifndef LUA_CROSS_COMPILER
+  {LSTRKEY("stat"),      LFUNCVAL(os_stat)},
+#endif
   {LSTRKEY("time"),      LFUNCVAL(os_time)},
   {LSTRKEY("tmpname"),   LFUNCVAL(os_tmpname)},
   {LNILKEY, LNILVAL}
@@ -0,0 +1,114 @@
+// Small LZ77 compressor for data links (RFS payloads)
+
+#include <string.h>
+#include "type.h"
+#include "lz.h"
+
+#define LZ_MAX_LITERALS       32
+#define LZ_MIN_MATCH          3
+#define LZ_MAX_MATCH          ( 7 + 255 + 2 )
+
+static unsigned lz_hash( const u8 *p )
+{
+  u32 v = ( ( u32 )p[ 0 ] << 16 ) | ( ( u32 )p[ 1 ] << 8 ) | p[ 2 ];
+
+  return ( ( u32 )( v * 2654435761UL ) >> ( 32 - LZ_HASH_BITS ) ) & ( LZ_HASH_SIZE - 1 );
+}
+
+u32 lz_compress( const u8 *src, u32 srclen, u8 *dest, u32 destmax, u16 *phash )
+{
+  u32 ip = 0, op = 1, litpos = 0, lit = 0, ref, off, len, maxlen;
+  unsigned h;
+
+  if( srclen == 0 || srclen > 0xFFFF || destmax < 2 )
+    return 0;
+  // The hash table has the positions + 1 of the last 3 bytes sequences (0 for none)
+  memset( phash, 0, LZ_HASH_SIZE * sizeof( u16 ) );
+  while( ip < srclen )
+  {
+    if( ip + LZ_MIN_MATCH <= srclen )
+    {
+      h = lz_hash( src + ip );
+      ref = phash[ h ];
+      phash[ h ] = ( u16 )( ip + 1 );
+      if( ref && ( off = ip - ref ) < LZ_WINDOW_SIZE && !memcmp( src + ref - 1, src + ip, LZ_MIN_MATCH ) )
+      {
+        ref --;
+        maxlen = srclen - ip < LZ_MAX_MATCH ? srclen - ip : LZ_MAX_MATCH;
+        for( len = LZ_MIN_MATCH; len < maxlen && src[ ref + len ] == src[ ip + len ]; len ++ );
+        // Close the current literal run (or drop its unused control byte)
+        if( lit )
+          dest[ litpos ] = ( u8 )( lit - 1 );
+        else
+          op --;
+        if( op + 3 > destmax )
+          return 0;
+        if( len - 2 < 7 )
+          dest[ op ++ ] = ( u8 )( ( ( len - 2 ) << 5 ) | ( off >> 8 ) );
+        else
+        {
+          dest[ op ++ ] = ( u8 )( ( 7 << 5 ) | ( off >> 8 ) );
+          dest[ op ++ ] = ( u8 )( len - 2 - 7 );
+        }
+        dest[ op ++ ] = ( u8 )off;
+        // The positions inside the match go to the hash table too
+        for( ip ++, len --; len; ip ++, len -- )
+          if( ip + LZ_MIN_MATCH <= srclen )
+            phash[ lz_hash( src + ip ) ] = ( u16 )( ip + 1 );
+        litpos = op ++;
+        lit = 0;
+        continue;
+      }
+    }
+    if( op >= destmax )
+      return 0;
+    dest[ op ++ ] = src[ ip ++ ];
+    if( ++ lit == LZ_MAX_LITERALS )
+    {
+      dest[ litpos ] = ( u8 )( lit - 1 );
+      litpos = op ++;
+      lit = 0;
+    }
+  }
+  if( lit )
+    dest[ litpos ] = ( u8 )( lit - 1 );
+  else
+    op --;
+  return op;
+}
+
+s32 lz_decompress( const u8 *src, u32 srclen, u8 *dest, u32 destmax )
+{
+  u32 ip = 0, op = 0, len, ref;
+  u8 c;
+
+  while( ip < srclen )
+  {
+    c = src[ ip ++ ];
+    if( c < LZ_MAX_LITERALS )
+    {
+      len = c + 1;
+      if( ip + len > srclen || op + len > destmax )
+        return -1;
+      memcpy( dest + op, src + ip, len );
+      ip += len;
+      op += len;
+    }
+    else
+    {
+      len = c >> 5;
+      if( len == 7 && ip < srclen )
+        len += src[ ip ++ ];
+      if( ip >= srclen )
+        return -1;
+      ref = ( ( u32 )( c & 0x1F ) << 8 ) + src[ ip ++ ] + 1;
+      len += 2;
+      if( ref > op || op + len > destmax )
+        return -1;
+      // The match can overlap the data that it produces
+      for( ref = op - ref; len; len -- )
+        dest[ op ++ ] = dest[ ref ++ ];
+    }
+  }
+  return ( s32 )op;
+}
@@ -25,6 +25,7 @@
 
 #include "mmcfs.h"
 #include "romfs.h"
+#include "ramfs.h"
 #include "semifs.h"
 
 // Define here your autorun/boot files, 
@@ -97,6 +98,9 @@ int main( void )
   // Register the ROM filesystem
   dm_register( romfs_init() );
 
+  // Register the RAM filesystem
+  dm_register( ramfs_init() );
+
   // Register the MMC filesystems
   for( i = 0; i < 2; i ++ )
     dm_register( mmcfs_init( i ) );
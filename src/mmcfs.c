@@ -12,42 +12,57 @@
 #include "ff.h"
 #include "diskio.h"
 #include "platform.h"
+#include "nandftl.h"
 #include <fcntl.h>
 
-#define MMCFS_MAX_FDS   4
-static FIL mmcfs_fd_table[ MMCFS_MAX_FDS ];
-static int mmcfs_num_fd;
+// Maximum number of open files (can be overriden in platform_conf.h)
+#ifndef MMCFS_MAX_FDS
+#define MMCFS_MAX_FDS   8
+#endif
+
+// File objects are allocated from a pool only when needed (FatFs is built with
+// _FS_TINY, the files share the sector window of the file system object and
+// the disk cache, if enabled, keeps the recently used sectors)
+DM_POOL_DECLARE( mmcfs_fd_pool, sizeof( FIL ), MMCFS_MAX_FDS );
+#define mmcfs_get_fd( fd )  ( ( FIL* )dm_pool_get( &mmcfs_fd_pool, fd ) )
+
+#if _USE_FASTSEEK
+// Cluster link maps (FatFs fast seek): a map is built for a read-only file
+// on its first seek, so following seeks don't have to walk the FAT chain
+// Number of maps (files that can use fast seek at the same time)
+#ifndef MMCFS_CLMT_MAPS
+#define MMCFS_CLMT_MAPS     4
+#endif
+
+// Size of a map (in DWORDs, a file can have ( MMCFS_CLMT_ITEMS - 2 ) / 2 fragments)
+#ifndef MMCFS_CLMT_ITEMS
+#define MMCFS_CLMT_ITEMS    32
+#endif
+
+DM_POOL_DECLARE( mmcfs_clmt_pool, MMCFS_CLMT_ITEMS * sizeof( DWORD ), MMCFS_CLMT_MAPS );
+
+// Map of each file: a map index or one of the values below
+#define MMCFS_CLMT_NONE     ( -1 )  // not built (yet)
+#define MMCFS_CLMT_NEVER    ( -2 )  // can't be used (write access or too many fragments)
+static s8 mmcfs_clmt[ MMCFS_MAX_FDS ];
+#endif // #if _USE_FASTSEEK
+
+static MMCFS_SEEK_STATS mmcfs_seek_stats;
 
 // Data structures used by FatFs
 static FATFS mmc_fs;
 static FATFS nand_fs;
-static FIL mmc_fileObject;
 //static DIR mmc_dir;
 //static FILINFO mmc_fileInfo;
 
 #define PATH_BUF_SIZE   40
 static char mmc_pathBuf[PATH_BUF_SIZE];
 
-static int mmcfs_find_empty_fd( void )
-{
-  int i;
-
-  for (i = 0; i < MMCFS_MAX_FDS; i ++)
-    if (mmcfs_fd_table[i].fs == NULL)
-      return i;
-  return -1;
-}
-
 static int mmcfs_open_r( struct _reent *r, const char *path, int flags, int mode, int devid )
 {
   int fd;
   int mmc_mode;
-
-  if (mmcfs_num_fd == MMCFS_MAX_FDS)
-  {
-    r->_errno = ENFILE;
-    return -1;
-  }
+  FIL* pFile;
 
   // Default to top directory if none given
   mmc_pathBuf[0] = devid + '0';
@@ -98,18 +113,25 @@ static int mmcfs_open_r( struct _reent *r, const char *path, int flags, int mode
   }
 #endif  // _FS_READONLY
 
-  // Open the file for reading
-  if (f_open(&mmc_fileObject, mmc_pathBuf, mmc_mode) != FR_OK)
+  // Get a file object and open the file directly into it
+  if ((fd = dm_pool_alloc(&mmcfs_fd_pool)) == -1)
+  {
+    r->_errno = ENFILE;
+    return -1;
+  }
+  pFile = mmcfs_get_fd(fd);
+  if (f_open(pFile, mmc_pathBuf, mmc_mode) != FR_OK)
   {
+    dm_pool_free(&mmcfs_fd_pool, fd);
     r->_errno = ENOENT;
     return -1;
   }
 
   if (mode & O_APPEND)
-    mmc_fileObject.fptr = mmc_fileObject.fsize;
-  fd = mmcfs_find_empty_fd();
-  memcpy(mmcfs_fd_table + fd, &mmc_fileObject, sizeof(FIL));
-  mmcfs_num_fd ++;
+    pFile->fptr = pFile->fsize;
+#if _USE_FASTSEEK
+  mmcfs_clmt[ fd ] = ( mmc_mode & FA_WRITE ) ? MMCFS_CLMT_NEVER : MMCFS_CLMT_NONE;
+#endif
   return fd;
 }
 
@@ -125,11 +147,15 @@ static int mmcfs_open_r_nand( struct _reent *r, const char *path, int flags, int
 
 static int mmcfs_close_r( struct _reent *r, int fd )
 {
-  FIL* pFile = mmcfs_fd_table + fd;
+  FIL* pFile = mmcfs_get_fd( fd );
 
   f_close( pFile );
+#if _USE_FASTSEEK
+  if( mmcfs_clmt[ fd ] >= 0 )
+    dm_pool_free( &mmcfs_clmt_pool, mmcfs_clmt[ fd ] );
+#endif
   memset(pFile, 0, sizeof(FIL));
-  mmcfs_num_fd --;
+  dm_pool_free(&mmcfs_fd_pool, fd);
   return 0;
 }
 
@@ -143,7 +169,7 @@ static _ssize_t mmcfs_write_r( struct _reent *r, int fd, const void* ptr, size_t
 #else
   UINT bytesWritten;
 
-  if (f_write(mmcfs_fd_table + fd, ptr, len, &bytesWritten) != FR_OK)
+  if (f_write(mmcfs_get_fd( fd ), ptr, len, &bytesWritten) != FR_OK)
   {
     r->_errno = EIO;
     return -1;
@@ -157,7 +183,7 @@ static _ssize_t mmcfs_read_r( struct _reent *r, int fd, void* ptr, size_t len )
 {
   UINT bytesRead;
 
-  if (f_read(mmcfs_fd_table + fd, ptr, len, &bytesRead) != FR_OK)
+  if (f_read(mmcfs_get_fd( fd ), ptr, len, &bytesRead) != FR_OK)
   {
     r->_errno = EIO;
     return -1;
@@ -166,10 +192,49 @@ static _ssize_t mmcfs_read_r( struct _reent *r, int fd, void* ptr, size_t len )
   return (_ssize_t) bytesRead;
 }
 
+#if _USE_FASTSEEK
+// Helper: build the cluster link map of a file
+static void mmcfsh_build_map( int fd, FIL *pFile )
+{
+  int idx;
+  DWORD *tbl;
+
+  if( ( idx = dm_pool_alloc( &mmcfs_clmt_pool ) ) == -1 )
+    return; // no free map, try again on the next seek
+  tbl = ( DWORD* )dm_pool_get( &mmcfs_clmt_pool, idx );
+  tbl[ 0 ] = MMCFS_CLMT_ITEMS;
+  pFile->cltbl = tbl;
+  mmcfs_seek_stats.links += ( pFile->fsize + pFile->fs->csize * 512 - 1 ) / ( pFile->fs->csize * 512 );
+  if( f_lseek( pFile, CREATE_LINKMAP ) != FR_OK )
+  {
+    pFile->cltbl = NULL;
+    dm_pool_free( &mmcfs_clmt_pool, idx );
+    mmcfs_clmt[ fd ] = MMCFS_CLMT_NEVER;
+    return;
+  }
+  mmcfs_clmt[ fd ] = idx;
+  mmcfs_seek_stats.maps ++;
+}
+#endif // #if _USE_FASTSEEK
+
+// Helper: return the number of FAT links that f_lseek follows without a
+// cluster link map (it walks forward from the current cluster or from the
+// start of the file)
+static u32 mmcfsh_seek_links( FIL *pFile, u32 newpos )
+{
+  u32 bcs = pFile->fs->csize * 512;
+
+  if( newpos == 0 )
+    return 0;
+  if( pFile->fptr > 0 && ( newpos - 1 ) / bcs >= ( pFile->fptr - 1 ) / bcs )
+    return ( newpos - 1 ) / bcs - ( pFile->fptr - 1 ) / bcs;
+  return ( newpos - 1 ) / bcs;
+}
+
 // lseek
 static off_t mmcfs_lseek_r( struct _reent *r, int fd, off_t off, int whence )
 {
-  FIL* pFile = mmcfs_fd_table + fd;
+  FIL* pFile = mmcfs_get_fd( fd );
   u32 newpos = 0;
 
   switch( whence )
@@ -192,6 +257,15 @@ static off_t mmcfs_lseek_r( struct _reent *r, int fd, off_t off, int whence )
     default:
       return -1;
   }
+  mmcfs_seek_stats.seeks ++;
+#if _USE_FASTSEEK
+  if( mmcfs_clmt[ fd ] == MMCFS_CLMT_NONE )
+    mmcfsh_build_map( fd, pFile );
+  if( pFile->cltbl )
+    mmcfs_seek_stats.fastseeks ++;
+  else
+#endif
+    mmcfs_seek_stats.links += mmcfsh_seek_links( pFile, newpos );
   if (f_lseek (pFile, newpos) != FR_OK)
     return -1;
   return newpos;
@@ -284,6 +358,103 @@ static int mmcfs_unlink_r_nand( struct _reent *r, const char* fname )
   return mmcfs_unlink_r( r, fname, 1 );
 }
 
+// mkdir
+static int mmcfs_mkdir_r( struct _reent *r, const char* name, int devnum )
+{
+#if _FS_READONLY
+  return -1;
+#else
+  mmc_pathBuf[0] = devnum + '0';
+  mmc_pathBuf[1] = ':';
+  mmc_pathBuf[2] = 0;
+  if (strchr(name, '/') == NULL)
+    strcat(mmc_pathBuf, "/");
+  strcat(mmc_pathBuf, name);
+  return f_mkdir(mmc_pathBuf) == FR_OK ? 0 : -1;
+#endif // _FS_READONLY
+}
+
+static int mmcfs_mkdir_r_mmc( struct _reent *r, const char* name, int mode )
+{
+  return mmcfs_mkdir_r( r, name, 0 );
+}
+
+static int mmcfs_mkdir_r_nand( struct _reent *r, const char* name, int mode )
+{
+  return mmcfs_mkdir_r( r, name, 1 );
+}
+
+// ioctl
+static int mmcfs_ioctl_r( struct _reent *r, int fd, unsigned long request, void *ptr )
+{
+  FIL* pFile = mmcfs_get_fd( fd );
+
+  switch( request )
+  {
+#if _USE_PREALLOC && !_FS_READONLY
+    case FDPREALLOC:
+      // Reserve contiguous clusters after the end of the file
+      if( !( pFile->flag & FA_WRITE ) )
+      {
+        r->_errno = EBADF;
+        return -1;
+      }
+      switch( f_prealloc( pFile, *( u32* )ptr ) )
+      {
+        case FR_OK:
+          return 0;
+
+        case FR_DENIED:
+          r->_errno = ENOSPC;
+          break;
+
+        default:
+          r->_errno = EIO;
+          break;
+      }
+      return -1;
+#endif
+
+    case FDBLKSIZE:
+      *( u32* )ptr = ( u32 )pFile->fs->csize * _MAX_SS;
+      return 0;
+
+    default:
+      r->_errno = EINVAL;
+      return -1;
+  }
+}
+
+// batch
+static int mmcfs_batch_r( struct _reent *r, int begin, int devnum )
+{
+#if _USE_BATCH && !_FS_READONLY
+  char path[ 4 ];
+
+  path[ 0 ] = devnum + '0';
+  strcpy( path + 1, ":/" );
+  if( f_batch( path, begin ? 1 : 0 ) != FR_OK )
+  {
+    r->_errno = EIO;
+    return -1;
+  }
+  return 0;
+#else
+  r->_errno = ENOSYS;
+  return -1;
+#endif
+}
+
+static int mmcfs_batch_r_mmc( struct _reent *r, int begin )
+{
+  return mmcfs_batch_r( r, begin, 0 );
+}
+
+static int mmcfs_batch_r_nand( struct _reent *r, int begin )
+{
+  return mmcfs_batch_r( r, begin, 1 );
+}
+
 // MMC device descriptor structure
 static const DM_DEVICE mmcfs_device =
 {
@@ -297,7 +468,12 @@ static const DM_DEVICE mmcfs_device =
   mmcfs_readdir_r,      // readdir
   mmcfs_closedir_r,     // closedir
   NULL,                 // getaddr
-  mmcfs_unlink_r_mmc    // unlink
+  mmcfs_unlink_r_mmc,   // unlink
+  mmcfs_ioctl_r,        // ioctl
+  mmcfs_batch_r_mmc,    // batch
+  NULL,                 // rename
+  mmcfs_mkdir_r_mmc,    // mkdir
+  NULL                  // stat
 };
 
 // MMC device descriptor structure (NAND)
@@ -313,16 +489,45 @@ static DM_DEVICE nand_device =
   mmcfs_readdir_r,      // readdir
   mmcfs_closedir_r,     // closedir
   NULL,                 // getaddr
-  mmcfs_unlink_r_nand   // unlink
+  mmcfs_unlink_r_nand,  // unlink
+  mmcfs_ioctl_r,        // ioctl
+  mmcfs_batch_r_nand,   // batch
+  NULL,                 // rename
+  mmcfs_mkdir_r_nand,   // mkdir
+  NULL                  // stat
 };
 
+#ifdef MMCFS_CARD_PIN
 #define MMC_CARD_RESNUM        PLATFORM_IO_ENCODE( MMCFS_CARD_PORT, MMCFS_CARD_PIN, PLATFORM_IO_ENC_PIN )
+#endif
+
+#ifdef BUILD_NANDFTL
+// Helper: mount /nand, formatting the chip if the FTL didn't find any data
+static int mmcfsh_mount_nand()
+{
+  DWORD nclst;
+  FATFS *fs;
+  FRESULT res;
+
+  res = f_getfree( "1:/", &nclst, &fs );
+  if( res == FR_NO_FILESYSTEM && nandftl_is_blank() )
+  {
+    printf( "Formatting /nand...\n" );
+    res = f_mkfs( 1, 1, 0 );
+  }
+  return res == FR_OK;
+}
+#define MMCFS_NUM_DRIVES       2
+#else
+#define MMCFS_NUM_DRIVES       1
+#endif
 
 const DM_DEVICE* mmcfs_init( unsigned i )
 {
-  if( i >= 1 )
+  if( i >= MMCFS_NUM_DRIVES )
     return NULL;
 
+#ifdef MMCFS_CARD_PIN
   if( i == 0 )
   {
     platform_pio_op( MMCFS_CARD_PORT, 1 << MMCFS_CARD_PIN, PLATFORM_IO_PIN_DIR_INPUT );
@@ -331,17 +536,48 @@ const DM_DEVICE* mmcfs_init( unsigned i )
     if( platform_pio_op( MMCFS_CARD_PORT, 1 << MMCFS_CARD_PIN, PLATFORM_IO_PIN_GET ) )
       return NULL;
   }
+#endif
 
   // Mount the MMC file system using logical disk 0
   if ( f_mount( i, i == 0 ? &mmc_fs : &nand_fs ) != FR_OK )
     return NULL;
+#ifdef BUILD_NANDFTL
+  if( i == 1 && !mmcfsh_mount_nand() )
+  {
+    f_mount( 1, NULL );
+    return NULL;
+  }
+#endif
   return i == 0 ? &mmcfs_device : &nand_device;
 }
 
+void mmcfs_get_seek_stats( MMCFS_SEEK_STATS *pstats, int reset )
+{
+  memcpy( pstats, &mmcfs_seek_stats, sizeof( MMCFS_SEEK_STATS ) );
+  if( reset )
+    memset( &mmcfs_seek_stats, 0, sizeof( MMCFS_SEEK_STATS ) );
+}
+
+void mmcfs_get_dcache_stats( MMCFS_DCACHE_STATS *pstats, int reset )
+{
+#if _USE_DCACHE
+  DCSTAT st;
+
+  f_getdcstat( &st, reset ? 1 : 0 );
+  pstats->hits = st.hits;
+  pstats->neg_hits = st.neg_hits;
+  pstats->misses = st.misses;
+  pstats->purges = st.purges;
+#else
+  memset( pstats, 0, sizeof( MMCFS_DCACHE_STATS ) );
+#endif
+}
+
 extern volatile DSTATUS Stat;
 
 void mmcfs_int_handler()
 {
+#ifdef MMCFS_CARD_PIN
   Stat = STA_NOINIT;
   if( platform_pio_op( MMCFS_CARD_PORT, 1 << MMCFS_CARD_PIN, PLATFORM_IO_PIN_GET ) == 0 ) // card inserted
   {
@@ -353,6 +589,7 @@ void mmcfs_int_handler()
     dm_unregister( "/mmc" );
     f_mount( 0, NULL );
   }
+#endif
 }
 
 #else // #ifdef BUILD_MMCFS
@@ -362,6 +599,16 @@ const DM_DEVICE* mmcfs_init()
   return NULL;
 }
 
+void mmcfs_get_seek_stats( MMCFS_SEEK_STATS *pstats, int reset )
+{
+  memset( pstats, 0, sizeof( MMCFS_SEEK_STATS ) );
+}
+
+void mmcfs_get_dcache_stats( MMCFS_DCACHE_STATS *pstats, int reset )
+{
+  memset( pstats, 0, sizeof( MMCFS_DCACHE_STATS ) );
+}
+
 void mmcfs_int_handler()
 {
 }
@@ -0,0 +1,212 @@
+// Module for asynchronous file I/O (elua_aio.h)
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+#include "platform.h"
+#include "auxmods.h"
+#include "lrotable.h"
+#include "elua_aio.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "platform_conf.h"
+#ifdef BUILD_AIO
+
+// The registry keeps a table with the data of each request (indexed by the
+// request ID): { file, buffer, offset, op }. The buffer is a userdata, so it
+// doesn't move and it's collected with the request.
+#define AIO_REQ_TABLE_KEY     ( int )&aio_submit
+
+enum
+{
+  AIO_FIELD_FILE = 1,
+  AIO_FIELD_BUF,
+  AIO_FIELD_OFFSET,
+  AIO_FIELD_OP
+};
+
+// Helper: check the file argument and return its stdio handle
+static FILE* aioh_check_file( lua_State *L )
+{
+  FILE *fp = *( FILE** )luaL_checkudata( L, 1, LUA_FILEHANDLE );
+
+  if( fp == NULL )
+    luaL_error( L, "attempt to use a closed file" );
+  return fp;
+}
+
+// Helper: queue a request and save its data in the request table
+static int aioh_submit( lua_State *L, int op, FILE *fp, void *buf, u32 len, int bufidx )
+{
+  long offset = ( long )luaL_optinteger( L, 3, ftell( fp ) );
+  int id;
+
+  if( offset < 0 )
+    return luaL_error( L, "invalid offset" );
+  // Both the stdio buffer and the device must see the same file contents
+  fflush( fp );
+  if( ( id = aio_submit( op, fileno( fp ), buf, len, ( u32 )offset ) ) == -1 )
+    return luaL_error( L, "too many asynchronous requests" );
+  lua_rawgeti( L, LUA_REGISTRYINDEX, AIO_REQ_TABLE_KEY );
+  lua_createtable( L, 4, 0 );
+  lua_pushvalue( L, 1 );
+  lua_rawseti( L, -2, AIO_FIELD_FILE );
+  lua_pushvalue( L, bufidx );
+  lua_rawseti( L, -2, AIO_FIELD_BUF );
+  lua_pushinteger( L, offset );
+  lua_rawseti( L, -2, AIO_FIELD_OFFSET );
+  lua_pushinteger( L, op );
+  lua_rawseti( L, -2, AIO_FIELD_OP );
+  lua_rawseti( L, -2, id );
+  lua_pop( L, 1 );
+  lua_pushinteger( L, id );
+  return 1;
+}
+
+// Helper: push the data of a request on the stack (error if not found)
+static void aioh_get_request( lua_State *L, int id )
+{
+  lua_rawgeti( L, LUA_REGISTRYINDEX, AIO_REQ_TABLE_KEY );
+  lua_rawgeti( L, -1, id );
+  lua_remove( L, -2 );
+  if( lua_isnil( L, -1 ) || aio_get_state( id ) == AIO_STATE_FREE )
+    luaL_error( L, "invalid request ID" );
+}
+
+// Helper: forget a request
+static void aioh_release( lua_State *L, int id )
+{
+  aio_release( id );
+  lua_rawgeti( L, LUA_REGISTRYINDEX, AIO_REQ_TABLE_KEY );
+  lua_pushnil( L );
+  lua_rawseti( L, -2, id );
+  lua_pop( L, 1 );
+}
+
+// Lua: id = read( file, size, [offset] )
+static int aio_read( lua_State *L )
+{
+  FILE *fp = aioh_check_file( L );
+  u32 len = ( u32 )luaL_checkinteger( L, 2 );
+  void *buf;
+
+  buf = lua_newuserdata( L, len > 0 ? len : 1 );
+  return aioh_submit( L, AIO_OP_READ, fp, buf, len, lua_gettop( L ) );
+}
+
+// Lua: id = write( file, data, [offset] )
+static int aio_write( lua_State *L )
+{
+  FILE *fp = aioh_check_file( L );
+  size_t len;
+  const char *data = luaL_checklstring( L, 2, &len );
+  void *buf;
+
+  // Copy the data, the executor doesn't run with the string anchored anywhere
+  buf = lua_newuserdata( L, len > 0 ? len : 1 );
+  memcpy( buf, data, len );
+  return aioh_submit( L, AIO_OP_WRITE, fp, buf, len, lua_gettop( L ) );
+}
+
+// Lua: done = done( id )
+static int aio_done( lua_State *L )
+{
+  int id = luaL_checkinteger( L, 1 );
+
+  lua_pushboolean( L, aio_get_state( id ) == AIO_STATE_DONE );
+  return 1;
+}
+
+// Lua: res, err = result( id )
+// 'res' is the data (read) or the number of bytes written (write), or nil
+// for error. The request is finished in the foreground if needed.
+static int aio_result( lua_State *L )
+{
+  int id = luaL_checkinteger( L, 1 );
+  FILE *fp;
+  s32 res;
+  int err, op;
+  long offset;
+
+  aioh_get_request( L, id ); // req
+  aio_wait( id );
+  res = aio_get_result( id, &err );
+  lua_rawgeti( L, -1, AIO_FIELD_FILE ); // req file
+  fp = *( FILE** )lua_touserdata( L, -1 );
+  lua_rawgeti( L, -2, AIO_FIELD_OFFSET ); // req file offset
+  offset = ( long )lua_tointeger( L, -1 );
+  lua_rawgeti( L, -3, AIO_FIELD_OP ); // req file offset op
+  op = lua_tointeger( L, -1 );
+  lua_pop( L, 3 ); // req
+  // Keep the stdio view of the file in sync with the device
+  if( fp != NULL && res >= 0 )
+    fseek( fp, offset + res, SEEK_SET );
+  if( res < 0 )
+  {
+    lua_pushnil( L );
+    lua_pushinteger( L, err );
+  }
+  else if( op == AIO_OP_READ )
+  {
+    lua_rawgeti( L, -1, AIO_FIELD_BUF ); // req buf
+    lua_pushlstring( L, ( const char* )lua_touserdata( L, -1 ), res ); // req buf data
+    lua_remove( L, -2 ); // req data
+    lua_pushinteger( L, err );
+  }
+  else
+  {
+    lua_pushinteger( L, res );
+    lua_pushinteger( L, err );
+  }
+  aioh_release( L, id );
+  return 2;
+}
+
+// Lua: cancel( id )
+static int aio_cancel( lua_State *L )
+{
+  int id = luaL_checkinteger( L, 1 );
+
+  aioh_get_request( L, id );
+  aioh_release( L, id );
+  return 0;
+}
+
+// Lua: n = pending()
+static int aio_pending( lua_State *L )
+{
+  lua_pushinteger( L, aio_get_pending() );
+  return 1;
+}
+
+// Module function map
+#define MIN_OPT_LEVEL 2
+#include "lrodefs.h"
+const LUA_REG_TYPE aio_map[] = 
+{
+  { LSTRKEY( "read" ), LFUNCVAL( aio_read ) },
+  { LSTRKEY( "write" ), LFUNCVAL( aio_write ) },
+  { LSTRKEY( "done" ), LFUNCVAL( aio_done ) },
+  { LSTRKEY( "result" ), LFUNCVAL( aio_result ) },
+  { LSTRKEY( "cancel" ), LFUNCVAL( aio_cancel ) },
+  { LSTRKEY( "pending" ), LFUNCVAL( aio_pending ) },
+  { LNILKEY, LNILVAL }
+};
+
+LUALIB_API int luaopen_aio( lua_State *L )
+{
+  // Requests don't survive a Lua state
+  aio_init();
+  lua_newtable( L );
+  lua_rawseti( L, LUA_REGISTRYINDEX, AIO_REQ_TABLE_KEY );
+#if LUA_OPTIMIZE_MEMORY > 0
+  return 0;
+#else // #if LUA_OPTIMIZE_MEMORY > 0
+  luaL_register( L, AUXLIB_AIO, aio_map );
+  return 1;
+#endif // #if LUA_OPTIMIZE_MEMORY > 0
+}
+
+#endif // #ifdef BUILD_AIO
@@ -60,6 +60,9 @@ LUALIB_API int ( luaopen_i2c )( lua_State *L );
 #define AUXLIB_NRF      "nrf"
 LUALIB_API int ( luaopen_nrf )( lua_State *L );
 
+#define AUXLIB_AIO      "aio"
+LUALIB_API int ( luaopen_aio )( lua_State *L );
+
 // Helper macros
 #define MOD_CHECK_ID( mod, id )\
   if( !platform_ ## mod ## _exists( id ) )\
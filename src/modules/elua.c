@@ -13,6 +13,11 @@
 #include "devman.h"
 #include "help.h"
 #include "term.h"
+#include "diskcache.h"
+#include "mmcfs.h"
+#include "nandftl.h"
+#include "blkdev.h"
+#include "elua_rfs.h"
 #include <string.h>
 #include <time.h>
 
@@ -92,6 +97,185 @@ static int elua_fs_mounted( lua_State *L )
   return 1;
 }
 
+// Lua: entries = listdir( path ), a table with the size of every file
+static int elua_listdir( lua_State *L )
+{
+  const char *pname = luaL_checkstring( L, 1 );
+  DM_DIR *pdir;
+  struct dm_dirent *pent;
+
+  if( ( pdir = dm_opendir( pname ) ) == NULL )
+    return 0;
+  lua_newtable( L );
+  while( ( pent = dm_readdir( pdir ) ) != NULL )
+  {
+    lua_pushnumber( L, ( lua_Number )pent->fsize );
+    lua_setfield( L, -2, pent->fname );
+  }
+  dm_closedir( pdir );
+  return 1;
+}
+
+// Lua: limit, used = fdlimit( dev, [limit] )
+static int elua_fdlimit( lua_State *L )
+{
+  const char *pname = luaL_checkstring( L, 1 );
+  int limit, used;
+
+  if( lua_isnumber( L, 2 ) )
+    dm_set_fd_limit( pname, luaL_checkinteger( L, 2 ) );
+  if( ( used = dm_get_fd_usage( pname, &limit ) ) < 0 )
+    return luaL_error( L, "device %s not found", pname );
+  lua_pushinteger( L, limit );
+  lua_pushinteger( L, used );
+  return 2;
+}
+
+// Lua: count = resolvecount()
+static int elua_resolvecount( lua_State *L )
+{
+  lua_pushnumber( L, ( lua_Number )dm_get_resolve_count() );
+  return 1;
+}
+
+// Helper: set a field of the table on the top of the stack
+static void eluah_set_field( lua_State *L, const char *name, u32 value )
+{
+  lua_pushnumber( L, ( lua_Number )value );
+  lua_setfield( L, -2, name );
+}
+
+// Lua: stats = seekstats( [reset] )
+static int elua_seekstats( lua_State *L )
+{
+  MMCFS_SEEK_STATS stats;
+
+  mmcfs_get_seek_stats( &stats, lua_toboolean( L, 1 ) );
+  lua_createtable( L, 0, 4 );
+  eluah_set_field( L, "seeks", stats.seeks );
+  eluah_set_field( L, "fastseeks", stats.fastseeks );
+  eluah_set_field( L, "links", stats.links );
+  eluah_set_field( L, "maps", stats.maps );
+  return 1;
+}
+
+// Lua: stats = dcache( [reset] )
+static int elua_dcache( lua_State *L )
+{
+  MMCFS_DCACHE_STATS stats;
+
+  mmcfs_get_dcache_stats( &stats, lua_toboolean( L, 1 ) );
+  lua_createtable( L, 0, 4 );
+  eluah_set_field( L, "hits", stats.hits );
+  eluah_set_field( L, "neg_hits", stats.neg_hits );
+  eluah_set_field( L, "misses", stats.misses );
+  eluah_set_field( L, "purges", stats.purges );
+  return 1;
+}
+
+#ifdef BUILD_DISKCACHE
+
+// Lua: stats = diskcache( [reset] )
+static int elua_diskcache( lua_State *L )
+{
+  DISKCACHE_STATS stats;
+
+  disk_cache_get_stats( &stats );
+  if( lua_toboolean( L, 1 ) )
+    disk_cache_reset_stats();
+  lua_createtable( L, 0, 9 );
+  eluah_set_field( L, "meta_sectors", disk_cache_get_size( DISKCACHE_META ) );
+  eluah_set_field( L, "data_sectors", disk_cache_get_size( DISKCACHE_DATA ) );
+  eluah_set_field( L, "meta_hits", stats.hits[ DISKCACHE_META ] );
+  eluah_set_field( L, "meta_misses", stats.misses[ DISKCACHE_META ] );
+  eluah_set_field( L, "data_hits", stats.hits[ DISKCACHE_DATA ] );
+  eluah_set_field( L, "data_misses", stats.misses[ DISKCACHE_DATA ] );
+  eluah_set_field( L, "bypass", stats.bypass );
+  eluah_set_field( L, "writebacks", stats.writebacks );
+  eluah_set_field( L, "writecmds", stats.writecmds );
+  return 1;
+}
+#endif // #ifdef BUILD_DISKCACHE
+
+// Lua: stats = blkdev( [reset] )
+static int elua_blkdev( lua_State *L )
+{
+  BLKDEV_STATS stats;
+
+  blkdev_get_stats( &stats, lua_toboolean( L, 1 ) );
+  lua_createtable( L, 0, 7 );
+  eluah_set_field( L, "reads", stats.reads );
+  eluah_set_field( L, "writes", stats.writes );
+  eluah_set_field( L, "dev_reads", stats.dev_reads );
+  eluah_set_field( L, "dev_writes", stats.dev_writes );
+  eluah_set_field( L, "ra_fills", stats.ra_fills );
+  eluah_set_field( L, "ra_hits", stats.ra_hits );
+  eluah_set_field( L, "merged", stats.merged );
+  return 1;
+}
+
+#ifdef BUILD_NANDFTL
+
+// Lua: stats = nandftl( [reset] )
+static int elua_nandftl( lua_State *L )
+{
+  NANDFTL_STATS stats;
+
+  nandftl_get_stats( &stats, lua_toboolean( L, 1 ) );
+  lua_createtable( L, 0, 11 );
+  eluah_set_field( L, "sectors", nandftl_get_sectors() );
+  eluah_set_field( L, "host_writes", stats.host_writes );
+  eluah_set_field( L, "flash_writes", stats.flash_writes );
+  eluah_set_field( L, "gc_blocks", stats.gc_blocks );
+  eluah_set_field( L, "gc_moves", stats.gc_moves );
+  eluah_set_field( L, "wl_moves", stats.wl_moves );
+  eluah_set_field( L, "erases", stats.erases );
+  eluah_set_field( L, "free_blocks", stats.free_blocks );
+  eluah_set_field( L, "bad_blocks", stats.bad_blocks );
+  eluah_set_field( L, "min_erase", stats.min_erase );
+  eluah_set_field( L, "max_erase", stats.max_erase );
+  return 1;
+}
+
+// Lua: gc()
+static int elua_nandftl_gc( lua_State *L )
+{
+  lua_pushboolean( L, nandftl_gc_step() );
+  return 1;
+}
+#endif // #ifdef BUILD_NANDFTL
+
+#ifdef BUILD_RFS
+
+// Lua: stats = rfscompress( [enable] )
+// Enabling or disabling the compression resets the statistics
+static int elua_rfscompress( lua_State *L )
+{
+  u32 raw, wire;
+
+  if( lua_isboolean( L, 1 ) )
+    remotefs_set_compression( lua_toboolean( L, 1 ) );
+  remotefs_get_compression_stats( &raw, &wire );
+  lua_createtable( L, 0, 2 );
+  eluah_set_field( L, "raw", raw );
+  eluah_set_field( L, "wire", wire );
+  return 1;
+}
+
+// Lua: stats = rfsstats( [reset] )
+static int elua_rfsstats( lua_State *L )
+{
+  u32 requests, sent, received;
+
+  remotefs_get_stats( &requests, &sent, &received, lua_toboolean( L, 1 ) );
+  lua_createtable( L, 0, 3 );
+  eluah_set_field( L, "requests", requests );
+  eluah_set_field( L, "sent", sent );
+  eluah_set_field( L, "received", received );
+  return 1;
+}
+#endif // #ifdef BUILD_RFS
+
 // Lua: res = help( [topic] )
 static int elua_help( lua_State *L )
 {
@@ -119,6 +303,23 @@ const LUA_REG_TYPE elua_map[] =
   { LSTRKEY( "save_history" ), LFUNCVAL( elua_save_history ) },
   { LSTRKEY( "strftime" ), LFUNCVAL( elua_strftime ) },
   { LSTRKEY( "fs_mounted" ), LFUNCVAL( elua_fs_mounted ) },
+  { LSTRKEY( "listdir" ), LFUNCVAL( elua_listdir ) },
+  { LSTRKEY( "fdlimit" ), LFUNCVAL( elua_fdlimit ) },
+  { LSTRKEY( "resolvecount" ), LFUNCVAL( elua_resolvecount ) },
+  { LSTRKEY( "seekstats" ), LFUNCVAL( elua_seekstats ) },
+  { LSTRKEY( "dcache" ), LFUNCVAL( elua_dcache ) },
+#ifdef BUILD_DISKCACHE
+  { LSTRKEY( "diskcache" ), LFUNCVAL( elua_diskcache ) },
+#endif
+  { LSTRKEY( "blkdev" ), LFUNCVAL( elua_blkdev ) },
+#ifdef BUILD_NANDFTL
+  { LSTRKEY( "nandftl" ), LFUNCVAL( elua_nandftl ) },
+  { LSTRKEY( "nandftl_gc" ), LFUNCVAL( elua_nandftl_gc ) },
+#endif
+#ifdef BUILD_RFS
+  { LSTRKEY( "rfscompress" ), LFUNCVAL( elua_rfscompress ) },
+  { LSTRKEY( "rfsstats" ), LFUNCVAL( elua_rfsstats ) },
+#endif
   { LSTRKEY( "help" ), LFUNCVAL( elua_help ) },
 #if LUA_OPTIMIZE_MEMORY > 0
   { LSTRKEY( "EGC_NOT_ACTIVE" ), LNUMVAL( EGC_NOT_ACTIVE ) },
@@ -6,6 +6,7 @@
 #include "platform.h"
 #include "auxmods.h"
 #include "elua_net.h"
+#include "devman.h"
 #include <stdio.h>
 #include <string.h>
 #include <stddef.h>
@@ -118,6 +119,34 @@ static int net_send( lua_State* L )
   return 2;  
 }
 
+// Lua: res, err = sendfile( sock, file, [offset], [len] )
+// Sends the file contents without going through Lua strings
+// 'offset' defaults to the current file position, 'len' to "up to EOF"
+static int net_sendfile( lua_State* L )
+{
+  sock_t *s = sock_check( L );
+  FILE *fp = *( FILE** )luaL_checkudata( L, 2, LUA_FILEHANDLE );
+  long offset;
+  u32 len = DM_SENDFILE_TO_EOF;
+  int res;
+
+  if( fp == NULL )
+    return luaL_error( L, "attempt to use a closed file" );
+  offset = ( long )luaL_optinteger( L, 3, ftell( fp ) );
+  if( offset < 0 )
+    return luaL_error( L, "invalid offset" );
+  if( !lua_isnoneornil( L, 4 ) )
+    len = ( u32 )luaL_checkinteger( L, 4 );
+  fflush( fp );
+  res = dm_sendfile( fileno( fp ), s->sock, ( u32 )offset, len );
+  // Keep the stdio view of the file in sync with the device
+  if( res >= 0 )
+    fseek( fp, offset + res, SEEK_SET );
+  lua_pushinteger( L, res );
+  lua_pushinteger( L, elua_net_get_last_err( s->sock ) );
+  return 2;
+}
+
 // Lua: err = connect( sock, iptype, port, [timer_id, timeout] )
 // "iptype" is actually an int returned by "net.packip"
 static int net_connect( lua_State *L )
@@ -375,6 +404,7 @@ const LUA_REG_TYPE net_map[] =
   { LSTRKEY( "set_split" ), LFUNCVAL( net_set_split ) },
   { LSTRKEY( "close" ), LFUNCVAL( net_close ) },
   { LSTRKEY( "send" ), LFUNCVAL( net_send ) },
+  { LSTRKEY( "sendfile" ), LFUNCVAL( net_sendfile ) },
   { LSTRKEY( "recv" ), LFUNCVAL( net_recv ) },
   { LSTRKEY( "lookup" ), LFUNCVAL( net_lookup ) },
   { LSTRKEY( "netcfg" ), LFUNCVAL( net_netcfg ) },
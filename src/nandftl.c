@@ -0,0 +1,627 @@
+// Log-structured flash translation layer for small page NAND flash (nandftl.h)
+
+#include "platform_conf.h"
+#ifdef BUILD_NANDFTL
+
+#include "nandftl.h"
+#include "platform.h"
+#include "type.h"
+#include "blkdev.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Default configuration (can be overriden in platform_conf.h)
+#ifndef NANDFTL_BLOCKS
+#error "BUILD_NANDFTL needs NANDFTL_BLOCKS (number of flash blocks used by the FTL)"
+#endif
+
+// Number of pages in a flash block
+#ifndef NANDFTL_PAGES_PER_BLOCK
+#define NANDFTL_PAGES_PER_BLOCK   32
+#endif
+
+// Number of pages mapped by a single map entry. Larger units make the map
+// smaller, but a unit is always written as a whole (the sectors that didn't
+// change are copied from the previous copy of the unit).
+#ifndef NANDFTL_PAGES_PER_UNIT
+#define NANDFTL_PAGES_PER_UNIT    1
+#endif
+
+// Blocks that are not exported to the file system (room for the garbage
+// collector and for the blocks that go bad)
+#ifndef NANDFTL_RESERVED_BLOCKS
+#define NANDFTL_RESERVED_BLOCKS   ( NANDFTL_BLOCKS / 16 )
+#endif
+
+// The garbage collector runs in the foreground (from a write) when there are
+// less free blocks than this
+#ifndef NANDFTL_GC_MIN_FREE
+#define NANDFTL_GC_MIN_FREE       3
+#endif
+
+// The garbage collector runs in the background (from nandftl_sync or
+// nandftl_gc_step) when there are less free blocks than this
+#ifndef NANDFTL_GC_FREE
+#define NANDFTL_GC_FREE           ( NANDFTL_GC_MIN_FREE * 2 )
+#endif
+
+// A block with static data is moved when its erase count is this much lower
+// than the largest erase count
+#ifndef NANDFTL_WEAR_DELTA
+#define NANDFTL_WEAR_DELTA        64
+#endif
+
+#if NANDFTL_PAGES_PER_BLOCK > 255
+#error "NANDFTL_PAGES_PER_BLOCK must be at most 255"
+#endif
+
+#if NANDFTL_PAGES_PER_BLOCK % NANDFTL_PAGES_PER_UNIT != 0
+#error "NANDFTL_PAGES_PER_BLOCK must be a multiple of NANDFTL_PAGES_PER_UNIT"
+#endif
+
+#if NANDFTL_RESERVED_BLOCKS < NANDFTL_GC_MIN_FREE + 2
+#error "NANDFTL_RESERVED_BLOCKS must be at least NANDFTL_GC_MIN_FREE + 2"
+#endif
+
+#define NFTL_SECTORS              ( ( NANDFTL_BLOCKS - NANDFTL_RESERVED_BLOCKS ) * NANDFTL_PAGES_PER_BLOCK )
+#define NFTL_PAGES                ( NANDFTL_BLOCKS * NANDFTL_PAGES_PER_BLOCK )
+#define NFTL_UNITS                ( NFTL_SECTORS / NANDFTL_PAGES_PER_UNIT )
+#define NFTL_PHYS_UNITS           ( NFTL_PAGES / NANDFTL_PAGES_PER_UNIT )
+#define NFTL_UNITS_PER_BLOCK      ( NANDFTL_PAGES_PER_BLOCK / NANDFTL_PAGES_PER_UNIT )
+#define NFTL_NONE                 0xFFFFFFFFUL
+
+// The map uses 16-bit unit numbers when the chip is small enough
+#if NFTL_PHYS_UNITS < 0xFFFF
+typedef u16 nftl_unit_t;
+#define NFTL_UNMAPPED             0xFFFF
+#else
+typedef u32 nftl_unit_t;
+#define NFTL_UNMAPPED             0xFFFFFFFFUL
+#endif
+
+// RAM needed by the FTL: erase counts, map, valid unit counts and block states
+#define NFTL_MEM_SIZE             ( NANDFTL_BLOCKS * sizeof( u32 ) + NFTL_UNITS * sizeof( nftl_unit_t ) + NANDFTL_BLOCKS * 2 )
+
+// Spare area layout (byte 5 is the bad block marker of small page chips)
+#define NFTL_SP_SECTOR            0         // logical sector (u32, NFTL_NONE for padding)
+#define NFTL_SP_BADBLOCK          5         // 0xFF for good blocks
+#define NFTL_SP_MAGIC             6         // NFTL_MAGIC (u16)
+#define NFTL_SP_SEQ               8         // block sequence number (u32)
+#define NFTL_SP_ECNT              12        // block erase count (u32)
+#define NFTL_MAGIC                0x4654
+
+// Block states
+enum
+{
+  NFTL_BLK_FREE = 0,                // no valid data, erased when it's opened
+  NFTL_BLK_OPEN,                    // the write frontier
+  NFTL_BLK_USED,                    // full or closed, has valid data
+  NFTL_BLK_GC,                      // being collected
+  NFTL_BLK_RETIRE,                  // a program failed, collected and then marked bad
+  NFTL_BLK_BAD
+};
+
+static u32 *nftl_ecnt;
+static nftl_unit_t *nftl_map;
+static u8 *nftl_valid;
+static u8 *nftl_state;
+
+static u32 nftl_open = NFTL_NONE;   // frontier block
+static u32 nftl_open_seq;           // sequence number of the frontier block
+static unsigned nftl_next;          // next free page in the frontier block (unit aligned)
+static u32 nftl_seq;                // last block sequence number
+static u32 nftl_free;               // number of free blocks
+static u32 nftl_max_ecnt;
+static int nftl_in_gc;
+static int nftl_ready;
+static int nftl_blank;
+static NANDFTL_STATS nftl_stats;
+static u8 nftl_buf[ NANDFTL_PAGE_SIZE ];
+static u8 nftl_spare[ NANDFTL_SPARE_SIZE ];
+
+#ifdef NANDFTL_START_ADDRESS
+#ifndef NANDFTL_MEM_SIZE
+#error "NANDFTL_START_ADDRESS needs NANDFTL_MEM_SIZE"
+#endif
+#endif
+
+// ****************************************************************************
+// Helpers
+
+static u32 nftlh_get32( const u8 *p )
+{
+  return p[ 0 ] | ( ( u32 )p[ 1 ] << 8 ) | ( ( u32 )p[ 2 ] << 16 ) | ( ( u32 )p[ 3 ] << 24 );
+}
+
+static void nftlh_put32( u8 *p, u32 v )
+{
+  p[ 0 ] = ( u8 )v;
+  p[ 1 ] = ( u8 )( v >> 8 );
+  p[ 2 ] = ( u8 )( v >> 16 );
+  p[ 3 ] = ( u8 )( v >> 24 );
+}
+
+// Helper: allocate the FTL tables
+static int nftlh_alloc()
+{
+  u8 *p;
+
+  if( nftl_ecnt )
+    return PLATFORM_OK;
+#ifdef NANDFTL_START_ADDRESS
+  if( NFTL_MEM_SIZE > NANDFTL_MEM_SIZE )
+    return PLATFORM_ERR;
+  p = ( u8* )NANDFTL_START_ADDRESS;
+#else
+  if( ( p = malloc( NFTL_MEM_SIZE ) ) == NULL )
+    return PLATFORM_ERR;
+#endif
+  nftl_ecnt = ( u32* )p;
+  nftl_map = ( nftl_unit_t* )( p + NANDFTL_BLOCKS * sizeof( u32 ) );
+  nftl_valid = ( u8* )( nftl_map + NFTL_UNITS );
+  nftl_state = nftl_valid + NANDFTL_BLOCKS;
+  return PLATFORM_OK;
+}
+
+// Helper: mark a block as bad (on the chip too)
+static void nftlh_mark_bad( u32 block )
+{
+  nftl_state[ block ] = NFTL_BLK_BAD;
+  memset( nftl_spare, 0xFF, NANDFTL_SPARE_SIZE );
+  nftl_spare[ NFTL_SP_BADBLOCK ] = 0;
+  nand_ll_write( block * NANDFTL_PAGES_PER_BLOCK, NULL, nftl_spare );
+}
+
+// Helper: a block lost its last valid page
+static void nftlh_release( u32 block )
+{
+  if( nftl_state[ block ] == NFTL_BLK_USED )
+  {
+    nftl_state[ block ] = NFTL_BLK_FREE;
+    nftl_free ++;
+  }
+}
+
+// Helper: map a unit to a physical unit (invalidating the previous copy)
+static void nftlh_map_unit( u32 unit, u32 phys )
+{
+  u32 old = nftl_map[ unit ], block;
+
+  if( old != NFTL_UNMAPPED )
+  {
+    block = old / NFTL_UNITS_PER_BLOCK;
+    if( -- nftl_valid[ block ] == 0 )
+      nftlh_release( block );
+  }
+  nftl_map[ unit ] = ( nftl_unit_t )phys;
+  nftl_valid[ phys / NFTL_UNITS_PER_BLOCK ] ++;
+}
+
+static int nftlh_collect_block( u32 block );
+
+// Helper: move the block with static data that has the smallest erase count
+// if it's too far behind the most worn block
+static void nftlh_wear_level()
+{
+  u32 b, cold = NFTL_NONE;
+
+  for( b = 0; b < NANDFTL_BLOCKS; b ++ )
+    if( nftl_state[ b ] == NFTL_BLK_USED && ( cold == NFTL_NONE || nftl_ecnt[ b ] < nftl_ecnt[ cold ] ) )
+      cold = b;
+  if( cold == NFTL_NONE || nftl_max_ecnt - nftl_ecnt[ cold ] <= NANDFTL_WEAR_DELTA )
+    return;
+  if( nftlh_collect_block( cold ) == PLATFORM_OK )
+    nftl_stats.wl_moves ++;
+}
+
+// Helper: choose the block reclaimed by the garbage collector
+static u32 nftlh_pick_victim()
+{
+  u32 b, victim = NFTL_NONE;
+
+  for( b = 0; b < NANDFTL_BLOCKS; b ++ )
+  {
+    if( nftl_state[ b ] == NFTL_BLK_RETIRE )
+      return b;
+    if( nftl_state[ b ] == NFTL_BLK_USED && nftl_valid[ b ] < NFTL_UNITS_PER_BLOCK &&
+        ( victim == NFTL_NONE || nftl_valid[ b ] < nftl_valid[ victim ] ) )
+      victim = b;
+  }
+  return victim;
+}
+
+// Helper: run the garbage collector on a single block
+static int nftlh_collect()
+{
+  u32 victim = nftlh_pick_victim();
+
+  if( victim == NFTL_NONE || nftlh_collect_block( victim ) != PLATFORM_OK )
+    return PLATFORM_ERR;
+  nftl_stats.gc_blocks ++;
+  return PLATFORM_OK;
+}
+
+// Helper: open a new frontier block (the free block with the smallest erase
+// count). Returns the block or NFTL_NONE if there are no free blocks.
+static u32 nftlh_open_block()
+{
+  u32 b, block;
+
+  if( !nftl_in_gc )
+  {
+    while( nftl_free < NANDFTL_GC_MIN_FREE )
+      if( nftlh_collect() != PLATFORM_OK )
+        break;
+    if( nftl_free >= NANDFTL_GC_MIN_FREE )
+      nftlh_wear_level();
+    // The pages moved above might have opened a frontier already
+    if( nftl_open != NFTL_NONE )
+      return nftl_open;
+  }
+  while( 1 )
+  {
+    for( b = 0, block = NFTL_NONE; b < NANDFTL_BLOCKS; b ++ )
+      if( nftl_state[ b ] == NFTL_BLK_FREE && ( block == NFTL_NONE || nftl_ecnt[ b ] < nftl_ecnt[ block ] ) )
+        block = b;
+    if( block == NFTL_NONE )
+      return NFTL_NONE;
+    nftl_free --;
+    nftl_stats.erases ++;
+    if( nand_ll_erase( block ) == PLATFORM_OK )
+      break;
+    nftlh_mark_bad( block );
+  }
+  if( ++ nftl_ecnt[ block ] > nftl_max_ecnt )
+    nftl_max_ecnt = nftl_ecnt[ block ];
+  nftl_state[ block ] = NFTL_BLK_OPEN;
+  nftl_valid[ block ] = 0;
+  nftl_open = block;
+  nftl_open_seq = ++ nftl_seq;
+  nftl_next = 0;
+  return block;
+}
+
+// Helper: close the frontier block
+static void nftlh_close_block()
+{
+  nftl_state[ nftl_open ] = NFTL_BLK_USED;
+  if( nftl_valid[ nftl_open ] == 0 )
+    nftlh_release( nftl_open );
+  nftl_open = NFTL_NONE;
+}
+
+// Helper: write a unit at the frontier. 'data' has 'count' sectors of the
+// unit, starting with sector 'first' of the unit; the other sectors are
+// copied from the current copy of the unit (or erased if it's not mapped).
+static int nftlh_program( u32 unit, const u8 *data, unsigned first, unsigned count )
+{
+  u32 page, old;
+  const u8 *src;
+  unsigned tries, i;
+  int err = 0;
+
+  for( tries = 0; tries < 3; tries ++ )
+  {
+    if( nftl_open == NFTL_NONE && nftlh_open_block() == NFTL_NONE )
+      return PLATFORM_ERR;
+    page = nftl_open * NANDFTL_PAGES_PER_BLOCK + nftl_next;
+    old = nftl_map[ unit ];
+    for( i = 0; i < NANDFTL_PAGES_PER_UNIT; i ++ )
+    {
+      src = nftl_buf;
+      if( err )
+        src = NULL;
+      else if( i >= first && i < first + count )
+        src = data + ( i - first ) * NANDFTL_PAGE_SIZE;
+      else if( old == NFTL_UNMAPPED )
+        memset( nftl_buf, 0xFF, NANDFTL_PAGE_SIZE );
+      else if( nand_ll_read( old * NANDFTL_PAGES_PER_UNIT + i, nftl_buf, NULL ) != PLATFORM_OK )
+      {
+        // The old copy can't be read: the rest of the unit is padding (it
+        // doesn't belong to any sector), so the block stays contiguous
+        err = 1;
+        src = NULL;
+      }
+      memset( nftl_spare, 0xFF, NANDFTL_SPARE_SIZE );
+      nftlh_put32( nftl_spare + NFTL_SP_SECTOR, err ? NFTL_NONE : unit * NANDFTL_PAGES_PER_UNIT + i );
+      nftl_spare[ NFTL_SP_MAGIC ] = NFTL_MAGIC & 0xFF;
+      nftl_spare[ NFTL_SP_MAGIC + 1 ] = NFTL_MAGIC >> 8;
+      nftlh_put32( nftl_spare + NFTL_SP_SEQ, nftl_open_seq );
+      nftlh_put32( nftl_spare + NFTL_SP_ECNT, nftl_ecnt[ nftl_open ] );
+      if( nand_ll_write( page + i, src, nftl_spare ) != PLATFORM_OK )
+        break;
+      nftl_stats.flash_writes ++;
+    }
+    if( i == NANDFTL_PAGES_PER_UNIT )
+    {
+      if( !err )
+        nftlh_map_unit( unit, page / NANDFTL_PAGES_PER_UNIT );
+      if( ( nftl_next += NANDFTL_PAGES_PER_UNIT ) == NANDFTL_PAGES_PER_BLOCK )
+        nftlh_close_block();
+      return err ? PLATFORM_ERR : PLATFORM_OK;
+    }
+    // The block is retired, its valid pages are moved by the garbage collector
+    nftl_state[ nftl_open ] = NFTL_BLK_RETIRE;
+    nftl_open = NFTL_NONE;
+    if( err )
+      break;
+  }
+  return PLATFORM_ERR;
+}
+
+// Helper: move the valid units of a block to the frontier and free it
+static int nftlh_collect_block( u32 block )
+{
+  u8 oldstate = nftl_state[ block ];
+  u32 phys = block * NFTL_UNITS_PER_BLOCK, sector;
+  unsigned i;
+
+  // The block is not released by nftlh_map_unit while its units are moved
+  nftl_state[ block ] = NFTL_BLK_GC;
+  nftl_in_gc ++;
+  for( i = 0; i < NFTL_UNITS_PER_BLOCK && nftl_valid[ block ] > 0; i ++, phys ++ )
+  {
+    // The first page of a unit has the first sector of the unit
+    if( nand_ll_read( phys * NANDFTL_PAGES_PER_UNIT, NULL, nftl_spare ) != PLATFORM_OK )
+      break;
+    sector = nftlh_get32( nftl_spare + NFTL_SP_SECTOR );
+    if( sector >= NFTL_SECTORS || nftl_map[ sector / NANDFTL_PAGES_PER_UNIT ] != phys )
+      continue;
+    if( nftlh_program( sector / NANDFTL_PAGES_PER_UNIT, NULL, 0, 0 ) != PLATFORM_OK )
+      break;
+    nftl_stats.gc_moves += NANDFTL_PAGES_PER_UNIT;
+  }
+  nftl_in_gc --;
+  if( nftl_valid[ block ] > 0 )
+  {
+    nftl_state[ block ] = oldstate;
+    return PLATFORM_ERR;
+  }
+  if( oldstate == NFTL_BLK_RETIRE )
+    nftlh_mark_bad( block );
+  else
+  {
+    nftl_state[ block ] = NFTL_BLK_FREE;
+    nftl_free ++;
+  }
+  return PLATFORM_OK;
+}
+
+// Helper: check a spare area written by the FTL
+static int nftlh_is_ftl_spare( const u8 *spare )
+{
+  return spare[ NFTL_SP_MAGIC ] == ( NFTL_MAGIC & 0xFF ) && spare[ NFTL_SP_MAGIC + 1 ] == ( NFTL_MAGIC >> 8 );
+}
+
+// ****************************************************************************
+// Public interface
+
+// Mount the FTL: rebuild the map from the spare areas of the flash pages.
+// The blocks are scanned in physical order, the sequence number of the block
+// tells which copy of a unit is the newest one. The pages of a unit are
+// written in order, so a unit is complete only if its last page is written. The last frontier block is
+// not reused (its first erased page might have been hit by a power loss
+// during programming), it's reclaimed by the garbage collector later.
+int nandftl_init()
+{
+  u32 *pseq;
+  u32 b, i, page, sector, unit, seq, cur;
+
+  nftl_ready = 0;
+  if( nand_ll_init() != PLATFORM_OK || nftlh_alloc() != PLATFORM_OK )
+    return NANDFTL_ERROR;
+  if( ( pseq = malloc( NANDFTL_BLOCKS * sizeof( u32 ) ) ) == NULL )
+    return NANDFTL_ERROR;
+  memset( nftl_map, 0xFF, NFTL_UNITS * sizeof( nftl_unit_t ) );
+  memset( nftl_valid, 0, NANDFTL_BLOCKS );
+  nftl_blank = 1;
+  nftl_seq = nftl_max_ecnt = 0;
+  nftl_open = NFTL_NONE;
+  for( b = 0; b < NANDFTL_BLOCKS; b ++ )
+  {
+    page = b * NANDFTL_PAGES_PER_BLOCK;
+    nftl_ecnt[ b ] = pseq[ b ] = 0;
+    nftl_state[ b ] = NFTL_BLK_FREE;
+    if( nand_ll_read( page, NULL, nftl_spare ) != PLATFORM_OK || nftl_spare[ NFTL_SP_BADBLOCK ] != 0xFF )
+    {
+      nftl_state[ b ] = NFTL_BLK_BAD;
+      continue;
+    }
+    // Blocks written by something else are free (they are erased when used)
+    if( !nftlh_is_ftl_spare( nftl_spare ) )
+      continue;
+    nftl_blank = 0;
+    nftl_state[ b ] = NFTL_BLK_USED;
+    pseq[ b ] = seq = nftlh_get32( nftl_spare + NFTL_SP_SEQ );
+    nftl_ecnt[ b ] = nftlh_get32( nftl_spare + NFTL_SP_ECNT );
+    if( seq > nftl_seq )
+      nftl_seq = seq;
+    if( nftl_ecnt[ b ] > nftl_max_ecnt )
+      nftl_max_ecnt = nftl_ecnt[ b ];
+    for( i = 0; i < NANDFTL_PAGES_PER_BLOCK; i ++, page ++ )
+    {
+      if( i > 0 && nand_ll_read( page, NULL, nftl_spare ) != PLATFORM_OK )
+        break;
+      // Pages are written in order, the first page that doesn't belong to
+      // the block is the end of the written part
+      if( !nftlh_is_ftl_spare( nftl_spare ) || nftlh_get32( nftl_spare + NFTL_SP_SEQ ) != seq )
+        break;
+      sector = nftlh_get32( nftl_spare + NFTL_SP_SECTOR );
+      if( sector >= NFTL_SECTORS || i % NANDFTL_PAGES_PER_UNIT != NANDFTL_PAGES_PER_UNIT - 1 ||
+          sector % NANDFTL_PAGES_PER_UNIT != NANDFTL_PAGES_PER_UNIT - 1 )
+        continue;
+      // A later unit of the same block or a unit of a newer block wins
+      unit = sector / NANDFTL_PAGES_PER_UNIT;
+      cur = nftl_map[ unit ];
+      if( cur == NFTL_UNMAPPED || pseq[ cur / NFTL_UNITS_PER_BLOCK ] <= seq )
+        nftl_map[ unit ] = ( nftl_unit_t )( page / NANDFTL_PAGES_PER_UNIT );
+    }
+  }
+  free( pseq );
+  for( i = 0; i < NFTL_UNITS; i ++ )
+    if( nftl_map[ i ] != NFTL_UNMAPPED )
+      nftl_valid[ nftl_map[ i ] / NFTL_UNITS_PER_BLOCK ] ++;
+  for( b = 0, nftl_free = 0; b < NANDFTL_BLOCKS; b ++ )
+  {
+    if( nftl_state[ b ] == NFTL_BLK_USED && nftl_valid[ b ] == 0 )
+      nftl_state[ b ] = NFTL_BLK_FREE;
+    if( nftl_state[ b ] == NFTL_BLK_FREE )
+      nftl_free ++;
+  }
+  nftl_ready = 1;
+  return nftl_blank ? NANDFTL_BLANK : NANDFTL_OK;
+}
+
+// Returns 1 if the FTL didn't find any of its data on the chip when mounted
+int nandftl_is_blank()
+{
+  return nftl_blank;
+}
+
+// Returns the number of sectors exported by the FTL
+u32 nandftl_get_sectors()
+{
+  return NFTL_SECTORS;
+}
+
+int nandftl_read( u32 sector, u8 *buf, unsigned count )
+{
+  u32 phys;
+
+  if( !nftl_ready || sector + count > NFTL_SECTORS )
+    return PLATFORM_ERR;
+  for( ; count; count --, sector ++, buf += NANDFTL_PAGE_SIZE )
+  {
+    // Sectors that were never written read as erased flash
+    if( ( phys = nftl_map[ sector / NANDFTL_PAGES_PER_UNIT ] ) == NFTL_UNMAPPED )
+      memset( buf, 0xFF, NANDFTL_PAGE_SIZE );
+    else if( nand_ll_read( phys * NANDFTL_PAGES_PER_UNIT + sector % NANDFTL_PAGES_PER_UNIT, buf, NULL ) != PLATFORM_OK )
+      return PLATFORM_ERR;
+  }
+  return PLATFORM_OK;
+}
+
+int nandftl_write( u32 sector, const u8 *buf, unsigned count )
+{
+  unsigned first, n;
+
+  if( !nftl_ready || sector + count > NFTL_SECTORS )
+    return PLATFORM_ERR;
+  // Every unit is written once, with all the sectors of the request it has
+  for( ; count; count -= n, sector += n, buf += n * NANDFTL_PAGE_SIZE )
+  {
+    first = sector % NANDFTL_PAGES_PER_UNIT;
+    n = NANDFTL_PAGES_PER_UNIT - first < count ? NANDFTL_PAGES_PER_UNIT - first : count;
+    if( nftlh_program( sector / NANDFTL_PAGES_PER_UNIT, buf, first, n ) != PLATFORM_OK )
+      return PLATFORM_ERR;
+    nftl_stats.host_writes += n;
+  }
+  nftl_blank = 0;
+  return PLATFORM_OK;
+}
+
+// Called when the file system syncs: a good time for some background GC
+int nandftl_sync()
+{
+  if( !nftl_ready )
+    return PLATFORM_ERR;
+  nandftl_gc_step();
+  return PLATFORM_OK;
+}
+
+// Reclaim a single block if the number of free blocks is below the
+// background GC threshold. Returns 1 if a block was reclaimed, 0 otherwise.
+int nandftl_gc_step()
+{
+  if( !nftl_ready || nftl_free >= NANDFTL_GC_FREE )
+    return 0;
+  return nftlh_collect() == PLATFORM_OK;
+}
+
+void nandftl_get_stats( NANDFTL_STATS *pstats, int reset )
+{
+  u32 b, bad = 0, minecnt = NFTL_NONE;
+
+  if( nftl_ready )
+    for( b = 0; b < NANDFTL_BLOCKS; b ++ )
+    {
+      if( nftl_state[ b ] == NFTL_BLK_BAD )
+        bad ++;
+      else if( nftl_ecnt[ b ] < minecnt )
+        minecnt = nftl_ecnt[ b ];
+    }
+  nftl_stats.free_blocks = nftl_free;
+  nftl_stats.bad_blocks = bad;
+  nftl_stats.min_erase = minecnt == NFTL_NONE ? 0 : minecnt;
+  nftl_stats.max_erase = nftl_max_ecnt;
+  memcpy( pstats, &nftl_stats, sizeof( NANDFTL_STATS ) );
+  if( reset )
+    memset( &nftl_stats, 0, sizeof( NANDFTL_STATS ) );
+}
+
+// ****************************************************************************
+// Block device (see blkdev.h)
+
+static DSTATUS nftl_stat = STA_NOINIT;
+
+static DSTATUS nftlh_blk_init()
+{
+  if( nftl_stat & STA_NOINIT )
+    nftl_stat = nandftl_init() == NANDFTL_ERROR ? STA_NOINIT : 0;
+  return nftl_stat;
+}
+
+static DSTATUS nftlh_blk_status()
+{
+  return nftl_stat;
+}
+
+static DRESULT nftlh_blk_read( BYTE *buff, DWORD sector, BYTE count )
+{
+  if( nftl_stat & STA_NOINIT )
+    return RES_NOTRDY;
+  return nandftl_read( sector, buff, count ) == PLATFORM_OK ? RES_OK : RES_ERROR;
+}
+
+static DRESULT nftlh_blk_write( const BYTE *buff, DWORD sector, BYTE count )
+{
+  if( nftl_stat & STA_NOINIT )
+    return RES_NOTRDY;
+  return nandftl_write( sector, buff, count ) == PLATFORM_OK ? RES_OK : RES_ERROR;
+}
+
+static DRESULT nftlh_blk_ioctl( BYTE ctrl, void *buff )
+{
+  if( nftl_stat & STA_NOINIT )
+    return RES_NOTRDY;
+  switch( ctrl )
+  {
+    case CTRL_SYNC: // a good time for some background garbage collection
+      return nandftl_sync() == PLATFORM_OK ? RES_OK : RES_ERROR;
+
+    case GET_SECTOR_COUNT:
+      *( DWORD* )buff = NFTL_SECTORS;
+      return RES_OK;
+
+    case GET_SECTOR_SIZE:
+      *( WORD* )buff = NANDFTL_PAGE_SIZE;
+      return RES_OK;
+
+    case GET_BLOCK_SIZE: // the FTL hides the erase blocks
+      *( DWORD* )buff = 1;
+      return RES_OK;
+  }
+  return RES_PARERR;
+}
+
+const BLKDEV nand_blkdev =
+{
+  nftlh_blk_init,
+  nftlh_blk_status,
+  nftlh_blk_read,
+  nftlh_blk_write,
+  nftlh_blk_ioctl,
+  0
+};
+
+#endif // #ifdef BUILD_NANDFTL
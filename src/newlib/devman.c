@@ -6,18 +6,101 @@
 #include <reent.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include "devman.h"
 #include "genstd.h"
 #include "common.h"
+#include "ioctl.h"
 #include "platform_conf.h"
+#include "utils.h"
+#ifdef BUILD_UIP
+#include "elua_net.h"
+#endif
+
+// Total number of descriptors (including STDIO)
+#ifndef DM_MAX_FDS
+#define DM_MAX_FDS            32
+#endif
+
+#if DM_MAX_FDS > 32767
+#error "DM_MAX_FDS too large (Newlib keeps descriptors in a short)"
+#endif
+
+// Default maximum number of descriptors for a single device
+#ifndef DM_DEFAULT_FD_LIMIT
+#define DM_DEFAULT_FD_LIMIT   DM_MAX_FDS
+#endif
+
+// Descriptor table entry
+typedef struct
+{
+  const DM_DEVICE *pdev;    // NULL if the descriptor is free
+  int devfd;                // device descriptor (next free entry if free)
+  u8 devid;                 // device index (DM_FD_NO_DEVID if not counted)
+} DM_FD_ENTRY;
+
+#define DM_FD_NO_DEVID        0xFF
 
 static const DM_DEVICE* dm_list[ DM_MAX_DEVICES ];           // list of devices
 static int dm_num_devs;                               // number of devices
+static u16 dm_fd_count[ DM_MAX_DEVICES ];             // open descriptors for each device
+static u16 dm_fd_limit[ DM_MAX_DEVICES ];             // descriptor limit for each device
+static DM_FD_ENTRY dm_fd_table[ DM_MAX_FDS ];         // descriptor table
+static int dm_fd_free;                                // first free descriptor (-1 if none)
+
+// Prefix table used for path resolution (rebuilt when the device list changes)
+// Device names are kept in lowercase and grouped by length, so a path is
+// resolved with a single pass over its first component and a comparison with
+// the few names that have the same length.
+typedef struct
+{
+  char name[ DM_MAX_DEV_NAME ];     // name without the leading '/'
+  u8 devid;
+} DM_PREFIX_ENTRY;
+
+static DM_PREFIX_ENTRY dm_prefix_table[ DM_MAX_DEVICES ];
+static u8 dm_prefix_start[ DM_MAX_DEV_NAME + 1 ];    // first entry for each name length
+static int dm_root_devid = -1;                        // index of the "/" device
+static u32 dm_resolve_count;                          // number of resolutions
+
+#ifdef DM_FD_LIMITS
+// Build time descriptor limits for specific devices
+typedef struct
+{
+  const char *name;
+  u16 limit;
+} DM_FD_LIMIT_DATA;
+
+static const DM_FD_LIMIT_DATA dm_fd_build_limits[] = { DM_FD_LIMITS };
+#endif
 
 // "Shared" variables: these can be used by any FS that implements 'ls' via opendir/readdir/closedir
 struct dm_dirent dm_shared_dirent;
 char dm_shared_fname[ DM_MAX_FNAME_LENGTH + 1 ];
 
+// Helper: rebuild the path resolution table from the device list
+static void dmh_build_prefix_table()
+{
+  unsigned len, i, j, n = 0;
+  const char *pname;
+
+  for( len = 0; len < DM_MAX_DEV_NAME; len ++ )
+  {
+    dm_prefix_start[ len ] = n;
+    for( i = 0; i < dm_num_devs; i ++ )
+    {
+      pname = dm_list[ i ]->name + 1;
+      if( strlen( pname ) != len )
+        continue;
+      for( j = 0; j < len; j ++ )
+        dm_prefix_table[ n ].name[ j ] = tolower( ( unsigned char )pname[ j ] );
+      dm_prefix_table[ n ++ ].devid = i;
+    }
+  }
+  dm_prefix_start[ DM_MAX_DEV_NAME ] = n;
+  dm_root_devid = dm_prefix_start[ 1 ] > 0 ? dm_prefix_table[ 0 ].devid : -1;
+}
+
 // Register a device
 // Returns the index of the device in the device table
 int dm_register( const DM_DEVICE *pdev )
@@ -38,37 +121,23 @@ int dm_register( const DM_DEVICE *pdev )
     return DM_ERR_NO_SPACE;
     
   // Register it now
+  dm_fd_count[ dm_num_devs ] = 0;
+  dm_fd_limit[ dm_num_devs ] = DM_DEFAULT_FD_LIMIT;
+#ifdef DM_FD_LIMITS
+  for( i = 0; i < sizeof( dm_fd_build_limits ) / sizeof( DM_FD_LIMIT_DATA ); i ++ )
+    if( !strcasecmp( pdev->name, dm_fd_build_limits[ i ].name ) )
+      dm_fd_limit[ dm_num_devs ] = dm_fd_build_limits[ i ].limit;
+#endif
   dm_list[ dm_num_devs ++ ] = pdev;
+  dmh_build_prefix_table();
   return dm_num_devs - 1;
 }
 
-// Helper: get a device ID from its name
-// Also return a pointer to the remaining part of the name as side effect
-static int dm_device_id_from_name( const char* name, const char **rest )
-{
-  unsigned i, pos;
-  unsigned matchlen = 0;
-
-  if( rest )
-    *rest = NULL;
-  for( i = pos = 0; i < dm_num_devs; i ++ )
-    if( !strncasecmp( name, dm_list[ i ]->name, strlen( dm_list[ i ]->name ) ) && strlen( dm_list[ i ]->name ) > matchlen )
-    {
-      matchlen = strlen( dm_list[ i ]->name );
-      pos = i;
-    }
-  if( matchlen == 0 )
-    return DM_ERR_NO_DEVICE;
-  if( rest )
-    *rest = name + strlen( dm_list[ pos ]->name );
-  return pos;
-}
-
 // Unregister a device
 // Returns 0 for OK or an error code if error
 int dm_unregister( const char* name )
 {
-  int i;
+  int i, pos;
   
   if( name == NULL || *name == '\0' || *name != '/' || strlen( name ) > DM_MAX_DEV_NAME )
     return DM_ERR_INVALID_NAME;
@@ -82,11 +151,81 @@ int dm_unregister( const char* name )
   
   // Remove it
   if( i != dm_num_devs - 1 )
+  {
     memmove( dm_list + i, dm_list + i + 1, ( dm_num_devs - i - 1 ) * sizeof( DM_DEVICE* ) );
+    memmove( dm_fd_count + i, dm_fd_count + i + 1, ( dm_num_devs - i - 1 ) * sizeof( u16 ) );
+    memmove( dm_fd_limit + i, dm_fd_limit + i + 1, ( dm_num_devs - i - 1 ) * sizeof( u16 ) );
+  }
   dm_num_devs --;
+  // Descriptors still open on this device aren't counted anymore, the following
+  // devices just moved one position down in the device list
+  for( pos = DM_FIRST_FD; pos < DM_MAX_FDS; pos ++ )
+  {
+    if( dm_fd_table[ pos ].pdev == NULL || dm_fd_table[ pos ].devid == DM_FD_NO_DEVID )
+      continue;
+    if( dm_fd_table[ pos ].devid == i )
+      dm_fd_table[ pos ].devid = DM_FD_NO_DEVID;
+    else if( dm_fd_table[ pos ].devid > i )
+      dm_fd_table[ pos ].devid --;
+  }
+  dmh_build_prefix_table();
   return DM_OK;
 }
 
+// Resolve a path to a device (see devman.h for the rules)
+// Returns the device index or an error code, the remaining part of the path
+// is returned as side effect
+int dm_resolve_path( const char *path, const char **prest, int flags )
+{
+  char comp[ DM_MAX_DEV_NAME ];
+  const char *p;
+  unsigned len, i;
+  int devid = DM_ERR_NO_DEVICE;
+
+  dm_resolve_count ++;
+  if( path == NULL || *path != '/' )
+    return DM_ERR_INVALID_NAME;
+  // Get the (lowercase) first component of the path
+  for( p = path + 1, len = 0; *p != '\0' && *p != '/'; p ++, len ++ )
+    if( len < DM_MAX_DEV_NAME )
+      comp[ len ] = tolower( ( unsigned char )*p );
+  if( *p == '/' || !( flags & DM_RESOLVE_FILE ) )
+  {
+    // Look for a device with this name
+    if( len == 0 && ( flags & DM_RESOLVE_FILE ) )
+      return DM_ERR_INVALID_NAME;
+    if( len < DM_MAX_DEV_NAME )
+      for( i = dm_prefix_start[ len ]; i < dm_prefix_start[ len + 1 ]; i ++ )
+        if( !memcmp( comp, dm_prefix_table[ i ].name, len ) )
+        {
+          devid = dm_prefix_table[ i ].devid;
+          break;
+        }
+    if( devid >= 0 )
+      p += ( flags & DM_RESOLVE_FILE ) ? 1 : 0;
+    else if( flags & DM_RESOLVE_FILE )
+      return DM_ERR_NO_DEVICE;
+  }
+  if( devid < 0 )
+  {
+    // Not a device name, look for a file on the "/" device
+    if( ( devid = dm_root_devid ) < 0 )
+      return DM_ERR_NO_DEVICE;
+    p = path + 1;
+  }
+  if( ( flags & DM_RESOLVE_FILE ) && *p == '\0' )
+    return DM_ERR_INVALID_NAME;
+  if( prest )
+    *prest = p;
+  return devid;
+}
+
+// Returns the number of path resolutions since startup
+u32 dm_get_resolve_count()
+{
+  return dm_resolve_count;
+}
+
 // Get a device entry
 const DM_DEVICE* dm_get_device_at( int idx )
 {
@@ -106,13 +245,158 @@ int dm_get_num_devices()
 // At this point it is assumed that the std device (usually UART) is already initialized
 int dm_init() 
 {
-  dm_register( std_get_desc() );
+  int i;
+
+  // Build the descriptor free list
+  for( i = DM_FIRST_FD; i < DM_MAX_FDS; i ++ )
+  {
+    dm_fd_table[ i ].pdev = NULL;
+    dm_fd_table[ i ].devfd = i == DM_MAX_FDS - 1 ? -1 : i + 1;
+  }
+  dm_fd_free = DM_FIRST_FD < DM_MAX_FDS ? DM_FIRST_FD : -1;
+  // The STDIO descriptors are permanently bound to the std device
+  if( dm_register( std_get_desc() ) >= 0 )
+    for( i = DM_STDIN_NUM; i <= DM_STDERR_NUM; i ++ )
+    {
+      dm_fd_table[ i ].pdev = dm_list[ 0 ];
+      dm_fd_table[ i ].devfd = i;
+      dm_fd_table[ i ].devid = DM_FD_NO_DEVID;
+    }
 #ifndef BUILD_CON_TCP         // we need buffering on stdout for console over TCP
   setbuf( stdout, NULL );
 #endif
   return DM_OK;
 }
 
+// ****************************************************************************
+// Descriptor management
+
+// Allocate a new descriptor for the given device
+// Returns the descriptor or an error code if error
+int dm_fd_alloc( int devid )
+{
+  int fd;
+
+  if( devid < 0 || devid >= dm_num_devs )
+    return DM_ERR_NO_DEVICE;
+  if( dm_fd_free == -1 || dm_fd_count[ devid ] >= dm_fd_limit[ devid ] )
+    return DM_ERR_NO_SPACE;
+  fd = dm_fd_free;
+  dm_fd_free = dm_fd_table[ fd ].devfd;
+  dm_fd_table[ fd ].pdev = dm_list[ devid ];
+  dm_fd_table[ fd ].devfd = -1;
+  dm_fd_table[ fd ].devid = devid;
+  dm_fd_count[ devid ] ++;
+  return fd;
+}
+
+// Set the device specific descriptor of a descriptor returned by dm_fd_alloc
+void dm_fd_bind( int fd, int devfd )
+{
+  dm_fd_table[ fd ].devfd = devfd;
+}
+
+// Release a descriptor returned by dm_fd_alloc
+void dm_fd_release( int fd )
+{
+  DM_FD_ENTRY *pentry;
+
+  if( fd < DM_FIRST_FD || fd >= DM_MAX_FDS || dm_fd_table[ fd ].pdev == NULL )
+    return;
+  pentry = dm_fd_table + fd;
+  if( pentry->devid != DM_FD_NO_DEVID )
+    dm_fd_count[ pentry->devid ] --;
+  pentry->pdev = NULL;
+  pentry->devfd = dm_fd_free;
+  dm_fd_free = fd;
+}
+
+// Return the device of a descriptor (and the device specific descriptor as a
+// side effect) or NULL if the descriptor is not valid
+const DM_DEVICE* dm_fd_get_device( int fd, int *pdevfd )
+{
+  if( fd < 0 || fd >= DM_MAX_FDS || dm_fd_table[ fd ].pdev == NULL )
+    return NULL;
+  if( pdevfd )
+    *pdevfd = dm_fd_table[ fd ].devfd;
+  return dm_fd_table[ fd ].pdev;
+}
+
+// Helper: find a device by its exact name
+static int dmh_find_device( const char *name )
+{
+  int i;
+
+  for( i = 0; i < dm_num_devs; i ++ )
+    if( !strcasecmp( name, dm_list[ i ]->name ) )
+      return i;
+  return DM_ERR_NO_DEVICE;
+}
+
+// Set the maximum number of descriptors for a device
+// Returns the previous limit or an error code
+int dm_set_fd_limit( const char *name, int limit )
+{
+  int devid, prev;
+
+  if( ( devid = dmh_find_device( name ) ) < 0 )
+    return devid;
+  prev = dm_fd_limit[ devid ];
+  dm_fd_limit[ devid ] = limit < 0 ? 0 : ( limit > DM_MAX_FDS ? DM_MAX_FDS : limit );
+  return prev;
+}
+
+// Return the number of descriptors currently open on a device (and its
+// limit as a side effect) or an error code
+int dm_get_fd_usage( const char *name, int *plimit )
+{
+  int devid;
+
+  if( ( devid = dmh_find_device( name ) ) < 0 )
+    return devid;
+  if( plimit )
+    *plimit = dm_fd_limit[ devid ];
+  return dm_fd_count[ devid ];
+}
+
+// ****************************************************************************
+// Per-descriptor state pools
+
+// Allocate an object from the pool
+// Returns its index or -1 if the pool is exhausted or there's not enough memory
+int dm_pool_alloc( DM_POOL *pool )
+{
+  int idx;
+
+  if( pool->free != -1 )
+  {
+    idx = pool->free;
+    pool->free = pool->next[ idx ] == 0xFF ? -1 : pool->next[ idx ];
+    return idx;
+  }
+  if( pool->high == pool->limit )
+    return -1;
+  if( ( pool->slots[ pool->high ] = malloc( pool->objsize ) ) == NULL )
+    return -1;
+  return pool->high ++;
+}
+
+// Return the object with the given index
+void* dm_pool_get( DM_POOL *pool, int idx )
+{
+  return pool->slots[ idx ];
+}
+
+// Give back an object to the pool (it is kept for the next allocation)
+void dm_pool_free( DM_POOL *pool, int idx )
+{
+  pool->next[ idx ] = pool->free == -1 ? 0xFF : pool->free;
+  pool->free = idx;
+}
+
+// ****************************************************************************
+// Directory functions
+
 // Open a directory and return its descriptor
 DM_DIR* dm_opendir( const char* dirname )
 {
@@ -122,7 +406,7 @@ DM_DIR* dm_opendir( const char* dirname )
   int pos;
   void *data;
 
-  if( ( pos = dm_device_id_from_name( dirname, &rest ) ) == DM_ERR_NO_DEVICE )
+  if( ( pos = dm_resolve_path( dirname, &rest, 0 ) ) < 0 )
   {
     _REENT->_errno = ENOSYS;
     return NULL;
@@ -187,15 +471,221 @@ int dm_closedir( DM_DIR *d )
 const char* dm_getaddr( int fd )
 {
   const DM_DEVICE* pdev;
+  int devfd;
   
-  // Find device, check write function
-  pdev = dm_get_device_at( DM_GET_DEVID( fd ) );
+  // Find device, check getaddr function
+  pdev = dm_fd_get_device( fd, &devfd );
   if( !pdev || pdev->p_getaddr_r == NULL )
   {
     _REENT->_errno = ENOSYS;
     return NULL;
   }
   
-  return pdev->p_getaddr_r( _REENT, DM_GET_FD( fd ) );
+  return pdev->p_getaddr_r( _REENT, devfd );
+}
+
+// Return the address of a memory mapped file only if the device guarantees
+// that the file never moves (FDGETADDR_FIXED ioctl), NULL otherwise. Devices
+// that can move their files (RAMFS) must pin the file in getaddr to keep the
+// address valid, so they don't answer it. Use this instead of dm_getaddr when
+// the address is needed only for a short time. errno is not changed.
+const char* dm_getaddr_fixed( int fd )
+{
+  const DM_DEVICE* pdev;
+  const char *paddr;
+  int devfd, err;
+
+  pdev = dm_fd_get_device( fd, &devfd );
+  if( !pdev || pdev->p_ioctl_r == NULL )
+    return NULL;
+  err = _REENT->_errno;
+  if( pdev->p_ioctl_r( _REENT, devfd, FDGETADDR_FIXED, &paddr ) == -1 )
+  {
+    _REENT->_errno = err;
+    return NULL;
+  }
+  return paddr;
+}
+
+// Start (begin = 1) or commit (begin = 0) a batch of metadata updates on the
+// device of 'path', or on all the devices if 'path' is NULL. Devices that
+// don't support batches are ignored. Batches can be nested.
+// Returns 0 for OK or -1 for error
+int dm_batch( const char *path, int begin )
+{
+  const DM_DEVICE *pdev;
+  const char *rest;
+  int i, res = 0;
+
+  if( path )
+  {
+    if( ( i = dm_resolve_path( path, &rest, 0 ) ) < 0 )
+    {
+      _REENT->_errno = ENOSYS;
+      return -1;
+    }
+    pdev = dm_list[ i ];
+    return pdev->p_batch_r ? pdev->p_batch_r( _REENT, begin ) : 0;
+  }
+  for( i = 0; i < dm_num_devs; i ++ )
+    if( ( pdev = dm_list[ i ] ) != NULL && pdev->p_batch_r && pdev->p_batch_r( _REENT, begin ) != 0 )
+      res = -1;
+  return res;
+}
+
+// Rename a file. Both names must be on the same device.
+// Returns 0 for OK or -1 for error
+int dm_rename( const char *oldname, const char *newname )
+{
+  const DM_DEVICE *pdev;
+  const char *oldrest, *newrest;
+  int i;
+
+  if( ( i = dm_resolve_path( oldname, &oldrest, DM_RESOLVE_FILE ) ) < 0 )
+  {
+    _REENT->_errno = ENOENT;
+    return -1;
+  }
+  if( dm_resolve_path( newname, &newrest, DM_RESOLVE_FILE ) != i )
+  {
+    _REENT->_errno = EXDEV;
+    return -1;
+  }
+  pdev = dm_list[ i ];
+  if( pdev->p_rename_r == NULL )
+  {
+    _REENT->_errno = ENOSYS;
+    return -1;
+  }
+  return pdev->p_rename_r( _REENT, oldrest, newrest );
+}
+
+// Create a directory
+// Returns 0 for OK or -1 for error
+int dm_mkdir( const char *name, int mode )
+{
+  const DM_DEVICE *pdev;
+  const char *rest;
+  int i;
+
+  if( ( i = dm_resolve_path( name, &rest, DM_RESOLVE_FILE ) ) < 0 )
+  {
+    _REENT->_errno = ENOENT;
+    return -1;
+  }
+  pdev = dm_list[ i ];
+  if( pdev->p_mkdir_r == NULL )
+  {
+    _REENT->_errno = ENOSYS;
+    return -1;
+  }
+  return pdev->p_mkdir_r( _REENT, rest, mode );
+}
+
+// Get the size, modification time and type of a file
+// Returns 0 for OK or -1 for error
+int dm_stat( const char *name, struct dm_stat *pstat )
+{
+  const DM_DEVICE *pdev;
+  const char *rest;
+  int i;
+
+  if( ( i = dm_resolve_path( name, &rest, DM_RESOLVE_FILE ) ) < 0 )
+  {
+    _REENT->_errno = ENOENT;
+    return -1;
+  }
+  pdev = dm_list[ i ];
+  if( pdev->p_stat_r == NULL )
+  {
+    _REENT->_errno = ENOSYS;
+    return -1;
+  }
+  return pdev->p_stat_r( _REENT, rest, pstat );
+}
+
+
+// Send 'len' bytes from file 'fd' (starting at 'offset') to the TCP socket 's'
+// If the file is memory mapped at a fixed address (dm_getaddr_fixed) the data
+// goes directly from there to the TCP/IP stack, otherwise it is read in small
+// chunks in a temporary buffer. No Lua objects are involved in either case.
+// The file position is left right after the last byte sent.
+// Returns the number of bytes sent or -1 for error
+#ifdef BUILD_UIP
+
+// Maximum size of a single network send (elua_net_size is 16 bits)
+#define DM_SENDFILE_MAX_CHUNK       0x4000
+// Size of the temporary buffer used for files that are not memory mapped
+#define DM_SENDFILE_BUFSIZE         512
+
+int dm_sendfile( int fd, int s, u32 offset, u32 len )
+{
+  const DM_DEVICE* pdev;
+  const char *paddr = NULL;
+  char *buf = NULL;
+  int devfd;
+  off_t fsize;
+  u32 total = 0, chunk;
+  elua_net_size sent;
+  _ssize_t readbytes;
+
+  pdev = dm_fd_get_device( fd, &devfd );
+  if( !pdev || pdev->p_lseek_r == NULL || pdev->p_read_r == NULL )
+  {
+    _REENT->_errno = ENOSYS;
+    return -1;
+  }
+  // Clamp the request to the actual file size
+  if( ( fsize = pdev->p_lseek_r( _REENT, devfd, 0, SEEK_END ) ) < 0 )
+    return -1;
+  if( offset > fsize )
+    offset = fsize;
+  len = UMIN( len, fsize - offset );
+  paddr = dm_getaddr_fixed( fd );
+  if( paddr ) // memory mapped file, send directly from its address
+  {
+    while( total < len )
+    {
+      chunk = UMIN( len - total, DM_SENDFILE_MAX_CHUNK );
+      if( ( sent = elua_net_send( s, paddr + offset + total, chunk ) ) <= 0 )
+        break;
+      total += sent;
+      if( sent < chunk )
+        break;
+    }
+  }
+  else if( len > 0 ) // read data in the temporary buffer and send it from there
+  {
+    if( ( buf = malloc( DM_SENDFILE_BUFSIZE ) ) == NULL )
+    {
+      _REENT->_errno = ENOMEM;
+      return -1;
+    }
+    if( pdev->p_lseek_r( _REENT, devfd, offset, SEEK_SET ) < 0 )
+      len = 0;
+    while( total < len )
+    {
+      chunk = UMIN( len - total, DM_SENDFILE_BUFSIZE );
+      if( ( readbytes = pdev->p_read_r( _REENT, devfd, buf, chunk ) ) <= 0 )
+        break;
+      if( ( sent = elua_net_send( s, buf, readbytes ) ) <= 0 )
+        break;
+      total += sent;
+      if( sent < readbytes )
+        break;
+    }
+    free( buf );
+  }
+  pdev->p_lseek_r( _REENT, devfd, offset + total, SEEK_SET );
+  return total;
+}
+
+#else // #ifdef BUILD_UIP
+
+int dm_sendfile( int fd, int s, u32 offset, u32 len )
+{
+  _REENT->_errno = ENOSYS;
+  return -1;
 }
 
+#endif // #ifdef BUILD_UIP
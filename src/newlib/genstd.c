@@ -145,7 +145,12 @@ static const DM_DEVICE std_device =
   NULL,                 // readdir
   NULL,                 // closedir
   NULL,                 // getaddr
-  NULL                  // unlink
+  NULL,                 // unlink
+  NULL,                 // ioctl
+  NULL,                 // batch
+  NULL,                 // rename
+  NULL,                 // mkdir
+  NULL                  // stat
 };
 
 const DM_DEVICE* std_get_desc()
@@ -14,6 +14,7 @@
 #include "genstd.h"
 #include "utils.h"
 #include "salloc.h"
+#include "elua_aio.h"
 
 #ifdef USE_MULTIPLE_ALLOCATOR
 #include "dlmalloc.h"
@@ -26,47 +27,13 @@
 // Also returns a pointer to the actual file name (without the device part)
 static int find_dm_entry( const char* name, char **pactname )
 {
-  int i;
-  const DM_DEVICE* pdev;
-  const char* preal;
-  char tempname[ DM_MAX_DEV_NAME + 1 ];
-  
-  // Sanity check for name
-  if( name == NULL || *name == '\0' || *name != '/' )
-    return -1;
-    
-  // Find device name
-  preal = strchr( name + 1, '/' );
-  if( preal == NULL )
-  {
-    // This shortcut allows to register the "/" filesystem and use it like "/file.ext"
-    strcpy( tempname, "/" );
-    preal = name;
-  }
-  else
-  {
-    if( ( preal - name > DM_MAX_DEV_NAME ) || ( preal - name == 1 ) ) // name too short/too long
-      return -1;
-    memcpy( tempname, name, preal - name );
-    tempname[ preal - name ] = '\0';
-  }
-    
-  // Find device
-  for( i = 0; i < dm_get_num_devices(); i ++ )
-  {
-    pdev = dm_get_device_at( i );
-    if( !strcasecmp( tempname, pdev->name ) )
-      break;
-  }
-  if( i == dm_get_num_devices() )
-    return -1;
-    
-  // Find the actual first char of the name
-  preal ++;
-  if( *preal == '\0' )
+  const char *preal;
+  int devid;
+
+  if( ( devid = dm_resolve_path( name, &preal, DM_RESOLVE_FILE ) ) < 0 )
     return -1;
   *pactname = ( char * )preal;
-  return i;  
+  return devid;
 }
 
 // *****************************************************************************
@@ -74,7 +41,7 @@ static int find_dm_entry( const char* name, char **pactname )
 int _open_r( struct _reent *r, const char *name, int flags, int mode )
 {
   char* actname;
-  int res, devid;
+  int res, devid, fd;
   const DM_DEVICE* pdev;
  
   // Look for device, return error if not found or if function not implemented
@@ -89,11 +56,23 @@ int _open_r( struct _reent *r, const char *name, int flags, int mode )
     r->_errno = ENOSYS;
     return -1;   
   }
+
+  // Reserve a descriptor first, so the device isn't asked to open a file that
+  // can't be returned to the caller anyway
+  if( ( fd = dm_fd_alloc( devid ) ) < 0 )
+  {
+    r->_errno = ENFILE;
+    return -1;
+  }
   
   // Device found, call its function
   if( ( res = pdev->p_open_r( r, actname, flags, mode ) ) < 0 )
+  {
+    dm_fd_release( fd );
     return res;
-  return DM_MAKE_DESC( devid, res );
+  }
+  dm_fd_bind( fd, res );
+  return fd;
 }
 
 // *****************************************************************************
@@ -101,17 +80,29 @@ int _open_r( struct _reent *r, const char *name, int flags, int mode )
 int _close_r( struct _reent *r, int file )
 {
   const DM_DEVICE* pdev;
+  int devfd, res;
   
   // Find device, check close function
-  pdev = dm_get_device_at( DM_GET_DEVID( file ) );
+  if( ( pdev = dm_fd_get_device( file, &devfd ) ) == NULL )
+  {
+    r->_errno = EBADF;
+    return -1;
+  }
   if( pdev->p_close_r == NULL )
   {
     r->_errno = ENOSYS;
     return -1; 
   }
   
+#ifdef BUILD_AIO
+  // Pending asynchronous requests must not outlive the descriptor
+  aio_cancel_fd( file );
+#endif
+
   // And call the close function
-  return pdev->p_close_r( r, DM_GET_FD( file ) );
+  res = pdev->p_close_r( r, devfd );
+  dm_fd_release( file );
+  return res;
 }
 
 // *****************************************************************************
@@ -132,9 +123,14 @@ int _fstat_r( struct _reent *r, int file, struct stat *st )
 off_t _lseek_r( struct _reent *r, int file, off_t off, int whence )
 {
   const DM_DEVICE* pdev;
+  int devfd;
   
   // Find device, check close function
-  pdev = dm_get_device_at( DM_GET_DEVID( file ) );
+  if( ( pdev = dm_fd_get_device( file, &devfd ) ) == NULL )
+  {
+    r->_errno = EBADF;
+    return -1;
+  }
   if( pdev->p_lseek_r == NULL )
   {
     r->_errno = ENOSYS;
@@ -142,7 +138,7 @@ off_t _lseek_r( struct _reent *r, int file, off_t off, int whence )
   }
   
   // And call the close function
-  return pdev->p_lseek_r( r, DM_GET_FD( file ), off, whence );
+  return pdev->p_lseek_r( r, devfd, off, whence );
 }
 
 // *****************************************************************************
@@ -150,9 +146,14 @@ off_t _lseek_r( struct _reent *r, int file, off_t off, int whence )
 _ssize_t _read_r( struct _reent *r, int file, void *ptr, size_t len )
 {
   const DM_DEVICE* pdev;
+  int devfd;
   
   // Find device, check read function
-  pdev = dm_get_device_at( DM_GET_DEVID( file ) );
+  if( ( pdev = dm_fd_get_device( file, &devfd ) ) == NULL )
+  {
+    r->_errno = EBADF;
+    return -1;
+  }
   if( pdev->p_read_r == NULL )
   {
     r->_errno = ENOSYS;
@@ -160,7 +161,7 @@ _ssize_t _read_r( struct _reent *r, int file, void *ptr, size_t len )
   }
   
   // And call the read function
-  return pdev->p_read_r( r, DM_GET_FD( file ), ptr, len );  
+  return pdev->p_read_r( r, devfd, ptr, len );  
 }
 
 // *****************************************************************************
@@ -168,9 +169,14 @@ _ssize_t _read_r( struct _reent *r, int file, void *ptr, size_t len )
 _ssize_t _write_r( struct _reent *r, int file, const void *ptr, size_t len )
 {
   const DM_DEVICE* pdev;
+  int devfd;
   
   // Find device, check write function
-  pdev = dm_get_device_at( DM_GET_DEVID( file ) );
+  if( ( pdev = dm_fd_get_device( file, &devfd ) ) == NULL )
+  {
+    r->_errno = EBADF;
+    return -1;
+  }
   if( pdev->p_write_r == NULL )
   {
     r->_errno = ENOSYS;
@@ -178,7 +184,7 @@ _ssize_t _write_r( struct _reent *r, int file, const void *ptr, size_t len )
   }
   
   // And call the write function
-  return pdev->p_write_r( r, DM_GET_FD( file ), ptr, len );  
+  return pdev->p_write_r( r, devfd, ptr, len );  
 }
 
 // ****************************************************************************
@@ -212,6 +218,30 @@ int _unlink_r( struct _reent *r, const char *fname )
   return pdev->p_unlink_r( r, actname );  
 }
 
+// ****************************************************************************
+// ioctl
+
+int ioctl( int file, unsigned long request, void *ptr )
+{
+  const DM_DEVICE* pdev;
+  int devfd;
+
+  // Find device, check ioctl function
+  if( ( pdev = dm_fd_get_device( file, &devfd ) ) == NULL )
+  {
+    _REENT->_errno = EBADF;
+    return -1;
+  }
+  if( pdev->p_ioctl_r == NULL )
+  {
+    _REENT->_errno = ENOSYS;
+    return -1;
+  }
+
+  // And call the ioctl function
+  return pdev->p_ioctl_r( _REENT, devfd, request, ptr );
+}
+
 // ****************************************************************************
 // Miscalenous functions
 
@@ -1,5 +1,8 @@
 // nRF functions
 
+#include "platform_conf.h"
+#ifdef BUILD_NRF
+
 #include "type.h"
 #include "nrf.h"
 #include "nrf_ll.h"
@@ -360,3 +363,4 @@ void nrf_irq_handler()
 {
 }
 
+#endif // #ifdef BUILD_NRF
@@ -121,6 +121,8 @@
 #define SERMUX_PHYS_SPEED     115200
 #define SERMUX_NUM_VUART      2
 #define SERMUX_BUFFER_SIZES   { RFS_BUFFER_SIZE, CON_BUF_SIZE }
+// Framed protocol with flow control (needs "mux2" or "rfsmux2" on the host)
+//#define SERMUX_PROTOCOL_V2
 
 // Interrupt list
 #define INT_UART_RX           ELUA_INT_FIRST_ID
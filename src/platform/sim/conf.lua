@@ -1,6 +1,6 @@
 -- Configuration file for the linux (sim) backend
 
-specific_files = sf( "boot.s utils.s hostif_%s.c platform.c host.c", comp.cpu:lower() )
+specific_files = sf( "boot.s utils.s hostif_%s.c platform.c host.c diskio_sim.c nand_sim.c net_sim.c", comp.cpu:lower() )
 local ldscript = "i386.ld"
   
 -- Override default optimize settings
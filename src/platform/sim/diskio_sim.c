@@ -0,0 +1,255 @@
+// Block device of the simulator SD card (mmc_blkdev, see blkdev.h)
+// Drive 0 (/mmc) is either a RAM disk (formatted as FAT16 when it is first
+// initialized) or a disk image file on the host (MMCFS_SIM_IMAGE). An
+// optional artificial latency for each command can be used to model the
+// timing of a real SD card.
+// The NAND chip (/nand) is simulated by nand_sim.c (behind the NAND FTL).
+
+#include "platform_conf.h"
+#if defined( BUILD_MMCFS ) && defined( MMCFS_SIM )
+
+#include "ffconf.h"
+#include "diskio.h"
+#include "blkdev.h"
+#include "hostif.h"
+#include <string.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+#define SIM_SECTOR_SIZE               512
+
+// Default configuration (can be overriden in platform_conf.h)
+// Size of the RAM disk in sectors (at least 8192, it is formatted as FAT16)
+#ifndef MMCFS_SIM_RAMDISK_SECTORS
+#define MMCFS_SIM_RAMDISK_SECTORS     8192
+#endif
+
+// Latency of each read or write command in microseconds
+#ifndef MMCFS_SIM_CMD_LATENCY_US
+#define MMCFS_SIM_CMD_LATENCY_US      0
+#endif
+
+// Transfer time of a sector in microseconds
+#ifndef MMCFS_SIM_SECTOR_LATENCY_US
+#define MMCFS_SIM_SECTOR_LATENCY_US   0
+#endif
+
+#if !defined( MMCFS_SIM_IMAGE ) && MMCFS_SIM_RAMDISK_SECTORS < 8192
+#error "The simulator RAM disk must have at least 8192 sectors"
+#endif
+
+volatile DSTATUS Stat = STA_NOINIT;
+static DWORD sim_sectors;
+
+#ifdef MMCFS_SIM_IMAGE
+static int sim_fd = -1;
+#else
+static BYTE *sim_ramdisk;
+#endif
+
+// Helper: wait for the simulated command latency
+static void simh_delay( BYTE count )
+{
+#if MMCFS_SIM_CMD_LATENCY_US > 0 || MMCFS_SIM_SECTOR_LATENCY_US > 0
+  hostif_usleep( MMCFS_SIM_CMD_LATENCY_US + count * MMCFS_SIM_SECTOR_LATENCY_US );
+#endif
+}
+
+#ifdef MMCFS_SIM_IMAGE
+
+// Helper: move to the given sector in the image file
+static int simh_seek( DWORD sector )
+{
+  return hostif_lseek( sim_fd, ( long )sector * SIM_SECTOR_SIZE, SEEK_SET ) == ( long )sector * SIM_SECTOR_SIZE;
+}
+
+// Helper: open the image file and find its size
+static DSTATUS simh_init_image()
+{
+  long size;
+
+  if( ( sim_fd = hostif_open( MMCFS_SIM_IMAGE, O_RDWR, 0 ) ) < 0 )
+  {
+    printf( "Unable to open the disk image %s\n", MMCFS_SIM_IMAGE );
+    return STA_NOINIT | STA_NODISK;
+  }
+  if( ( size = hostif_lseek( sim_fd, 0, SEEK_END ) ) < SIM_SECTOR_SIZE )
+  {
+    hostif_close( sim_fd );
+    sim_fd = -1;
+    return STA_NOINIT;
+  }
+  sim_sectors = ( DWORD )( size / SIM_SECTOR_SIZE );
+  return 0;
+}
+
+#else // #ifdef MMCFS_SIM_IMAGE
+
+// Little endian helpers for the boot sector
+#define SIM_ST_WORD( p, v )   ( p )[ 0 ] = ( BYTE )( v ), ( p )[ 1 ] = ( BYTE )( ( v ) >> 8 )
+#define SIM_ST_DWORD( p, v )  SIM_ST_WORD( p, v ), SIM_ST_WORD( ( p ) + 2, ( v ) >> 16 )
+
+#define SIM_ROOT_ENTRIES      512
+
+// Helper: format the RAM disk as a FAT16 volume (no partition table)
+static void simh_format()
+{
+  BYTE *p = sim_ramdisk;
+  DWORD spc, nclusters, fatsz, rootsz;
+
+  // Choose the cluster size that keeps the cluster count in the FAT16 range
+  for( spc = 1; sim_sectors / spc > 65000; spc <<= 1 );
+  rootsz = SIM_ROOT_ENTRIES * 32 / SIM_SECTOR_SIZE;
+  nclusters = ( sim_sectors - 1 - rootsz ) / spc;
+  fatsz = ( ( nclusters + 2 ) * 2 + SIM_SECTOR_SIZE - 1 ) / SIM_SECTOR_SIZE;
+  memset( sim_ramdisk, 0, ( 1 + fatsz + rootsz ) * SIM_SECTOR_SIZE );
+  // Boot sector
+  p[ 0 ] = 0xEB; p[ 1 ] = 0x3C; p[ 2 ] = 0x90;
+  memcpy( p + 3, "ELUASIM ", 8 );
+  SIM_ST_WORD( p + 11, SIM_SECTOR_SIZE );     // bytes per sector
+  p[ 13 ] = ( BYTE )spc;                      // sectors per cluster
+  SIM_ST_WORD( p + 14, 1 );                   // reserved sectors
+  p[ 16 ] = 1;                                // number of FATs
+  SIM_ST_WORD( p + 17, SIM_ROOT_ENTRIES );    // root directory entries
+  if( sim_sectors < 0x10000 )
+    SIM_ST_WORD( p + 19, sim_sectors );
+  else
+    SIM_ST_DWORD( p + 32, sim_sectors );
+  p[ 21 ] = 0xF8;                             // media descriptor
+  SIM_ST_WORD( p + 22, fatsz );               // sectors per FAT
+  SIM_ST_WORD( p + 24, 63 );                  // sectors per track
+  SIM_ST_WORD( p + 26, 255 );                 // number of heads
+  p[ 36 ] = 0x80;                             // drive number
+  p[ 38 ] = 0x29;                             // extended boot signature
+  SIM_ST_DWORD( p + 39, 0x454C5541 );         // volume serial number
+  memcpy( p + 43, "ELUA RAM   FAT16   ", 19 );
+  p[ 510 ] = 0x55; p[ 511 ] = 0xAA;
+  // FAT (two reserved entries)
+  p += SIM_SECTOR_SIZE;
+  SIM_ST_WORD( p, 0xFFF8 );
+  SIM_ST_WORD( p + 2, 0xFFFF );
+}
+
+// Helper: allocate and format the RAM disk
+static DSTATUS simh_init_ramdisk()
+{
+  if( sim_ramdisk == NULL )
+  {
+    sim_sectors = MMCFS_SIM_RAMDISK_SECTORS;
+    if( ( sim_ramdisk = hostif_getmem( sim_sectors * SIM_SECTOR_SIZE ) ) == NULL )
+      return STA_NOINIT;
+    simh_format();
+  }
+  return 0;
+}
+
+#endif // #ifdef MMCFS_SIM_IMAGE
+
+// ****************************************************************************
+// Block device interface (see blkdev.h)
+
+static DSTATUS sim_disk_initialize()
+{
+  if( Stat & STA_NOINIT )
+  {
+#ifdef MMCFS_SIM_IMAGE
+    Stat = simh_init_image();
+#else
+    Stat = simh_init_ramdisk();
+#endif
+  }
+  return Stat;
+}
+
+static DSTATUS sim_disk_status()
+{
+  return Stat;
+}
+
+static DRESULT sim_disk_read( BYTE *buff, DWORD sector, BYTE count )
+{
+  if( count == 0 )
+    return RES_PARERR;
+  if( Stat & STA_NOINIT )
+    return RES_NOTRDY;
+  if( sector + count > sim_sectors )
+    return RES_PARERR;
+  simh_delay( count );
+#ifdef MMCFS_SIM_IMAGE
+  if( !simh_seek( sector ) || hostif_read( sim_fd, buff, count * SIM_SECTOR_SIZE ) != count * SIM_SECTOR_SIZE )
+    return RES_ERROR;
+#else
+  memcpy( buff, sim_ramdisk + sector * SIM_SECTOR_SIZE, count * SIM_SECTOR_SIZE );
+#endif
+  return RES_OK;
+}
+
+static DRESULT sim_disk_write( const BYTE *buff, DWORD sector, BYTE count )
+{
+  if( count == 0 )
+    return RES_PARERR;
+  if( Stat & STA_NOINIT )
+    return RES_NOTRDY;
+  if( sector + count > sim_sectors )
+    return RES_PARERR;
+  simh_delay( count );
+#ifdef MMCFS_SIM_IMAGE
+  if( !simh_seek( sector ) || hostif_write( sim_fd, buff, count * SIM_SECTOR_SIZE ) != count * SIM_SECTOR_SIZE )
+    return RES_ERROR;
+#else
+  memcpy( sim_ramdisk + sector * SIM_SECTOR_SIZE, buff, count * SIM_SECTOR_SIZE );
+#endif
+  return RES_OK;
+}
+
+static DRESULT sim_disk_ioctl( BYTE ctrl, void *buff )
+{
+  if( Stat & STA_NOINIT )
+    return RES_NOTRDY;
+  switch( ctrl )
+  {
+    case CTRL_SYNC:
+      return RES_OK;
+
+    case GET_SECTOR_COUNT:
+      *( DWORD* )buff = sim_sectors;
+      return RES_OK;
+
+    case GET_SECTOR_SIZE:
+      *( WORD* )buff = SIM_SECTOR_SIZE;
+      return RES_OK;
+
+    case GET_BLOCK_SIZE:
+      *( DWORD* )buff = 1;
+      return RES_OK;
+  }
+  return RES_PARERR;
+}
+
+const BLKDEV mmc_blkdev =
+{
+  sim_disk_initialize,
+  sim_disk_status,
+  sim_disk_read,
+  sim_disk_write,
+  sim_disk_ioctl,
+  0
+};
+
+void disk_timerproc( void )
+{
+}
+
+// The simulator has no real time clock
+DWORD get_fattime( void )
+{
+  return ( ( 2011UL - 1980 ) << 25 )  // Year = 2011
+         | ( 1UL << 21 )              // Month = Jan
+         | ( 1UL << 16 )              // Day = 1
+         | ( 12U << 11 )              // Hour = 12
+         | ( 0U << 5 )                // Min = 0
+         | ( 0U >> 1 )                // Sec = 0
+         ;
+}
+
+#endif // #if defined( BUILD_MMCFS ) && defined( MMCFS_SIM )
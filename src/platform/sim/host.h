@@ -12,6 +12,53 @@ ssize_t host_read( int fd, void * buf, size_t count );
 ssize_t host_write( int fd, const void * buf, size_t count );
 int host_open( const char *name, int flags, mode_t mode );
 int host_close( int fd );
+off_t host_lseek( int fd, off_t offset, int whence );
+
+struct host_timespec
+{
+  long tv_sec;
+  long tv_nsec;
+};
+
+int host_nanosleep( const struct host_timespec *req, struct host_timespec *rem );
+
+#define CLOCK_MONOTONIC 1
+
+int host_clock_gettime( int clk_id, struct host_timespec *tp );
+
+// Sockets (all the socket calls go through socketcall on i386)
+#define SYS_SOCKET      1
+#define SYS_CONNECT     3
+#define SYS_SEND        9
+#define SYS_RECV        10
+#define SYS_SETSOCKOPT  14
+
+#define AF_INET         2
+#define SOCK_STREAM     1
+#define IPPROTO_TCP     6
+#define TCP_NODELAY     1
+#define MSG_NOSIGNAL    0x4000
+
+struct host_sockaddr_in
+{
+  unsigned short sin_family;
+  unsigned short sin_port;          // network byte order
+  unsigned char sin_addr[ 4 ];
+  unsigned char sin_zero[ 8 ];
+};
+
+int host_socketcall( int call, unsigned long *args );
+
+struct host_pollfd
+{
+  int fd;
+  short events;
+  short revents;
+};
+
+#define POLLIN          0x001
+
+int host_poll( struct host_pollfd *fds, unsigned nfds, int timeout );
 
 #define PROT_READ 0x1   /* Page can be read.  */
 #define PROT_WRITE  0x2   /* Page can be written.  */
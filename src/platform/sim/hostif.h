@@ -30,5 +30,26 @@ int hostif_write( int fd, const void *buf, unsigned count );
 // Close
 int hostif_close( int fd );
 
+// Seek
+long hostif_lseek( int fd, long offset, int whence );
+
+// Sleep for the given number of microseconds
+void hostif_usleep( unsigned us );
+
+// Microseconds from a monotonic host clock (wraps around)
+unsigned hostif_get_us();
+
+// Open a TCP connection to the given IPv4 address (4 bytes) and port
+// Returns the descriptor of the connection or -1 for error
+int hostif_tcp_connect( const unsigned char *ip, unsigned port );
+
+// Send data on a connection (no signal if the connection was closed)
+int hostif_send( int fd, const void *buf, unsigned count );
+
+// Receive data from a connection, waiting at most 'timeout' milliseconds
+// (-1 for infinite). Returns the number of bytes, 0 for timeout or -1 if the
+// connection was closed.
+int hostif_recv( int fd, void *buf, unsigned count, int timeout );
+
 #endif // __HOSTIO_H__
 
@@ -64,3 +64,86 @@ int hostif_close( int fd )
   return host_close( fd );
 }
 
+long hostif_lseek( int fd, long offset, int whence )
+{
+  return ( long )host_lseek( fd, ( off_t )offset, whence );
+}
+
+void hostif_usleep( unsigned us )
+{
+  struct host_timespec ts;
+
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = ( us % 1000000 ) * 1000;
+  host_nanosleep( &ts, NULL );
+}
+
+unsigned hostif_get_us()
+{
+  struct host_timespec ts;
+
+  if( host_clock_gettime( CLOCK_MONOTONIC, &ts ) == -1 )
+    return 0;
+  return ( unsigned )ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int hostif_tcp_connect( const unsigned char *ip, unsigned port )
+{
+  struct host_sockaddr_in addr;
+  unsigned long args[ 5 ];
+  int fd, flag = 1;
+
+  args[ 0 ] = AF_INET;
+  args[ 1 ] = SOCK_STREAM;
+  args[ 2 ] = 0;
+  if( ( fd = host_socketcall( SYS_SOCKET, args ) ) == -1 )
+    return -1;
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_family = AF_INET;
+  addr.sin_port = ( unsigned short )( ( ( port & 0xFF ) << 8 ) | ( ( port >> 8 ) & 0xFF ) );
+  memcpy( addr.sin_addr, ip, 4 );
+  args[ 0 ] = fd;
+  args[ 1 ] = ( unsigned long )&addr;
+  args[ 2 ] = sizeof( addr );
+  if( host_socketcall( SYS_CONNECT, args ) == -1 )
+  {
+    host_close( fd );
+    return -1;
+  }
+  // Requests are complete packets, don't delay them
+  args[ 1 ] = IPPROTO_TCP;
+  args[ 2 ] = TCP_NODELAY;
+  args[ 3 ] = ( unsigned long )&flag;
+  args[ 4 ] = sizeof( flag );
+  host_socketcall( SYS_SETSOCKOPT, args );
+  return fd;
+}
+
+int hostif_send( int fd, const void *buf, unsigned count )
+{
+  unsigned long args[ 4 ];
+
+  args[ 0 ] = fd;
+  args[ 1 ] = ( unsigned long )buf;
+  args[ 2 ] = count;
+  args[ 3 ] = MSG_NOSIGNAL;
+  return host_socketcall( SYS_SEND, args );
+}
+
+int hostif_recv( int fd, void *buf, unsigned count, int timeout )
+{
+  struct host_pollfd pfd;
+  unsigned long args[ 4 ];
+  int res;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  if( ( res = host_poll( &pfd, 1, timeout ) ) <= 0 )
+    return res;
+  args[ 0 ] = fd;
+  args[ 1 ] = ( unsigned long )buf;
+  args[ 2 ] = count;
+  args[ 3 ] = 0;
+  return ( res = host_socketcall( SYS_RECV, args ) ) > 0 ? res : -1;
+}
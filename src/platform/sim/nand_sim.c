@@ -0,0 +1,131 @@
+// NAND flash simulator (low level interface of the FTL, see nandftl.h)
+// The chip is kept in RAM. Like a real chip, programming can only clear bits
+// and erasing sets a whole block to 0xFF. If NAND_SIM_IMAGE is defined the
+// chip is loaded from that file when it's initialized and every change is
+// written back, so the FTL can be remounted in the next simulator run. The
+// latencies can be used to model the timing of a real chip.
+
+#include "platform_conf.h"
+#ifdef BUILD_NANDFTL
+
+#include "nandftl.h"
+#include "platform.h"
+#include "hostif.h"
+#include <string.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+// Default configuration (can be overriden in platform_conf.h)
+#ifndef NAND_SIM_BLOCKS
+#define NAND_SIM_BLOCKS           NANDFTL_BLOCKS
+#endif
+
+#ifndef NANDFTL_PAGES_PER_BLOCK
+#define NANDFTL_PAGES_PER_BLOCK   32
+#endif
+
+// Page read, page program and block erase times in microseconds
+#ifndef NAND_SIM_READ_US
+#define NAND_SIM_READ_US          0
+#endif
+
+#ifndef NAND_SIM_PROG_US
+#define NAND_SIM_PROG_US          0
+#endif
+
+#ifndef NAND_SIM_ERASE_US
+#define NAND_SIM_ERASE_US         0
+#endif
+
+#define SIM_RAW_PAGE_SIZE         ( NANDFTL_PAGE_SIZE + NANDFTL_SPARE_SIZE )
+#define SIM_PAGES                 ( NAND_SIM_BLOCKS * NANDFTL_PAGES_PER_BLOCK )
+
+static u8 *sim_nand;
+#ifdef NAND_SIM_IMAGE
+static int sim_nand_fd = -1;
+#endif
+
+// Helper: wait for the simulated operation time
+static void simh_nand_delay( unsigned us )
+{
+  if( us > 0 )
+    hostif_usleep( us );
+}
+
+// Helper: write a part of the chip back to the image file
+static int simh_nand_save( u32 offset, u32 size )
+{
+#ifdef NAND_SIM_IMAGE
+  if( hostif_lseek( sim_nand_fd, ( long )offset, SEEK_SET ) != ( long )offset ||
+      hostif_write( sim_nand_fd, sim_nand + offset, size ) != ( int )size )
+    return PLATFORM_ERR;
+#endif
+  return PLATFORM_OK;
+}
+
+// Helper: program part of a page (bits can only go from 1 to 0)
+static void simh_nand_program( u8 *dest, const u8 *src, unsigned size )
+{
+  while( size -- )
+    *dest ++ &= *src ++;
+}
+
+int nand_ll_init()
+{
+  if( sim_nand )
+    return PLATFORM_OK;
+  if( ( sim_nand = hostif_getmem( SIM_PAGES * SIM_RAW_PAGE_SIZE ) ) == NULL )
+    return PLATFORM_ERR;
+  memset( sim_nand, 0xFF, SIM_PAGES * SIM_RAW_PAGE_SIZE );
+#ifdef NAND_SIM_IMAGE
+  // The image can be shorter than the chip (the rest of the chip is erased)
+  if( ( sim_nand_fd = hostif_open( NAND_SIM_IMAGE, O_RDWR, 0 ) ) < 0 )
+  {
+    printf( "Unable to open the NAND image %s\n", NAND_SIM_IMAGE );
+    return PLATFORM_ERR;
+  }
+  hostif_read( sim_nand_fd, sim_nand, SIM_PAGES * SIM_RAW_PAGE_SIZE );
+#endif
+  return PLATFORM_OK;
+}
+
+int nand_ll_read( u32 page, u8 *data, u8 *spare )
+{
+  u8 *p = sim_nand + page * SIM_RAW_PAGE_SIZE;
+
+  if( page >= SIM_PAGES )
+    return PLATFORM_ERR;
+  simh_nand_delay( NAND_SIM_READ_US );
+  if( data )
+    memcpy( data, p, NANDFTL_PAGE_SIZE );
+  if( spare )
+    memcpy( spare, p + NANDFTL_PAGE_SIZE, NANDFTL_SPARE_SIZE );
+  return PLATFORM_OK;
+}
+
+int nand_ll_write( u32 page, const u8 *data, const u8 *spare )
+{
+  u8 *p = sim_nand + page * SIM_RAW_PAGE_SIZE;
+
+  if( page >= SIM_PAGES )
+    return PLATFORM_ERR;
+  simh_nand_delay( NAND_SIM_PROG_US );
+  if( data )
+    simh_nand_program( p, data, NANDFTL_PAGE_SIZE );
+  if( spare )
+    simh_nand_program( p + NANDFTL_PAGE_SIZE, spare, NANDFTL_SPARE_SIZE );
+  return simh_nand_save( page * SIM_RAW_PAGE_SIZE, SIM_RAW_PAGE_SIZE );
+}
+
+int nand_ll_erase( u32 block )
+{
+  u32 size = NANDFTL_PAGES_PER_BLOCK * SIM_RAW_PAGE_SIZE;
+
+  if( block >= NAND_SIM_BLOCKS )
+    return PLATFORM_ERR;
+  simh_nand_delay( NAND_SIM_ERASE_US );
+  memset( sim_nand + block * size, 0xFF, size );
+  return simh_nand_save( block * size, size );
+}
+
+#endif // #ifdef BUILD_NANDFTL
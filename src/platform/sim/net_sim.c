@@ -0,0 +1,109 @@
+// Network sockets of the simulator (elua_net, BUILD_SIM_NET)
+// There's no TCP/IP stack in the simulator image: TCP client sockets are
+// connections of the host, so the simulator can talk to servers that run on
+// the same machine (for example 'rfs_server tcp <dir>' for RFS_TRANSPORT_TCP).
+// The host buffers the incoming data, so elua_net_set_buffer has nothing to do.
+// UDP, accept, DNS and the receive callbacks aren't implemented.
+
+#include "platform_conf.h"
+#ifdef BUILD_SIM_NET
+
+#include "type.h"
+#include "elua_net.h"
+#include "hostif.h"
+
+#define SIM_NET_MAX_SOCKETS   4
+
+// Host descriptor of each socket (SIM_NET_FREE if the socket isn't used,
+// SIM_NET_IDLE if it isn't connected)
+#define SIM_NET_FREE          ( -2 )
+#define SIM_NET_IDLE          ( -1 )
+static int sim_net_fds[ SIM_NET_MAX_SOCKETS ] = { SIM_NET_FREE, SIM_NET_FREE, SIM_NET_FREE, SIM_NET_FREE };
+static int sim_net_errs[ SIM_NET_MAX_SOCKETS ];
+
+static int sim_net_check( int s )
+{
+  return s >= 0 && s < SIM_NET_MAX_SOCKETS && sim_net_fds[ s ] != SIM_NET_FREE;
+}
+
+int elua_net_socket( int type )
+{
+  int s;
+
+  if( type != ELUA_NET_SOCK_STREAM )
+    return ELUA_NET_INVALID_SOCKET;
+  for( s = 0; s < SIM_NET_MAX_SOCKETS; s ++ )
+    if( sim_net_fds[ s ] == SIM_NET_FREE )
+    {
+      sim_net_fds[ s ] = SIM_NET_IDLE;
+      sim_net_errs[ s ] = ELUA_NET_ERR_OK;
+      return s;
+    }
+  return ELUA_NET_INVALID_SOCKET;
+}
+
+int elua_net_set_buffer( int s, unsigned bufsize )
+{
+  ( void )bufsize;
+  return sim_net_check( s );
+}
+
+int elua_net_connect( int s, elua_net_ip addr, u16 port, unsigned timer_id, s32 to_us )
+{
+  ( void )timer_id;
+  ( void )to_us;
+  if( !sim_net_check( s ) || sim_net_fds[ s ] != SIM_NET_IDLE )
+    return -1;
+  if( ( sim_net_fds[ s ] = hostif_tcp_connect( addr.ipbytes, port ) ) == -1 )
+  {
+    sim_net_fds[ s ] = SIM_NET_IDLE;
+    sim_net_errs[ s ] = ELUA_NET_ERR_ABORTED;
+    return -1;
+  }
+  sim_net_errs[ s ] = ELUA_NET_ERR_OK;
+  return 0;
+}
+
+elua_net_size elua_net_send( int s, const void* buf, elua_net_size len )
+{
+  int res;
+
+  if( !sim_net_check( s ) || sim_net_fds[ s ] < 0 || len <= 0 )
+    return 0;
+  if( ( res = hostif_send( sim_net_fds[ s ], buf, len ) ) <= 0 )
+  {
+    sim_net_errs[ s ] = ELUA_NET_ERR_CLOSED;
+    return 0;
+  }
+  sim_net_errs[ s ] = ELUA_NET_ERR_OK;
+  return ( elua_net_size )res;
+}
+
+elua_net_size elua_net_recv( int s, void *buf, elua_net_size maxsize, unsigned timer_id, s32 to_us )
+{
+  int res;
+
+  ( void )timer_id;
+  if( !sim_net_check( s ) || sim_net_fds[ s ] < 0 || maxsize <= 0 )
+    return 0;
+  res = hostif_recv( sim_net_fds[ s ], buf, maxsize, to_us < 0 ? -1 : ( int )( ( to_us + 999 ) / 1000 ) );
+  sim_net_errs[ s ] = res > 0 ? ELUA_NET_ERR_OK : res == 0 ? ELUA_NET_ERR_TIMEDOUT : ELUA_NET_ERR_CLOSED;
+  return res > 0 ? ( elua_net_size )res : 0;
+}
+
+int elua_net_close( int s )
+{
+  if( !sim_net_check( s ) )
+    return 0;
+  if( sim_net_fds[ s ] >= 0 )
+    hostif_close( sim_net_fds[ s ] );
+  sim_net_fds[ s ] = SIM_NET_FREE;
+  return 1;
+}
+
+int elua_net_get_last_err( int s )
+{
+  return sim_net_check( s ) ? sim_net_errs[ s ] : ELUA_NET_ERR_CLOSED;
+}
+
+#endif // #ifdef BUILD_SIM_NET
@@ -143,15 +143,44 @@ int platform_s_uart_set_flow_control( unsigned id, int type )
 }
 
 // ****************************************************************************
-// "Dummy" timer functions
+// Timer functions
+// Timer 0 is a free running 1MHz counter that reads the host clock
 
 void platform_s_timer_delay( unsigned id, u32 delay_us )
 {
+  hostif_usleep( delay_us );
 }
 
 u32 platform_s_timer_op( unsigned id, int op, u32 data )
 {
-  return 0;
+  u32 res = 0;
+
+  switch( op )
+  {
+    case PLATFORM_TIMER_OP_START:
+    case PLATFORM_TIMER_OP_READ:
+      res = hostif_get_us();
+      break;
+
+    case PLATFORM_TIMER_OP_GET_MAX_DELAY:
+      res = platform_timer_get_diff_us( id, 0, 0xFFFFFFFF );
+      break;
+
+    case PLATFORM_TIMER_OP_GET_MIN_DELAY:
+      res = 1;
+      break;
+
+    case PLATFORM_TIMER_OP_SET_CLOCK:
+    case PLATFORM_TIMER_OP_GET_CLOCK:
+      res = 1000000;
+      break;
+  }
+  return res;
+}
+
+int platform_s_timer_set_match_int( unsigned id, u32 period_us, int type )
+{
+  return PLATFORM_TIMER_INT_INVALID_ID;
 }
 
 // ****************************************************************************
@@ -168,3 +197,9 @@ int platform_cpu_get_global_interrupts()
   return 0;
 }
 
+// Only software interrupts (like INT_AIO_DONE) are available
+const elua_int_descriptor elua_int_table[ INT_ELUA_LAST ] = 
+{
+  { NULL, NULL, NULL }
+};
+
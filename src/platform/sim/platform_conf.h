@@ -7,15 +7,24 @@
 #include "type.h"
 #include "stacks.h"
 #include "buf.h"
+#include "elua_int.h"
 
 // *****************************************************************************
 // Define here what components you want for this platform
 
 #define BUILD_SHELL
 #define BUILD_ROMFS
+#define BUILD_RAMFS
 #define BUILD_CON_GENERIC
 #define BUILD_TERM
 //#define BUILD_RFS
+//#define BUILD_RFS_CACHE
+//#define BUILD_RFS_COMPRESS
+#define BUILD_LUA_INT_HANDLERS
+#define BUILD_AIO
+#define BUILD_MMCFS
+#define BUILD_DISKCACHE
+#define BUILD_NANDFTL
 
 #define TERM_LINES    25
 #define TERM_COLS     80
@@ -27,7 +36,10 @@
   _ROM( AUXLIB_PD, luaopen_pd, pd_map )\
   _ROM( LUA_MATHLIBNAME, luaopen_math, math_map )\
   _ROM( AUXLIB_TERM, luaopen_term, term_map )\
-  _ROM( AUXLIB_ELUA, luaopen_elua, elua_map )
+  _ROM( AUXLIB_ELUA, luaopen_elua, elua_map )\
+  _ROM( AUXLIB_CPU, luaopen_cpu, cpu_map )\
+  _ROM( AUXLIB_TMR, luaopen_tmr, tmr_map )\
+  _ROM( AUXLIB_AIO, luaopen_aio, aio_map )
 
 // Bogus defines for common.c
 #define CON_UART_ID           0
@@ -44,7 +56,7 @@
 #define NUM_PIO               0
 #define NUM_SPI               0
 #define NUM_UART              0
-#define NUM_TIMER             0
+#define NUM_TIMER             1
 #define NUM_PWM               0
 #define NUM_ADC               0
 #define NUM_CAN               0
@@ -68,8 +80,64 @@ extern void *memory_end_address;
 #define MEM_START_ADDRESS     { ( void* )memory_start_address }
 #define MEM_END_ADDRESS       { ( void* )memory_end_address }
 
+// RAM filesystem configuration (kept in a static array)
+#define RAMFS_SIZE            ( 128 * 1024 )
+
+// MMCFS configuration: /mmc is a RAM disk, or a disk image file on the host
+// if MMCFS_SIM_IMAGE is defined (it must be a FAT image without a partition
+// table). The latencies can be used to model a real SD card.
+#define MMCFS_SIM
+//#define MMCFS_SIM_IMAGE             "mmc.img"
+#define MMCFS_SIM_RAMDISK_SECTORS   8192
+#define MMCFS_SIM_CMD_LATENCY_US    0
+#define MMCFS_SIM_SECTOR_LATENCY_US 0
+
+// NAND FTL configuration: /nand is a simulated 4MB small page NAND chip
+// (nand_sim.c), kept in the NAND_SIM_IMAGE file if defined. The times can be
+// used to model a real chip.
+#define NANDFTL_BLOCKS              256
+#define NANDFTL_PAGES_PER_UNIT      2         // like the STM32 board
+//#define NAND_SIM_IMAGE              "nand.img"
+#define NAND_SIM_READ_US            0
+#define NAND_SIM_PROG_US            0
+#define NAND_SIM_ERASE_US           0
+
+// Block layer configuration (write queue and read ahead sizes)
+#define BLKDEV_QUEUE_SECTORS        16
+#define BLKDEV_READAHEAD_SECTORS    16
+
+// Descriptor configuration (the simulator can afford a lot of open files)
+#define DM_MAX_FDS            256
+#define ROMFS_MAX_FDS         128
+#define RAMFS_MAX_FDS         128
+
+// Interrupt queue size
+#define PLATFORM_INT_QUEUE_LOG_SIZE 5
+
+// Interrupt list (the simulator has only software interrupts)
+#define INT_AIO_DONE          ELUA_INT_FIRST_ID
+#define INT_ELUA_LAST         INT_AIO_DONE
+
+#define PLATFORM_CPU_CONSTANTS\
+  _C( INT_AIO_DONE )
+
 // RFS configuration
-#define RFS_TIMEOUT           0 // dummy, always blocking by implementation
+// The RFS server is reached through pipes (main_sim.c) or, with BUILD_SIM_NET
+// and RFS_TRANSPORT_TCP, through a TCP connection of the host (start the server
+// with 'rfs_server tcp <dir>')
+//#define BUILD_SIM_NET
+//#define RFS_TRANSPORT_TCP
 #define RFS_BUFFER_SIZE       BUF_SIZE_512
+#ifdef RFS_TRANSPORT_TCP
+#define RFS_TCP_SERVER_IP0    127
+#define RFS_TCP_SERVER_IP1    0
+#define RFS_TCP_SERVER_IP2    0
+#define RFS_TCP_SERVER_IP3    1
+#define RFS_TCP_BUFFER_SIZE   8192
+#define RFS_TIMER_ID          0 // dummy, the host sockets have their own timeouts
+#define RFS_TIMEOUT           2000000
+#else
+#define RFS_TIMEOUT           0 // dummy, always blocking by implementation
+#endif
 
 #endif // #ifndef __PLATFORM_CONF_H__
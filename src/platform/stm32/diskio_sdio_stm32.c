@@ -37,11 +37,10 @@
 #include "stm32f10x.h"
 #include "ffconf.h"
 #include "diskio.h"
+#include "blkdev.h"
 
 #include "sdcard.h"
 #include "stm32f10x_sdio.h"
-#include "nand_if.h"
-#include "fsmc_nand.h"
 #include <stdio.h>
 
 static SD_CardInfo SDCardInfo2;
@@ -58,32 +57,22 @@ volatile DSTATUS Stat = STA_NOINIT;
 /* Initialize Disk Drive                                                 */
 /*-----------------------------------------------------------------------*/
 
-DSTATUS disk_initialize (
-	BYTE drv		/* Physical drive number (0) */
-)
+static DSTATUS sdio_disk_initialize (void)
 {
-  if( drv == 0 )
-  {
-    if( ( Stat & STA_NOINIT ) == 0 )
-      return 0;
-    SD_Init();
-    SD_InitializeCards();
-    SD_GetCardInfo(&SDCardInfo2);
-    SD_SelectDeselect((uint32_t) (SDCardInfo2.RCA << 16));
-    SD_SetDeviceMode(SD_DMA_MODE);
-    NVIC_InitTypeDef nvic_init_structure;
-    nvic_init_structure.NVIC_IRQChannel = SDIO_IRQn;
-    nvic_init_structure.NVIC_IRQChannelPreemptionPriority = 4;
-    nvic_init_structure.NVIC_IRQChannelSubPriority = 0;
-    nvic_init_structure.NVIC_IRQChannelCmd = ENABLE;
-    NVIC_Init(&nvic_init_structure);
-    Stat &= ~STA_NOINIT;
-  } 
-  else 
-  {
-    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_FSMC, ENABLE);
-  	NAND_Init();
-  }
+  if( ( Stat & STA_NOINIT ) == 0 )
+    return 0;
+  SD_Init();
+  SD_InitializeCards();
+  SD_GetCardInfo(&SDCardInfo2);
+  SD_SelectDeselect((uint32_t) (SDCardInfo2.RCA << 16));
+  SD_SetDeviceMode(SD_DMA_MODE);
+  NVIC_InitTypeDef nvic_init_structure;
+  nvic_init_structure.NVIC_IRQChannel = SDIO_IRQn;
+  nvic_init_structure.NVIC_IRQChannelPreemptionPriority = 4;
+  nvic_init_structure.NVIC_IRQChannelSubPriority = 0;
+  nvic_init_structure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&nvic_init_structure);
+  Stat &= ~STA_NOINIT;
 	return 0;
 }
 
@@ -92,11 +81,9 @@ DSTATUS disk_initialize (
 /* Get Disk Status                                                       */
 /*-----------------------------------------------------------------------*/
 
-DSTATUS disk_status (
-	BYTE drv		/* Physical drive number (0) */
-)
+static DSTATUS sdio_disk_status (void)
 {
-	return drv == 0 ? Stat : 0;
+	return Stat;
 }
 
 
@@ -104,64 +91,36 @@ DSTATUS disk_status (
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_read (
-	BYTE drv,			/* Physical drive number (0) */
+static DRESULT sdio_disk_read (
 	BYTE *buff,			/* Pointer to the data buffer to store read data */
 	DWORD sector,		/* Start sector number (LBA) */
 	BYTE count			/* Sector count (1..255) */
 )
 {
-  if( drv == 0 && ( Stat & STA_NOINIT ) )
+  if( Stat & STA_NOINIT )
     return RES_NOTRDY;
-  while( count )
-  {
-    if( drv == 0 )
-    {
-      if( SD_ReadBlock(sector * 512, (uint32_t *)buff, 512) != SD_OK )
-        return RES_ERROR;    
-    }
-    else
-    {
-	    if( NAND_Read(sector * 512, (uint32_t *)buff, 512) != NAND_OK )
-        return RES_ERROR;
-    }
-    sector ++;
-    count --;
-    buff += 512;
-  }
-	return RES_OK;
+  // Consecutive SD sectors are read with a single command (CMD18)
+  if( count > 1 )
+    return SD_ReadMultiBlocks(sector * 512, (uint32_t *)buff, 512, count) == SD_OK ? RES_OK : RES_ERROR;
+  return SD_ReadBlock(sector * 512, (uint32_t *)buff, 512) == SD_OK ? RES_OK : RES_ERROR;
 }
 
 /*-----------------------------------------------------------------------*/
 /* Write Sector(s)                                                       */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_write (
-	BYTE drv,			/* Physical drive number (0) */
+static DRESULT sdio_disk_write (
 	const BYTE *buff,	/* Pointer to the data to be written */
 	DWORD sector,		/* Start sector number (LBA) */
 	BYTE count			/* Sector count (1..255) */
 )
 {  
-  if( drv == 0 && ( Stat & STA_NOINIT ) )
+  if( Stat & STA_NOINIT )
     return RES_NOTRDY;
-  while( count )
-  {
-    if( drv == 0 )
-    {
-      if( SD_WriteBlock(sector * 512, (uint32_t *)buff, 512) != SD_OK )
-        return RES_ERROR;    
-    }
-    else
-    {
-      if( NAND_Write(sector * 512, (uint32_t *)buff, 512) != NAND_OK )
-        return RES_ERROR;
-    }
-    sector ++;
-    count --;
-    buff += 512;
-  }
-	return RES_OK;
+  // Consecutive SD sectors are written with a single command (CMD25)
+  if( count > 1 )
+    return SD_WriteMultiBlocks(sector * 512, (uint32_t *)buff, 512, count) == SD_OK ? RES_OK : RES_ERROR;
+  return SD_WriteBlock(sector * 512, (uint32_t *)buff, 512) == SD_OK ? RES_OK : RES_ERROR;
 }
 
 /*-----------------------------------------------------------------------*/
@@ -185,29 +144,23 @@ DWORD get_fattime ()
 /* Miscellaneous Functions                                               */
 /*-----------------------------------------------------------------------*/
  		
-DRESULT disk_ioctl (
-	BYTE drv,		// Physical drive number (0) 
+static DRESULT sdio_disk_ioctl (
 	BYTE ctrl,		// Control code
 	void *buff		// Buffer to send/receive control data
 )
 {		
 	DRESULT res= RES_OK;
 
-  if( drv == 0 && ( Stat & STA_NOINIT ) )
+  if( Stat & STA_NOINIT )
     return RES_NOTRDY;
   switch (ctrl) {
   case CTRL_SYNC :		/// Make sure that no pending write process
-    if( drv == 0 )
-      res = SD_GetTransferState() == SD_NO_TRANSFER ? RES_OK : RES_ERROR;
-    else
-      res = FSMC_NAND_GetStatus() == NAND_READY ? RES_OK : RES_ERROR;
+    res = SD_GetTransferState() == SD_NO_TRANSFER ? RES_OK : RES_ERROR;
     break;
 
   case GET_SECTOR_COUNT :	  // Get number of sectors on the disk (DWORD)
-    if( drv == 0 )
-      *( DWORD* )buff = 131072; // [TODO] we should actually remember the disk size!
-    else
-      *( DWORD* )buff = 65536;
+    // The block layer uses this to stop the read ahead at the end of the card
+    *( DWORD* )buff = SDCardInfo2.CardCapacity ? SDCardInfo2.CardCapacity / 512 : 131072;
     res = RES_OK;
     break;
 
@@ -219,11 +172,26 @@ DRESULT disk_ioctl (
   case GET_BLOCK_SIZE :	    // Get erase block size in unit of sector (DWORD)
     *(DWORD*)buff = 32;
     res = RES_OK;
+    break;
+
+  default:
+    res = RES_PARERR;
     }
 	  
 	return res;
 }
 
+// Block device descriptor (see blkdev.h)
+const BLKDEV mmc_blkdev =
+{
+  sdio_disk_initialize,
+  sdio_disk_status,
+  sdio_disk_read,
+  sdio_disk_write,
+  sdio_disk_ioctl,
+  0
+};
+
 void disk_timerproc( void )
 {
 }
@@ -235,6 +235,89 @@ uint32_t FSMC_NAND_ReadSmallPage(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_
   return (status | addressstatus);
 }
 
+/******************************************************************************
+* Function Name  : FSMC_NAND_WritePageSpare
+* Description    : This routine writes a 512 Bytes page and its spare area with
+*                  a single program operation.
+* Input          : - pBuffer: pointer on the Buffer containing the page data
+*                  - pSpare: pointer on the Buffer containing the spare area
+*                  - Address: page address
+* Output         : None
+* Return         : New status of the NAND operation. This parameter can be:
+*                   - NAND_TIMEOUT_ERROR: when the previous operation generate 
+*                     a Timeout error
+*                   - NAND_ERROR: when the program operation failed
+*                   - NAND_READY: when memory is ready for the next operation 
+*******************************************************************************/
+uint32_t FSMC_NAND_WritePageSpare(uint8_t *pBuffer, uint8_t *pSpare, NAND_ADDRESS Address)
+{
+  uint32_t index = 0x00;
+
+  /* Page write command and address */
+  *(__IO uint8_t *)(Bank_NAND_ADDR | CMD_AREA) = NAND_CMD_AREA_A;
+  *(__IO uint8_t *)(Bank_NAND_ADDR | CMD_AREA) = NAND_CMD_WRITE0;
+
+  *(__IO uint8_t *)(Bank_NAND_ADDR | ADDR_AREA) = 0x00;  
+  *(__IO uint8_t *)(Bank_NAND_ADDR | ADDR_AREA) = ADDR_1st_CYCLE(ROW_ADDRESS);  
+  *(__IO uint8_t *)(Bank_NAND_ADDR | ADDR_AREA) = ADDR_2nd_CYCLE(ROW_ADDRESS);  
+  *(__IO uint8_t *)(Bank_NAND_ADDR | ADDR_AREA) = ADDR_3rd_CYCLE(ROW_ADDRESS);  
+
+  /* Write data, then the spare area (the column address wraps into it) */
+  for(; index < NAND_PAGE_SIZE; index++)
+  {
+    *(__IO uint8_t *)(Bank_NAND_ADDR | DATA_AREA) = pBuffer[index];
+  }
+  for(index = 0x00; index < NAND_SPARE_AREA_SIZE; index++)
+  {
+    *(__IO uint8_t *)(Bank_NAND_ADDR | DATA_AREA) = pSpare[index];
+  }
+
+  *(__IO uint8_t *)(Bank_NAND_ADDR | CMD_AREA) = NAND_CMD_WRITE_TRUE1;
+
+  /* Check status for successful operation */
+  return (FSMC_NAND_GetStatus());
+}
+
+/******************************************************************************
+* Function Name  : FSMC_NAND_ReadPageSpare
+* Description    : This routine reads a 512 Bytes page and its spare area with
+*                  a single read operation.
+* Input          : - pBuffer: pointer on the Buffer to fill with the page data
+*                  - pSpare: pointer on the Buffer to fill with the spare area
+*                  - Address: page address
+* Output         : None
+* Return         : New status of the NAND operation. This parameter can be:
+*                   - NAND_TIMEOUT_ERROR: when the previous operation generate 
+*                     a Timeout error
+*                   - NAND_READY: when memory is ready for the next operation 
+*******************************************************************************/
+uint32_t FSMC_NAND_ReadPageSpare(uint8_t *pBuffer, uint8_t *pSpare, NAND_ADDRESS Address)
+{
+  uint32_t index = 0x00;
+
+  /* Page Read command and page address */
+  *(__IO uint8_t *)(Bank_NAND_ADDR | CMD_AREA) = NAND_CMD_AREA_A; 
+ 
+  *(__IO uint8_t *)(Bank_NAND_ADDR | ADDR_AREA) = 0x00; 
+  *(__IO uint8_t *)(Bank_NAND_ADDR | ADDR_AREA) = ADDR_1st_CYCLE(ROW_ADDRESS); 
+  *(__IO uint8_t *)(Bank_NAND_ADDR | ADDR_AREA) = ADDR_2nd_CYCLE(ROW_ADDRESS); 
+  *(__IO uint8_t *)(Bank_NAND_ADDR | ADDR_AREA) = ADDR_3rd_CYCLE(ROW_ADDRESS); 
+  
+  *(__IO uint8_t *)(Bank_NAND_ADDR | CMD_AREA) = NAND_CMD_AREA_TRUE1; 
+
+  /* Get Data into Buffer, then the spare area */
+  for(; index < NAND_PAGE_SIZE; index++)
+  {
+    pBuffer[index]= *(__IO uint8_t *)(Bank_NAND_ADDR | DATA_AREA);
+  }
+  for(index = 0x00; index < NAND_SPARE_AREA_SIZE; index++)
+  {
+    pSpare[index]= *(__IO uint8_t *)(Bank_NAND_ADDR | DATA_AREA);
+  }
+
+  return (FSMC_NAND_GetStatus());
+}
+
 /******************************************************************************
 * Function Name  : FSMC_NAND_WriteSpareArea
 * Description    : This routine write the spare area information for the specified 
@@ -86,6 +86,8 @@ void FSMC_NAND_Init(void);
 void FSMC_NAND_ReadID(NAND_IDTypeDef* NAND_ID);
 uint32_t FSMC_NAND_WriteSmallPage(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t NumPageToWrite);
 uint32_t FSMC_NAND_ReadSmallPage (uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t NumPageToRead);
+uint32_t FSMC_NAND_WritePageSpare(uint8_t *pBuffer, uint8_t *pSpare, NAND_ADDRESS Address);
+uint32_t FSMC_NAND_ReadPageSpare(uint8_t *pBuffer, uint8_t *pSpare, NAND_ADDRESS Address);
 uint32_t FSMC_NAND_WriteSpareArea(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t NumSpareAreaTowrite);
 uint32_t FSMC_NAND_ReadSpareArea(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t NumSpareAreaToRead);
 uint32_t FSMC_NAND_EraseBlock(NAND_ADDRESS Address);
@@ -17,6 +17,7 @@
 //#define BUILD_XMODEM
 #define BUILD_SHELL
 #define BUILD_ROMFS
+#define BUILD_RAMFS
 #define BUILD_MMCFS
 #define BUILD_TERM_VRAM
 //#define BUILD_TERM
@@ -27,6 +28,8 @@
 #define BUILD_ADC
 //#define BUILD_RPC
 #define BUILD_RFS
+#define BUILD_RFS_CACHE
+#define BUILD_RFS_COMPRESS
 //#define BUILD_CON_TCP
 #define BUILD_VRAM
 #define BUILD_LINENOISE
@@ -36,9 +39,13 @@
 #define BUILD_ENC28J60
 #define BUILD_NRF
 #define BUILD_HELP
+#define BUILD_AIO
+#define BUILD_DISKCACHE
+#define BUILD_NANDFTL
 
 #define MMCFS_SDIO_STM32
 #define RFS_TRANSPORT_UDP
+//#define RFS_TRANSPORT_TCP
 
 // *****************************************************************************
 // UART/Timer IDs configuration data (used in main.c)
@@ -70,6 +77,12 @@
 #define RPCLINE
 #endif
 
+#ifdef BUILD_AIO
+#define AIOLINE _ROM( AUXLIB_AIO, luaopen_aio, aio_map )
+#else
+#define AIOLINE
+#endif
+
 #ifdef PS_LIB_TABLE_NAME
 #define PLATLINE _ROM( PS_LIB_TABLE_NAME, luaopen_platform, platform_map )
 #else
@@ -95,6 +108,7 @@
   _ROM( LUA_MATHLIBNAME, luaopen_math, math_map )\
   _ROM( AUXLIB_NET, luaopen_net, net_map)\
   _ROM( AUXLIB_NRF, luaopen_nrf, nrf_map)\
+  AIOLINE\
   PLATLINE
 
 // *****************************************************************************
@@ -216,12 +230,22 @@ u32 platform_s_cpu_get_frequency();
 // Use #define PIO_PINS_PER_PORT 0 if this isn't needed
 #define PIO_PINS_PER_PORT     16
 
+// Timer used by the shell commands that measure time ('cp', 'fsbench')
+#define SHELL_TIMER_ID        3
+
 // Remote file system data
 #define RFS_BUFFER_SIZE       BUF_SIZE_512
 //#define RFS_UART_ID           0
 #define RFS_TIMER_ID          2
 #define RFS_TIMEOUT           400000
 //#define RFS_UART_SPEED        115200
+// RFS over TCP (RFS_TRANSPORT_TCP): address of the server and packet size (the
+// packet buffers live in the external SRAM, see below)
+#define RFS_TCP_SERVER_IP0    192
+#define RFS_TCP_SERVER_IP1    168
+#define RFS_TCP_SERVER_IP2    1
+#define RFS_TCP_SERVER_IP3    100
+#define RFS_TCP_BUFFER_SIZE   8192
 
 // Linenoise buffer sizes
 #define LINENOISE_HISTORY_SIZE_LUA    50
@@ -232,8 +256,42 @@ u32 platform_s_cpu_get_frequency();
 #define SRAM_SIZE             ( 64 * 1024 )
 #define EXTSRAM_START         0x68000000
 #define EXTSRAM_SIZE          ( 512 * 2 * 1024 )
+// The RAM filesystem lives at the end of the external SRAM, outside the heap
+#define RAMFS_SIZE            ( 128 * 1024 )
+#define RAMFS_START_ADDRESS   ( EXTSRAM_START + EXTSRAM_SIZE - RAMFS_SIZE )
+// The FatFs sector cache lives right below the RAM filesystem
+#define DISKCACHE_META_SECTORS  16
+#define DISKCACHE_DATA_SECTORS  16
+#define DISKCACHE_FLUSH_SECTORS 8
+#define DISKCACHE_SIZE        ( ( DISKCACHE_META_SECTORS + DISKCACHE_DATA_SECTORS + DISKCACHE_FLUSH_SECTORS ) * 512 )
+#define DISKCACHE_START_ADDRESS ( RAMFS_START_ADDRESS - DISKCACHE_SIZE )
+// The NAND FTL map lives right below the sector cache. It covers the whole
+// chip (4096 blocks) with a map entry for every 2 pages, so the map needs
+// 264K (a map entry for every page would need 504K).
+#define NANDFTL_BLOCKS        4096
+#define NANDFTL_PAGES_PER_UNIT 2
+#define NANDFTL_MEM_SIZE      ( 264 * 1024 )
+#define NANDFTL_START_ADDRESS ( DISKCACHE_START_ADDRESS - NANDFTL_MEM_SIZE )
+// The block layer write queue and read ahead buffer live below the FTL map
+#define BLKDEV_QUEUE_SECTORS  16
+#define BLKDEV_READAHEAD_SECTORS 16
+#define BLKDEV_SIZE           ( ( BLKDEV_QUEUE_SECTORS + BLKDEV_READAHEAD_SECTORS ) * 512 )
+#define BLKDEV_START_ADDRESS  ( NANDFTL_START_ADDRESS - BLKDEV_SIZE )
+// The RFS block cache lives below the block layer buffers
+#define RFS_CACHE_SIZE        ( 64 * 1024 )
+#define RFS_CACHE_START_ADDRESS ( BLKDEV_START_ADDRESS - RFS_CACHE_SIZE )
+// The RFS TCP packet and compression buffers live below the RFS block cache
+#ifdef RFS_TRANSPORT_TCP
+#define RFS_TCP_BUFFER_START_ADDRESS ( RFS_CACHE_START_ADDRESS - 2 * RFS_TCP_BUFFER_SIZE )
+#define EXTSRAM_HEAP_END      RFS_TCP_BUFFER_START_ADDRESS
+#else
+#define EXTSRAM_HEAP_END      RFS_CACHE_START_ADDRESS
+#endif
+// Descriptor configuration (keep the number of open FatFs files limited)
+#define DM_MAX_FDS            32
+#define DM_FD_LIMITS          { "/mmc", 6 }, { "/nand", 6 }
 #define MEM_START_ADDRESS     { ( void* )end, ( void* )EXTSRAM_START }
-#define MEM_END_ADDRESS       { ( void* )( SRAM_BASE + SRAM_SIZE - STACK_SIZE_TOTAL - 1 ), ( void* )( EXTSRAM_START + EXTSRAM_SIZE - 1 ) }
+#define MEM_END_ADDRESS       { ( void* )( SRAM_BASE + SRAM_SIZE - STACK_SIZE_TOTAL - 1 ), ( void* )( EXTSRAM_HEAP_END - 1 ) }
 //#define MEM_START_ADDRESS     { ( void* )end }
 //#define MEM_END_ADDRESS       { ( void* )( SRAM_BASE + SRAM_SIZE - STACK_SIZE_TOTAL - 1 ) }
 
@@ -245,13 +303,15 @@ u32 platform_s_cpu_get_frequency();
 #define INT_GPIO_NEGEDGE      ( ELUA_INT_FIRST_ID + 1 )
 #define INT_TMR_MATCH         ( ELUA_INT_FIRST_ID + 2 )
 #define INT_UART_RX           ( ELUA_INT_FIRST_ID + 3 )
-#define INT_ELUA_LAST         INT_UART_RX
+#define INT_AIO_DONE          ( ELUA_INT_FIRST_ID + 4 )
+#define INT_ELUA_LAST         INT_AIO_DONE
 
 #define PLATFORM_CPU_CONSTANTS\
   _C( INT_GPIO_POSEDGE ),     \
   _C( INT_GPIO_NEGEDGE ),     \
   _C( INT_TMR_MATCH ),        \
-  _C( INT_UART_RX )
+  _C( INT_UART_RX ),          \
+  _C( INT_AIO_DONE )
 
 #endif // #ifndef __PLATFORM_CONF_H__
 
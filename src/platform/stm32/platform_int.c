@@ -353,5 +353,6 @@ const elua_int_descriptor elua_int_table[ INT_ELUA_LAST ] =
   { int_gpio_posedge_set_status, int_gpio_posedge_get_status, int_gpio_posedge_get_flag },
   { int_gpio_negedge_set_status, int_gpio_negedge_get_status, int_gpio_negedge_get_flag },
   { int_tmr_match_set_status, int_tmr_match_get_status, int_tmr_match_get_flag },
-  { int_uart_rx_set_status, int_uart_rx_get_status, int_uart_rx_get_flag }  
+  { int_uart_rx_set_status, int_uart_rx_get_status, int_uart_rx_get_flag },
+  { NULL, NULL, NULL }                // INT_AIO_DONE (software interrupt)
 };
@@ -0,0 +1,494 @@
+// RAM filesystem implementation
+#include "ramfs.h"
+#include "type.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "devman.h"
+#include <stdio.h>
+#include "ioctl.h"
+
+#include "platform_conf.h"
+#ifdef BUILD_RAMFS
+
+#ifndef RAMFS_SIZE
+#error "BUILD_RAMFS needs RAMFS_SIZE defined in platform_conf.h"
+#endif
+
+// Default configuration (can be overriden in platform_conf.h)
+#ifndef RAMFS_BLOCK_SIZE
+#define RAMFS_BLOCK_SIZE      256
+#endif
+
+#ifndef RAMFS_MAX_FILES
+#define RAMFS_MAX_FILES       32
+#endif
+
+#ifndef RAMFS_MAX_FDS
+#define RAMFS_MAX_FDS         16
+#endif
+
+#define RAMFS_NUM_BLOCKS      ( RAMFS_SIZE / RAMFS_BLOCK_SIZE )
+#define RAMFS_NBLOCKS( size ) ( ( ( size ) + RAMFS_BLOCK_SIZE - 1 ) / RAMFS_BLOCK_SIZE )
+#define RAMFS_BLOCK_ADDR( b ) ( ramfs_area + ( u32 )( b ) * RAMFS_BLOCK_SIZE )
+
+#if RAMFS_NUM_BLOCKS > 0xFFFF
+#error "Too many RAMFS blocks, increase RAMFS_BLOCK_SIZE"
+#endif
+
+// Storage area: a fixed memory zone if RAMFS_START_ADDRESS is given,
+// a static array otherwise
+#ifdef RAMFS_START_ADDRESS
+#define ramfs_area            ( ( u8* )( RAMFS_START_ADDRESS ) )
+#else
+static u8 ramfs_area[ RAMFS_SIZE ];
+#endif
+
+// File entry (an empty name marks an unused entry)
+typedef struct
+{
+  char name[ DM_MAX_FNAME_LENGTH + 1 ];
+  u16 start;
+  u16 nblocks;
+  u32 size;
+  u8 nopen;
+  u8 pinned;
+} RAMFS_FILE;
+
+// File descriptor data
+typedef struct
+{
+  s8 fidx;
+  int flags;
+  u32 offset;
+} RAMFS_FD;
+
+static RAMFS_FILE ramfs_files[ RAMFS_MAX_FILES ];
+DM_POOL_DECLARE( ramfs_fd_pool, sizeof( RAMFS_FD ), RAMFS_MAX_FDS );
+#define ramfs_get_fd( fd )    ( ( RAMFS_FD* )dm_pool_get( &ramfs_fd_pool, fd ) )
+
+// *****************************************************************************
+// Extent allocator
+
+// Returns 1 if the block range [start, start + n) doesn't overlap any file
+// other than 'except'
+static int ramfsh_is_free( unsigned start, unsigned n, int except )
+{
+  unsigned i;
+  const RAMFS_FILE *pf;
+
+  if( start + n > RAMFS_NUM_BLOCKS )
+    return 0;
+  for( i = 0, pf = ramfs_files; i < RAMFS_MAX_FILES; i ++, pf ++ )
+  {
+    if( i == except || pf->name[ 0 ] == '\0' || pf->nblocks == 0 )
+      continue;
+    if( start < pf->start + pf->nblocks && pf->start < start + n )
+      return 0;
+  }
+  return 1;
+}
+
+// Find the lowest free run of 'n' blocks, ignoring file 'except'
+// Returns the first block of the run or -1 if not found
+static int ramfsh_find_extent( unsigned n, int except )
+{
+  unsigned i, pos;
+  const RAMFS_FILE *pf;
+  int res = -1;
+
+  // Candidate positions: the start of the area and the end of each file
+  if( ramfsh_is_free( 0, n, except ) )
+    return 0;
+  for( i = 0, pf = ramfs_files; i < RAMFS_MAX_FILES; i ++, pf ++ )
+  {
+    if( i == except || pf->name[ 0 ] == '\0' || pf->nblocks == 0 )
+      continue;
+    pos = pf->start + pf->nblocks;
+    if( ( res == -1 || pos < res ) && ramfsh_is_free( pos, n, except ) )
+      res = pos;
+  }
+  return res;
+}
+
+// Move the files towards the start of the area to merge the free space
+// Pinned files (files that might be executed in place) are never moved
+static void ramfsh_compact()
+{
+  unsigned i;
+  int newstart, moved = 1;
+  RAMFS_FILE *pf;
+
+  while( moved )
+    for( i = 0, moved = 0, pf = ramfs_files; i < RAMFS_MAX_FILES; i ++, pf ++ )
+    {
+      if( pf->name[ 0 ] == '\0' || pf->nblocks == 0 || pf->pinned )
+        continue;
+      if( ( newstart = ramfsh_find_extent( pf->nblocks, i ) ) != -1 && newstart < pf->start )
+      {
+        memmove( RAMFS_BLOCK_ADDR( newstart ), RAMFS_BLOCK_ADDR( pf->start ), pf->size );
+        pf->start = newstart;
+        moved = 1;
+      }
+    }
+}
+
+// Reverse the order of 'len' bytes at 'p'
+static void ramfsh_reverse( u8 *p, u32 len )
+{
+  u8 *q = p + len - 1, temp;
+
+  while( p < q )
+  {
+    temp = *p;
+    *p ++ = *q;
+    *q -- = temp;
+  }
+}
+
+// Move file 'fidx' after the files that follow it (up to the next pinned file)
+// After ramfsh_compact this puts the file right before the free space, so it
+// can grow in place. The files are rotated in place, no extra memory is needed.
+static void ramfsh_move_last( int fidx )
+{
+  RAMFS_FILE *pf = ramfs_files + fidx;
+  const RAMFS_FILE *pcrt;
+  unsigned i, limit = RAMFS_NUM_BLOCKS, regend = pf->start + pf->nblocks;
+  u32 total, mine;
+
+  for( i = 0, pcrt = ramfs_files; i < RAMFS_MAX_FILES; i ++, pcrt ++ )
+    if( pcrt->name[ 0 ] && pcrt->nblocks > 0 && pcrt->pinned && pcrt->start > pf->start && pcrt->start < limit )
+      limit = pcrt->start;
+  for( i = 0, pcrt = ramfs_files; i < RAMFS_MAX_FILES; i ++, pcrt ++ )
+    if( pcrt->name[ 0 ] && pcrt->nblocks > 0 && pcrt->start > pf->start && pcrt->start < limit && pcrt->start + pcrt->nblocks > regend )
+      regend = pcrt->start + pcrt->nblocks;
+  if( regend == pf->start + pf->nblocks )
+    return;
+  total = ( u32 )( regend - pf->start ) * RAMFS_BLOCK_SIZE;
+  mine = ( u32 )pf->nblocks * RAMFS_BLOCK_SIZE;
+  ramfsh_reverse( RAMFS_BLOCK_ADDR( pf->start ), mine );
+  ramfsh_reverse( RAMFS_BLOCK_ADDR( pf->start ) + mine, total - mine );
+  ramfsh_reverse( RAMFS_BLOCK_ADDR( pf->start ), total );
+  for( i = 0; i < RAMFS_MAX_FILES; i ++ )
+    if( ramfs_files[ i ].name[ 0 ] && ramfs_files[ i ].nblocks > 0 && ramfs_files[ i ].start > pf->start && ramfs_files[ i ].start < limit )
+      ramfs_files[ i ].start -= pf->nblocks;
+  pf->start = regend - pf->nblocks;
+}
+
+// Make sure that file 'fidx' can hold at least 'size' bytes
+// Returns 1 for OK, 0 if there's not enough space
+static int ramfsh_ensure_size( int fidx, u32 size )
+{
+  RAMFS_FILE *pf = ramfs_files + fidx;
+  unsigned need = RAMFS_NBLOCKS( size );
+  int newstart;
+
+  if( need <= pf->nblocks )
+    return 1;
+  if( need > RAMFS_NUM_BLOCKS )
+    return 0;
+  // Can we grow in place?
+  if( pf->nblocks > 0 && ramfsh_is_free( pf->start + pf->nblocks, need - pf->nblocks, fidx ) )
+  {
+    pf->nblocks = need;
+    return 1;
+  }
+  // Look for a new extent, compact the area if needed
+  if( ( newstart = ramfsh_find_extent( need, fidx ) ) == -1 )
+  {
+    ramfsh_compact();
+    if( pf->nblocks > 0 )
+    {
+      ramfsh_move_last( fidx );
+      if( ramfsh_is_free( pf->start + pf->nblocks, need - pf->nblocks, fidx ) )
+      {
+        pf->nblocks = need;
+        pf->pinned = 0;
+        return 1;
+      }
+    }
+    if( ( newstart = ramfsh_find_extent( need, fidx ) ) == -1 )
+      return 0;
+  }
+  if( pf->size > 0 && newstart != pf->start )
+    memmove( RAMFS_BLOCK_ADDR( newstart ), RAMFS_BLOCK_ADDR( pf->start ), pf->size );
+  pf->start = newstart;
+  pf->nblocks = need;
+  pf->pinned = 0;
+  return 1;
+}
+
+// *****************************************************************************
+// File and descriptor helpers
+
+static int ramfsh_find_file( const char *name )
+{
+  unsigned i;
+
+  for( i = 0; i < RAMFS_MAX_FILES; i ++ )
+    if( ramfs_files[ i ].name[ 0 ] && !strncasecmp( ramfs_files[ i ].name, name, DM_MAX_FNAME_LENGTH ) )
+      return i;
+  return -1;
+}
+
+static int ramfsh_find_empty_file()
+{
+  unsigned i;
+
+  for( i = 0; i < RAMFS_MAX_FILES; i ++ )
+    if( ramfs_files[ i ].name[ 0 ] == '\0' )
+      return i;
+  return -1;
+}
+
+// *****************************************************************************
+// Device functions
+
+static int ramfs_open_r( struct _reent *r, const char *path, int flags, int mode )
+{
+  int fd, fidx, create = 0;
+  RAMFS_FILE *pf;
+  RAMFS_FD *pfd;
+
+  // Scrub binary flag, if defined
+#ifdef O_BINARY
+  flags &= ~O_BINARY;
+#endif
+  // Only a flat namespace is supported
+  if( *path == '\0' || strchr( path, '/' ) || strlen( path ) > DM_MAX_FNAME_LENGTH )
+  {
+    r->_errno = ENOENT;
+    return -1;
+  }
+  if( ( fidx = ramfsh_find_file( path ) ) == -1 )
+  {
+    if( ( flags & O_CREAT ) == 0 )
+    {
+      r->_errno = ENOENT;
+      return -1;
+    }
+    if( ( fidx = ramfsh_find_empty_file() ) == -1 )
+    {
+      r->_errno = ENOSPC;
+      return -1;
+    }
+    create = 1;
+  }
+  else if( ( flags & ( O_CREAT | O_EXCL ) ) == ( O_CREAT | O_EXCL ) )
+  {
+    r->_errno = EEXIST;
+    return -1;
+  }
+  if( ( fd = dm_pool_alloc( &ramfs_fd_pool ) ) == -1 )
+  {
+    r->_errno = ENFILE;
+    return -1;
+  }
+  pf = ramfs_files + fidx;
+  if( create )
+  {
+    memset( pf, 0, sizeof( RAMFS_FILE ) );
+    strcpy( pf->name, path );
+  }
+  else if( ( flags & O_TRUNC ) && ( flags & O_ACCMODE ) != O_RDONLY )
+    pf->size = pf->nblocks = pf->pinned = 0;
+  pf->nopen ++;
+  pfd = ramfs_get_fd( fd );
+  pfd->fidx = fidx;
+  pfd->flags = flags;
+  pfd->offset = 0;
+  return fd;
+}
+
+static int ramfs_close_r( struct _reent *r, int fd )
+{
+  RAMFS_FD *pfd = ramfs_get_fd( fd );
+
+  ramfs_files[ pfd->fidx ].nopen --;
+  dm_pool_free( &ramfs_fd_pool, fd );
+  return 0;
+}
+
+static _ssize_t ramfs_write_r( struct _reent *r, int fd, const void* ptr, size_t len )
+{
+  RAMFS_FD *pfd = ramfs_get_fd( fd );
+  RAMFS_FILE *pf = ramfs_files + pfd->fidx;
+
+  if( ( pfd->flags & O_ACCMODE ) == O_RDONLY )
+  {
+    r->_errno = EBADF;
+    return -1;
+  }
+  if( pfd->flags & O_APPEND )
+    pfd->offset = pf->size;
+  if( !ramfsh_ensure_size( pfd->fidx, pfd->offset + len ) )
+  {
+    r->_errno = ENOSPC;
+    return -1;
+  }
+  memcpy( RAMFS_BLOCK_ADDR( pf->start ) + pfd->offset, ptr, len );
+  pfd->offset += len;
+  if( pfd->offset > pf->size )
+    pf->size = pfd->offset;
+  return len;
+}
+
+static _ssize_t ramfs_read_r( struct _reent *r, int fd, void* ptr, size_t len )
+{
+  RAMFS_FD *pfd = ramfs_get_fd( fd );
+  RAMFS_FILE *pf = ramfs_files + pfd->fidx;
+  u32 actlen;
+
+  if( ( pfd->flags & O_ACCMODE ) == O_WRONLY )
+  {
+    r->_errno = EBADF;
+    return -1;
+  }
+  if( pfd->offset >= pf->size )
+    return 0;
+  actlen = pf->size - pfd->offset;
+  if( len < actlen )
+    actlen = len;
+  memcpy( ptr, RAMFS_BLOCK_ADDR( pf->start ) + pfd->offset, actlen );
+  pfd->offset += actlen;
+  return actlen;
+}
+
+// lseek
+static off_t ramfs_lseek_r( struct _reent *r, int fd, off_t off, int whence )
+{
+  RAMFS_FD *pfd = ramfs_get_fd( fd );
+  RAMFS_FILE *pf = ramfs_files + pfd->fidx;
+  u32 newpos = 0;
+
+  switch( whence )
+  {
+    case SEEK_SET:
+      newpos = off;
+      break;
+
+    case SEEK_CUR:
+      newpos = pfd->offset + off;
+      break;
+
+    case SEEK_END:
+      newpos = pf->size + off;
+      break;
+
+    default:
+      return -1;
+  }
+  if( newpos > pf->size )
+    return -1;
+  pfd->offset = newpos;
+  return newpos;
+}
+
+// Directory operations
+static u32 ramfs_dir_data = 0;
+
+// opendir
+static void* ramfs_opendir_r( struct _reent *r, const char* dname )
+{
+  if( !dname || strlen( dname ) == 0 || ( strlen( dname ) == 1 && !strcmp( dname, "/" ) ) )
+  {
+    ramfs_dir_data = 0;
+    return &ramfs_dir_data;
+  }
+  return NULL;
+}
+
+// readdir
+extern struct dm_dirent dm_shared_dirent;
+extern char dm_shared_fname[ DM_MAX_FNAME_LENGTH + 1 ];
+static struct dm_dirent* ramfs_readdir_r( struct _reent *r, void *d )
+{
+  u32 *pidx = ( u32* )d;
+  struct dm_dirent *pent = &dm_shared_dirent;
+  RAMFS_FILE *pf;
+
+  while( *pidx < RAMFS_MAX_FILES && ramfs_files[ *pidx ].name[ 0 ] == '\0' )
+    ( *pidx ) ++;
+  if( *pidx == RAMFS_MAX_FILES )
+    return NULL;
+  pf = ramfs_files + ( *pidx ) ++;
+  strcpy( dm_shared_fname, pf->name );
+  pent->fname = dm_shared_fname;
+  pent->fsize = pf->size;
+  pent->ftime = 0;
+  return pent;
+}
+
+// closedir
+static int ramfs_closedir_r( struct _reent *r, void *d )
+{
+  *( u32* )d = 0;
+  return 0;
+}
+
+// getaddr
+static const char* ramfs_getaddr_r( struct _reent *r, int fd )
+{
+  RAMFS_FILE *pf = ramfs_files + ramfs_get_fd( fd )->fidx;
+
+  // The caller might keep this address (Lua bytecode executed in place),
+  // so don't move this file anymore when compacting the area
+  pf->pinned = 1;
+  return ( const char* )RAMFS_BLOCK_ADDR( pf->start );
+}
+
+// unlink
+static int ramfs_unlink_r( struct _reent *r, const char *fname )
+{
+  int fidx;
+
+  if( ( fidx = ramfsh_find_file( fname ) ) == -1 )
+  {
+    r->_errno = ENOENT;
+    return -1;
+  }
+  if( ramfs_files[ fidx ].nopen > 0 )
+  {
+    r->_errno = EBUSY;
+    return -1;
+  }
+  memset( ramfs_files + fidx, 0, sizeof( RAMFS_FILE ) );
+  return 0;
+}
+
+// Our RAMFS device descriptor structure
+static const DM_DEVICE ramfs_device =
+{
+  "/ram",
+  ramfs_open_r,         // open
+  ramfs_close_r,        // close
+  ramfs_write_r,        // write
+  ramfs_read_r,         // read
+  ramfs_lseek_r,        // lseek
+  ramfs_opendir_r,      // opendir
+  ramfs_readdir_r,      // readdir
+  ramfs_closedir_r,     // closedir
+  ramfs_getaddr_r,      // getaddr
+  ramfs_unlink_r,       // unlink
+  NULL,                 // ioctl
+  NULL,                 // batch
+  NULL,                 // rename
+  NULL,                 // mkdir
+  NULL                  // stat
+};
+
+const DM_DEVICE* ramfs_init()
+{
+  memset( ramfs_files, 0, sizeof( ramfs_files ) );
+  return &ramfs_device;
+}
+
+#else // #ifdef BUILD_RAMFS
+
+const DM_DEVICE* ramfs_init()
+{
+  return NULL;
+}
+
+#endif // #ifdef BUILD_RAMFS
+
@@ -5,6 +5,7 @@
 #include "client.h"
 #include "os_io.h"
 #include "eluarpc.h"
+#include "lz.h"
 
 #include <stdio.h>
 #include "platform_conf.h"
@@ -27,23 +28,49 @@ static u8 *rfsc_buffer;
 static p_rfsc_send rfsc_send;
 static p_rfsc_recv rfsc_recv;
 static u32 rfsc_timeout;
+static u8 rfsc_max_window = 1;
+static u8 rfsc_window;              // 0 if the protocol wasn't negotiated yet
+static u8 rfsc_version;
+static u8 rfsc_seq;
+static u8 rfsc_pending;             // responses that nobody waits for
+static u32 rfsc_caps;               // optional operations of the server (v3)
+static u32 rfsc_max_packet = 1 << RFS_BUFFER_SIZE; // size of rfsc_buffer
+static u32 rfsc_packet = 1 << RFS_BUFFER_SIZE;     // largest packet of the session
+static int rfsc_encoding = ELUARPC_ENC_V2; // used if the server accepts compact packets
+
+// Directory listings read with readdir_batch (only for one directory at a time)
+static u8 *rfsc_dir_buffer;
+static u32 rfsc_dir_buffer_size;
+static u32 rfsc_dir_d;              // owner of the buffer (0 for none)
+static u32 rfsc_dir_pos, rfsc_dir_len;
+static u8 rfsc_dir_last;
+
+// Compression of the read/write data (readz/writez, only with servers that
+// have RFS_CAP_COMPRESS)
+static u8 *rfsc_zbuffer;            // NULL if compression is disabled
+static u32 rfsc_zbuffer_size;
+static u16 *rfsc_zhash;
+static u32 rfsc_zraw, rfsc_zwire;   // data bytes before and after compression
+
+// Traffic statistics (requests sent, bytes sent and received)
+static u32 rfsc_nrequests, rfsc_nsent, rfsc_nreceived;
+
+// Maximum number of unexpected packets skipped while waiting for a response
+#define RFSC_MAX_SKIPPED_PACKETS  16
+
+// Largest block of data read or written with a single request
+#define RFSC_MAX_DATA             ( rfsc_packet - ELUARPC_WRITE_REQUEST_EXTRA )
+
+// Size of a readdir_batch response without the entries
+#define RFSC_BATCH_RESPONSE_EXTRA ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_SEQ_SIZE + ELUARPC_RESPONSE_SIZE + 2 * ELUARPC_U32_SIZE + ELUARPC_PTR_HEADER_SIZE + ELUARPC_END_SIZE )
 
 // ****************************************************************************
 // Client helpers
 
-#ifndef RFS_TRANSPORT_UDP
-
-static int rfsch_send_request_read_response()
+static int rfsch_send_request()
 {
   u16 temp16;
-  u32 readbytes;
 
-#ifndef ELUA_CPU_LINUX
-  // Empty receive buffer
-  while( rfsc_recv( rfsc_buffer, 1, 0 ) == 1 );
-#endif
-
-  // Send request
   if( eluarpc_get_packet_size( rfsc_buffer, &temp16 ) == ELUARPC_ERR )
   {
     RFSDEBUG( "[RFS] get packet size error\n" );
@@ -52,17 +79,29 @@ static int rfsch_send_request_read_response()
   if( rfsc_send( rfsc_buffer, temp16 ) != temp16 )
   {
     RFSDEBUG( "[RFS] rfsc_send error\n" );
+    // The connection to the server might be new, negotiate the protocol again
+    rfsc_window = 0;
     return CLIENT_ERR;
   }
-  
-  // Get response
+  rfsc_nrequests ++;
+  rfsc_nsent += temp16;
+  return CLIENT_OK;
+}
+
+#ifndef RFS_TRANSPORT_UDP
+
+static int rfsch_read_packet()
+{
+  u16 temp16;
+  u32 readbytes;
+
   // First the length, then the rest of the data
   if( ( readbytes = rfsc_recv( rfsc_buffer, ELUARPC_START_OFFSET, rfsc_timeout ) ) != ELUARPC_START_OFFSET )
   {
-    RFSDEBUG( "[RFS] rfsc_recv (1) error: expected %u, got %u\n", ( unsigned )( temp16 - ELUARPC_START_OFFSET ), ( unsigned )readbytes );
+    RFSDEBUG( "[RFS] rfsc_recv (1) error: expected %u, got %u\n", ( unsigned )ELUARPC_START_OFFSET, ( unsigned )readbytes );
     return CLIENT_ERR;
   }
-  if( eluarpc_get_packet_size( rfsc_buffer, &temp16 ) == ELUARPC_ERR )
+  if( eluarpc_get_packet_size( rfsc_buffer, &temp16 ) == ELUARPC_ERR || temp16 > rfsc_max_packet )
   {
     RFSDEBUG( "[RFS] eluarpc_get_packet_size() error\n" );
     return CLIENT_ERR;
@@ -72,44 +111,266 @@ static int rfsch_send_request_read_response()
     RFSDEBUG( "[RFS] rfsc_recv (2) error: expected %u, got %u\n", ( unsigned )( temp16 - ELUARPC_START_OFFSET ), ( unsigned )readbytes );
     return CLIENT_ERR;
   }
+  rfsc_nreceived += temp16;
   return CLIENT_OK;
 }
 
 #else
 
-static int rfsch_send_request_read_response()
+static int rfsch_read_packet()
 {
   u16 temp16;
   u32 readbytes;
 
-  // Send request
-  if( eluarpc_get_packet_size( rfsc_buffer, &temp16 ) == ELUARPC_ERR )
+  // A datagram is always a complete packet
+  if( ( readbytes = rfsc_recv( rfsc_buffer, rfsc_max_packet, rfsc_timeout ) ) < ELUARPC_START_OFFSET )
   {
-    RFSDEBUG( "[RFS] get packet size error\n" );
+    RFSDEBUG( "[RFS] rfsc_recv error: got %u bytes\n", ( unsigned )readbytes );
     return CLIENT_ERR;
   }
-  if( rfsc_send( rfsc_buffer, temp16 ) != temp16 )
+  if( eluarpc_get_packet_size( rfsc_buffer, &temp16 ) == ELUARPC_ERR )
   {
-    RFSDEBUG( "[RFS] rfsc_send error\n" );
+    RFSDEBUG( "[RFS] eluarpc_get_packet_size() error\n" );
     return CLIENT_ERR;
   }
-  
-  // Get response
-  if( ( readbytes = rfsc_recv( rfsc_buffer, 1 << RFS_BUFFER_SIZE, rfsc_timeout ) ) < ELUARPC_START_OFFSET )
+  rfsc_nreceived += readbytes;
+  return CLIENT_OK;
+}
+
+#endif
+
+// Helper: read the response with the given sequence number (or the next
+// response if 'seq' is ELUARPC_NO_SEQ). Responses to older requests that
+// timed out are skipped.
+static int rfsch_read_response( int seq )
+{
+  unsigned skipped;
+  u8 temp;
+
+  for( skipped = 0; skipped < RFSC_MAX_SKIPPED_PACKETS; skipped ++ )
   {
-    RFSDEBUG( "[RFS] rfsc_recv (1) error: expected %u, got %u\n", ( unsigned )( temp16 - ELUARPC_START_OFFSET ), ( unsigned )readbytes );
-    return CLIENT_ERR;
+    if( rfsch_read_packet() == CLIENT_ERR )
+      break;
+    if( seq == ELUARPC_NO_SEQ || eluarpc_get_seq( rfsc_buffer ) == seq )
+    {
+      // A server that doesn't know the request sends it back unchanged
+      if( eluarpc_get_request_id( rfsc_buffer, &temp ) == ELUARPC_OK )
+      {
+        RFSDEBUG( "[RFS] request %d not supported by the server\n", temp );
+        break;
+      }
+      return CLIENT_OK;
+    }
+    RFSDEBUG( "[RFS] skipping response %d (expected %d)\n", eluarpc_get_seq( rfsc_buffer ), seq );
   }
-  if( eluarpc_get_packet_size( rfsc_buffer, &temp16 ) == ELUARPC_ERR )
+  // The server might have been restarted, negotiate the protocol again
+  rfsc_window = 0;
+  return CLIENT_ERR;
+}
+
+// Helper: set the sequence number of the next request and return it
+static int rfsch_next_seq()
+{
+  if( rfsc_version < 2 )
   {
-    RFSDEBUG( "[RFS] eluarpc_get_packet_size() error\n" );
+    eluarpc_set_seq( ELUARPC_NO_SEQ );
+    return ELUARPC_NO_SEQ;
+  }
+  eluarpc_set_seq( rfsc_seq );
+  return rfsc_seq ++;
+}
+
+// Helper: negotiate the protocol version and the window with the server
+// v1 servers send the request back, so the client falls back to v1
+static void rfsch_negotiate()
+{
+  u32 version, window, caps = 0, size;
+  int seq;
+
+  // The hello request is always sent with the v1 encoding (old servers send
+  // it back)
+  eluarpc_set_seq( ELUARPC_NO_SEQ );
+  eluarpc_set_encoding( ELUARPC_ENC_V1 );
+  remotefs_hello_write_request( rfsc_buffer, RFS_PROTOCOL_VERSION, rfsc_max_window );
+  if( rfsch_send_request() == CLIENT_ERR || rfsch_read_packet() == CLIENT_ERR )
+    return; // no answer, try again with the next request
+  // v3 servers also send their capabilities
+  if( remotefs_hello_read_response_v3( rfsc_buffer, &version, &window, &caps ) == ELUARPC_ERR )
+  {
+    caps = 0;
+    if( remotefs_hello_read_response( rfsc_buffer, &version, &window ) == ELUARPC_ERR )
+      version = window = 0;
+  }
+  if( version < 2 || window == 0 )
+  {
+    rfsc_version = 1;
+    rfsc_window = 1;
+    rfsc_caps = 0;
+  }
+  else
+  {
+    rfsc_version = version < RFS_PROTOCOL_VERSION ? version : RFS_PROTOCOL_VERSION;
+    rfsc_window = window < rfsc_max_window ? window : rfsc_max_window;
+    rfsc_caps = rfsc_version >= 3 ? caps : 0;
+  }
+  eluarpc_set_encoding( rfsc_caps & RFS_CAP_COMPACT_RPC ? rfsc_encoding : ELUARPC_ENC_V1 );
+  // Ask for larger packets if the buffer has room for them
+  rfsc_packet = rfsc_max_packet < RFS_DEFAULT_PACKET_SIZE ? rfsc_max_packet : RFS_DEFAULT_PACKET_SIZE;
+  if( rfsc_max_packet > rfsc_packet && ( rfsc_caps & RFS_CAP_BUFSIZE ) )
+  {
+    seq = rfsch_next_seq();
+    remotefs_bufsize_write_request( rfsc_buffer, rfsc_max_packet );
+    if( rfsch_send_request() == CLIENT_ERR || rfsch_read_response( seq ) == CLIENT_ERR || remotefs_bufsize_read_response( rfsc_buffer, &size ) == ELUARPC_ERR )
+      return; // keep the default size
+    if( size > rfsc_packet )
+      rfsc_packet = size < rfsc_max_packet ? size : rfsc_max_packet;
+  }
+  RFSDEBUG( "[RFS] protocol v%d, window %d, caps %02X, packet %u\n", rfsc_version, rfsc_window, ( unsigned )rfsc_caps, ( unsigned )rfsc_packet );
+}
+
+// Helper: start a new operation (drops old data, negotiates the protocol
+// if needed)
+static void rfsch_begin()
+{
+#if !defined( ELUA_CPU_LINUX ) && !defined( RFS_TRANSPORT_UDP ) && !defined( RFS_TRANSPORT_TCP )
+  // Wait for the responses that weren't read (they could be only partially
+  // received now), then empty the receive buffer
+  for( ; rfsc_pending; rfsc_pending -- )
+    if( rfsch_read_packet() == CLIENT_ERR )
+      break;
+  rfsc_pending = 0;
+  while( rfsc_recv( rfsc_buffer, 1, 0 ) == 1 );
+#else
+  // The responses that weren't read are skipped by rfsch_read_response
+  rfsc_pending = 0;
+#endif
+  if( rfsc_window == 0 )
+    rfsch_negotiate();
+}
+
+// Helper: start an operation with a single request
+static int rfsch_start_request()
+{
+  rfsch_begin();
+  return rfsch_next_seq();
+}
+
+// Helper: send the request built in rfsc_buffer and read its response
+static int rfsch_send_request_read_response( int seq )
+{
+  if( rfsch_send_request() == CLIENT_ERR )
+    return CLIENT_ERR;
+  return rfsch_read_response( seq );
+}
+
+// Helper: start an operation that needs the given capability of the server
+// Returns CLIENT_ERR if the server doesn't have it (nothing is sent).
+static int rfsch_start_request_cap( u32 cap, int *pseq )
+{
+  rfsch_begin();
+  if( ( rfsc_caps & cap ) == 0 )
     return CLIENT_ERR;
+  *pseq = rfsch_next_seq();
+  return CLIENT_OK;
+}
+
+// Helper: read a little endian u32
+static u32 rfsch_get_u32( const u8 *p )
+{
+  return p[ 0 ] | ( ( u32 )p[ 1 ] << 8 ) | ( ( u32 )p[ 2 ] << 16 ) | ( ( u32 )p[ 3 ] << 24 );
+}
+
+// Helper: can a block of 'count' bytes be compressed?
+static int rfsch_use_z( u32 count )
+{
+  return rfsc_zbuffer && ( rfsc_caps & RFS_CAP_COMPRESS ) && count <= rfsc_zbuffer_size;
+}
+
+// Helper: build a write request for a block, compressed if this makes it
+// smaller
+static void rfsch_build_write_request( int fd, const void *buf, u32 count )
+{
+  u32 zlen;
+
+  if( !rfsch_use_z( count ) )
+  {
+    remotefs_write_write_request( rfsc_buffer, fd, buf, count );
+    return;
   }
- 
+  if( ( zlen = lz_compress( buf, count, rfsc_zbuffer, count - 1, rfsc_zhash ) ) != 0 )
+    remotefs_writez_write_request( rfsc_buffer, fd, count, rfsc_zbuffer, zlen );
+  else
+    remotefs_writez_write_request( rfsc_buffer, fd, count, buf, count );
+  rfsc_zraw += count;
+  rfsc_zwire += zlen ? zlen : count;
+}
+
+// Helper: get the result of a write or writez response
+static int rfsch_get_write_result( u32 *presult )
+{
+  if( remotefs_write_read_response( rfsc_buffer, presult ) == ELUARPC_OK )
+    return CLIENT_OK;
+  return remotefs_writez_read_response( rfsc_buffer, presult ) == ELUARPC_OK ? CLIENT_OK : CLIENT_ERR;
+}
+
+// Helper: build a read request for a block, compressed if 'z' is set
+static void rfsch_build_read_request( int fd, u32 count, int z )
+{
+  if( z )
+    remotefs_readz_write_request( rfsc_buffer, fd, count );
+  else
+    remotefs_read_write_request( rfsc_buffer, fd, count );
+}
+
+// Helper: get the data of a read response (readz if 'z' is set). Compressed
+// data is decompressed to 'dest' (at most 'maxsize' bytes), otherwise
+// '*ppdata' points to the data in the response.
+static int rfsch_get_read_data( int z, u8 *dest, u32 maxsize, const u8 **ppdata, u32 *psize )
+{
+  const u8 *pdata;
+  u32 size, datalen;
+
+  if( !z )
+    return remotefs_read_read_response( rfsc_buffer, ppdata, psize ) == ELUARPC_OK ? CLIENT_OK : CLIENT_ERR;
+  if( remotefs_readz_read_response( rfsc_buffer, &size, &pdata, &datalen ) == ELUARPC_ERR || datalen > size )
+    return CLIENT_ERR;
+  rfsc_zraw += size;
+  rfsc_zwire += datalen;
+  if( datalen < size )
+  {
+    if( lz_decompress( pdata, datalen, dest, maxsize ) != ( s32 )size )
+    {
+      RFSDEBUG( "[RFS] invalid compressed data\n" );
+      return CLIENT_ERR;
+    }
+    pdata = dest;
+  }
+  *ppdata = pdata;
+  *psize = size;
   return CLIENT_OK;
 }
 
-#endif
+// Helper: read the next entries of directory 'd' in the directory buffer
+static int rfsch_readdir_batch( u32 d )
+{
+  const u8 *pdata;
+  u32 count, last, size, maxsize = rfsc_dir_buffer_size;
+  int seq = rfsch_next_seq();
+
+  if( maxsize > rfsc_packet - RFSC_BATCH_RESPONSE_EXTRA )
+    maxsize = rfsc_packet - RFSC_BATCH_RESPONSE_EXTRA;
+  remotefs_readdir_batch_write_request( rfsc_buffer, d, maxsize );
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
+    return CLIENT_ERR;
+  if( remotefs_readdir_batch_read_response( rfsc_buffer, &count, &last, &pdata, &size ) == ELUARPC_ERR || size > rfsc_dir_buffer_size )
+    return CLIENT_ERR;
+  memcpy( rfsc_dir_buffer, pdata, size );
+  rfsc_dir_pos = 0;
+  rfsc_dir_len = size;
+  rfsc_dir_last = last != 0;
+  RFSDEBUG( "[RFS] readdir_batch: %u entries, %u bytes\n", ( unsigned )count, ( unsigned )size );
+  return CLIENT_OK;
+}
 
 // ****************************************************************************
 // Client public interface
@@ -120,6 +381,26 @@ void rfsc_setup( u8 *pbuf, p_rfsc_send rfsc_send_func, p_rfsc_recv rfsc_recv_fun
   rfsc_send = rfsc_send_func;
   rfsc_recv = rfsc_recv_func;
   rfsc_timeout = timeout;
+  rfsc_window = 0;
+  rfsc_pending = 0;
+}
+
+// Set the size of the buffer given to rfsc_setup (1 << RFS_BUFFER_SIZE by
+// default). Packets larger than RFS_DEFAULT_PACKET_SIZE are used only with
+// servers that accept them (the size is negotiated again).
+void rfsc_set_max_packet( u32 size )
+{
+  rfsc_max_packet = size;
+  rfsc_packet = size < RFS_DEFAULT_PACKET_SIZE ? size : RFS_DEFAULT_PACKET_SIZE;
+  rfsc_window = 0;
+}
+
+// Get the largest block of data that can be read or written with a single
+// request with the current server
+u32 rfsc_get_max_data()
+{
+  rfsch_begin();
+  return RFSC_MAX_DATA;
 }
 
 void rfsc_set_timeout( u32 timeout )
@@ -127,34 +408,109 @@ void rfsc_set_timeout( u32 timeout )
   rfsc_timeout = timeout;
 }
 
+void rfsc_set_max_window( unsigned window )
+{
+  rfsc_max_window = window == 0 ? 1 : window > 255 ? 255 : window;
+  rfsc_window = 0;
+}
+
+// Set the eluarpc encoding used with servers that accept compact packets
+// (ELUARPC_ENC_xxx, the protocol is negotiated again)
+void rfsc_set_encoding( int enc )
+{
+  rfsc_encoding = enc;
+  rfsc_window = 0;
+}
+
+// Set the buffers used to compress the read/write data with servers that
+// support it: a block buffer (blocks larger than 'size' aren't compressed)
+// and a hash table of LZ_HASH_SIZE entries. NULL disables compression. The
+// statistics are reset.
+void rfsc_set_compression( u8 *pbuf, u32 size, u16 *phash )
+{
+  rfsc_zbuffer = pbuf && phash ? pbuf : NULL;
+  rfsc_zbuffer_size = size;
+  rfsc_zhash = phash;
+  rfsc_zraw = rfsc_zwire = 0;
+}
+
+// Get the number of data bytes read/written with compression enabled, before
+// and after compression
+void rfsc_get_compression_stats( u32 *praw, u32 *pwire )
+{
+  *praw = rfsc_zraw;
+  *pwire = rfsc_zwire;
+}
+
+// Get the number of requests sent to the server and the number of bytes sent
+// and received since the last reset (every request is a round trip, but
+// pipelined requests share their round trips)
+void rfsc_get_stats( u32 *prequests, u32 *psent, u32 *preceived, int reset )
+{
+  *prequests = rfsc_nrequests;
+  *psent = rfsc_nsent;
+  *preceived = rfsc_nreceived;
+  if( reset )
+    rfsc_nrequests = rfsc_nsent = rfsc_nreceived = 0;
+}
+
+// Set the buffer used to read many directory entries with a single request
+// (protocol v3). Without it the entries are read one by one.
+void rfsc_set_dir_buffer( u8 *pbuf, u32 size )
+{
+  rfsc_dir_buffer = pbuf;
+  rfsc_dir_buffer_size = pbuf ? size : 0;
+  rfsc_dir_d = 0;
+}
+
 int rfsc_open( const char* pathname, int flags, int mode )
 {
-  int fd;
+  return rfsc_open_stat( pathname, flags, mode, NULL, NULL );
+}
+
+// Like rfsc_open, also returns the size and the modification time of the file
+// (both are 0 if the server doesn't send them)
+int rfsc_open_stat( const char* pathname, int flags, int mode, u32 *psize, u32 *pmtime )
+{
+  u32 size, mtime;
+  int fd, seq = rfsch_start_request();
 
   // Make the request
   remotefs_open_write_request( rfsc_buffer, pathname, os_open_sys_flags_to_rfs_flags( flags ), mode );
 
   // Send the request / get the respone
-  if( rfsch_send_request_read_response() == CLIENT_ERR )
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
     return -1;
 
-  // Interpret the response
-  if( remotefs_open_read_response( rfsc_buffer, &fd ) == ELUARPC_ERR )
-    return -1;
+  // Interpret the response (v2 servers send the size and mtime of the file)
+  if( remotefs_open_read_response_v2( rfsc_buffer, &fd, &size, &mtime ) == ELUARPC_ERR )
+  {
+    size = mtime = 0;
+    if( remotefs_open_read_response( rfsc_buffer, &fd ) == ELUARPC_ERR )
+      return -1;
+  }
+  if( psize )
+    *psize = size;
+  if( pmtime )
+    *pmtime = mtime;
   return fd;
 }
 
 s32 rfsc_write( int fd, const void *buf, u32 count )
 {
-  // Make the request
-  remotefs_write_write_request( rfsc_buffer, fd, buf, count );
+  int seq = rfsch_start_request();
+
+  // Make the request (short write if it doesn't fit in a packet)
+  if( count > RFSC_MAX_DATA )
+    count = RFSC_MAX_DATA;
+  rfsch_build_write_request( fd, buf, count );
 
   // Send the request / get the response
-  if( rfsch_send_request_read_response() == CLIENT_ERR )
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
     return -1;
   
   // Interpret the response
-  if( remotefs_write_read_response( rfsc_buffer, &count ) == ELUARPC_ERR )
+  if( rfsch_get_write_result( &count ) == CLIENT_ERR )
     return -1;
   return ( s32 )count;
 }
@@ -162,30 +518,195 @@ s32 rfsc_write( int fd, const void *buf, u32 count )
 s32 rfsc_read( int fd, void *buf, u32 count )
 {
   const u8 *resbuf;
+  int seq = rfsch_start_request();
+  int z;
 
-  // Make the request
-  remotefs_read_write_request( rfsc_buffer, fd, count );
+  // Make the request (short read if it doesn't fit in a packet)
+  if( count > RFSC_MAX_DATA )
+    count = RFSC_MAX_DATA;
+  z = rfsch_use_z( count );
+  rfsch_build_read_request( fd, count, z );
 
   // Send the request / get the response
-  if( rfsch_send_request_read_response() == CLIENT_ERR )
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
     return -1;
 
-  // Interpret the response
-  if( remotefs_read_read_response( rfsc_buffer, &resbuf, &count ) == ELUARPC_ERR )
+  // Interpret the response (compressed data goes directly to 'buf')
+  if( rfsch_get_read_data( z, buf, count, &resbuf, &count ) == CLIENT_ERR )
     return -1;
-  memcpy( buf, resbuf, count );
+  if( resbuf != buf )
+    memcpy( buf, resbuf, count );
   return ( s32 )count;
 }
 
+// Helper: get the position of the server before a stream that can have
+// many requests in flight (-1 if not needed or unknown)
+static s32 rfsch_stream_start( int fd, u32 count, u32 blksize, unsigned window )
+{
+  if( window < 2 || count <= blksize )
+    return -1;
+  return rfsc_lseek( fd, 0, SEEK_CUR );
+}
+
+// Helper: a stream stopped with requests still in flight, so the server
+// might have executed more of them than the client accounted for. Move the
+// server position to the end of the data that was actually transferred.
+static void rfsch_stream_resync( int fd, s32 start, u32 total )
+{
+  if( start != -1 )
+    rfsc_lseek( fd, start + ( s32 )total, SEEK_SET );
+}
+
+// Write 'count' bytes in 'blksize' pieces, keeping up to 'window' write
+// requests in flight. The server executes them in order, so they go to
+// consecutive positions in the file. Returns the number of bytes written
+// before the first short write or error (-1 if nothing was written); the
+// file position of the server is left right after them.
+s32 rfsc_write_stream( int fd, const void *buf, u32 count, u32 blksize )
+{
+  const u8 *p = ( const u8* )buf;
+  u32 sent = 0, total = 0, towrite, res;
+  unsigned inflight = 0, window;
+  int first_seq, stop = 0, err = 0;
+  s32 start;
+
+  rfsch_begin();
+  window = rfsc_window ? rfsc_window : 1;
+  if( blksize > RFSC_MAX_DATA )
+    blksize = RFSC_MAX_DATA;
+  start = rfsch_stream_start( fd, count, blksize, window );
+  first_seq = rfsch_next_seq();
+  while( ( sent < count && !stop ) || inflight > 0 )
+  {
+    // Keep the window full
+    while( sent < count && !stop && inflight < window )
+    {
+      towrite = count - sent > blksize ? blksize : count - sent;
+      rfsch_build_write_request( fd, p + sent, towrite );
+      if( rfsch_send_request() == CLIENT_ERR )
+      {
+        stop = err = 1;
+        break;
+      }
+      sent += towrite;
+      inflight ++;
+      rfsch_next_seq();
+    }
+    if( inflight == 0 )
+      break;
+    // Wait for the oldest response
+    towrite = count - total > blksize ? blksize : count - total;
+    if( rfsch_read_response( first_seq ) == CLIENT_ERR || rfsch_get_write_result( &res ) == CLIENT_ERR )
+    {
+      err = 1;
+      break;
+    }
+    inflight --;
+    first_seq = first_seq == ELUARPC_NO_SEQ ? ELUARPC_NO_SEQ : ( u8 )( first_seq + 1 );
+    if( !stop )
+    {
+      total += res;
+      if( res < towrite )
+        stop = 1;
+    }
+  }
+  // The writes after a short write or an error might have been executed too
+  if( sent != total )
+    rfsch_stream_resync( fd, start, total );
+  return total == 0 && err ? -1 : ( s32 )total;
+}
+
+// Read 'count' bytes in 'blksize' pieces, keeping up to 'window' read
+// requests in flight (the server executes them in order). The data is given
+// to 'cb' in file order. Returns the number of bytes read before the first
+// short read or error (-1 if nothing was read); the file position of the
+// server is left right after them.
+s32 rfsc_read_stream_cb( int fd, u32 count, u32 blksize, p_rfsc_data cb, void *arg )
+{
+  const u8 *resbuf;
+  u32 sent = 0, total = 0, toread, res;
+  unsigned inflight = 0, window;
+  int first_seq, stop = 0, err = 0, z;
+  s32 start;
+
+  rfsch_begin();
+  window = rfsc_window ? rfsc_window : 1;
+  if( blksize > RFSC_MAX_DATA )
+    blksize = RFSC_MAX_DATA;
+  start = rfsch_stream_start( fd, count, blksize, window );
+  first_seq = rfsch_next_seq();
+  z = rfsch_use_z( blksize );
+  while( ( sent < count && !stop ) || inflight > 0 )
+  {
+    // Keep the window full
+    while( sent < count && !stop && inflight < window )
+    {
+      toread = count - sent > blksize ? blksize : count - sent;
+      rfsch_build_read_request( fd, toread, z );
+      if( rfsch_send_request() == CLIENT_ERR )
+      {
+        stop = err = 1;
+        break;
+      }
+      sent += toread;
+      inflight ++;
+      rfsch_next_seq();
+    }
+    if( inflight == 0 )
+      break;
+    // Wait for the oldest response
+    toread = count - total > blksize ? blksize : count - total;
+    if( rfsch_read_response( first_seq ) == CLIENT_ERR || rfsch_get_read_data( z, rfsc_zbuffer, rfsc_zbuffer_size, &resbuf, &res ) == CLIENT_ERR )
+    {
+      err = 1;
+      break;
+    }
+    inflight --;
+    first_seq = first_seq == ELUARPC_NO_SEQ ? ELUARPC_NO_SEQ : ( u8 )( first_seq + 1 );
+    // After a short read (end of file) the responses still in flight are empty
+    if( !stop )
+    {
+      if( res > toread )
+        res = toread;
+      cb( resbuf, res, arg );
+      total += res;
+      if( res < toread )
+        stop = 1;
+    }
+  }
+  // At the end of the file the position is already right, but after an
+  // error the reads still in flight might have moved it
+  if( err && sent != total )
+    rfsch_stream_resync( fd, start, total );
+  return total == 0 && err ? -1 : ( s32 )total;
+}
+
+// Helper: copy the data of a read stream to a buffer
+static void rfsch_copy_data( const u8 *p, u32 size, void *arg )
+{
+  u8 **pdest = ( u8** )arg;
+
+  memcpy( *pdest, p, size );
+  *pdest += size;
+}
+
+s32 rfsc_read_stream( int fd, void *buf, u32 count, u32 blksize )
+{
+  u8 *p = ( u8* )buf;
+
+  return rfsc_read_stream_cb( fd, count, blksize, rfsch_copy_data, &p );
+}
+
 s32 rfsc_lseek( int fd, s32 offset, int whence )
 {
   s32 res;
+  int seq = rfsch_start_request();
 
   // Make the request
   remotefs_lseek_write_request( rfsc_buffer, fd, offset, os_lseek_sys_whence_to_rfs_whence( whence ) );
 
   // Send the request / get the response
-  if( rfsch_send_request_read_response() == CLIENT_ERR )
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
     return -1;
 
   // Interpret the response
@@ -196,13 +717,13 @@ s32 rfsc_lseek( int fd, s32 offset, int whence )
 
 int rfsc_close( int fd )
 {
-  int res;
+  int res, seq = rfsch_start_request();
 
   // Make the request
   remotefs_close_write_request( rfsc_buffer, fd );
 
   // Send the request / get the response
-  if( rfsch_send_request_read_response() == CLIENT_ERR )
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
     return -1;
 
   // Interpret the response
@@ -211,13 +732,30 @@ int rfsc_close( int fd )
   return res;
 }
 
+// Close a file without waiting for the response (protocol v2 only, the result
+// of the close is lost). Used for files that were only read.
+void rfsc_close_nowait( int fd )
+{
+  rfsch_begin();
+  if( rfsc_version < 2 )
+  {
+    rfsc_close( fd );
+    return;
+  }
+  rfsch_next_seq();
+  remotefs_close_write_request( rfsc_buffer, fd );
+  if( rfsch_send_request() == CLIENT_OK )
+    rfsc_pending ++;
+}
+
 u32 rfsc_opendir( const char* name )
 {
   u32 res;
+  int seq = rfsch_start_request();
 
   // Make the request
   remotefs_opendir_write_request( rfsc_buffer, name );
-  if( rfsch_send_request_read_response() == CLIENT_ERR )
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
     return 0;
 
   // Interpret the response
@@ -228,9 +766,39 @@ u32 rfsc_opendir( const char* name )
 
 void rfsc_readdir( u32 d, const char **pname, u32 *psize, u32 *ptime )
 {
+  const u8 *pent;
+  int seq;
+
+  // Use readdir_batch if possible (the directory buffer is used only by a
+  // directory at a time, the others are read one entry at a time)
+  rfsch_begin();
+  if( rfsc_dir_buffer_size > RFS_DIRENT_HEADER_SIZE && ( rfsc_caps & RFS_CAP_READDIR_BATCH ) && ( rfsc_dir_d == 0 || rfsc_dir_d == d ) )
+  {
+    if( rfsc_dir_d == 0 )
+    {
+      rfsc_dir_d = d;
+      rfsc_dir_pos = rfsc_dir_len = 0;
+      rfsc_dir_last = 0;
+    }
+    if( rfsc_dir_pos >= rfsc_dir_len && !rfsc_dir_last && rfsch_readdir_batch( d ) == CLIENT_ERR )
+      rfsc_dir_last = 1;
+    if( rfsc_dir_pos >= rfsc_dir_len )
+    {
+      *pname = NULL;
+      return;
+    }
+    pent = rfsc_dir_buffer + rfsc_dir_pos;
+    *psize = rfsch_get_u32( pent );
+    *ptime = rfsch_get_u32( pent + 4 );
+    *pname = ( const char* )pent + RFS_DIRENT_HEADER_SIZE;
+    rfsc_dir_pos += RFS_DIRENT_HEADER_SIZE + strlen( *pname ) + 1;
+    return;
+  }
+  seq = rfsch_next_seq();
+
   // Make the request
   remotefs_readdir_write_request( rfsc_buffer, d );
-  if( rfsch_send_request_read_response() == CLIENT_ERR )
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
   {
     *pname = NULL;
     return;
@@ -243,11 +811,15 @@ void rfsc_readdir( u32 d, const char **pname, u32 *psize, u32 *ptime )
 
 int rfsc_closedir( u32 d )
 {
-  int res;
+  int res, seq;
+
+  if( rfsc_dir_d == d )
+    rfsc_dir_d = 0;
+  seq = rfsch_start_request();
 
   // Make the request
   remotefs_closedir_write_request( rfsc_buffer, d );
-  if( rfsch_send_request_read_response() == CLIENT_ERR )
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
     return -1;
 
   // Interpret the response
@@ -256,4 +828,71 @@ int rfsc_closedir( u32 d )
   return res;
 }  
 
+// Get the size, modification time and type of a file (protocol v3)
+int rfsc_stat( const char *name, u32 *psize, u32 *pmtime, int *pisdir )
+{
+  int res, seq;
+  u32 size, mtime, isdir;
+
+  if( rfsch_start_request_cap( RFS_CAP_STAT, &seq ) == CLIENT_ERR )
+    return -1;
+  remotefs_stat_write_request( rfsc_buffer, name );
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
+    return -1;
+  if( remotefs_stat_read_response( rfsc_buffer, &res, &size, &mtime, &isdir ) == ELUARPC_ERR )
+    return -1;
+  if( psize )
+    *psize = size;
+  if( pmtime )
+    *pmtime = mtime;
+  if( pisdir )
+    *pisdir = isdir != 0;
+  return res;
+}
+
+// Remove a file (protocol v3)
+int rfsc_unlink( const char *name )
+{
+  int res, seq;
+
+  if( rfsch_start_request_cap( RFS_CAP_UNLINK, &seq ) == CLIENT_ERR )
+    return -1;
+  remotefs_unlink_write_request( rfsc_buffer, name );
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
+    return -1;
+  if( remotefs_unlink_read_response( rfsc_buffer, &res ) == ELUARPC_ERR )
+    return -1;
+  return res;
+}
+
+// Rename a file (protocol v3)
+int rfsc_rename( const char *oldname, const char *newname )
+{
+  int res, seq;
+
+  if( rfsch_start_request_cap( RFS_CAP_RENAME, &seq ) == CLIENT_ERR )
+    return -1;
+  remotefs_rename_write_request( rfsc_buffer, oldname, newname );
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
+    return -1;
+  if( remotefs_rename_read_response( rfsc_buffer, &res ) == ELUARPC_ERR )
+    return -1;
+  return res;
+}
+
+// Create a directory (protocol v3)
+int rfsc_mkdir( const char *name, int mode )
+{
+  int res, seq;
+
+  if( rfsch_start_request_cap( RFS_CAP_MKDIR, &seq ) == CLIENT_ERR )
+    return -1;
+  remotefs_mkdir_write_request( rfsc_buffer, name, mode );
+  if( rfsch_send_request_read_response( seq ) == CLIENT_ERR )
+    return -1;
+  if( remotefs_mkdir_read_response( rfsc_buffer, &res ) == ELUARPC_ERR )
+    return -1;
+  return res;
+}
+
 #endif // #ifdef BUILD_RFS
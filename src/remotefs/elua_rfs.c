@@ -7,12 +7,16 @@
 #include "remotefs.h"
 #include "eluarpc.h"
 #include "client.h"
+#include "rfs_cache.h"
+#include "lz.h"
 #include "sermux.h"
 #include "buf.h"
 #include "elua_net.h"
 #include "utils.h"
+#include "ioctl.h"
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
 #ifdef ELUA_SIMULATOR
 #include "hostif.h"
 #endif
@@ -25,76 +29,116 @@
 #define RFS_FLOW_TYPE        PLATFORM_UART_FLOW_NONE
 #endif
 
+// Maximum number of requests in flight when reading or writing (protocol v2,
+// 1 disables pipelining). With the UDP transport each request in flight needs
+// a receive buffer of 1 << RFS_BUFFER_SIZE bytes.
+#ifndef RFS_MAX_WINDOW
+#define RFS_MAX_WINDOW       4
+#endif
+
+// eluarpc encoding used with the servers that accept compact packets
+// (ELUARPC_ENC_V1 always uses the old encoding, add ELUARPC_ENC_CRC to protect
+// the packets with a CRC16 on noisy links)
+#ifndef RFS_ENCODING
+#define RFS_ENCODING         ELUARPC_ENC_V2
+#endif
+
+// Packet size with the TCP transport (larger packets are used only with the
+// servers that accept them, RFS_DEFAULT_PACKET_SIZE bytes otherwise)
+#if defined( RFS_TRANSPORT_TCP ) && !defined( RFS_TCP_BUFFER_SIZE )
+#define RFS_TCP_BUFFER_SIZE       4096
+#endif
+
 // Our RFS buffer
 // Compute the usable buffer size starting from RFS_BUFFER_SIZE (which is the
 // size of the serial buffer). A complete packet must fit in RFS_BUFFER_SIZE
 // bytes. Computed this to be large enough for a WRITE request.
-#define RFS_REAL_BUFFER_SIZE      ( ( 1 << RFS_BUFFER_SIZE ) - ELUARPC_WRITE_REQUEST_EXTRA )
-static u8 rfs_buffer[ 1 << RFS_BUFFER_SIZE ];
+#ifdef RFS_TRANSPORT_TCP
+#define RFS_PACKET_SIZE           RFS_TCP_BUFFER_SIZE
+#else
+#define RFS_PACKET_SIZE           ( 1 << RFS_BUFFER_SIZE )
+#endif
+#define RFS_REAL_BUFFER_SIZE      ( RFS_PACKET_SIZE - ELUARPC_WRITE_REQUEST_EXTRA )
+#ifdef RFS_TCP_BUFFER_START_ADDRESS
+// The packet buffer (followed by the compression buffer) has a fixed address,
+// usually in external RAM (2 * RFS_TCP_BUFFER_SIZE bytes)
+#define rfs_buffer                ( ( u8* )( RFS_TCP_BUFFER_START_ADDRESS ) )
+#else
+static u8 rfs_buffer[ RFS_PACKET_SIZE ];
+#endif
 
-#ifdef ELUA_SIMULATOR
+// Directory entries read with a single request (protocol v3)
+#ifndef RFS_DIR_BUFFER_SIZE
+#define RFS_DIR_BUFFER_SIZE       ( ( 1 << RFS_BUFFER_SIZE ) - ELUARPC_WRITE_REQUEST_EXTRA )
+#endif
+static u8 rfs_dir_buffer[ RFS_DIR_BUFFER_SIZE ];
+
+#ifdef BUILD_RFS_COMPRESS
+// Compression of the read/write data: a block and the compressor hash table
+#ifdef RFS_TCP_BUFFER_START_ADDRESS
+#define rfs_zbuffer               ( rfs_buffer + RFS_PACKET_SIZE )
+#else
+static u8 rfs_zbuffer[ RFS_REAL_BUFFER_SIZE ];
+#endif
+static u16 rfs_zhash[ LZ_HASH_SIZE ];
+#endif
+
+#if defined( ELUA_CPU_LINUX ) && !defined( RFS_TRANSPORT_TCP )
 static int rfs_read_fd, rfs_write_fd;
 #endif
 
 static int rfs_open_r( struct _reent *r, const char *path, int flags, int mode )
 {
-  return rfsc_open( path, flags, mode );
+  u32 size, mtime;
+  int fd = rfsc_open_stat( path, flags, mode, &size, &mtime );
+
+  rfscache_open( fd, path, flags, size, mtime );
+  return fd;
 }
 
 static int rfs_close_r( struct _reent *r, int fd )
 {
+  // Nothing can go wrong when closing a file that was only read, so don't
+  // wait for the response
+  if( rfscache_close( fd ) )
+  {
+    rfsc_close_nowait( fd );
+    return 0;
+  }
   return rfsc_close( fd );
 }
 
 static _ssize_t rfs_write_r( struct _reent *r, int fd, const void* ptr, size_t len )
 { 
-  s32 total = 0, res;
-  u32 towrite;
-  const u8 *p = ( const u8* )ptr;
+  s32 res;
 
-  // Write in RFS_REAL_BUFFER_SIZE increments
-//  printf( "Got WRITE request for %d bytes\n", len );
-  while( len )
-  {
-    towrite = len > RFS_REAL_BUFFER_SIZE ? RFS_REAL_BUFFER_SIZE : len;
-    if( ( res = rfsc_write( fd, p, towrite ) ) == -1 )
-      break;
-    total += res;
-//    printf( "Wrote %d bytes\n", res );
-    if( res < towrite )
-      break;
-    len -= towrite;
-    p += towrite; 
-  }
-  return ( _ssize_t )total;
+  rfscache_write( fd );
+  // Write in RFS_REAL_BUFFER_SIZE increments (pipelined)
+  if( len == 0 || ( res = rfsc_write_stream( fd, ptr, len, RFS_REAL_BUFFER_SIZE ) ) == -1 )
+    return 0;
+  return ( _ssize_t )res;
 }
 
 static _ssize_t rfs_read_r( struct _reent *r, int fd, void* ptr, size_t len )
 {
-  s32 total = 0, res;
-  u32 toread;
-  u8 *p = ( u8* )ptr;
+  s32 res;
 
-  // Read in RFS_REAL_BUFFER_SIZE increments
-//  printf( "Got READ request for %d bytes\n", len );
-  while( len )
-  {
-    toread = len > RFS_REAL_BUFFER_SIZE ? RFS_REAL_BUFFER_SIZE : len;
-    if( ( res = rfsc_read( fd, p, toread ) ) == -1 )
-      break;
-    total += res; 
-//    printf( "Read %d bytes\n", res );
-    if( res < toread )
-      break;
-    len -= toread;
-    p += toread;
-  }
-  return ( _ssize_t )total;
+  if( len == 0 )
+    return 0;
+  // Cached files are read through the block cache, the others in
+  // RFS_REAL_BUFFER_SIZE increments (pipelined)
+  if( rfscache_is_cached( fd ) )
+    res = rfscache_read( fd, ptr, len );
+  else
+    res = rfsc_read_stream( fd, ptr, len, RFS_REAL_BUFFER_SIZE );
+  return res == -1 ? 0 : ( _ssize_t )res;
 }
 
 // lseek
 static off_t rfs_lseek_r( struct _reent *r, int fd, off_t off, int whence )
 {
+  if( rfscache_is_cached( fd ) )
+    return ( off_t )rfscache_lseek( fd, ( s32 )off, whence );
   return ( off_t )rfsc_lseek( fd, ( s32 )off, whence );
 }
 
@@ -121,6 +165,66 @@ static int rfs_closedir_r( struct _reent *r, void *d )
   return rfsc_closedir( ( u32 )d );
 }
 
+// Helper: set errno after an operation that failed on the server
+// (-1 is also returned when the server doesn't have the operation)
+static int rfsh_result( struct _reent *r, int res )
+{
+  if( res != 0 )
+  {
+    r->_errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+// unlink
+static int rfs_unlink_r( struct _reent *r, const char *path )
+{
+  rfscache_remove( path );
+  return rfsh_result( r, rfsc_unlink( path ) );
+}
+
+// rename
+static int rfs_rename_r( struct _reent *r, const char *oldname, const char *newname )
+{
+  rfscache_remove( oldname );
+  rfscache_remove( newname );
+  return rfsh_result( r, rfsc_rename( oldname, newname ) );
+}
+
+// mkdir
+static int rfs_mkdir_r( struct _reent *r, const char *name, int mode )
+{
+  return rfsh_result( r, rfsc_mkdir( name, mode ) );
+}
+
+// stat
+static int rfs_stat_r( struct _reent *r, const char *name, struct dm_stat *pstat )
+{
+  int isdir;
+
+  if( rfsh_result( r, rfsc_stat( name, &pstat->fsize, &pstat->ftime, &isdir ) ) == -1 )
+    return -1;
+  pstat->isdir = isdir;
+  return 0;
+}
+
+// ioctl
+static int rfs_ioctl_r( struct _reent *r, int fd, unsigned long request, void *ptr )
+{
+  switch( request )
+  {
+    case FDBLKSIZE:
+      // The largest transfer that fits in a single request
+      *( u32* )ptr = rfsc_get_max_data();
+      return 0;
+
+    default:
+      r->_errno = EINVAL;
+      return -1;
+  }
+}
+
 // ****************************************************************************
 // Remote FS serial transport functions
 
@@ -157,27 +261,34 @@ static u32 rfs_recv( u8 *p, u32 size, s32 timeout )
 #ifdef RFS_TRANSPORT_UDP
 static int rfs_socket = ELUA_NET_INVALID_SOCKET;
 static volatile elua_net_ip rfs_server_ip;
-static volatile u16 rfs_data_size;
 static p_elua_net_state_cb rfs_prev_state_cb;
 
+// Received packets wait in a queue (one packet for each request in flight,
+// plus the response of a close that wasn't waited for)
+#define RFS_UDP_QUEUE_SIZE    ( RFS_MAX_WINDOW + 1 )
+static u8 rfs_udp_queue[ RFS_UDP_QUEUE_SIZE ][ 1 << RFS_BUFFER_SIZE ];
+static volatile u16 rfs_udp_size[ RFS_UDP_QUEUE_SIZE ];
+static volatile unsigned rfs_udp_head, rfs_udp_tail;
+
 #define RFS_MAX_DISCOVERIES   3
 #define RFS_DISCOVERY_TO      40000
 
 // Receive callback (directly from the TCP stack)
 static void rfs_recv_cb( int sockno, const u8 *pdata, unsigned size, elua_net_ip ip, u16 port )
 {
+  unsigned slot;
+
   if( rfs_socket == ELUA_NET_INVALID_SOCKET )
     return;
   ( void )sockno;
   if( rfs_server_ip.ipaddr == 0 && size == ELUARPC_START_OFFSET && eluarpc_is_discover_response_packet( pdata ) ) // this is a response for the discovery request
-  {
     rfs_server_ip.ipaddr = ip.ipaddr;
-    rfs_data_size = size;
-  }
-  else // regular data packet
+  else if( rfs_udp_head - rfs_udp_tail < RFS_UDP_QUEUE_SIZE ) // regular data packet (dropped if the queue is full)
   {
-    rfs_data_size = UMIN( size, 1 << RFS_BUFFER_SIZE );
-    memcpy( rfs_buffer, pdata, rfs_data_size );
+    slot = rfs_udp_head % RFS_UDP_QUEUE_SIZE;
+    rfs_udp_size[ slot ] = UMIN( size, 1 << RFS_BUFFER_SIZE );
+    memcpy( rfs_udp_queue[ slot ], pdata, rfs_udp_size[ slot ] );
+    rfs_udp_head ++;
   }
 }
 
@@ -202,14 +313,15 @@ static int rfs_lookup_server()
     tmrstart = platform_timer_op( RFS_TIMER_ID, PLATFORM_TIMER_OP_START, 0 );
     while( 1 )
     {
-      if( rfs_data_size )
+      if( rfs_server_ip.ipaddr != 0 )
         break;
       if( platform_timer_get_diff_us( RFS_TIMER_ID, tmrstart, platform_timer_op( RFS_TIMER_ID, PLATFORM_TIMER_OP_READ, 0 ) ) >= RFS_DISCOVERY_TO )
         break;
     }
-    rfs_data_size = 0;
     retries ++;
   }
+  // Drop the packets of the previous server (if any)
+  rfs_udp_tail = rfs_udp_head;
   return rfs_server_ip.ipaddr != 0;
 }
 
@@ -226,9 +338,8 @@ static u32 rfs_recv( u8 *p, u32 size, s32 timeout )
 {
   u32 readbytes = 0;
   u32 tmrstart = 0;
+  unsigned slot;
 
-  ( void )p;
-  ( void )size;
   if( rfs_socket == ELUA_NET_INVALID_SOCKET )
     return 0;
   if( rfs_server_ip.ipaddr == 0 ) // this shouldn't happen at all
@@ -237,15 +348,20 @@ static u32 rfs_recv( u8 *p, u32 size, s32 timeout )
     tmrstart = platform_timer_op( RFS_TIMER_ID, PLATFORM_TIMER_OP_START, 0 );
   while( 1 )
   {
-    if( rfs_data_size )
+    if( rfs_udp_head != rfs_udp_tail )
       break;
     if( timeout == 0 || ( timeout > 0 && platform_timer_get_diff_us( RFS_TIMER_ID, tmrstart, platform_timer_op( RFS_TIMER_ID, PLATFORM_TIMER_OP_READ, 0 ) ) >= timeout ) )
       break;
   }
-  readbytes = rfs_data_size;
-  rfs_data_size = 0;
-  if( readbytes == 0 ) // server error, must search again
+  if( rfs_udp_head == rfs_udp_tail ) // server error, must search again
+  {
     rfs_server_ip.ipaddr = 0;
+    return 0;
+  }
+  slot = rfs_udp_tail % RFS_UDP_QUEUE_SIZE;
+  readbytes = UMIN( rfs_udp_size[ slot ], size );
+  memcpy( p, rfs_udp_queue[ slot ], readbytes );
+  rfs_udp_tail ++;
   return readbytes;
 }
 
@@ -263,10 +379,103 @@ static void rfs_state_cb( int state )
 }
 #endif
 
+// ****************************************************************************
+// TCP transport implementation
+// The connection is opened by the first request and again after an error (the
+// server closes the session of a connection, so the protocol is negotiated
+// again).
+
+#ifdef RFS_TRANSPORT_TCP
+
+#ifndef RFS_TCP_CONNECT_TIMEOUT
+#define RFS_TCP_CONNECT_TIMEOUT   2000000
+#endif
+
+// uIP drops the data that doesn't fit in the socket buffer (at most 32767
+// bytes), so the responses of all the requests in flight (and of a close that
+// wasn't waited for) must fit there
+#if RFS_TCP_BUFFER_SIZE > 16383
+#error "RFS_TCP_BUFFER_SIZE must be smaller than 16K"
+#endif
+#define RFS_TCP_WINDOW            UMIN( RFS_MAX_WINDOW, 32767 / RFS_TCP_BUFFER_SIZE - 1 )
+#define RFS_TCP_RECV_SIZE         ( ( RFS_TCP_WINDOW + 1 ) * RFS_TCP_BUFFER_SIZE )
+
+static int rfs_socket = ELUA_NET_INVALID_SOCKET;
+
+static void rfs_tcp_close()
+{
+  if( rfs_socket != ELUA_NET_INVALID_SOCKET )
+  {
+    elua_net_close( rfs_socket );
+    rfs_socket = ELUA_NET_INVALID_SOCKET;
+  }
+}
+
+static int rfs_tcp_connect()
+{
+  elua_net_ip ip;
+
+  if( rfs_socket != ELUA_NET_INVALID_SOCKET )
+    return 1;
+  if( ( rfs_socket = elua_net_socket( ELUA_NET_SOCK_STREAM ) ) == ELUA_NET_INVALID_SOCKET )
+    return 0;
+  ip.ipbytes[ 0 ] = RFS_TCP_SERVER_IP0;
+  ip.ipbytes[ 1 ] = RFS_TCP_SERVER_IP1;
+  ip.ipbytes[ 2 ] = RFS_TCP_SERVER_IP2;
+  ip.ipbytes[ 3 ] = RFS_TCP_SERVER_IP3;
+  if( elua_net_set_buffer( rfs_socket, RFS_TCP_RECV_SIZE ) == 0 || elua_net_connect( rfs_socket, ip, RFS_TCP_PORT, RFS_TIMER_ID, RFS_TCP_CONNECT_TIMEOUT ) != 0 )
+  {
+    rfs_tcp_close();
+    return 0;
+  }
+  return 1;
+}
+
+static u32 rfs_send( const u8 *p, u32 size )
+{
+  u32 cnt = 0;
+  elua_net_size res;
+
+  if( !rfs_tcp_connect() )
+    return 0;
+  while( cnt < size )
+  {
+    if( ( res = elua_net_send( rfs_socket, p + cnt, ( elua_net_size )( size - cnt ) ) ) <= 0 )
+    {
+      rfs_tcp_close();
+      break;
+    }
+    cnt += res;
+  }
+  return cnt;
+}
+
+static u32 rfs_recv( u8 *p, u32 size, s32 timeout )
+{
+  u32 cnt = 0;
+  elua_net_size res;
+
+  if( rfs_socket == ELUA_NET_INVALID_SOCKET )
+    return 0;
+  // The data of a packet can come in more than one piece
+  while( cnt < size )
+  {
+    if( ( res = elua_net_recv( rfs_socket, p + cnt, ( elua_net_size )( size - cnt ), RFS_TIMER_ID, timeout ) ) <= 0 )
+    {
+      // The rest of the stream can't be trusted after a partial packet
+      rfs_tcp_close();
+      break;
+    }
+    cnt += res;
+  }
+  return cnt;
+}
+#endif
+
 // ****************************************************************************
 // Remote FS pipe transport functions (used only in simulator)
 
-#ifdef ELUA_CPU_LINUX
+#if defined( ELUA_CPU_LINUX ) && !defined( RFS_TRANSPORT_TCP )
 static u32 rfs_send( const u8 *p, u32 size )
 {
   return ( u32 )hostif_write( rfs_write_fd, p, size );
@@ -274,8 +483,18 @@ static u32 rfs_send( const u8 *p, u32 size )
 
 static u32 rfs_recv( u8 *p, u32 size, s32 timeout )
 {
+  u32 cnt = 0;
+  int res;
+
+  // The pipe can return less data than requested
   timeout = timeout;
-  return ( u32 )hostif_read( rfs_read_fd, p, size );
+  while( cnt < size )
+  {
+    if( ( res = hostif_read( rfs_read_fd, p + cnt, size - cnt ) ) <= 0 )
+      break;
+    cnt += res;
+  }
+  return cnt;
 }
 #endif
 
@@ -292,12 +511,42 @@ static const DM_DEVICE rfs_device =
   rfs_readdir_r,        // readdir
   rfs_closedir_r,       // closedir
   NULL,                 // getaddr
-  NULL                  // unlink - for security purposes
+  rfs_unlink_r,         // unlink
+  rfs_ioctl_r,          // ioctl
+  NULL,                 // batch
+  rfs_rename_r,         // rename
+  rfs_mkdir_r,          // mkdir
+  rfs_stat_r            // stat
 };
 
+// Enable or disable the compression of the read/write data (used only if
+// the server supports it)
+void remotefs_set_compression( int enable )
+{
+#ifdef BUILD_RFS_COMPRESS
+  if( enable )
+    rfsc_set_compression( rfs_zbuffer, RFS_REAL_BUFFER_SIZE, rfs_zhash );
+  else
+#endif
+    rfsc_set_compression( NULL, 0, NULL );
+}
+
+// Get the data bytes transferred with compression enabled (before and after
+// compression)
+void remotefs_get_compression_stats( u32 *praw, u32 *pwire )
+{
+  rfsc_get_compression_stats( praw, pwire );
+}
+
+// Get the number of requests and the bytes sent and received (and reset them)
+void remotefs_get_stats( u32 *prequests, u32 *psent, u32 *preceived, int reset )
+{
+  rfsc_get_stats( prequests, psent, preceived, reset );
+}
+
 const DM_DEVICE *remotefs_init()
 {
-#ifdef ELUA_CPU_LINUX 
+#if defined( ELUA_CPU_LINUX ) && !defined( RFS_TRANSPORT_TCP )
   // Open our read/write pipes
   rfs_read_fd = hostif_open( RFS_SRV_WRITE_PIPE, O_RDONLY, 0 );
   rfs_write_fd = hostif_open( RFS_SRV_READ_PIPE, O_WRONLY, 0 );
@@ -319,8 +568,20 @@ const DM_DEVICE *remotefs_init()
   if( ( rfs_socket = elua_net_socket( ELUA_NET_SOCK_DGRAM ) ) != ELUA_NET_INVALID_SOCKET )
     elua_net_set_recv_callback( rfs_socket, rfs_recv_cb );
   rfs_prev_state_cb = elua_net_set_state_cb( rfs_state_cb );
+#elif defined( RFS_TRANSPORT_TCP ) // the connection is opened by the first request
+  rfs_socket = ELUA_NET_INVALID_SOCKET;
 #endif
   rfsc_setup( rfs_buffer, rfs_send, rfs_recv, RFS_TIMEOUT );
+  rfsc_set_max_packet( RFS_PACKET_SIZE );
+#ifdef RFS_TRANSPORT_TCP
+  rfsc_set_max_window( RFS_TCP_WINDOW );
+#else
+  rfsc_set_max_window( RFS_MAX_WINDOW );
+#endif
+  rfsc_set_encoding( RFS_ENCODING );
+  rfsc_set_dir_buffer( rfs_dir_buffer, RFS_DIR_BUFFER_SIZE );
+  remotefs_set_compression( 1 );
+  rfscache_init( RFS_REAL_BUFFER_SIZE );
   return &rfs_device;
 }
 
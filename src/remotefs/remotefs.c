@@ -21,6 +21,18 @@ int remotefs_open_read_response( const u8 *p, int *presult )
   return eluarpc_gen_read( p, "ri", RFS_OP_OPEN, presult );  
 }
 
+// Protocol v2: the response also has the size and the modification time of
+// the file, which the client uses to validate its cached copy
+void remotefs_open_write_response_v2( u8 *p, int result, u32 size, u32 mtime )
+{
+  eluarpc_gen_write( p, "rill", RFS_OP_OPEN, result, size, mtime );
+}
+
+int remotefs_open_read_response_v2( const u8 *p, int *presult, u32 *psize, u32 *pmtime )
+{
+  return eluarpc_gen_read( p, "rill", RFS_OP_OPEN, presult, psize, pmtime );
+}
+
 void remotefs_open_write_request( u8 *p, const char* pathname, int flags, int mode )
 {
   eluarpc_gen_write( p, "opii", RFS_OP_OPEN, pathname, strlen( pathname ) + 1, flags, mode );
@@ -200,4 +212,229 @@ int remotefs_closedir_read_request( const u8 *p, u32 *pd )
   return eluarpc_gen_read( p, "ol", RFS_OP_CLOSEDIR, pd );
 }
 
+// ****************************************************************************
+// Operation: hello
+// hello: hello( u32 version, u32 window )
+
+void remotefs_hello_write_response( u8 *p, u32 version, u32 window )
+{
+  eluarpc_gen_write( p, "rll", RFS_OP_HELLO, version, window );
+}
+
+int remotefs_hello_read_response( const u8 *p, u32 *pversion, u32 *pwindow )
+{
+  return eluarpc_gen_read( p, "rll", RFS_OP_HELLO, pversion, pwindow );
+}
+
+// Protocol v3: the response also has the capabilities of the server
+void remotefs_hello_write_response_v3( u8 *p, u32 version, u32 window, u32 caps )
+{
+  eluarpc_gen_write( p, "rlll", RFS_OP_HELLO, version, window, caps );
+}
+
+int remotefs_hello_read_response_v3( const u8 *p, u32 *pversion, u32 *pwindow, u32 *pcaps )
+{
+  return eluarpc_gen_read( p, "rlll", RFS_OP_HELLO, pversion, pwindow, pcaps );
+}
+
+void remotefs_hello_write_request( u8 *p, u32 version, u32 window )
+{
+  eluarpc_gen_write( p, "oll", RFS_OP_HELLO, version, window );
+}
+
+int remotefs_hello_read_request( const u8 *p, u32 *pversion, u32 *pwindow )
+{
+  return eluarpc_gen_read( p, "oll", RFS_OP_HELLO, pversion, pwindow );
+}
+
+// ****************************************************************************
+// Operation: readdir_batch
+// readdir_batch: void readdir_batch( u32 d, u32 maxsize )
+
+void remotefs_readdir_batch_write_response( u8 *p, u32 count, u32 last, const void *data, u32 size )
+{
+  eluarpc_gen_write( p, "rllp", RFS_OP_READDIR_BATCH, count, last, data, size );
+}
+
+int remotefs_readdir_batch_read_response( const u8 *p, u32 *pcount, u32 *plast, const u8 **pdata, u32 *psize )
+{
+  return eluarpc_gen_read( p, "rllp", RFS_OP_READDIR_BATCH, pcount, plast, pdata, psize );
+}
+
+void remotefs_readdir_batch_write_request( u8 *p, u32 d, u32 maxsize )
+{
+  eluarpc_gen_write( p, "oll", RFS_OP_READDIR_BATCH, d, maxsize );
+}
+
+int remotefs_readdir_batch_read_request( const u8 *p, u32 *pd, u32 *pmaxsize )
+{
+  return eluarpc_gen_read( p, "oll", RFS_OP_READDIR_BATCH, pd, pmaxsize );
+}
+
+// ****************************************************************************
+// Operation: stat
+// stat: int stat( const char *name, u32 *psize, u32 *pmtime, u32 *pisdir )
+
+void remotefs_stat_write_response( u8 *p, int result, u32 size, u32 mtime, u32 isdir )
+{
+  eluarpc_gen_write( p, "rilll", RFS_OP_STAT, result, size, mtime, isdir );
+}
+
+int remotefs_stat_read_response( const u8 *p, int *presult, u32 *psize, u32 *pmtime, u32 *pisdir )
+{
+  return eluarpc_gen_read( p, "rilll", RFS_OP_STAT, presult, psize, pmtime, pisdir );
+}
+
+void remotefs_stat_write_request( u8 *p, const char *name )
+{
+  eluarpc_gen_write( p, "op", RFS_OP_STAT, name, strlen( name ) + 1 );
+}
+
+int remotefs_stat_read_request( const u8 *p, const char **pname )
+{
+  return eluarpc_gen_read( p, "op", RFS_OP_STAT, pname, NULL );
+}
+
+// ****************************************************************************
+// Operation: unlink
+// unlink: int unlink( const char *name )
+
+void remotefs_unlink_write_response( u8 *p, int result )
+{
+  eluarpc_gen_write( p, "ri", RFS_OP_UNLINK, result );
+}
+
+int remotefs_unlink_read_response( const u8 *p, int *presult )
+{
+  return eluarpc_gen_read( p, "ri", RFS_OP_UNLINK, presult );
+}
+
+void remotefs_unlink_write_request( u8 *p, const char *name )
+{
+  eluarpc_gen_write( p, "op", RFS_OP_UNLINK, name, strlen( name ) + 1 );
+}
+
+int remotefs_unlink_read_request( const u8 *p, const char **pname )
+{
+  return eluarpc_gen_read( p, "op", RFS_OP_UNLINK, pname, NULL );
+}
+
+// ****************************************************************************
+// Operation: rename
+// rename: int rename( const char *oldname, const char *newname )
+
+void remotefs_rename_write_response( u8 *p, int result )
+{
+  eluarpc_gen_write( p, "ri", RFS_OP_RENAME, result );
+}
+
+int remotefs_rename_read_response( const u8 *p, int *presult )
+{
+  return eluarpc_gen_read( p, "ri", RFS_OP_RENAME, presult );
+}
+
+void remotefs_rename_write_request( u8 *p, const char *oldname, const char *newname )
+{
+  eluarpc_gen_write( p, "opp", RFS_OP_RENAME, oldname, strlen( oldname ) + 1, newname, strlen( newname ) + 1 );
+}
+
+int remotefs_rename_read_request( const u8 *p, const char **poldname, const char **pnewname )
+{
+  return eluarpc_gen_read( p, "opp", RFS_OP_RENAME, poldname, NULL, pnewname, NULL );
+}
+
+// ****************************************************************************
+// Operation: mkdir
+// mkdir: int mkdir( const char *name, int mode )
+
+void remotefs_mkdir_write_response( u8 *p, int result )
+{
+  eluarpc_gen_write( p, "ri", RFS_OP_MKDIR, result );
+}
+
+int remotefs_mkdir_read_response( const u8 *p, int *presult )
+{
+  return eluarpc_gen_read( p, "ri", RFS_OP_MKDIR, presult );
+}
+
+void remotefs_mkdir_write_request( u8 *p, const char *name, int mode )
+{
+  eluarpc_gen_write( p, "opi", RFS_OP_MKDIR, name, strlen( name ) + 1, mode );
+}
+
+int remotefs_mkdir_read_request( const u8 *p, const char **pname, int *pmode )
+{
+  return eluarpc_gen_read( p, "opi", RFS_OP_MKDIR, pname, NULL, pmode );
+}
+
+// ****************************************************************************
+// Operation: readz
+// readz: ssize_t readz( int fd, void *buf, size_t count )
+
+void remotefs_readz_write_response( u8 *p, u32 size, const void *data, u32 datalen )
+{
+  eluarpc_gen_write( p, "rlp", RFS_OP_READZ, size, data, datalen );
+}
+
+int remotefs_readz_read_response( const u8 *p, u32 *psize, const u8 **ppdata, u32 *pdatalen )
+{
+  return eluarpc_gen_read( p, "rlp", RFS_OP_READZ, psize, ppdata, pdatalen );
+}
+
+void remotefs_readz_write_request( u8 *p, int fd, u32 count )
+{
+  eluarpc_gen_write( p, "oil", RFS_OP_READZ, fd, count );
+}
+
+int remotefs_readz_read_request( const u8 *p, int *pfd, u32 *pcount )
+{
+  return eluarpc_gen_read( p, "oil", RFS_OP_READZ, pfd, pcount );
+}
+
+// ****************************************************************************
+// Operation: writez
+// writez: ssize_t writez( int fd, const void *buf, size_t count )
+
+void remotefs_writez_write_response( u8 *p, u32 result )
+{
+  eluarpc_gen_write( p, "rl", RFS_OP_WRITEZ, result );
+}
+
+int remotefs_writez_read_response( const u8 *p, u32 *presult )
+{
+  return eluarpc_gen_read( p, "rl", RFS_OP_WRITEZ, presult );
+}
+
+void remotefs_writez_write_request( u8 *p, int fd, u32 count, const void *data, u32 datalen )
+{
+  eluarpc_gen_write( p, "oilp", RFS_OP_WRITEZ, fd, count, data, datalen );
+}
+
+int remotefs_writez_read_request( const u8 *p, int *pfd, u32 *pcount, const void **pdata, u32 *pdatalen )
+{
+  return eluarpc_gen_read( p, "oilp", RFS_OP_WRITEZ, pfd, pcount, pdata, pdatalen );
+}
+
+// ****************************************************************************
+// Operation: bufsize
+// bufsize: u32 bufsize( u32 size )
+
+void remotefs_bufsize_write_response( u8 *p, u32 size )
+{
+  eluarpc_gen_write( p, "rl", RFS_OP_BUFSIZE, size );
+}
 
+int remotefs_bufsize_read_response( const u8 *p, u32 *psize )
+{
+  return eluarpc_gen_read( p, "rl", RFS_OP_BUFSIZE, psize );
+}
+
+void remotefs_bufsize_write_request( u8 *p, u32 size )
+{
+  eluarpc_gen_write( p, "ol", RFS_OP_BUFSIZE, size );
+}
+
+int remotefs_bufsize_read_request( const u8 *p, u32 *psize )
+{
+  return eluarpc_gen_read( p, "ol", RFS_OP_BUFSIZE, psize );
+}
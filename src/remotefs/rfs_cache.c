@@ -0,0 +1,543 @@
+// Client cache of remote file blocks (rfs_cache.h)
+
+#include "platform_conf.h"
+#if defined( BUILD_RFS ) && defined( BUILD_RFS_CACHE )
+
+#include "rfs_cache.h"
+#include "client.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+// Default configuration (can be overriden in platform_conf.h)
+// Size of the block storage in bytes
+#ifndef RFS_CACHE_SIZE
+#define RFS_CACHE_SIZE            ( 32 * 1024 )
+#endif
+
+// Number of files that can have blocks in the cache
+#ifndef RFS_CACHE_FILES
+#define RFS_CACHE_FILES           8
+#endif
+
+// Number of open files that are tracked by the cache (files opened when the
+// table is full are read directly from the server)
+#ifndef RFS_CACHE_FDS
+#define RFS_CACHE_FDS             8
+#endif
+
+// Number of blocks read ahead when a sequential run is detected
+#ifndef RFS_CACHE_READAHEAD
+#define RFS_CACHE_READAHEAD       8
+#endif
+
+// Longest path (with the terminating zero) that can be cached
+#ifndef RFS_CACHE_PATH_SIZE
+#define RFS_CACHE_PATH_SIZE       64
+#endif
+
+#define RFS_CACHE_BLOCK_SIZE      512
+#define RFS_CACHE_BLOCKS          ( RFS_CACHE_SIZE / RFS_CACHE_BLOCK_SIZE )
+#define RFS_CACHE_NONE            0xFF
+#define RFS_CACHE_NO_BLOCK        -1
+#define RFS_CACHE_NO_POS          0xFFFFFFFFUL
+
+#if RFS_CACHE_READAHEAD < 1 || RFS_CACHE_READAHEAD > RFS_CACHE_BLOCKS / 2
+#error "RFS_CACHE_READAHEAD must be between 1 and half the number of cache blocks"
+#endif
+
+#if RFS_CACHE_FILES >= RFS_CACHE_NONE
+#error "Too many files in the RFS cache"
+#endif
+
+// The blocks can live at a fixed address (usually in external RAM) or in the
+// data section
+#ifdef RFS_CACHE_START_ADDRESS
+#define rc_data                   ( ( u8* )( RFS_CACHE_START_ADDRESS ) )
+#else
+static u8 rc_buffers[ RFS_CACHE_BLOCKS * RFS_CACHE_BLOCK_SIZE ];
+#define rc_data                   rc_buffers
+#endif
+#define rc_block_data( i )        ( rc_data + ( i ) * RFS_CACHE_BLOCK_SIZE )
+
+// Cached file (free if the path is empty)
+typedef struct
+{
+  char path[ RFS_CACHE_PATH_SIZE ];
+  u32 size;
+  u32 mtime;
+  u32 stamp;
+} RC_FILE;
+
+// Cached block (free if 'file' is RFS_CACHE_NONE)
+typedef struct
+{
+  u32 blk;
+  u32 stamp;
+  u16 len;
+  u8 file;
+} RC_BLOCK;
+
+// Open file (free if 'fd' is -1). Readers of a file that was invalidated
+// while they were open have 'file' set to RFS_CACHE_NONE and read from the
+// server. Writers are tracked only to invalidate the file when they write.
+typedef struct
+{
+  int fd;
+  u32 pos;                          // position seen by the application
+  u32 srvpos;                       // position of the file on the server
+  u32 next_blk;                     // next block of a sequential run
+  u8 file;
+  u8 writer;
+  char path[ RFS_CACHE_PATH_SIZE ]; // writers only
+} RC_FD;
+
+// State of a block fetch
+typedef struct
+{
+  int slots[ RFS_CACHE_READAHEAD ];
+  u32 done;
+} RC_FETCH;
+
+static RC_FILE rc_files[ RFS_CACHE_FILES ];
+static RC_BLOCK rc_blocks[ RFS_CACHE_BLOCKS ];
+static RC_FD rc_fds[ RFS_CACHE_FDS ];
+static u32 rc_stamp;
+static u32 rc_xfer_size;
+
+// ****************************************************************************
+// Helpers
+
+static RC_FD* rch_get_fd( int fd )
+{
+  unsigned i;
+
+  for( i = 0; i < RFS_CACHE_FDS; i ++ )
+    if( rc_fds[ i ].fd == fd )
+      return rc_fds + i;
+  return NULL;
+}
+
+static int rch_find_file( const char *path )
+{
+  unsigned i;
+
+  for( i = 0; i < RFS_CACHE_FILES; i ++ )
+    if( rc_files[ i ].path[ 0 ] && !strcmp( rc_files[ i ].path, path ) )
+      return i;
+  return RFS_CACHE_NONE;
+}
+
+static int rch_find_block( u8 file, u32 blk )
+{
+  unsigned i;
+
+  for( i = 0; i < RFS_CACHE_BLOCKS; i ++ )
+    if( rc_blocks[ i ].file == file && rc_blocks[ i ].blk == blk )
+      return i;
+  return RFS_CACHE_NO_BLOCK;
+}
+
+// Helper: drop a file and its blocks, its readers go to the server from now on
+static void rch_invalidate( u8 file )
+{
+  unsigned i;
+
+  rc_files[ file ].path[ 0 ] = '\0';
+  for( i = 0; i < RFS_CACHE_BLOCKS; i ++ )
+    if( rc_blocks[ i ].file == file )
+      rc_blocks[ i ].file = RFS_CACHE_NONE;
+  for( i = 0; i < RFS_CACHE_FDS; i ++ )
+    if( rc_fds[ i ].fd != -1 && rc_fds[ i ].file == file )
+      rc_fds[ i ].file = RFS_CACHE_NONE;
+}
+
+static void rch_invalidate_path( const char *path )
+{
+  int file;
+
+  if( ( file = rch_find_file( path ) ) != RFS_CACHE_NONE )
+    rch_invalidate( file );
+}
+
+static void rch_invalidate_all()
+{
+  unsigned i;
+
+  for( i = 0; i < RFS_CACHE_FILES; i ++ )
+    if( rc_files[ i ].path[ 0 ] )
+      rch_invalidate( i );
+}
+
+// Helper: add a file to the cache (replaces the least recently used file)
+static u8 rch_new_file( const char *path, u32 size, u32 mtime )
+{
+  unsigned i, file = 0;
+
+  for( i = 0; i < RFS_CACHE_FILES; i ++ )
+  {
+    if( rc_files[ i ].path[ 0 ] == '\0' )
+    {
+      file = i;
+      break;
+    }
+    if( rc_files[ i ].stamp < rc_files[ file ].stamp )
+      file = i;
+  }
+  if( rc_files[ file ].path[ 0 ] )
+    rch_invalidate( file );
+  strcpy( rc_files[ file ].path, path );
+  rc_files[ file ].size = size;
+  rc_files[ file ].mtime = mtime;
+  rc_files[ file ].stamp = ++ rc_stamp;
+  return ( u8 )file;
+}
+
+// Helper: get a free block (or the least recently used one)
+static int rch_new_block()
+{
+  unsigned i, blk = 0;
+
+  for( i = 0; i < RFS_CACHE_BLOCKS; i ++ )
+  {
+    if( rc_blocks[ i ].file == RFS_CACHE_NONE )
+    {
+      blk = i;
+      break;
+    }
+    if( rc_blocks[ i ].stamp < rc_blocks[ blk ].stamp )
+      blk = i;
+  }
+  rc_blocks[ blk ].stamp = ++ rc_stamp;
+  return blk;
+}
+
+// Helper: make sure that the server reads from the given position
+static int rch_server_seek( RC_FD *pf, u32 pos )
+{
+  if( pf->srvpos == pos )
+    return 1;
+  pf->srvpos = RFS_CACHE_NO_POS;
+  if( rfsc_lseek( pf->fd, ( s32 )pos, SEEK_SET ) != ( s32 )pos )
+    return 0;
+  pf->srvpos = pos;
+  return 1;
+}
+
+// Helper: store the data of a fetch in its blocks
+static void rch_store_data( const u8 *p, u32 size, void *arg )
+{
+  RC_FETCH *pfetch = ( RC_FETCH* )arg;
+  u32 off, n;
+
+  while( size )
+  {
+    off = pfetch->done % RFS_CACHE_BLOCK_SIZE;
+    n = RFS_CACHE_BLOCK_SIZE - off;
+    if( n > size )
+      n = size;
+    memcpy( rc_block_data( pfetch->slots[ pfetch->done / RFS_CACHE_BLOCK_SIZE ] ) + off, p, n );
+    pfetch->done += n;
+    p += n;
+    size -= n;
+  }
+}
+
+// Helper: read 'count' blocks of a file starting with 'blk' from the server
+// Returns the cache block with 'blk' or RFS_CACHE_NO_BLOCK
+static int rch_fetch( RC_FD *pf, u32 blk, unsigned count )
+{
+  RC_FETCH fetch;
+  RC_FILE *pfile = rc_files + pf->file;
+  u32 start = blk * RFS_CACHE_BLOCK_SIZE, size;
+  s32 res;
+  unsigned i;
+
+  // Stop at the end of the file and before the blocks that are already cached
+  if( count > ( pfile->size - start + RFS_CACHE_BLOCK_SIZE - 1 ) / RFS_CACHE_BLOCK_SIZE )
+    count = ( pfile->size - start + RFS_CACHE_BLOCK_SIZE - 1 ) / RFS_CACHE_BLOCK_SIZE;
+  for( i = 1; i < count; i ++ )
+    if( rch_find_block( pf->file, blk + i ) != RFS_CACHE_NO_BLOCK )
+    {
+      count = i;
+      break;
+    }
+  // The new blocks don't have a valid block number until they are read
+  for( i = 0; i < count; i ++ )
+  {
+    fetch.slots[ i ] = rch_new_block();
+    rc_blocks[ fetch.slots[ i ] ].file = pf->file;
+    rc_blocks[ fetch.slots[ i ] ].blk = RFS_CACHE_NO_POS;
+  }
+  size = count * RFS_CACHE_BLOCK_SIZE;
+  if( size > pfile->size - start )
+    size = pfile->size - start;
+  fetch.done = 0;
+  res = -1;
+  if( rch_server_seek( pf, start ) )
+    res = rfsc_read_stream_cb( pf->fd, size, rc_xfer_size, rch_store_data, &fetch );
+  pf->srvpos = res == -1 ? RFS_CACHE_NO_POS : start + res;
+  // Keep the blocks that were read (the file might be shorter now)
+  for( i = 0; i < count; i ++ )
+  {
+    if( res == -1 || i * RFS_CACHE_BLOCK_SIZE >= ( u32 )res )
+    {
+      rc_blocks[ fetch.slots[ i ] ].file = RFS_CACHE_NONE;
+      continue;
+    }
+    size = ( u32 )res - i * RFS_CACHE_BLOCK_SIZE;
+    rc_blocks[ fetch.slots[ i ] ].blk = blk + i;
+    rc_blocks[ fetch.slots[ i ] ].len = ( u16 )( size > RFS_CACHE_BLOCK_SIZE ? RFS_CACHE_BLOCK_SIZE : size );
+  }
+  pf->next_blk = blk + count;
+  return res > 0 ? fetch.slots[ 0 ] : RFS_CACHE_NO_BLOCK;
+}
+
+// Helper: read from the server (file invalidated while it was open)
+static s32 rch_server_read( RC_FD *pf, void *buf, u32 count )
+{
+  s32 res;
+
+  if( !rch_server_seek( pf, pf->pos ) )
+    return -1;
+  if( ( res = rfsc_read_stream( pf->fd, buf, count, rc_xfer_size ) ) == -1 )
+  {
+    pf->srvpos = RFS_CACHE_NO_POS;
+    return -1;
+  }
+  pf->pos = pf->srvpos = pf->pos + res;
+  return res;
+}
+
+// ****************************************************************************
+// Public interface
+
+void rfscache_init( u32 xfer_size )
+{
+  unsigned i;
+
+  rc_xfer_size = xfer_size;
+  for( i = 0; i < RFS_CACHE_FILES; i ++ )
+    rc_files[ i ].path[ 0 ] = '\0';
+  for( i = 0; i < RFS_CACHE_BLOCKS; i ++ )
+    rc_blocks[ i ].file = RFS_CACHE_NONE;
+  for( i = 0; i < RFS_CACHE_FDS; i ++ )
+    rc_fds[ i ].fd = -1;
+}
+
+// Called after a file was opened on the server. Returns 1 if its reads go
+// through the cache.
+int rfscache_open( int fd, const char *path, int flags, u32 size, u32 mtime )
+{
+  RC_FD *pf;
+  int writer = ( flags & O_ACCMODE ) != O_RDONLY || ( flags & ( O_TRUNC | O_APPEND ) );
+  u8 file;
+
+  if( fd < 0 )
+    return 0;
+  pf = rch_get_fd( -1 );
+  if( strlen( path ) >= RFS_CACHE_PATH_SIZE )
+  {
+    // Can't be cached (and can't be tracked)
+    if( writer )
+      rch_invalidate_all();
+    return 0;
+  }
+  if( writer )
+  {
+    // The file will change, its writes invalidate it again
+    rch_invalidate_path( path );
+    if( pf )
+    {
+      pf->fd = fd;
+      pf->writer = 1;
+      pf->file = RFS_CACHE_NONE;
+      strcpy( pf->path, path );
+    }
+    return 0;
+  }
+  // Files without a token (v1 servers) aren't cached
+  if( pf == NULL || mtime == 0 )
+    return 0;
+  if( ( file = rch_find_file( path ) ) != RFS_CACHE_NONE )
+  {
+    if( rc_files[ file ].size != size || rc_files[ file ].mtime != mtime )
+    {
+      rch_invalidate( file );
+      file = RFS_CACHE_NONE;
+    }
+    else
+      rc_files[ file ].stamp = ++ rc_stamp;
+  }
+  if( file == RFS_CACHE_NONE )
+    file = rch_new_file( path, size, mtime );
+  pf->fd = fd;
+  pf->writer = 0;
+  pf->file = file;
+  pf->pos = pf->srvpos = pf->next_blk = 0;
+  return 1;
+}
+
+// Returns 1 if the reads and seeks of 'fd' are handled by the cache
+int rfscache_is_cached( int fd )
+{
+  RC_FD *pf = fd < 0 ? NULL : rch_get_fd( fd );
+
+  return pf != NULL && !pf->writer;
+}
+
+s32 rfscache_read( int fd, void *buf, u32 count )
+{
+  RC_FD *pf = rch_get_fd( fd );
+  u8 *p = ( u8* )buf;
+  u32 done = 0, size, blk, off, n;
+  int slot;
+
+  if( pf->file == RFS_CACHE_NONE )
+    return rch_server_read( pf, buf, count );
+  size = rc_files[ pf->file ].size;
+  if( pf->pos >= size )
+    return 0;
+  if( count > size - pf->pos )
+    count = size - pf->pos;
+  while( done < count && pf->file != RFS_CACHE_NONE )
+  {
+    blk = pf->pos / RFS_CACHE_BLOCK_SIZE;
+    off = pf->pos % RFS_CACHE_BLOCK_SIZE;
+    if( ( slot = rch_find_block( pf->file, blk ) ) == RFS_CACHE_NO_BLOCK )
+    {
+      // Read the blocks needed by the request, or a full read ahead if the
+      // request continues a sequential run
+      n = ( off + count - done + RFS_CACHE_BLOCK_SIZE - 1 ) / RFS_CACHE_BLOCK_SIZE;
+      if( n > RFS_CACHE_READAHEAD || blk == pf->next_blk )
+        n = RFS_CACHE_READAHEAD;
+      if( ( slot = rch_fetch( pf, blk, n ) ) == RFS_CACHE_NO_BLOCK )
+        break;
+    }
+    rc_blocks[ slot ].stamp = ++ rc_stamp;
+    // A short block means that the file is shorter now
+    if( off >= rc_blocks[ slot ].len )
+      break;
+    n = rc_blocks[ slot ].len - off;
+    if( n > count - done )
+      n = count - done;
+    memcpy( p + done, rc_block_data( slot ) + off, n );
+    done += n;
+    pf->pos += n;
+  }
+  return done == 0 && pf->pos < size ? -1 : ( s32 )done;
+}
+
+s32 rfscache_lseek( int fd, s32 offset, int whence )
+{
+  RC_FD *pf = rch_get_fd( fd );
+  s32 newpos;
+
+  if( pf->file == RFS_CACHE_NONE )
+  {
+    // The size might have changed, ask the server
+    if( whence == SEEK_CUR )
+    {
+      whence = SEEK_SET;
+      offset += ( s32 )pf->pos;
+    }
+    pf->srvpos = RFS_CACHE_NO_POS;
+    if( ( newpos = rfsc_lseek( fd, offset, whence ) ) != -1 )
+      pf->pos = pf->srvpos = ( u32 )newpos;
+    return newpos;
+  }
+  switch( whence )
+  {
+    case SEEK_SET:
+      newpos = offset;
+      break;
+
+    case SEEK_CUR:
+      newpos = ( s32 )pf->pos + offset;
+      break;
+
+    case SEEK_END:
+      newpos = ( s32 )rc_files[ pf->file ].size + offset;
+      break;
+
+    default:
+      return -1;
+  }
+  if( newpos < 0 )
+    return -1;
+  pf->pos = ( u32 )newpos;
+  return newpos;
+}
+
+// Called before a write
+void rfscache_write( int fd )
+{
+  RC_FD *pf = fd < 0 ? NULL : rch_get_fd( fd );
+
+  if( pf == NULL )
+    rch_invalidate_all(); // the path of the file isn't known
+  else if( pf->writer )
+    rch_invalidate_path( pf->path );
+}
+
+// Called before a file is removed or renamed
+void rfscache_remove( const char *path )
+{
+  rch_invalidate_path( path );
+}
+
+// Called before a file is closed. Returns 1 if the file was only read.
+int rfscache_close( int fd )
+{
+  RC_FD *pf = fd < 0 ? NULL : rch_get_fd( fd );
+  int res;
+
+  if( pf == NULL )
+    return 0;
+  res = !pf->writer;
+  pf->fd = -1;
+  return res;
+}
+
+#else // #if defined( BUILD_RFS ) && defined( BUILD_RFS_CACHE )
+
+#include "rfs_cache.h"
+
+void rfscache_init( u32 xfer_size )
+{
+}
+
+int rfscache_open( int fd, const char *path, int flags, u32 size, u32 mtime )
+{
+  return 0;
+}
+
+int rfscache_is_cached( int fd )
+{
+  return 0;
+}
+
+s32 rfscache_read( int fd, void *buf, u32 count )
+{
+  return -1;
+}
+
+s32 rfscache_lseek( int fd, s32 offset, int whence )
+{
+  return -1;
+}
+
+void rfscache_write( int fd )
+{
+}
+
+void rfscache_remove( const char *path )
+{
+}
+
+int rfscache_close( int fd )
+{
+  return 0;
+}
+
+#endif // #if defined( BUILD_RFS ) && defined( BUILD_RFS_CACHE )
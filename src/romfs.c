@@ -11,33 +11,22 @@
 #include "platform_conf.h"
 #ifdef BUILD_ROMFS
 
-#define ROMFS_MAX_FDS   4
+// Maximum number of open files (can be overriden in platform_conf.h)
+#ifndef ROMFS_MAX_FDS
+#define ROMFS_MAX_FDS   16
+#endif
 #define ROMFS_ALIGN     4
 #define fsmin( x , y ) ( ( x ) < ( y ) ? ( x ) : ( y ) )
 
-static FS romfs_fd_table[ ROMFS_MAX_FDS ];
-static int romfs_num_fd;
+// The per-file state is allocated from a pool only when needed
+DM_POOL_DECLARE( romfs_fd_pool, sizeof( FS ), ROMFS_MAX_FDS );
+#define romfs_get_fd( fd )  ( ( FS* )dm_pool_get( &romfs_fd_pool, fd ) )
 
 static u8 romfs_read( u32 addr )
 {
   return romfiles_fs[ addr ];
 }
 
-static int romfs_find_empty_fd()
-{
-  int i;
-  
-  for( i = 0; i < ROMFS_MAX_FDS; i ++ )
-    if( romfs_fd_table[ i ].p_read_func == NULL )
-      return i;
-  return -1;
-}
-
-static void romfs_close_fd( int fd )
-{
-  memset( romfs_fd_table + fd, 0, sizeof( FS ) );
-}
-
 // Open the given file, returning one of FS_FILE_NOT_FOUND, FS_FILE_ALREADY_OPENED
 // or FS_FILE_OK
 u8 romfs_open_file( const char* fname, p_read_fs_byte p_read_func, FS* pfs )
@@ -90,26 +79,23 @@ static int romfs_open_r( struct _reent *r, const char *path, int flags, int mode
   FS tempfs;
   int i;
   
-  if( romfs_num_fd == ROMFS_MAX_FDS )
+  if( romfs_open_file( path, romfs_read, &tempfs ) != FS_FILE_OK )
   {
-    r->_errno = ENFILE;
+    r->_errno = ENOENT;
     return -1;
   }
-  if( romfs_open_file( path, romfs_read, &tempfs ) != FS_FILE_OK )
+  if( ( i = dm_pool_alloc( &romfs_fd_pool ) ) == -1 )
   {
-    r->_errno = ENOENT;
+    r->_errno = ENFILE;
     return -1;
   }
-  i = romfs_find_empty_fd();
-  memcpy( romfs_fd_table + i, &tempfs, sizeof( FS ) );
-  romfs_num_fd ++;
+  memcpy( romfs_get_fd( i ), &tempfs, sizeof( FS ) );
   return i;
 }
 
 static int romfs_close_r( struct _reent *r, int fd )
 {
-  romfs_close_fd( fd );
-  romfs_num_fd --;
+  dm_pool_free( &romfs_fd_pool, fd );
   return 0;
 }
 
@@ -121,7 +107,7 @@ static _ssize_t romfs_write_r( struct _reent *r, int fd, const void* ptr, size_t
 
 static _ssize_t romfs_read_r( struct _reent *r, int fd, void* ptr, size_t len )
 {
-  FS* pfs = romfs_fd_table + fd; 
+  FS* pfs = romfs_get_fd( fd ); 
   long actlen = fsmin( len, pfs->size - pfs->offset );
   
   memcpy( ptr, romfiles_fs + pfs->offset + pfs->baseaddr, actlen );
@@ -132,7 +118,7 @@ static _ssize_t romfs_read_r( struct _reent *r, int fd, void* ptr, size_t len )
 // lseek
 static off_t romfs_lseek_r( struct _reent *r, int fd, off_t off, int whence )
 {
-  FS* pfs = romfs_fd_table + fd;   
+  FS* pfs = romfs_get_fd( fd );   
   u32 newpos = 0;
   
   switch( whence )
@@ -204,11 +190,27 @@ static int romfs_closedir_r( struct _reent *r, void *d )
 // getaddr
 static const char* romfs_getaddr_r( struct _reent *r, int fd )
 {
-  FS* pfs = romfs_fd_table + fd;
+  FS* pfs = romfs_get_fd( fd );
 
   return ( const char* )romfiles_fs + pfs->baseaddr;
 }
 
+// ioctl
+static int romfs_ioctl_r( struct _reent *r, int fd, unsigned long request, void *ptr )
+{
+  switch( request )
+  {
+    case FDGETADDR_FIXED:
+      // The files are in ROM, they never move
+      *( const char** )ptr = romfs_getaddr_r( r, fd );
+      return 0;
+
+    default:
+      r->_errno = EINVAL;
+      return -1;
+  }
+}
+
 // Our ROMFS device descriptor structure
 static const DM_DEVICE romfs_device = 
 {
@@ -222,7 +224,12 @@ static const DM_DEVICE romfs_device =
   romfs_readdir_r,      // readdir
   romfs_closedir_r,     // closedir
   romfs_getaddr_r,      // getaddr
-  NULL                  // unlink
+  NULL,                 // unlink
+  romfs_ioctl_r,        // ioctl
+  NULL,                 // batch
+  NULL,                 // rename
+  NULL,                 // mkdir
+  NULL                  // stat
 };
 
 const DM_DEVICE* romfs_init()
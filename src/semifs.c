@@ -259,7 +259,12 @@ static const DM_DEVICE semifs_device =
   semifs_readdir_r,      // readdir
   semifs_closedir_r,     // closedir
   NULL,                  // getaddr
-  NULL                   // unlink - not implemented yet
+  NULL,                  // unlink - not implemented yet
+  NULL,                  // ioctl
+  NULL,                  // batch
+  NULL,                  // rename
+  NULL,                  // mkdir
+  NULL                   // stat
 };
 
 const DM_DEVICE* semifs_init()
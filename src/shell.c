@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include "platform.h"
 #include "elua_net.h"
 #include "devman.h"
@@ -19,16 +20,22 @@
 #include "remotefs.h"
 #include "eluarpc.h"
 #include "linenoise.h"
+#ifdef ELUA_PLATFORM_STM32
 #include "stm32f10x.h"
+#endif
 #include "platform_conf.h"
 #include "editor.h"
 #include "common.h"
 #include "help.h"
+#include "ioctl.h"
 #ifdef BUILD_SHELL
 
+// The 'ee' command (I2C EEPROM shared with the FSMC pins) is STM32 only
+#ifdef ELUA_PLATFORM_STM32
 #define EE_I2C_ADDR               0xA0
 #define EE_I2C_NUM                0
 #define EE_PAGE_SIZE              64
+#endif
 
 // Shell alternate ' ' char
 #define SHELL_ALT_SPACE           '\x07'
@@ -50,6 +57,11 @@ typedef struct
   p_shell_handler handler_func;
 } SHELL_COMMAND;
 
+// Timer used by the commands that measure time ('cp', 'fsbench')
+#ifndef SHELL_TIMER_ID
+#define SHELL_TIMER_ID            0
+#endif
+
 // Shell data
 static char* shell_prog;
 
@@ -108,6 +120,21 @@ static char* shellh_pattern_from_fs( const char *pfs )
   return ppattern;
 }
 
+// Helper: start timing an operation
+static timer_data_type shellh_timer_start()
+{
+  return platform_timer_op( SHELL_TIMER_ID, PLATFORM_TIMER_OP_START, 0 );
+}
+
+// Helper: microseconds since 'start' (the operation must be shorter than the
+// maximum delay of the timer)
+static u32 shellh_timer_get_us( timer_data_type start )
+{
+  timer_data_type end = platform_timer_op( SHELL_TIMER_ID, PLATFORM_TIMER_OP_READ, 0 );
+
+  return platform_timer_get_diff_us( SHELL_TIMER_ID, end, start );
+}
+
 // Print a colorized "[Yes/No/eXit]" prompt
 static void shellh_print_action_prompt()
 {
@@ -139,10 +166,16 @@ static void shell_help( char* args )
   printf( "     -b: backup mode (prepend the destination file name with '_b').\n" );
   printf( "     -c: ask for confirmation before copying a file.\n" );
   printf( "     -f: overwrite destination files without confirmation.\n" TERM_RESET_COL );
+#ifdef ELUA_PLATFORM_STM32
   printf( "  %see <file>   %s- dump file to the EEPROM connected on I2C1\n" TERM_RESET_COL, SHELLH_CMD, SHELLH_HELP );
+#endif
   printf( "  %sedit <file> %s- edits the given file\n" TERM_RESET_COL, SHELLH_CMD, SHELLH_HELP );
   printf( "  %sver         %s- print eLua version\n" TERM_RESET_COL, SHELLH_CMD, SHELLH_HELP );
   printf( "  %srm <file> [-f] %s- removes the file, use '-f' to supress confirmation\n" TERM_RESET_COL, SHELLH_CMD, SHELLH_HELP );
+  printf( "  %sfsbench <path> [-s <KB>] [-b <bufsize>] [-r <reads>] [-n <files>] [-c <csv>] %s- file system benchmark\n", SHELLH_CMD, SHELLH_HELP );
+  printf( "     sequential writes and reads of a <KB> file (128KB by default) in <path>, random 512 bytes reads,\n" );
+  printf( "     creating, listing and deleting small files. If <path> is a file it's only read.\n" );
+  printf( "     -c: append the results to the given CSV file.\n" TERM_RESET_COL );
   printf( "  %sreset%s - resets the terminal and clears the screen\n" TERM_RESET_COL, SHELLH_CMD, SHELLH_HELP );
 #ifdef BUILD_HELP  
   printf( "  %sapihelp [topic] %s- help on eLua's API, lists all modules without arguments\n" TERM_RESET_COL, SHELLH_CMD, SHELLH_HELP );
@@ -476,7 +509,10 @@ static void shell_rm( char *args )
       }
       else
         pattern = args;
+      // Group the directory and FAT updates of all the removed files
+      dm_batch( pattern, 1 );
       shellh_pattern_iterator( pattern, shell_rm_iterator_cb, &ask );
+      dm_batch( pattern, 0 );
     }
   }
   else
@@ -487,6 +523,7 @@ static void shell_rm( char *args )
 
 // ----------------------------------------------------------------------------
 // 'ee' handler
+#ifdef ELUA_PLATFORM_STM32
 static void shell_ee( char *args )
 {
   FILE *fp;
@@ -539,14 +576,15 @@ static void shell_ee( char *args )
   printf( " done, wrote %u bytes\n", ( unsigned )addr );
   fclose( fp );
 }
+#endif // #ifdef ELUA_PLATFORM_STM32
 
 // ----------------------------------------------------------------------------
 // 'cp' handler
-#ifdef BUILD_RFS
-#define SHELL_COPY_BUFSIZE    ( ( 1 << RFS_BUFFER_SIZE ) - ELUARPC_WRITE_REQUEST_EXTRA )
-#else
-#define SHELL_COPY_BUFSIZE    256
+// Largest and smallest copy buffer (can be overriden in platform_conf.h)
+#ifndef SHELL_COPY_BUFSIZE
+#define SHELL_COPY_BUFSIZE      8192
 #endif
+#define SHELL_COPY_MIN_BUFSIZE  256
 #define SHELL_CP_FLAG_BACKUP    1
 #define SHELL_CP_FLAG_CONFIRM   2
 #define SHELL_CP_FLAG_OVERWRITE 4
@@ -560,13 +598,125 @@ typedef struct
   int flags;
 } shell_cp_state;
 
+// Copy helper: choose the size of the copy buffer. The buffer is a multiple
+// of the preferred transfer size of the destination (and of the source if
+// possible), so every write is a whole number of clusters or packets.
+static u32 shellh_cp_get_bufsize( int fds, int fdd )
+{
+  u32 bs = 0, bd = 0, size = SHELL_COPY_BUFSIZE;
+
+  ioctl( fds, FDBLKSIZE, &bs );
+  ioctl( fdd, FDBLKSIZE, &bd );
+  if( bd > 0 && bd <= size )
+  {
+    size -= size % bd;
+    if( bs > 0 && bs <= size && size % bs != 0 && bd % bs == 0 )
+      size -= size % bs;
+  }
+  else if( bs > 0 && bs <= size )
+    size -= size % bs;
+  return size;
+}
+
+// Copy helper: copy 'psrcname' to 'pdestname' using the file descriptors
+// directly (no stdio buffering). Files mapped in memory at a fixed address
+// (ROMFS) are written directly from their address; other files go through the
+// largest buffer that can be allocated. The destination file is preallocated
+// if the device can do it. Returns 1 for OK and 0 for error.
+static int shellh_cp_stream( const char *psrcname, const char *pdestname )
+{
+  int fds, fdd = -1, res = 0;
+  const char *paddr;
+  u8 *buf = NULL;
+  s32 size, n;
+  u32 bufsize, done = 0, us = 0, prealloc;
+  timer_data_type start;
+
+  if( ( fds = open( psrcname, O_RDONLY, 0 ) ) == -1 )
+  {
+    printf( TERM_FGCOL_LIGHT_RED "Unable to open %s for reading\n" TERM_RESET_COL, psrcname );
+    return 0;
+  }
+  size = lseek( fds, 0, SEEK_END );
+  lseek( fds, 0, SEEK_SET );
+  if( ( fdd = open( pdestname, O_WRONLY | O_CREAT | O_TRUNC, 0 ) ) == -1 )
+  {
+    printf( TERM_FGCOL_LIGHT_RED "Unable to open %s for writing\n" TERM_RESET_COL, pdestname );
+    goto cpsout;
+  }
+  // Reserve the space (the copy still works if the device can't do it)
+  if( size > 0 )
+  {
+    prealloc = size;
+    ioctl( fdd, FDPREALLOC, &prealloc );
+  }
+  bufsize = shellh_cp_get_bufsize( fds, fdd );
+  if( ( paddr = dm_getaddr_fixed( fds ) ) == NULL )
+  {
+    for( ; bufsize >= SHELL_COPY_MIN_BUFSIZE; bufsize >>= 1 )
+      if( ( buf = malloc( bufsize ) ) != NULL )
+        break;
+    if( buf == NULL )
+    {
+      printf( TERM_FGCOL_LIGHT_RED "Not enough memory\n" TERM_RESET_COL );
+      goto cpsout;
+    }
+  }
+  printf( TERM_FGCOL_LIGHT_GREEN "Copying %s to %s ... ", psrcname, pdestname );
+  while( 1 )
+  {
+    start = shellh_timer_start();
+    if( paddr )
+    {
+      if( ( n = size - done ) > bufsize )
+        n = bufsize;
+      if( n <= 0 )
+        break;
+    }
+    else if( ( n = read( fds, buf, bufsize ) ) <= 0 )
+    {
+      if( n == 0 )
+        break;
+      printf( TERM_FGCOL_LIGHT_RED "unable to read from %s\n" TERM_RESET_COL, psrcname );
+      goto cpsout;
+    }
+    if( write( fdd, paddr ? paddr + done : ( const char* )buf, n ) != n )
+    {
+      printf( TERM_FGCOL_LIGHT_RED "unable to write to %s\n" TERM_RESET_COL, pdestname );
+      goto cpsout;
+    }
+    done += n;
+    us += shellh_timer_get_us( start );
+  }
+  start = shellh_timer_start();
+  n = close( fdd );
+  fdd = -1;
+  if( n != 0 )
+  {
+    printf( TERM_FGCOL_LIGHT_RED "unable to write to %s\n" TERM_RESET_COL, pdestname );
+    goto cpsout;
+  }
+  us += shellh_timer_get_us( start );
+  if( platform_timer_exists( SHELL_TIMER_ID ) && us > 0 )
+    printf( TERM_FGCOL_LIGHT_BLUE "done, %u bytes in %u ms (%u KB/s)\n" TERM_RESET_COL, ( unsigned )done,
+            ( unsigned )( us / 1000 ), ( unsigned )( ( u64 )done * 1000000 / 1024 / us ) );
+  else
+    printf( TERM_FGCOL_LIGHT_BLUE "done, %u bytes\n" TERM_RESET_COL, ( unsigned )done );
+  res = 1;
+cpsout:
+  close( fds );
+  if( fdd != -1 )
+    close( fdd );
+  if( buf )
+    free( buf );
+  return res;
+}
+
 // Copy helper: makes the actual copy
 static int shellh_cp_copy( const char *psrcname, const char *pdestname, int flags )
 {
   int res = 0;
   FILE *fps = NULL, *fpd = NULL;
-  void *buf = NULL;
-  size_t datalen;
 
   // Check if the file exists first
   if( ( fps = fopen( psrcname, "rb" ) ) == NULL )
@@ -614,39 +764,15 @@ static int shellh_cp_copy( const char *psrcname, const char *pdestname, int flag
     else
       res = 0;
   }  
-  if( ( fpd = fopen( pdestname, "wb" ) ) == NULL )
-    printf( TERM_FGCOL_LIGHT_RED "Unable to open %s for writing\n" TERM_RESET_COL, pdestname );
-  else
-  {
-    // Alloc memory
-    if( ( buf = malloc( SHELL_COPY_BUFSIZE ) ) == NULL )
-      printf( TERM_FGCOL_LIGHT_RED "Not enough memory\n" TERM_RESET_COL );
-    else
-    {
-      // Do the actual copy
-      printf( TERM_FGCOL_LIGHT_GREEN "Copying %s to %s ... ", psrcname, pdestname );
-      while( 1 )
-      {
-        datalen = fread( buf, 1, SHELL_COPY_BUFSIZE, fps );
-        if( fwrite( buf, 1, datalen, fpd ) != datalen )
-        {
-          printf( TERM_FGCOL_LIGHT_RED "unable to write to %s\n" TERM_RESET_COL, pdestname );
-          goto cphout;
-        }
-        if( datalen < SHELL_COPY_BUFSIZE )
-          break;
-      }
-      printf( TERM_FGCOL_LIGHT_BLUE "done\n" TERM_RESET_COL );
-      res = 1;
-    }
-  }
+  // Do the actual copy
+  fclose( fps );
+  fps = NULL;
+  res = shellh_cp_stream( psrcname, pdestname ) ? 1 : 0;
 cphout:
   if( fps )
     fclose( fps );
   if( fpd )
     fclose( fpd );
-  if( buf )
-    free( buf );
   return res;
 }
 
@@ -783,12 +909,412 @@ static void shell_cp( char *args )
   cs.pdest = pdest;
   cs.psrcname = srcname;
   cs.flags = flags;
+  dm_batch( pdest, 1 );
   shellh_pattern_iterator( psrc, shell_cp_iterator_cb, &cs );
+  dm_batch( pdest, 0 );
 cpdone:
   if( srcwc )
     free( srcwc );
 }
 
+// ----------------------------------------------------------------------------
+// 'fsbench' handler
+
+#define SHELL_FSBENCH_FILE_SIZE     128 // KB
+#define SHELL_FSBENCH_RANDOM_READS  200
+#define SHELL_FSBENCH_SMALL_FILES   20
+#define SHELL_FSBENCH_SMALL_SIZE    100
+#define SHELL_FSBENCH_LIST_PASSES   10
+#define SHELL_FSBENCH_MAX_SAMPLES   256
+#define SHELL_FSBENCH_MAX_BUFSIZE   16384
+#define SHELL_FSBENCH_TMPNAME       "fsbench.tmp"
+
+static const unsigned shell_fsbench_bufsizes[] = { 64, 512, 4096 };
+#define SHELL_FSBENCH_NUM_BUFSIZES  ( sizeof( shell_fsbench_bufsizes ) / sizeof( unsigned ) )
+
+// Results of a single test
+typedef struct
+{
+  const char *name;
+  unsigned bufsize;
+  u32 ops;
+  u32 bytes;
+  u32 total_us;
+  u32 max_us;
+  u32 *samples;
+  unsigned nsamples;
+} shell_fsbench_test;
+
+// Benchmark state
+typedef struct
+{
+  const char *path;
+  FILE *fcsv;
+  u32 *samples;
+  u8 *buf;
+} shell_fsbench_state;
+
+// Helper: start a test
+static void shellh_fsb_begin( shell_fsbench_state *ps, shell_fsbench_test *pt, const char *name, unsigned bufsize )
+{
+  memset( pt, 0, sizeof( shell_fsbench_test ) );
+  pt->name = name;
+  pt->bufsize = bufsize;
+  pt->samples = ps->samples;
+}
+
+// Helper: end timing an operation. If there are more operations than
+// samples, the samples are a uniform random subset of all the latencies.
+static void shellh_fsb_end( shell_fsbench_test *pt, timer_data_type start, u32 bytes )
+{
+  u32 us = shellh_timer_get_us( start );
+  u32 i;
+
+  pt->total_us += us;
+  pt->bytes += bytes;
+  if( us > pt->max_us )
+    pt->max_us = us;
+  if( pt->ops < SHELL_FSBENCH_MAX_SAMPLES )
+    pt->samples[ pt->nsamples ++ ] = us;
+  else if( ( i = rand() % ( pt->ops + 1 ) ) < SHELL_FSBENCH_MAX_SAMPLES )
+    pt->samples[ i ] = us;
+  pt->ops ++;
+}
+
+static int shellh_fsb_cmp( const void *pa, const void *pb )
+{
+  u32 a = *( const u32* )pa, b = *( const u32* )pb;
+
+  return a < b ? -1 : a > b;
+}
+
+static u32 shellh_fsb_percentile( shell_fsbench_test *pt, unsigned p )
+{
+  return pt->nsamples ? pt->samples[ ( pt->nsamples - 1 ) * p / 100 ] : 0;
+}
+
+// Helper: print the results of a test (and write them to the CSV file)
+static void shellh_fsb_report( shell_fsbench_state *ps, shell_fsbench_test *pt )
+{
+  u32 total = pt->total_us ? pt->total_us : 1;
+  u32 mbs100 = ( u32 )( ( u64 )pt->bytes * 100 / total );
+  u32 opss = ( u32 )( ( u64 )pt->ops * 1000000 / total );
+  u32 p50, p90, p99;
+
+  qsort( pt->samples, pt->nsamples, sizeof( u32 ), shellh_fsb_cmp );
+  p50 = shellh_fsb_percentile( pt, 50 );
+  p90 = shellh_fsb_percentile( pt, 90 );
+  p99 = shellh_fsb_percentile( pt, 99 );
+  printf( TERM_FGCOL_LIGHT_GREEN "%-9s" TERM_FGCOL_LIGHT_CYAN " %5u %6u %5u.%02u %7u %8u %8u %8u %8u\n" TERM_RESET_COL,
+          pt->name, pt->bufsize, ( unsigned )pt->ops, ( unsigned )( mbs100 / 100 ), ( unsigned )( mbs100 % 100 ),
+          ( unsigned )opss, ( unsigned )p50, ( unsigned )p90, ( unsigned )p99, ( unsigned )pt->max_us );
+  if( ps->fcsv )
+    fprintf( ps->fcsv, "%s,%s,%u,%u,%u,%u,%u.%02u,%u,%u,%u,%u,%u\n", ps->path, pt->name, pt->bufsize,
+             ( unsigned )pt->ops, ( unsigned )pt->bytes, ( unsigned )pt->total_us, ( unsigned )( mbs100 / 100 ),
+             ( unsigned )( mbs100 % 100 ), ( unsigned )opss, ( unsigned )p50, ( unsigned )p90, ( unsigned )p99,
+             ( unsigned )pt->max_us );
+}
+
+// Sequential write test
+static int shellh_fsb_seqwrite( shell_fsbench_state *ps, const char *fname, u32 size, unsigned bufsize )
+{
+  shell_fsbench_test t;
+  timer_data_type start;
+  FILE *fp;
+  u32 done;
+
+  shellh_fsb_begin( ps, &t, "seqwrite", bufsize );
+  if( ( fp = fopen( fname, "wb" ) ) == NULL )
+    return 0;
+  for( done = 0; done < size; done += bufsize )
+  {
+    start = shellh_timer_start();
+    if( fwrite( ps->buf, 1, bufsize, fp ) != bufsize )
+    {
+      fclose( fp );
+      return 0;
+    }
+    shellh_fsb_end( &t, start, bufsize );
+  }
+  // Closing the file writes the cached data, count it as an operation
+  start = shellh_timer_start();
+  if( fclose( fp ) != 0 )
+    return 0;
+  shellh_fsb_end( &t, start, 0 );
+  shellh_fsb_report( ps, &t );
+  return 1;
+}
+
+// Sequential read test
+static int shellh_fsb_seqread( shell_fsbench_state *ps, const char *fname, unsigned bufsize )
+{
+  shell_fsbench_test t;
+  timer_data_type start;
+  FILE *fp;
+  size_t n;
+
+  shellh_fsb_begin( ps, &t, "seqread", bufsize );
+  if( ( fp = fopen( fname, "rb" ) ) == NULL )
+    return 0;
+  do
+  {
+    start = shellh_timer_start();
+    n = fread( ps->buf, 1, bufsize, fp );
+    shellh_fsb_end( &t, start, n );
+  } while( n == bufsize );
+  fclose( fp );
+  shellh_fsb_report( ps, &t );
+  return 1;
+}
+
+// Random 512 bytes reads
+static int shellh_fsb_randread( shell_fsbench_state *ps, const char *fname, unsigned count )
+{
+  shell_fsbench_test t;
+  timer_data_type start;
+  FILE *fp;
+  long size;
+  u32 blocks;
+
+  shellh_fsb_begin( ps, &t, "randread", 512 );
+  if( ( fp = fopen( fname, "rb" ) ) == NULL )
+    return 0;
+  fseek( fp, 0, SEEK_END );
+  size = ftell( fp );
+  if( ( blocks = size / 512 ) == 0 )
+  {
+    fclose( fp );
+    return 0;
+  }
+  while( count -- )
+  {
+    start = shellh_timer_start();
+    fseek( fp, ( long )( rand() % blocks ) * 512, SEEK_SET );
+    if( fread( ps->buf, 1, 512, fp ) != 512 )
+    {
+      fclose( fp );
+      return 0;
+    }
+    shellh_fsb_end( &t, start, 512 );
+  }
+  fclose( fp );
+  shellh_fsb_report( ps, &t );
+  return 1;
+}
+
+// Directory listing test (each operation lists the whole directory)
+static int shellh_fsb_list( shell_fsbench_state *ps, const char *dirname )
+{
+  shell_fsbench_test t;
+  timer_data_type start;
+  DM_DIR *d;
+  unsigned i, n = 0;
+
+  shellh_fsb_begin( ps, &t, "list", 0 );
+  for( i = 0; i < SHELL_FSBENCH_LIST_PASSES; i ++ )
+  {
+    start = shellh_timer_start();
+    if( ( d = dm_opendir( dirname ) ) == NULL )
+      return 0;
+    for( n = 0; dm_readdir( d ) != NULL; n ++ );
+    dm_closedir( d );
+    shellh_fsb_end( &t, start, 0 );
+  }
+  t.bufsize = n; // report the number of entries in the 'buf' column
+  shellh_fsb_report( ps, &t );
+  return 1;
+}
+
+// Small file tests: create 'count' files, list the directory, then delete them
+static int shellh_fsb_smallfiles( shell_fsbench_state *ps, const char *dirname, unsigned count )
+{
+  shell_fsbench_test t;
+  timer_data_type start;
+  char fname[ DM_MAX_DEV_NAME + DM_MAX_FNAME_LENGTH + 2 ];
+  FILE *fp;
+  unsigned i;
+  int res = 1;
+
+  shellh_fsb_begin( ps, &t, "create", SHELL_FSBENCH_SMALL_SIZE );
+  for( i = 0; i < count; i ++ )
+  {
+    snprintf( fname, sizeof( fname ), "%s/fsb%u.tmp", dirname, i );
+    start = shellh_timer_start();
+    if( ( fp = fopen( fname, "wb" ) ) == NULL )
+      break;
+    fwrite( ps->buf, 1, SHELL_FSBENCH_SMALL_SIZE, fp );
+    fclose( fp );
+    shellh_fsb_end( &t, start, SHELL_FSBENCH_SMALL_SIZE );
+  }
+  if( i == count )
+  {
+    shellh_fsb_report( ps, &t );
+    res = shellh_fsb_list( ps, dirname );
+  }
+  else
+    res = 0;
+  count = i;
+  shellh_fsb_begin( ps, &t, "unlink", 0 );
+  for( i = 0; i < count; i ++ )
+  {
+    snprintf( fname, sizeof( fname ), "%s/fsb%u.tmp", dirname, i );
+    start = shellh_timer_start();
+    if( unlink( fname ) != 0 )
+      res = 0;
+    shellh_fsb_end( &t, start, 0 );
+  }
+  if( res )
+    shellh_fsb_report( ps, &t );
+  return res;
+}
+
+static void shell_fsbench( char *args )
+{
+  shell_fsbench_state s;
+  char *p, *popt = NULL, *pcsv = NULL;
+  char dirname[ DM_MAX_DEV_NAME + DM_MAX_FNAME_LENGTH + 1 ];
+  char fname[ DM_MAX_DEV_NAME + DM_MAX_FNAME_LENGTH + 2 ];
+  unsigned size = SHELL_FSBENCH_FILE_SIZE, bufsize = 0, nrand = SHELL_FSBENCH_RANDOM_READS;
+  unsigned nfiles = SHELL_FSBENCH_SMALL_FILES, i, maxbuf;
+  int readonly = 0, ok = 1;
+  DM_DIR *d;
+  FILE *fp;
+  long csvsize;
+
+  memset( &s, 0, sizeof( s ) );
+  // Collect all arguments
+  while( *args )
+  {
+    p = strchr( args, ' ' );
+    *p = 0;
+    if( popt )
+    {
+      if( !strcasecmp( popt, "-c" ) )
+        pcsv = args;
+      else if( !strcasecmp( popt, "-s" ) )
+        size = atoi( args );
+      else if( !strcasecmp( popt, "-b" ) )
+        bufsize = atoi( args );
+      else if( !strcasecmp( popt, "-r" ) )
+        nrand = atoi( args );
+      else if( !strcasecmp( popt, "-n" ) )
+        nfiles = atoi( args );
+      else
+      {
+        printf( TERM_FGCOL_LIGHT_RED "Invalid argument '%s'\n" TERM_RESET_COL, popt );
+        return;
+      }
+      popt = NULL;
+    }
+    else if( *args == '-' )
+      popt = args;
+    else if( s.path == NULL )
+      s.path = args;
+    else
+    {
+      printf( TERM_FGCOL_LIGHT_RED "Invalid argument '%s'\n" TERM_RESET_COL, args );
+      return;
+    }
+    args = p + 1;
+  }
+  if( s.path == NULL || popt )
+  {
+    printf( TERM_FGCOL_LIGHT_RED "Usage: fsbench <path> [-s <KB>] [-b <bufsize>] [-r <reads>] [-n <files>] [-c <csv>]\n" TERM_RESET_COL );
+    return;
+  }
+  if( bufsize > SHELL_FSBENCH_MAX_BUFSIZE || size == 0 )
+  {
+    printf( TERM_FGCOL_LIGHT_RED "Invalid file or buffer size\n" TERM_RESET_COL );
+    return;
+  }
+  if( !platform_timer_exists( SHELL_TIMER_ID ) )
+  {
+    printf( TERM_FGCOL_LIGHT_RED "Timer %d not available\n" TERM_RESET_COL, SHELL_TIMER_ID );
+    return;
+  }
+  // An existing file is benchmarked in read only mode (for /rom and for
+  // read only remote file systems), otherwise the path is a directory
+  if( ( fp = fopen( s.path, "rb" ) ) != NULL )
+  {
+    fclose( fp );
+    readonly = 1;
+    snprintf( fname, sizeof( fname ), "%s", s.path );
+    snprintf( dirname, sizeof( dirname ), "%s", s.path );
+    *strrchr( dirname, '/' ) = '\0';
+  }
+  else
+  {
+    snprintf( dirname, sizeof( dirname ), "%s", s.path );
+    if( strlen( dirname ) > 1 && dirname[ strlen( dirname ) - 1 ] == '/' )
+      dirname[ strlen( dirname ) - 1 ] = '\0';
+    snprintf( fname, sizeof( fname ), "%s/" SHELL_FSBENCH_TMPNAME, dirname );
+  }
+  if( ( d = dm_opendir( dirname ) ) == NULL )
+  {
+    printf( TERM_FGCOL_LIGHT_RED "Invalid path '%s'\n" TERM_RESET_COL, s.path );
+    return;
+  }
+  dm_closedir( d );
+  maxbuf = bufsize ? bufsize : shell_fsbench_bufsizes[ SHELL_FSBENCH_NUM_BUFSIZES - 1 ];
+  if( maxbuf < 512 )
+    maxbuf = 512;
+  s.buf = malloc( maxbuf );
+  s.samples = malloc( SHELL_FSBENCH_MAX_SAMPLES * sizeof( u32 ) );
+  if( s.buf == NULL || s.samples == NULL )
+  {
+    printf( TERM_FGCOL_LIGHT_RED "Not enough memory\n" TERM_RESET_COL );
+    goto fsbdone;
+  }
+  for( i = 0; i < maxbuf; i ++ )
+    s.buf[ i ] = ( u8 )i;
+  if( pcsv )
+  {
+    if( ( s.fcsv = fopen( pcsv, "a+" ) ) == NULL )
+    {
+      printf( TERM_FGCOL_LIGHT_RED "Unable to open %s\n" TERM_RESET_COL, pcsv );
+      goto fsbdone;
+    }
+    fseek( s.fcsv, 0, SEEK_END );
+    csvsize = ftell( s.fcsv );
+    if( csvsize == 0 )
+      fprintf( s.fcsv, "path,test,bufsize,ops,bytes,time_us,mb_s,ops_s,p50_us,p90_us,p99_us,max_us\n" );
+  }
+  printf( TERM_FGCOL_LIGHT_BLUE "Benchmarking %s%s, timer resolution %u us\n" TERM_RESET_COL, s.path,
+          readonly ? " (read only)" : "", ( unsigned )platform_timer_op( SHELL_TIMER_ID, PLATFORM_TIMER_OP_GET_MIN_DELAY, 0 ) );
+  printf( TERM_FGCOL_LIGHT_YELLOW "test        buf    ops    MB/s   ops/s  p50(us)  p90(us)  p99(us)  max(us)\n" TERM_RESET_COL );
+  // Sequential tests
+  for( i = 0; i < SHELL_FSBENCH_NUM_BUFSIZES && ok; i ++ )
+  {
+    if( bufsize && i > 0 )
+      break;
+    if( !readonly )
+      ok = shellh_fsb_seqwrite( &s, fname, size * 1024, bufsize ? bufsize : shell_fsbench_bufsizes[ i ] );
+    if( ok )
+      ok = shellh_fsb_seqread( &s, fname, bufsize ? bufsize : shell_fsbench_bufsizes[ i ] );
+  }
+  if( ok && nrand )
+    ok = shellh_fsb_randread( &s, fname, nrand );
+  if( !readonly )
+    unlink( fname );
+  // Metadata tests
+  if( ok )
+  {
+    if( !readonly && nfiles )
+      ok = shellh_fsb_smallfiles( &s, dirname, nfiles );
+    else
+      ok = shellh_fsb_list( &s, dirname );
+  }
+  if( !ok )
+    printf( TERM_FGCOL_LIGHT_RED "I/O error on %s (give the name of an existing file for read only file systems)\n" TERM_RESET_COL, s.path );
+fsbdone:
+  if( s.fcsv )
+    fclose( s.fcsv );
+  if( s.buf )
+    free( s.buf );
+  if( s.samples )
+    free( s.samples );
+}
+
 // ----------------------------------------------------------------------------
 // 'reset' handler
 
@@ -832,9 +1358,12 @@ static const SHELL_COMMAND shell_commands[] =
   { "cat", shell_cat },
   { "type", shell_cat },
   { "cp", shell_cp },
+#ifdef ELUA_PLATFORM_STM32
   { "ee", shell_ee },
+#endif
   { "edit", shell_edit },
   { "rm", shell_rm },
+  { "fsbench", shell_fsbench },
   { "reset", shell_reset },
 #ifdef BUILD_HELP  
   { "apihelp", shell_apihelp },
@@ -0,0 +1,37 @@
+-- Block layer benchmark: small sequential reads and writes on /mmc and /nand
+-- Shows how many device commands the block layer needs for each pass.
+-- Needs benchtmr.lua (timer 0 of the tmr module).
+
+local SIZE = 128 * 1024
+local CHUNK = 64
+
+local bt = require "benchtmr"
+
+local function bench( path )
+  local data = string.rep( "0123456789abcdef", CHUNK / 16 )
+  local s
+
+  elua.blkdev( true )
+  local t0 = bt.start()
+  local f = io.open( path, "wb" )
+  if not f then return end
+  for i = 1, SIZE / CHUNK do f:write( data ) end
+  f:close()
+  local dtw = bt.elapsed( t0 )
+  s = elua.blkdev( true )
+  print( string.format( "%s: write %.1f KB/s, %d requests, %d device writes, %d merged",
+    path, SIZE / 1024 / dtw, s.writes, s.dev_writes, s.merged ) )
+
+  t0 = bt.start()
+  f = io.open( path, "rb" )
+  while f:read( CHUNK ) do end
+  f:close()
+  local dtr = bt.elapsed( t0 )
+  s = elua.blkdev( true )
+  print( string.format( "%s: read %.1f KB/s, %d requests, %d device reads, %d read ahead fills, %d hits",
+    path, SIZE / 1024 / dtr, s.reads, s.dev_reads, s.ra_fills, s.ra_hits ) )
+  os.remove( path )
+end
+
+bench( "/mmc/blkbench.dat" )
+bench( "/nand/blkbench.dat" )
@@ -0,0 +1,39 @@
+-- require latency benchmark for /mmc (shows the effect of the directory entry cache)
+-- The modules live in a deep /mmc/lib tree, which has to exist on the disk.
+-- On the simulator, use a disk image (MMCFS_SIM_IMAGE) prepared on the host:
+--   dd if=/dev/zero of=mmc.img bs=1M count=32 && mkfs.vfat mmc.img
+--   mmd -i mmc.img ::lib ::lib/a ::lib/a/b ::lib/a/b/c ::lib/a/b/c/d
+-- Needs benchtmr.lua (timer 0 of the tmr module).
+
+local DIR = "/mmc/lib/a/b/c/d"
+local NMODS = 10
+local ROUNDS = 20
+
+local bt = require "benchtmr"
+
+for i = 1, NMODS do
+  local f = assert( io.open( DIR .. "/dmod" .. i .. ".lua", "wb" ), DIR .. " not found" )
+  f:write( "return " .. i .. "\n" )
+  f:close()
+end
+
+local oldpath = package.path
+package.path = "/mmc/?.lua;/mmc/lib/?.lua;/mmc/lib/a/?.lua;/mmc/lib/a/b/?.lua;/mmc/lib/a/b/c/?.lua;" .. DIR .. "/?.lua"
+
+elua.dcache( true )
+local t0 = bt.start()
+for round = 1, ROUNDS do
+  for i = 1, NMODS do
+    local name = "dmod" .. i
+    package.loaded[ name ] = nil
+    assert( require( name ) == i )
+  end
+end
+local dt = bt.elapsed( t0 )
+local s = elua.dcache()
+package.path = oldpath
+
+print( string.format( "%d requires in %.3f s (%.2f ms each)", ROUNDS * NMODS, dt, dt * 1000 / ( ROUNDS * NMODS ) ) )
+print( string.format( "dcache: %d hits, %d negative hits, %d misses, %d purges", s.hits, s.neg_hits, s.misses, s.purges ) )
+
+for i = 1, NMODS do os.remove( DIR .. "/dmod" .. i .. ".lua" ) end
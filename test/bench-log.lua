@@ -0,0 +1,27 @@
+-- Append benchmark for /mmc (shows the effect of file:prealloc)
+-- Run it on the simulator or on a board with a SD card (needs benchtmr.lua)
+
+local NRECORDS = 2000
+local RECORD = string.rep( "x", 57 ) .. "\n"
+
+local bt = require "benchtmr"
+
+local function run( fname, prealloc )
+  local f = assert( io.open( fname, "wb" ) )
+  if prealloc then assert( f:prealloc( NRECORDS * #RECORD ) ) end
+  elua.diskcache( true )
+  local t0 = bt.start()
+  for i = 1, NRECORDS do f:write( RECORD ) end
+  f:close()
+  local dt = bt.elapsed( t0 )
+  local s = elua.diskcache()
+  print( string.format( "%-10s %d bytes in %.2fs, %d sectors written in %d commands",
+    prealloc and "prealloc" or "plain", NRECORDS * #RECORD, dt, s.writebacks, s.writecmds ) )
+  f = assert( io.open( fname, "rb" ) )
+  assert( f:seek( "end" ) == NRECORDS * #RECORD, "bad size" )
+  f:close()
+  os.remove( fname )
+end
+
+run( "/mmc/log1.txt", false )
+run( "/mmc/log2.txt", true )
@@ -0,0 +1,37 @@
+-- Write benchmark for /nand (shows the work done by the NAND FTL)
+-- Run it on the simulator or on a board with BUILD_NANDFTL enabled (needs
+-- benchtmr.lua)
+
+local NFILES = 8
+local NROUNDS = 20
+local BLOCK = string.rep( "n", 512 )
+
+local bt = require "benchtmr"
+
+local function write_file( fname, nblocks )
+  local f = assert( io.open( fname, "wb" ) )
+  for i = 1, nblocks do f:write( BLOCK ) end
+  f:close()
+end
+
+elua.nandftl( true )
+local t0 = bt.start()
+local total = 0
+for r = 1, NROUNDS do
+  for i = 1, NFILES do
+    local n = ( r * 7 + i * 3 ) % 32 + 1
+    write_file( "/nand/bench" .. i .. ".bin", n )
+    total = total + n * #BLOCK
+  end
+end
+local dt = bt.elapsed( t0 )
+local s = elua.nandftl()
+print( string.format( "%d bytes in %.2fs (%.1f KB/s)", total, dt, total / 1024 / dt ) )
+print( string.format( "host writes %d, flash writes %d (write amplification %.2f)",
+  s.host_writes, s.flash_writes, s.host_writes > 0 and s.flash_writes / s.host_writes or 0 ) )
+print( string.format( "gc blocks %d, gc moves %d, wl moves %d, erases %d",
+  s.gc_blocks, s.gc_moves, s.wl_moves, s.erases ) )
+print( string.format( "free blocks %d, bad blocks %d, erase counts %d..%d",
+  s.free_blocks, s.bad_blocks, s.min_erase, s.max_erase ) )
+while elua.nandftl_gc() do end
+for i = 1, NFILES do os.remove( "/nand/bench" .. i .. ".bin" ) end
@@ -0,0 +1,34 @@
+-- Path resolution benchmark
+-- Loads modules from /ram with a long package.path, so most of the time is
+-- spent probing for files that don't exist. Run it on the simulator.
+-- Needs benchtmr.lua (timer 0 of the tmr module).
+
+local NMODS = 10
+local ROUNDS = 20
+
+local bt = require "benchtmr"
+
+for i = 1, NMODS do
+  local f = assert( io.open( "/ram/bmod" .. i .. ".lua", "wb" ) )
+  f:write( "return " .. i .. "\n" )
+  f:close()
+end
+
+local oldpath = package.path
+package.path = "/rom/?.lua;/rom/?.lc;/mmc/?.lua;/mmc/?.lc;/ram/?.lc;/ram/?.lua"
+
+local t0, r0 = bt.start(), elua.resolvecount()
+for round = 1, ROUNDS do
+  for i = 1, NMODS do
+    local name = "bmod" .. i
+    package.loaded[ name ] = nil
+    assert( require( name ) == i )
+  end
+end
+local dt, nres = bt.elapsed( t0 ), elua.resolvecount() - r0
+package.path = oldpath
+
+print( string.format( "%d requires, %d resolutions in %.3f s", ROUNDS * NMODS, nres, dt ) )
+print( string.format( "%.0f resolutions/s, %.0f requires/s", nres / dt, ROUNDS * NMODS / dt ) )
+
+for i = 1, NMODS do os.remove( "/ram/bmod" .. i .. ".lua" ) end
@@ -0,0 +1,37 @@
+-- RFS throughput benchmark: sequential write and read of a file on /rfs
+-- Run it on the simulator (pipe transport) or on a board (serial or UDP) with
+-- a local rfs_server sharing a scratch directory. The file is read and written
+-- in large pieces, so the client can keep several requests in flight.
+-- Needs benchtmr.lua (timer 0 of the tmr module).
+
+local SIZE = 256 * 1024
+local CHUNK = 8192
+local FNAME = "/rfs/rfsbench.dat"
+
+package.path = "/rfs/?.lua;" .. package.path
+local bt = require "benchtmr"
+
+local data = string.rep( "0123456789abcdef", CHUNK / 16 )
+
+local t0 = bt.start()
+local f = assert( io.open( FNAME, "wb" ) )
+f:setvbuf( "full", CHUNK )
+for i = 1, SIZE / CHUNK do f:write( data ) end
+f:close()
+local dtw = bt.elapsed( t0 )
+
+t0 = bt.start()
+f = assert( io.open( FNAME, "rb" ) )
+f:setvbuf( "full", CHUNK )
+local total = 0
+while true do
+  local s = f:read( CHUNK )
+  if not s then break end
+  assert( s == data:sub( 1, #s ), "data mismatch" )
+  total = total + #s
+end
+f:close()
+local dtr = bt.elapsed( t0 )
+
+assert( total == SIZE, "short read" )
+print( string.format( "RFS write: %.1f KB/s, read: %.1f KB/s", SIZE / 1024 / dtw, SIZE / 1024 / dtr ) )
@@ -0,0 +1,37 @@
+-- RFS block cache benchmark: load the same module from /rfs several times
+-- Build with BUILD_RFS_CACHE and run it like bench-rfs.lua. The first load
+-- reads the file from the server, the next ones should only validate it.
+-- The module is rewritten at the end to check that the cache sees the change.
+-- Needs benchtmr.lua (timer 0 of the tmr module).
+
+local FNAME = "/rfs/cachemod.lua"
+local LOADS = 10
+
+package.path = "/rfs/?.lua;" .. package.path
+local bt = require "benchtmr"
+
+local function make_module( value )
+  local f = assert( io.open( FNAME, "wb" ) )
+  f:write( "local t = {}\n" )
+  -- About 40K of source code
+  for i = 1, 1000 do
+    f:write( string.format( "t[ %4d ] = \"%s\"\n", i, string.rep( "x", 24 ) ) )
+  end
+  f:write( string.format( "t.value = %d\nreturn t\n", value ) )
+  f:close()
+end
+
+make_module( 1 )
+local t0 = bt.start()
+assert( dofile( FNAME ).value == 1, "wrong module" )
+local first = bt.elapsed( t0 )
+
+t0 = bt.start()
+for i = 1, LOADS do
+  assert( dofile( FNAME ).value == 1, "wrong module" )
+end
+local cached = bt.elapsed( t0 ) / LOADS
+
+make_module( 2 )
+assert( dofile( FNAME ).value == 2, "stale module after a write" )
+print( string.format( "RFS module load: first %.3f s, next %.3f s", first, cached ) )
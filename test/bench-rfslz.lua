@@ -0,0 +1,48 @@
+-- RFS compression benchmark: copy a source tree from /rfs to /mmc with and
+-- without compression. Build with BUILD_RFS_COMPRESS and run it on a board
+-- with a SD card and a local rfs_server. On the host, put the files to copy
+-- under the shared directory and list them (one name per line, relative to
+-- the tree) in files.txt, for example:
+--   cd <shared dir>/srctree && find . -name "*.[ch]" | sed 's/^..//' > files.txt
+-- Needs benchtmr.lua (timer 0 of the tmr module).
+
+local SRC = "/rfs/srctree/"
+local DEST = "/mmc/lzbench"
+local CHUNK = 4096
+
+package.path = "/rfs/?.lua;" .. package.path
+local bt = require "benchtmr"
+
+local names = {}
+for name in assert( io.open( SRC .. "files.txt", "rb" ) ):lines() do
+  if #name > 0 then names[ #names + 1 ] = name end
+end
+os.mkdir( DEST )
+
+local function copy_tree()
+  local total = 0
+  for i, name in ipairs( names ) do
+    local fin = assert( io.open( SRC .. name, "rb" ) )
+    local fout = assert( io.open( string.format( "%s/f%04d.dat", DEST, i ), "wb" ) )
+    while true do
+      local s = fin:read( CHUNK )
+      if not s then break end
+      fout:write( s )
+      total = total + #s
+    end
+    fin:close()
+    fout:close()
+  end
+  return total
+end
+
+for _, enable in ipairs{ false, true } do
+  elua.rfscompress( enable )
+  local t0 = bt.start()
+  local total = copy_tree()
+  local dt = bt.elapsed( t0 )
+  local stats = elua.rfscompress()
+  local ratio = stats.wire > 0 and stats.raw / stats.wire or 1
+  print( string.format( "compression %s: %d files, %d bytes in %.2f s (%.1f KB/s), data on the link %d of %d bytes (%.2fx)",
+    enable and "on " or "off", #names, total, dt, total / 1024 / dt, stats.wire, stats.raw, ratio ) )
+end
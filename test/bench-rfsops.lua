@@ -0,0 +1,124 @@
+-- RFS operations benchmark: a fixed workload of small and large files on /rfs
+-- (create, read, list, sequential write and read, random seeks and remove).
+-- Every phase prints its operations/s, bytes/s and the RFS round trips and
+-- bytes on the link per operation. rfs_bench_sim.sh runs it on the simulator;
+-- on a board run it with a local rfs_server sharing a scratch directory.
+-- Needs benchtmr.lua (timer 0 of the tmr module) and elua.rfsstats (BUILD_RFS).
+
+local DIR = "/rfs/rfsops"
+local SMALL_FILES = 32
+local SMALL_SIZE = 1000
+local LARGE_SIZE = 256 * 1024
+local CHUNK = 4096
+local SEEKS = 200
+local SEEK_SIZE = 256
+
+package.path = "/rfs/?.lua;" .. package.path
+local bt = require "benchtmr"
+
+local errors = 0
+local check = function( cond ) if not cond then errors = errors + 1 end end
+
+local small_name = function( i ) return string.format( "%s/s%03d.dat", DIR, i ) end
+local small_data = function( i ) return string.rep( string.char( 65 + i % 26 ), SMALL_SIZE ) end
+
+-- Every 4K chunk of the large file is its number repeated, so any piece of
+-- the file can be checked without keeping it in memory
+local chunk_data = function( k ) return string.rep( string.format( "%07d\n", k ), CHUNK / 8 ) end
+local large_piece = function( offset, size )
+  local parts = {}
+  while size > 0 do
+    local k, pos = math.floor( offset / CHUNK ), offset % CHUNK
+    local n = math.min( size, CHUNK - pos )
+    parts[ #parts + 1 ] = chunk_data( k ):sub( pos + 1, pos + n )
+    offset, size = offset + n, size - n
+  end
+  return table.concat( parts )
+end
+
+local phases = {
+  { "create", function()
+    for i = 1, SMALL_FILES do
+      local f = assert( io.open( small_name( i ), "wb" ) )
+      f:write( small_data( i ) )
+      f:close()
+    end
+    return SMALL_FILES * 3, SMALL_FILES * SMALL_SIZE
+  end },
+
+  { "read", function()
+    for i = 1, SMALL_FILES do
+      local f = assert( io.open( small_name( i ), "rb" ) )
+      check( f:read( "*a" ) == small_data( i ) )
+      f:close()
+    end
+    return SMALL_FILES * 3, SMALL_FILES * SMALL_SIZE
+  end },
+
+  { "list", function()
+    for i = 1, 8 do
+      local entries = elua.listdir( DIR ) or {}
+      for j = 1, SMALL_FILES do check( entries[ string.format( "s%03d.dat", j ) ] == SMALL_SIZE ) end
+    end
+    return 8, 0
+  end },
+
+  { "write large", function()
+    local f = assert( io.open( DIR .. "/large.dat", "wb" ) )
+    for k = 0, LARGE_SIZE / CHUNK - 1 do f:write( chunk_data( k ) ) end
+    f:close()
+    return LARGE_SIZE / CHUNK + 2, LARGE_SIZE
+  end },
+
+  { "read large", function()
+    local f = assert( io.open( DIR .. "/large.dat", "rb" ) )
+    local k = 0
+    while true do
+      local s = f:read( CHUNK )
+      if not s then break end
+      check( s == chunk_data( k ) )
+      k = k + 1
+    end
+    f:close()
+    check( k == LARGE_SIZE / CHUNK )
+    return k + 3, k * CHUNK
+  end },
+
+  { "seek+read", function()
+    local f = assert( io.open( DIR .. "/large.dat", "rb" ) )
+    local seed = 1
+    for i = 1, SEEKS do
+      seed = seed * 16807 % 2147483647
+      local offset = seed % ( LARGE_SIZE - SEEK_SIZE )
+      f:seek( "set", offset )
+      check( f:read( SEEK_SIZE ) == large_piece( offset, SEEK_SIZE ) )
+    end
+    f:close()
+    return SEEKS * 2 + 2, SEEKS * SEEK_SIZE
+  end },
+
+  { "remove", function()
+    for i = 1, SMALL_FILES do check( os.remove( small_name( i ) ) ) end
+    check( os.remove( DIR .. "/large.dat" ) )
+    return SMALL_FILES + 1, 0
+  end },
+}
+
+os.mkdir( DIR )
+local report = function( name, ops, bytes, s, stats )
+  print( string.format( "%-12s %5d ops %8.0f ops/s %9.1f KB/s %6.2f rt/op %8.1f link bytes/op",
+    name, ops, ops / s, bytes / 1024 / s, stats.requests / ops, ( stats.sent + stats.received ) / ops ) )
+end
+local total = { ops = 0, bytes = 0, s = 0, requests = 0, sent = 0, received = 0 }
+for _, p in ipairs( phases ) do
+  elua.rfsstats( true )
+  local t0 = bt.start()
+  local ops, bytes = p[ 2 ]()
+  local s = bt.elapsed( t0 )
+  local stats = elua.rfsstats()
+  report( p[ 1 ], ops, bytes, s, stats )
+  total.ops, total.bytes, total.s = total.ops + ops, total.bytes + bytes, total.s + s
+  total.requests, total.sent, total.received = total.requests + stats.requests, total.sent + stats.sent, total.received + stats.received
+end
+report( "total", total.ops, total.bytes, total.s, total )
+print( errors == 0 and "rfsops: OK" or string.format( "rfsops: FAILED (%d errors)", errors ) )
@@ -0,0 +1,35 @@
+-- Random access benchmark for /mmc (shows the effect of fast seek)
+-- Run it on the simulator or on a board with a SD card (needs benchtmr.lua)
+
+local FNAME = "/mmc/seek.bin"
+local NBLOCKS = 2048
+local NSEEKS = 500
+
+local bt = require "benchtmr"
+
+local f = assert( io.open( FNAME, "wb" ) )
+for i = 0, NBLOCKS - 1 do f:write( string.format( "%07d", i ) .. string.rep( ".", 505 ) ) end
+f:close()
+
+local function run( mode )
+  local f = assert( io.open( FNAME, mode ) )
+  elua.seekstats( true )
+  local t0 = bt.start()
+  for i = 1, NSEEKS do
+    local blk = ( i * 7919 ) % NBLOCKS
+    f:seek( "set", blk * 512 )
+    assert( tonumber( f:read( 7 ) ) == blk, "bad data" )
+  end
+  local dt = bt.elapsed( t0 )
+  f:close()
+  local s = elua.seekstats()
+  print( string.format( "%-3s %d seeks (%d fast) in %.2fs, %d FAT links followed, %d maps built",
+    mode, s.seeks, s.fastseeks, dt, s.links, s.maps ) )
+  return s
+end
+
+-- Read/write files walk the FAT chain, read-only files use a link map
+local slow = run( "r+b" )
+local fast = run( "rb" )
+assert( fast.fastseeks > 0 and fast.links < slow.links, "fast seek not used" )
+os.remove( FNAME )
@@ -0,0 +1,14 @@
+-- Timing helper for the test scripts (os.clock() is always 0 on eLua)
+-- Load it with require "benchtmr", so it has to be in a directory on
+-- package.path (/mmc or /rom; the RFS benchmarks also look in /rfs).
+-- Needs the tmr module (timer 0).
+
+local TMR = 0
+
+return
+{
+  -- Start a measurement
+  start = function() return tmr.read( TMR ) end,
+  -- Seconds elapsed since 't0' (never 0, so rates can always be computed)
+  elapsed = function( t0 ) return math.max( tmr.gettimediff( TMR, tmr.read( TMR ), t0 ), 1 ) / 1000000 end
+}
@@ -0,0 +1,27 @@
+-- RFS file operations test (protocol v3 server): mkdir, stat, rename, remove
+-- Run it like bench-rfs.lua, the shared directory must be writable.
+
+local DIR = "/rfs/fileops"
+local FNAME = DIR .. "/a.txt"
+local NEWNAME = DIR .. "/b.txt"
+
+os.remove( FNAME )
+os.remove( NEWNAME )
+os.mkdir( DIR )
+local st = assert( os.stat( DIR ) )
+assert( st.mode == "directory", "not a directory" )
+
+local f = assert( io.open( FNAME, "wb" ) )
+f:write( string.rep( "x", 1000 ) )
+f:close()
+st = assert( os.stat( FNAME ) )
+assert( st.mode == "file" and st.size == 1000, "wrong stat result" )
+
+assert( os.rename( FNAME, NEWNAME ) )
+assert( os.stat( FNAME ) == nil, "old name still exists" )
+assert( io.open( NEWNAME, "rb" ):read( "*a" ) == string.rep( "x", 1000 ), "wrong data after rename" )
+
+assert( os.remove( NEWNAME ) )
+assert( os.stat( NEWNAME ) == nil, "file not removed" )
+assert( os.remove( "/rfs/../outside.txt" ) == nil, "names out of the shared directory must be refused" )
+print( "RFS file operations OK" )
@@ -0,0 +1,49 @@
+-- Asynchronous file I/O test
+-- Run it on the simulator (it needs /ram)
+
+local SIZE = 20000
+local data = {}
+for i = 1, SIZE / 10 do data[ #data + 1 ] = string.format( "%09d\n", i ) end
+data = table.concat( data )
+
+-- Completion interrupts resume the coroutine waiting for the request
+local waiting = {}
+cpu.set_int_handler( cpu.INT_AIO_DONE, function( id )
+  local co = waiting[ id ]
+  if co then
+    waiting[ id ] = nil
+    assert( coroutine.resume( co ) )
+  end
+end )
+
+local function await( id )
+  if not aio.done( id ) then
+    waiting[ id ] = coroutine.running()
+    coroutine.yield()
+  end
+  return aio.result( id )
+end
+
+local finished, ticks = false, 0
+local co = coroutine.create( function()
+  local f = assert( io.open( "/ram/aiotest", "w+b" ) )
+  local n = await( aio.write( f, data ) )
+  assert( n == SIZE, "short write" )
+  local s = await( aio.read( f, SIZE, 0 ) )
+  assert( s == data, "data mismatch" )
+  -- Reading past the end of the file returns only the available data
+  s = await( aio.read( f, 100, SIZE - 10 ) )
+  assert( #s == 10 )
+  f:close()
+  finished = true
+end )
+assert( coroutine.resume( co ) )
+
+-- The main program keeps running while the requests are executed
+while not finished do ticks = ticks + 1 end
+print( "Main loop iterations while waiting: " .. ticks )
+assert( ticks > 0 and aio.pending() == 0 )
+
+cpu.set_int_handler( cpu.INT_AIO_DONE, nil )
+os.remove( "/ram/aiotest" )
+print( "AIO test passed" )
@@ -0,0 +1,38 @@
+-- FatFs sector cache test
+-- Run it on a board with a SD card mounted on /mmc and BUILD_DISKCACHE enabled
+
+local FNAME = "/mmc/dctest.bin"
+local BLOCK = string.rep( "0123456789abcdef", 64 )
+
+local function hitrate( hits, misses )
+  local total = hits + misses
+  return total == 0 and 0 or math.floor( hits * 100 / total )
+end
+
+elua.diskcache( true )
+local f = assert( io.open( FNAME, "wb" ) )
+for i = 1, 64 do f:write( BLOCK ) end
+f:close()
+
+-- Read the file a few times (with small reads, which go through the cache)
+for i = 1, 4 do
+  f = assert( io.open( FNAME, "rb" ) )
+  local n = 0
+  while true do
+    local data = f:read( 300 )
+    if not data then break end
+    n = n + #data
+  end
+  f:close()
+  assert( n == 64 * #BLOCK, "bad file size" )
+end
+os.remove( FNAME )
+
+local s = elua.diskcache()
+print( string.format( "Cache: %d metadata sectors, %d data sectors", s.meta_sectors, s.data_sectors ) )
+print( string.format( "Metadata: %d hits, %d misses (%d%%)", s.meta_hits, s.meta_misses, hitrate( s.meta_hits, s.meta_misses ) ) )
+print( string.format( "Data: %d hits, %d misses (%d%%)", s.data_hits, s.data_misses, hitrate( s.data_hits, s.data_misses ) ) )
+print( string.format( "Direct transfers: %d", s.bypass ) )
+print( string.format( "Written: %d sectors with %d commands", s.writebacks, s.writecmds ) )
+assert( s.meta_hits > 0, "metadata not cached" )
+print( "Disk cache test passed" )
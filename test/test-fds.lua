@@ -0,0 +1,115 @@
+-- Descriptor allocator stress test
+-- Run it on the simulator (it needs /ram and a large DM_MAX_FDS)
+-- /rom and /mmc are also used when they have/accept files
+
+local NFILES = 8
+local ROUNDS = 10
+
+-- Create a few files with known contents
+for i = 1, NFILES do
+  local f = assert( io.open( "/ram/fd" .. i, "wb" ) )
+  f:write( string.rep( string.char( 64 + i ), i * 100 ) )
+  f:close()
+end
+
+local limit, used = elua.fdlimit( "/ram" )
+print( "/ram limit: " .. limit .. ", used: " .. used )
+
+for round = 1, ROUNDS do
+  -- Open as many files as possible
+  local handles = {}
+  while true do
+    local idx = #handles % NFILES + 1
+    local f = io.open( "/ram/fd" .. idx, "rb" )
+    if not f then break end
+    handles[ #handles + 1 ] = { f = f, idx = idx }
+  end
+  local _, used = elua.fdlimit( "/ram" )
+  assert( used == #handles, "usage count mismatch" )
+  if round == 1 then print( "Opened " .. #handles .. " files at the same time" ) end
+  assert( #handles >= 100, "too few descriptors" )
+
+  -- Every handle must read its own file
+  for _, h in ipairs( handles ) do
+    local data = h.f:read( "*a" )
+    assert( #data == h.idx * 100 and data:byte( 1 ) == 64 + h.idx, "bad data" )
+  end
+
+  -- Close half of them (every other one), then open them again
+  for i = 1, #handles, 2 do
+    handles[ i ].f:close()
+    handles[ i ].f = assert( io.open( "/ram/fd" .. handles[ i ].idx, "rb" ), "descriptor not reused" )
+  end
+
+  for _, h in ipairs( handles ) do h.f:close() end
+  _, used = elua.fdlimit( "/ram" )
+  assert( used == 0, "descriptor leak" )
+end
+
+-- Exhaust the descriptors with files from all the devices at the same time
+local function readall( name )
+  local f = assert( io.open( name, "rb" ) )
+  local data = f:read( "*a" )
+  f:close()
+  return data
+end
+
+local sources = { { dev = "/ram", name = "/ram/fd1" } }
+local romfiles = elua.listdir( "/rom" )
+if romfiles and next( romfiles ) then
+  sources[ #sources + 1 ] = { dev = "/rom", name = "/rom/" .. next( romfiles ) }
+end
+if elua.fs_mounted( "/mmc" ) then
+  local f = io.open( "/mmc/fdtest.bin", "wb" )
+  if f then
+    f:write( string.rep( "M", 300 ) )
+    f:close()
+    sources[ #sources + 1 ] = { dev = "/mmc", name = "/mmc/fdtest.bin", remove = true }
+  end
+end
+for _, s in ipairs( sources ) do
+  s.data = readall( s.name )
+  print( "Using " .. s.name )
+end
+
+local handles, active = {}, #sources
+while active > 0 do
+  for _, s in ipairs( sources ) do
+    if not s.full then
+      local f = io.open( s.name, "rb" )
+      if f then
+        handles[ #handles + 1 ] = { f = f, s = s }
+      else
+        s.full, active = true, active - 1
+      end
+    end
+  end
+end
+local total = 0
+for _, s in ipairs( sources ) do
+  local _, used = elua.fdlimit( s.dev )
+  total = total + used
+end
+assert( total == #handles, "usage count mismatch" )
+print( "Opened " .. #handles .. " files on " .. #sources .. " device(s) at the same time" )
+for _, h in ipairs( handles ) do
+  assert( h.f:read( "*a" ) == h.s.data, "bad data" )
+  h.f:close()
+end
+for _, s in ipairs( sources ) do
+  local _, used = elua.fdlimit( s.dev )
+  assert( used == 0, "descriptor leak on " .. s.dev )
+  if s.remove then os.remove( s.name ) end
+end
+
+-- Per-device limits
+elua.fdlimit( "/ram", 3 )
+local t = {}
+for i = 1, 3 do t[ i ] = assert( io.open( "/ram/fd1", "rb" ) ) end
+assert( io.open( "/ram/fd1", "rb" ) == nil, "limit not enforced" )
+for i = 1, 3 do t[ i ]:close() end
+elua.fdlimit( "/ram", limit )
+assert( elua.fdlimit( "/ram" ) == limit, "limit not restored" )
+
+for i = 1, NFILES do os.remove( "/ram/fd" .. i ) end
+print( "Descriptor test passed" )
@@ -0,0 +1,43 @@
+-- FAT file system regression test
+-- Run it on the simulator (/mmc is a RAM disk or a host image) or on a board
+-- with a SD card. Needs benchtmr.lua (timer 0 of the tmr module).
+
+local NFILES = 16
+local SIZES = { 0, 1, 511, 512, 513, 4096, 20000 }
+
+local bt = require "benchtmr"
+
+local function pattern( n, seed )
+  local t = {}
+  for i = 1, n do t[ i ] = string.char( ( i * 7 + seed ) % 256 ) end
+  return table.concat( t )
+end
+
+local t0 = bt.start()
+for i = 1, NFILES do
+  local size = SIZES[ ( i - 1 ) % #SIZES + 1 ]
+  local f = assert( io.open( "/mmc/t" .. i .. ".bin", "wb" ) )
+  f:write( pattern( size, i ) )
+  f:close()
+end
+
+for i = 1, NFILES do
+  local size = SIZES[ ( i - 1 ) % #SIZES + 1 ]
+  local f = assert( io.open( "/mmc/t" .. i .. ".bin", "rb" ) )
+  local data = f:read( "*a" )
+  f:close()
+  assert( data == pattern( size, i ), "bad data in file " .. i )
+end
+
+-- Seek and partial reads
+local f = assert( io.open( "/mmc/t7.bin", "rb" ) )
+local ref = pattern( 20000, 7 )
+for _, pos in ipairs{ 19999, 0, 512, 10000, 511, 4095 } do
+  f:seek( "set", pos )
+  assert( f:read( 1 ) == ref:sub( pos + 1, pos + 1 ), "bad data at " .. pos )
+end
+f:close()
+
+for i = 1, NFILES do assert( os.remove( "/mmc/t" .. i .. ".bin" ) ) end
+assert( io.open( "/mmc/t1.bin", "rb" ) == nil, "file not removed" )
+print( string.format( "FAT test passed (%.2fs)", bt.elapsed( t0 ) ) )